@@ -5,8 +5,10 @@
 #include <cassert>
 
 #include <petlib_array_ops.hpp>
+#include <petlib_cow.hpp>
 #include <petlib_math.hpp>
 #include <petlib_range.hpp>
+#include <petlib_reduce.hpp>
 #include <petlib_slice.hpp>
 
 namespace petlib {
@@ -17,6 +19,10 @@ template <typename T>
 class SubArray;
 template <typename T>
 class SliceArray;
+template <typename T, typename I = std::size_t>
+class IndirectArray;
+template <typename T>
+class MaskedArray;
 
 template <class T>
 class Array : public ArrayBase<Array<T>, T> {
@@ -30,185 +36,215 @@ class Array : public ArrayBase<Array<T>, T> {
   typedef const T& const_reference_t;
   typedef RangeIterator<T> iterator_t;
 
-  Array():data_(nullptr),n(0) {}
+  Array():buf_(),data_(nullptr),n(0),own_(true) {}
 
-  Array(size_t sz) : data_(new T[sz]), n(sz) {}
+  Array(size_t sz) : buf_(sz), data_(buf_.data()), n(sz), own_(true) {}
 
-  Array(Array&& a) : data_(a.data_), n(a.n) {
+  Array(Array&& a) : buf_(std::move(a.buf_)), data_(a.data_), n(a.n), own_(a.own_) {
     a.data_ = nullptr;
     a.n = 0;
+    a.own_ = true;
   }
 
-  Array(const Array& a) : data_(new T[a.n]), n(a.n) {
-    std::copy(a.data_, a.data_ + n, data_);
+  // shares the buffer of a, the first write makes the copy. A pinned
+  // buffer is copied here instead.
+  Array(const Array& a) : buf_(a.buf_), data_(buf_.data()), n(a.n), own_(true) {
+    if (buf_.shared()) {
+      own_ = false;
+      a.disown();
+    }
   }
 
   template <class A_t, typename other_type>
   Array(const ArrayBase<A_t, other_type>& a)
-      : data_(new T[a.size()]), n(a.size()) {
-    for (auto i = 0; i < n; ++i) data_[i] = a[i];
+      : buf_(a.size()), data_(buf_.data()), n(a.size()), own_(true) {
+    for (size_type i = 0; i < n; ++i) data_[i] = a[i];
   }
 
   template <class Xpr_t>
-  Array(const ArrayXpr<Xpr_t>& a) : data_(new T[a.size()]), n(a.size()) {
-    std::cerr << "debug \n";
-    std::cerr << "xpr.size = " << a.size() << "\n"; 
-    for (auto i = 0; i < n; ++i) {
-      std::cerr << i << " " << a[i] << "\n";
-      data_[i] = a[i];
-    }
-    std::cerr << "end debug\n";
+  Array(const ArrayXpr<Xpr_t>& a) : buf_(a.size()), data_(buf_.data()), n(a.size()), own_(true) {
+    T* p = data_;
+    xpr_for_each(a, n, [p](size_type i, auto v) { p[i] = v; });
   }
 
   ~Array() {
-    if (data_) delete[] data_;
+    data_ = nullptr;
     n = 0;
   }
 
   ///// various operators
    Array& operator=(Array&& a) noexcept {
-    delete[] data_;
+    buf_ = std::move(a.buf_);
     data_ = a.data_;
     a.data_ = nullptr;
     n = a.n;
     a.n = 0;
+    own_ = a.own_;
+    a.own_ = true;
     return *this;
   }
 
-   Array& operator=(const Array& x) noexcept {
-//    assert(n == x.n);
-    if (n!=x.n) {
-       if (data_) delete [] data_;
-       data_= new T[x.n];
-       n = x.n;
-    }
-    std::copy(x.data_, x.data_ + n, data_);
+   Array& operator=(const Array& x) {
+    if (this == &x) return *this;
+    buf_ = x.buf_;
+    data_ = buf_.data();
+    n = x.n;
+    own_ = !buf_.shared();
+    if (!own_) x.disown();
     return *this;
   }
 
   template <class A_t, typename other_type>
-   Array& operator=(const ArrayBase<A_t, other_type>& a) noexcept {
+   Array& operator=(const ArrayBase<A_t, other_type>& a) {
+    detach();
+    buf_.unpin();
     assert(n == a.size());
-    for (auto i = 0; i < n; ++i) data_[i] = a[i];
+    for (size_type i = 0; i < n; ++i) data_[i] = a[i];
     return *this;
   }
 
   template <class Xpr_t>
-   Array& operator=(const ArrayXpr<Xpr_t>& a) noexcept {
+   Array& operator=(const ArrayXpr<Xpr_t>& a) {
+    detach();
+    buf_.unpin();
 //    assert(n == a.size());
-    std::cerr << "debug \n";
-    std::cerr << "xpr.size = " << a.size() << "\n"; 
-    for (auto i = 0; i < n; ++i) {
-      std::cerr << i << " " << a[i] << "\n";
-      data_[i] = a[i];
-    }
-    std::cerr << "end debug\n";
+    T* p = data_;
+    xpr_for_each(a, n, [p](size_type i, auto v) { p[i] = v; });
     return *this;
   }
 
-   Array& operator=(const value_t& x) noexcept {
+   Array& operator=(const value_t& x) {
+    detach();
+    buf_.unpin();
     for (auto i = 0; i < n; ++i) data_[i] = x;
     return *this;
   }
 
-   Array& operator+=(const Array& x) noexcept {
+   Array& operator+=(const Array& x) {
+    detach();
     for (auto i = 0; i < n; ++i) data_[i] += x.data_[i];
     return *this;
   }
-   Array& operator-=(const Array& x) noexcept {
+   Array& operator-=(const Array& x) {
+    detach();
     for (auto i = 0; i < n; ++i) data_[i] -= x.data_[i];
     return *this;
   }
-   Array& operator*=(const Array& x) noexcept {
+   Array& operator*=(const Array& x) {
+    detach();
     for (auto i = 0; i < n; ++i) data_[i] *= x.data_[i];
     return *this;
   }
-   Array& operator/=(const Array& x) noexcept {
+   Array& operator/=(const Array& x) {
+    detach();
     for (auto i = 0; i < n; ++i) data_[i] /= x.data_[i];
     return *this;
   }
 
   template <class Xpr_t>
-   Array& operator+=(const ArrayXpr<Xpr_t>& x) noexcept {
-    for (auto i = 0; i < n; ++i) data_[i] += x[i];
+   Array& operator+=(const ArrayXpr<Xpr_t>& x) {
+    detach();
+    T* p = data_;
+    xpr_for_each(x, n, [p](size_type i, auto v) { p[i] += v; });
     return *this;
   }
   template <class Xpr_t>
-   Array& operator-=(const ArrayXpr<Xpr_t>& x) noexcept {
-    for (auto i = 0; i < n; ++i) data_[i] -= x[i];
+   Array& operator-=(const ArrayXpr<Xpr_t>& x) {
+    detach();
+    T* p = data_;
+    xpr_for_each(x, n, [p](size_type i, auto v) { p[i] -= v; });
     return *this;
   }
   template <class Xpr_t>
-   Array& operator*=(const ArrayXpr<Xpr_t>& x) noexcept {
-    for (auto i = 0; i < n; ++i) data_[i] *= x[i];
+   Array& operator*=(const ArrayXpr<Xpr_t>& x) {
+    detach();
+    T* p = data_;
+    xpr_for_each(x, n, [p](size_type i, auto v) { p[i] *= v; });
     return *this;
   }
   template <class Xpr_t>
-   Array& operator/=(const ArrayXpr<Xpr_t>& x) noexcept {
-    for (auto i = 0; i < n; ++i) data_[i] /= x[i];
+   Array& operator/=(const ArrayXpr<Xpr_t>& x) {
+    detach();
+    T* p = data_;
+    xpr_for_each(x, n, [p](size_type i, auto v) { p[i] /= v; });
     return *this;
   }
 
   template <class A_t>
-   Array& operator+=(const ArrayBase<A_t, value_t>& x) noexcept {
+   Array& operator+=(const ArrayBase<A_t, value_t>& x) {
+    detach();
     for (auto i = 0; i < n; ++i) data_[i] += x[i];
     return *this;
   }
   template <class A_t>
-   Array& operator-=(const ArrayBase<A_t, value_t>& x) noexcept {
+   Array& operator-=(const ArrayBase<A_t, value_t>& x) {
+    detach();
     for (auto i = 0; i < n; ++i) data_[i] -= x[i];
     return *this;
   }
   template <class A_t>
-   Array& operator*=(const ArrayBase<A_t, value_t>& x) noexcept {
+   Array& operator*=(const ArrayBase<A_t, value_t>& x) {
+    detach();
     for (auto i = 0; i < n; ++i) data_[i] *= x[i];
     return *this;
   }
   template <class A_t>
-   Array& operator/=(const ArrayBase<A_t, value_t>& x) noexcept {
+   Array& operator/=(const ArrayBase<A_t, value_t>& x) {
+    detach();
     for (auto i = 0; i < n; ++i) data_[i] /= x[i];
     return *this;
   }
 
-   Array& operator+=(const value_t x) noexcept {
+   Array& operator+=(const value_t x) {
+    detach();
     for (auto i = 0; i < n; ++i) data_[i] += x;
     return *this;
   }
-   Array& operator-=(const value_t x) noexcept {
+   Array& operator-=(const value_t x) {
+    detach();
     for (auto i = 0; i < n; ++i) data_[i] -= x;
     return *this;
   }
-   Array& operator*=(const value_t x) noexcept {
+   Array& operator*=(const value_t x) {
+    detach();
     for (auto i = 0; i < n; ++i) data_[i] *= x;
     return *this;
   }
-   Array& operator/=(const value_t x) noexcept {
+   Array& operator/=(const value_t x) {
+    detach();
     value_t xi = value_t(1) / x;
     for (auto i = 0; i < n; ++i) data_[i] *= xi;
     return *this;
   }
 
-   pointer_t begin() noexcept { return data_; }
+   pointer_t begin() { return pin(); }
    const_pointer_t begin() const noexcept { return data_; }
    const_pointer_t end() const noexcept { return (data_ + n); }
-   pointer_t rbegin() noexcept { return (data_ + n); }
+   pointer_t rbegin() { return pin() + n; }
    const_pointer_t rbegin() const noexcept { return (data_ + n); }
    const_pointer_t rend() const noexcept { return data_; }
    const_pointer_t data() const noexcept { return data_; }
-   pointer_t data() noexcept { return data_; }
+   pointer_t data() { return pin(); }
    bool empty() noexcept { return n == 0; }
    size_type size() const noexcept { return n; }
    difference_type stride() const noexcept {
     return difference_type{1};
   }
 
-   value_t& operator[](size_type i) noexcept { return data_[i]; }
+   value_t& operator[](size_type i) {
+    if (!own_) detach();
+    return data_[i];
+  }
    value_t operator[](size_type i) const noexcept { return data_[i]; }
 
-   value_t dotProduct(const Array& a) noexcept {
-    value_t sum(0);
-    for (auto i = 0; i < n; ++i) sum += data_[i] * a[i];
-    return sum;
+   value_t sum(SumMode mode = SumMode::Fast,
+               unsigned nthreads = 1) const {
+    return reduce::sum(data_, n, mode, nthreads);
+  }
+
+   value_t dotProduct(const Array& a, SumMode mode = SumMode::Fast,
+                      unsigned nthreads = 1) const {
+    return reduce::dot(data_, a.data_, n, mode, nthreads);
   }
 
    value_t max() const noexcept { return *std::max_element(data_, data_ + n); }
@@ -241,11 +277,18 @@ class Array : public ArrayBase<Array<T>, T> {
     return size_t(p- data_);
   }
 
+  // any subset of the statistics above, and the sum and norm, in one sweep
+  template <unsigned What = Stat::all>
+   Stats<value_t> stats(unsigned nthreads = 1) const {
+    return reduce::stats<What>(static_cast<const value_t*>(data_), n, nthreads);
+  }
+
   //
   // scale vector so that the dot product with itself = 1 or 0 if array is null
   //
 
-   void normalize() noexcept {
+   void normalize() {
+    detach();
     value_t sum = 0;
     for (auto i = 0; i < n; ++i) sum += data_[i] * data_[i];
     if (sum < petlib::numeric_traits<T>::eps) {
@@ -256,14 +299,16 @@ class Array : public ArrayBase<Array<T>, T> {
     for (auto i = 0; i < n; ++i) data_[i] *= sum;
   }
 
-   void swap_elements(size_t i, size_t j) noexcept {
+   void swap_elements(size_t i, size_t j) {
+    detach();
     value_t tmp = data_[i];
     data_[i] = data_[j];
     data_[j] = tmp;
   }
 
    void rotate_elements(size_t i, size_t j,
-                                 const value_t& angle) noexcept {
+                                 const value_t& angle) {
+    detach();
     value_t tmp = data_[i];
     value_t cs = std::cos(angle);
     value_t sn = std::sin(angle);
@@ -272,43 +317,89 @@ class Array : public ArrayBase<Array<T>, T> {
   }
 
   template <class A_t>
-   void reflect(const ArrayBase<A_t, value_t>& x) noexcept {
+   void reflect(const ArrayBase<A_t, value_t>& x) {
+    detach();
     value_t prd = dotProduct(*this, x);
     value_t den = dotProduct(x, x);
     value_t fact = prd / den;
     for (auto i = 0; i < n; ++i) data_[i] = data_[i] - fact * x[i];
   }
 
-   SliceArray<T> operator()(Slice& s) noexcept {
-    return SliceArray<T>(data_ + s.offset(), s.size(), s.stride());
+   SliceArray<T> operator()(Slice& s) {
+    return SliceArray<T>(pin() + s.offset(), s.size(), s.stride());
   }
 
-   SubArray<T> operator()(Range& r) noexcept {
-    return SubArray<T>(data_ + r.offset(), r.size());
+   SubArray<T> operator()(Range& r) {
+    return SubArray<T>(pin() + r.offset(), r.size());
+  }
+
+  template <typename I>
+   IndirectArray<T, I> operator()(const Array<I>& idx) {
+    return IndirectArray<T, I>(pin(), idx);
+  }
+
+   MaskedArray<T> operator()(const Array<bool>& mask) {
+    assert(mask.size() == n);
+    return MaskedArray<T>(pin(), mask);
   }
 
-   void resize(size_t new_size) noexcept {
-    if (data_) delete[] data_;
-    data_ = new T[new_size];
+   void resize(size_t new_size) {
+    buf_ = CowBuffer<T>(new_size);
+    data_ = buf_.data();
     n = new_size;
+    own_ = true;
   }
 
-   void grow(size_t new_size) noexcept {
+   void grow(size_t new_size) {
     if (new_size < n) {
       n = new_size;
     } else {
       if (n != new_size) {
-        T* tmp = new T[new_size];
-        std::copy(tmp, tmp + n, data_);
-        delete[] data_;
-        data_ = tmp;
+        CowBuffer<T> tmp(new_size);
+        std::copy(data_, data_ + n, tmp.data());
+        buf_ = std::move(tmp);
+        data_ = buf_.data();
+        n = new_size;
+        own_ = true;
       }
     }
   }
 
+  // Copy on write. own_ is set while no other Array holds the buffer,
+  //   so element access is a plain load or store after one test of it.
+  //   detach makes a private copy of a shared buffer, pin also keeps
+  //   it private for the views and pointers handed out. They are good
+  //   until the next assignment to or resize of the Array, which
+  //   unpins it, and copies made after that share again.
+  //   A reference from operator[] is not to be held across a copy.
+   void detach() {
+    if (own_) return;
+    if (buf_.shared()) data_ = buf_.unshare();
+    own_ = true;
+  }
+   pointer_t pin() {
+    detach();
+    buf_.pin();
+    return data_;
+  }
+
+   bool is_shared() const noexcept { return buf_.shared(); }
+   bool is_pinned() const noexcept { return buf_.pinned(); }
+   size_type use_count() const noexcept { return buf_.use_count(); }
+   bool shares_storage(const Array& a) const noexcept {
+    return buf_.same_buffer(a.buf_);
+  }
+
  private:
+  // the source of a copy, which may be read on several threads at once
+  void disown() const noexcept {
+    std::atomic_ref<bool>(own_).store(false, std::memory_order_relaxed);
+  }
+
+  CowBuffer<T> buf_;
   T* data_;
   size_type n;
+  mutable bool own_;
 };
 
 template <typename T>
@@ -367,14 +458,15 @@ class SubArray : public ArrayBase<SubArray<T>, T> {
   template <class A_t, typename other_type>
    SubArray& operator=(const ArrayBase<A_t, other_type>& a) noexcept {
     assert(n == a.size());
-    for (auto i = 0; i < n; ++i) data_[i] = a[i];
+    for (size_type i = 0; i < n; ++i) data_[i] = a[i];
     return *this;
   }
 
   template <class Xpr_t>
    SubArray& operator=(const ArrayXpr<Xpr_t>& a) noexcept {
     assert(n == a.size());
-    for (auto i = 0; i < n; ++i) data_[i] = a[i];
+    T* p = data_;
+    xpr_for_each(a, n, [p](size_type i, auto v) { p[i] = v; });
     return *this;
   }
 
@@ -419,22 +511,26 @@ class SubArray : public ArrayBase<SubArray<T>, T> {
 
   template <class Xpr_t>
    SubArray& operator+=(const ArrayXpr<Xpr_t>& x) noexcept {
-    for (auto i = 0; i < n; ++i) data_[i] += x[i];
+    T* p = data_;
+    xpr_for_each(x, n, [p](size_type i, auto v) { p[i] += v; });
     return *this;
   }
   template <class Xpr_t>
    SubArray& operator-=(const ArrayXpr<Xpr_t>& x) noexcept {
-    for (auto i = 0; i < n; ++i) data_[i] -= x[i];
+    T* p = data_;
+    xpr_for_each(x, n, [p](size_type i, auto v) { p[i] -= v; });
     return *this;
   }
   template <class Xpr_t>
    SubArray& operator*=(const ArrayXpr<Xpr_t>& x) noexcept {
-    for (auto i = 0; i < n; ++i) data_[i] *= x[i];
+    T* p = data_;
+    xpr_for_each(x, n, [p](size_type i, auto v) { p[i] *= v; });
     return *this;
   }
   template <class Xpr_t>
    SubArray& operator/=(const ArrayXpr<Xpr_t>& x) noexcept {
-    for (auto i = 0; i < n; ++i) data_[i] /= x[i];
+    T* p = data_;
+    xpr_for_each(x, n, [p](size_type i, auto v) { p[i] /= v; });
     return *this;
   }
 
@@ -494,10 +590,14 @@ class SubArray : public ArrayBase<SubArray<T>, T> {
    value_t& operator[](size_type i) noexcept { return data_[i]; }
    value_t operator[](size_type i) const noexcept { return data_[i]; }
 
-   value_t dotProduct(const SubArray& a) noexcept {
-    value_t sum(0);
-    for (auto i = 0; i < n; ++i) sum += data_[i] * a[i];
-    return sum;
+   value_t sum(SumMode mode = SumMode::Fast,
+               unsigned nthreads = 1) const {
+    return reduce::sum(data_, n, mode, nthreads);
+  }
+
+   value_t dotProduct(const SubArray& a, SumMode mode = SumMode::Fast,
+                      unsigned nthreads = 1) const {
+    return reduce::dot(data_, a.data_, n, mode, nthreads);
   }
 
    value_t max() const noexcept { return *std::max_element(data_, data_ + n); }
@@ -528,6 +628,12 @@ class SubArray : public ArrayBase<SubArray<T>, T> {
     return size_t(std::min_element(data_, data_ + n, petlib::abs_cmp<value_t>) - data_);
   }
 
+  // any subset of the statistics above, and the sum and norm, in one sweep
+  template <unsigned What = Stat::all>
+   Stats<value_t> stats(unsigned nthreads = 1) const {
+    return reduce::stats<What>(static_cast<const value_t*>(data_), n, nthreads);
+  }
+
   //
   // scale vector so that the dot product with itself = 1 or 0 if array is null
   //
@@ -574,6 +680,16 @@ class SubArray : public ArrayBase<SubArray<T>, T> {
     return SubArray<T>(data_ + r.offset(), r.size());
   }
 
+  template <typename I>
+   IndirectArray<T, I> operator()(const Array<I>& idx) noexcept {
+    return IndirectArray<T, I>(data_, idx);
+  }
+
+   MaskedArray<T> operator()(const Array<bool>& mask) {
+    assert(mask.size() == n);
+    return MaskedArray<T>(data_, mask);
+  }
+
  private:
   T* data_;
   size_type n;
@@ -656,11 +772,9 @@ class SliceArray : public ArrayBase<SliceArray<T>, T> {
   template <class Xpr_t>
    SliceArray& operator=(const ArrayXpr<Xpr_t>& a) noexcept {
     assert(n == a.size());
-    std::size_t i(0);
-    std::ptrdiff_t ix(0);
-    for (;i<n;++i,ix+=str) {
-      data_[ix] = a[i];
-    }
+    T* p = data_;
+    const std::ptrdiff_t st = str;
+    xpr_for_each(a, n, [p, st](std::size_t i, auto v) { p[std::ptrdiff_t(i) * st] = v; });
     return *this;
   }
 
@@ -751,33 +865,30 @@ class SliceArray : public ArrayBase<SliceArray<T>, T> {
 
   template <class Xpr_t>
    SliceArray& operator+=(const ArrayXpr<Xpr_t>& x) noexcept {
-    std::size_t i(0);
-    std::ptrdiff_t ix(0);
-    for (;i<n;++i,ix+=str) data_[ix] += x[i];
+    T* p = data_;
+    const std::ptrdiff_t st = str;
+    xpr_for_each(x, n, [p, st](std::size_t i, auto v) { p[std::ptrdiff_t(i) * st] += v; });
     return *this;
   }
   template <class Xpr_t>
    SliceArray& operator-=(const ArrayXpr<Xpr_t>& x) noexcept {
-    std::size_t i(0);
-    std::ptrdiff_t ix(0);
-    for (;i<n;++i,ix+=str) data_[ix] -= x[i];
+    T* p = data_;
+    const std::ptrdiff_t st = str;
+    xpr_for_each(x, n, [p, st](std::size_t i, auto v) { p[std::ptrdiff_t(i) * st] -= v; });
+    return *this;
   }
   template <class Xpr_t>
    SliceArray& operator*=(const ArrayXpr<Xpr_t>& x) noexcept {
-    std::size_t i(0);
-    std::ptrdiff_t ix(0);
-    for (;i<n;++i,ix+=str) {
-      data_[ix] *= x[i];
-    } 
+    T* p = data_;
+    const std::ptrdiff_t st = str;
+    xpr_for_each(x, n, [p, st](std::size_t i, auto v) { p[std::ptrdiff_t(i) * st] *= v; });
     return *this;
   }
   template <class Xpr_t>
    SliceArray& operator/=(const ArrayXpr<Xpr_t>& x) noexcept {
-    std::size_t i(0);
-    std::ptrdiff_t ix(0);
-    for (;i<n;++i,ix+=str) {
-      data_[ix] /= x[i];
-    }
+    T* p = data_;
+    const std::ptrdiff_t st = str;
+    xpr_for_each(x, n, [p, st](std::size_t i, auto v) { p[std::ptrdiff_t(i) * st] /= v; });
     return *this;
   }
 
@@ -912,6 +1023,13 @@ class SliceArray : public ArrayBase<SliceArray<T>, T> {
     return size_t(std::min_element(data_, this->end(), petlib::abs_cmp<value_t>) - data_);
   }
 
+  // any subset of the statistics above, and the sum and norm, in one sweep
+  template <unsigned What = Stat::all>
+   Stats<value_t> stats(unsigned nthreads = 1) const {
+    typedef reduce::SumTerms<value_t, const SliceArray&> terms_t;
+    return reduce::reduce_many<What, value_t>(terms_t{*this}, n, nthreads);
+  }
+
   //
   // scale vector so that the dot product with itself = 1 or 0 if array is null
   //
@@ -975,13 +1093,48 @@ class SliceArray : public ArrayBase<SliceArray<T>, T> {
 
 template <class A_t, class B_t, typename x_t, typename y_t>
  typename promote_traits<x_t, y_t>::promote_t dotProduct(
-    const ArrayBase<A_t, x_t>& a, const ArrayBase<B_t, y_t>& b) {
+    const ArrayBase<A_t, x_t>& a, const ArrayBase<B_t, y_t>& b,
+    SumMode mode = SumMode::Fast, unsigned nthreads = 1) {
   typedef typename promote_traits<x_t, y_t>::promote_t value_t;
-  value_t sum(0);
-  for (std::size_t i = std::size_t(0); i < a.size(); ++i) sum += a[i] * b[i];
-  return sum;
+  typedef reduce::DotTerms<value_t, const A_t&, const B_t&> terms_t;
+  return reduce::reduce<value_t>(terms_t{*a.leaf(), *b.leaf()}, a.size(), mode,
+                                 nthreads);
+}
+
+template <class A_t, typename x_t>
+ x_t sum(const ArrayBase<A_t, x_t>& a, SumMode mode = SumMode::Fast,
+         unsigned nthreads = 1) {
+  typedef reduce::SumTerms<x_t, const A_t&> terms_t;
+  return reduce::reduce<x_t>(terms_t{*a.leaf()}, a.size(), mode, nthreads);
+}
+
+// the sum of an expression, evaluated on the fly without a temporary
+template <class Xpr_t>
+ typename Xpr_t::value_t sum(const ArrayXpr<Xpr_t>& a,
+                             SumMode mode = SumMode::Fast,
+                             unsigned nthreads = 1) {
+  typedef typename Xpr_t::value_t value_t;
+  typedef reduce::SumTerms<value_t, const ArrayXpr<Xpr_t>&> terms_t;
+  return reduce::reduce<value_t>(terms_t{a}, a.size(), mode, nthreads);
+}
+
+template <unsigned What = Stat::all, class A_t, typename x_t>
+ Stats<x_t> stats(const ArrayBase<A_t, x_t>& a, unsigned nthreads = 1) {
+  typedef reduce::SumTerms<x_t, const A_t&> terms_t;
+  return reduce::reduce_many<What, x_t>(terms_t{*a.leaf()}, a.size(), nthreads);
+}
+
+// the statistics of an expression, evaluated on the fly without a temporary
+template <unsigned What = Stat::all, class Xpr_t>
+ Stats<typename Xpr_t::value_t> stats(const ArrayXpr<Xpr_t>& a,
+                                      unsigned nthreads = 1) {
+  typedef typename Xpr_t::value_t value_t;
+  typedef reduce::SumTerms<value_t, const ArrayXpr<Xpr_t>&> terms_t;
+  return reduce::reduce_many<What, value_t>(terms_t{a}, a.size(), nthreads);
 }
 
 }  // namespace petlib
 
-#endif
\ No newline at end of file
+#endif
+
+#include <petlib_indirect.hpp>
@@ -1,8 +1,11 @@
 #ifndef PETLIB_ARRAY_OPS_H
 #define PETLIB_ARRAY_OPS_H
 
+#include <cmath>
 #include <cstdint>
 #include <cstdlib>
+#include <type_traits>
+#include <petlib_vmath.hpp>
 
 namespace petlib {
 
@@ -143,16 +146,84 @@ struct ScalarRef {
 };
 
 
+//
+// Expressions with sin or cos in them are evaluated in chunks. A chunk
+// where no sin or cos argument is above vmath::trig_max, the common case,
+// runs the Cody-Waite reduction alone through small(i), the others select
+// the Payne-Hanek reduction of every lane through operator[].
+//
+constexpr std::size_t xpr_chunk = 256;
+
+template <class Op>
+constexpr bool is_trig_op = requires { &Op::eval_small; };
+
+template <class X>
+constexpr bool xpr_has_trig() noexcept {
+  if constexpr (requires { X::has_trig; })
+    return X::has_trig;
+  else
+    return false;
+}
+
+template <class X>
+typename X::value_t xpr_small(const X& x, std::size_t i) {
+  if constexpr (xpr_has_trig<X>())
+    return x.small(i);
+  else
+    return x[i];
+}
+
+template <class X>
+bool xpr_trig_small(const X& x, std::size_t lo, std::size_t hi) {
+  if constexpr (xpr_has_trig<X>())
+    return x.trig_small(lo, hi);
+  else
+    return true;
+}
+
+// f(i, x[i]) for i < n
+template <class X, class F>
+inline void xpr_for_each(const X& x, std::size_t n, const F& f) {
+  if constexpr (!xpr_has_trig<X>()) {
+    for (std::size_t i = 0; i < n; ++i) f(i, x[i]);
+  } else {
+    for (std::size_t lo = 0; lo < n; lo += xpr_chunk) {
+      const std::size_t hi = n - lo < xpr_chunk ? n : lo + xpr_chunk;
+      if (x.trig_small(lo, hi))
+        for (std::size_t i = lo; i < hi; ++i) f(i, x.small(i));
+      else
+        for (std::size_t i = lo; i < hi; ++i) f(i, x[i]);
+    }
+  }
+}
+
 template <class A, class Op>
 struct ArrayUnaryXpr {
   typedef typename Op::value_t result_t;
   typedef typename Op::value_t value_t;
   typedef std::size_t size_type;
+  static constexpr bool has_trig = xpr_has_trig<A>() || is_trig_op<Op>;
   const A a;
 
   ArrayUnaryXpr(const A& a0) : a(a0){};
    result_t operator[](size_t i) const { return Op::eval(a[i]); }
   size_type size() const { return a.size(); }
+
+  result_t small(size_t i) const {
+    if constexpr (is_trig_op<Op>)
+      return Op::eval_small(xpr_small(a, i));
+    else
+      return Op::eval(xpr_small(a, i));
+  }
+  bool trig_small(size_t lo, size_t hi) const {
+    if (!xpr_trig_small(a, lo, hi)) return false;
+    if constexpr (is_trig_op<Op>) {
+      bool big = false;
+      for (size_t i = lo; i < hi; ++i) big |= vmath::abs(double(xpr_small(a, i))) > vmath::trig_max;
+      return !big;
+    }
+    return true;
+  }
 };
 
 template <class A, class B, class Op>
@@ -166,9 +237,16 @@ struct ArrayBinaryXpr {
   const A a;
   const B b;
 
+  static constexpr bool has_trig = xpr_has_trig<A>() || xpr_has_trig<B>();
+
   ArrayBinaryXpr(const A& a0, const B& b0) : a(a0), b(b0){};
    result_t operator[](size_t i) const { return Op::eval(a[i], b[i]); }
   size_type size() const { return a.size(); }
+
+  result_t small(size_t i) const { return Op::eval(xpr_small(a, i), xpr_small(b, i)); }
+  bool trig_small(size_t lo, size_t hi) const {
+    return xpr_trig_small(a, lo, hi) && xpr_trig_small(b, lo, hi);
+  }
 };
 
 template <class Xpr_t>
@@ -178,9 +256,14 @@ struct ArrayXpr {
   typedef std::size_t size_type;
   const Xpr_t a;
 
+  static constexpr bool has_trig = xpr_has_trig<Xpr_t>();
+
   ArrayXpr(const Xpr_t& a0) : a(a0){};
    result_t operator[](size_t i) const { return a[i]; }
   size_type size() const { return a.size(); }
+
+  result_t small(size_t i) const { return xpr_small(a, i); }
+  bool trig_small(size_t lo, size_t hi) const { return xpr_trig_small(a, lo, hi); }
 };
 
 template <class Xpr_t>
@@ -190,9 +273,14 @@ struct ScalarXpr {
   typedef std::size_t size_type;
   const Xpr_t a;
 
+  static constexpr bool has_trig = xpr_has_trig<Xpr_t>();
+
   ScalarXpr(const Xpr_t& a0) : a(a0){};
    result_t operator[](size_t i) const { return a[i]; }
   size_type size() const { return 1; }
+
+  result_t small(size_t i) const { return xpr_small(a, i); }
+  bool trig_small(size_t lo, size_t hi) const { return xpr_trig_small(a, lo, hi); }
 };
 
 template <typename A, typename B>
@@ -421,8 +509,228 @@ PETLIB_MAKE_OP_(Mul,*,long double)
 PETLIB_MAKE_OP_(Div,/,long double)
 
 #undef PETLIB_MAKE_OP_
-  
 
+//
+// Elementary functions as lazy unary nodes. They evaluate inside the
+// same element loop as the arithmetic, exp(a) * b + sin(c) makes no
+// temporaries. The kernels and their error bounds are in
+// petlib_vmath.hpp; petlib::fast holds the same functions built on
+// the fast kernels. Integer arrays give double results.
+//
+template <typename A>
+struct math_value_traits {
+  typedef typename std::conditional<std::is_floating_point<A>::value, A,
+                                    double>::type value_t;
+};
+
+#define PETLIB_MAKE_OP_(name_, vfn_, sfn_)                                 \
+  template <typename A>                                                    \
+  struct name_##Op {                                                       \
+    typedef typename math_value_traits<A>::value_t value_t;                \
+    static value_t eval(const A& x) noexcept {                             \
+      if constexpr (std::is_same<value_t, long double>::value)             \
+        return std::sfn_(x);                                               \
+      else                                                                 \
+        return value_t(vmath::vfn_(double(x)));                            \
+    }                                                                      \
+  };
+
+PETLIB_MAKE_OP_(Exp, exp, exp)
+PETLIB_MAKE_OP_(Expm1, expm1, expm1)
+PETLIB_MAKE_OP_(Log, log, log)
+PETLIB_MAKE_OP_(Tanh, tanh, tanh)
+PETLIB_MAKE_OP_(Sqrt, sqrt, sqrt)
+PETLIB_MAKE_OP_(FastExp, fast::exp, exp)
+PETLIB_MAKE_OP_(FastExpm1, fast::expm1, expm1)
+PETLIB_MAKE_OP_(FastLog, fast::log, log)
+PETLIB_MAKE_OP_(FastTanh, fast::tanh, tanh)
+PETLIB_MAKE_OP_(FastSqrt, fast::sqrt, sqrt)
+#undef PETLIB_MAKE_OP_
+
+// sin and cos add eval_small, the kernel for |x| <= vmath::trig_max
+#define PETLIB_MAKE_OP_(name_, vfn_, sfn_)                                 \
+  template <typename A>                                                    \
+  struct name_##Op {                                                       \
+    typedef typename math_value_traits<A>::value_t value_t;                \
+    static value_t eval(const A& x) noexcept {                             \
+      if constexpr (std::is_same<value_t, long double>::value)             \
+        return std::sfn_(x);                                               \
+      else                                                                 \
+        return value_t(vmath::vfn_(double(x)));                            \
+    }                                                                      \
+    static value_t eval_small(const A& x) noexcept {                       \
+      if constexpr (std::is_same<value_t, long double>::value)             \
+        return std::sfn_(x);                                               \
+      else                                                                 \
+        return value_t(vmath::vfn_##_small(double(x)));                    \
+    }                                                                      \
+  };
+
+PETLIB_MAKE_OP_(Sin, sin, sin)
+PETLIB_MAKE_OP_(Cos, cos, cos)
+PETLIB_MAKE_OP_(FastSin, fast::sin, sin)
+PETLIB_MAKE_OP_(FastCos, fast::cos, cos)
+#undef PETLIB_MAKE_OP_
+
+#define PETLIB_MAKE_OP_(name_, vfn_)                                       \
+  template <typename A, typename B>                                        \
+  struct name_##Op {                                                       \
+    typedef typename math_value_traits<                                    \
+        typename promote_traits<A, B>::promote_t>::value_t value_t;        \
+    static value_t eval(const A& x, const B& y) noexcept {                 \
+      if constexpr (std::is_same<value_t, long double>::value)             \
+        return std::pow(value_t(x), value_t(y));                           \
+      else                                                                 \
+        return value_t(vmath::vfn_(double(x), double(y)));                 \
+    }                                                                      \
+  };                                                                       \
+                                                                           \
+  template <typename A, typename B>                                        \
+  struct Rev##name_##Op {                                                  \
+    typedef typename name_##Op<B, A>::value_t value_t;                     \
+    static value_t eval(const A& x, const B& y) noexcept {                 \
+      return name_##Op<B, A>::eval(y, x);                                  \
+    }                                                                      \
+  };
+
+PETLIB_MAKE_OP_(Pow, pow)
+PETLIB_MAKE_OP_(FastPow, fast::pow)
+#undef PETLIB_MAKE_OP_
+
+#define PETLIB_MAKE_OP_(name_, fn_)                                        \
+  template <class Array_t, class A_t>                                      \
+  ArrayXpr<ArrayUnaryXpr<ArrayRef<Array_t, A_t>, name_##Op<A_t> > >        \
+  fn_(const ArrayBase<Array_t, A_t>& a) {                                  \
+    typedef ArrayUnaryXpr<ArrayRef<Array_t, A_t>, name_##Op<A_t> > xpr_t;  \
+    return ArrayXpr<xpr_t>(xpr_t(ArrayRef<Array_t, A_t>(a)));              \
+  }                                                                        \
+                                                                           \
+  template <class XprA_t>                                                  \
+  ArrayXpr<ArrayUnaryXpr<ArrayXpr<XprA_t>,                                 \
+                         name_##Op<typename XprA_t::value_t> > >           \
+  fn_(const ArrayXpr<XprA_t>& a) {                                         \
+    typedef ArrayUnaryXpr<ArrayXpr<XprA_t>,                                \
+                          name_##Op<typename XprA_t::value_t> >            \
+        xpr_t;                                                             \
+    return ArrayXpr<xpr_t>(xpr_t(a));                                      \
+  }
+
+#define PETLIB_MAKE_POW_(name_)                                            \
+  template <class ArrayA_t, class ArrayB_t, typename A_t, typename B_t>    \
+  ArrayXpr<ArrayBinaryXpr<ArrayRef<ArrayA_t, A_t>, ArrayRef<ArrayB_t, B_t>, \
+                          name_##Op<A_t, B_t> > >                          \
+  pow(const ArrayBase<ArrayA_t, A_t>& a, const ArrayBase<ArrayB_t, B_t>& b) { \
+    typedef ArrayBinaryXpr<ArrayRef<ArrayA_t, A_t>, ArrayRef<ArrayB_t, B_t>, \
+                           name_##Op<A_t, B_t> >                           \
+        xpr_t;                                                             \
+    return ArrayXpr<xpr_t>(                                                \
+        xpr_t(ArrayRef<ArrayA_t, A_t>(a), ArrayRef<ArrayB_t, B_t>(b)));    \
+  }                                                                        \
+                                                                           \
+  template <class ArrayA_t, class XprB_t, typename A_t>                    \
+  ArrayXpr<ArrayBinaryXpr<ArrayRef<ArrayA_t, A_t>, ArrayXpr<XprB_t>,       \
+                          name_##Op<A_t, typename XprB_t::value_t> > >     \
+  pow(const ArrayBase<ArrayA_t, A_t>& a, const ArrayXpr<XprB_t>& b) {      \
+    typedef ArrayBinaryXpr<ArrayRef<ArrayA_t, A_t>, ArrayXpr<XprB_t>,      \
+                           name_##Op<A_t, typename XprB_t::value_t> >      \
+        xpr_t;                                                             \
+    return ArrayXpr<xpr_t>(xpr_t(ArrayRef<ArrayA_t, A_t>(a), b));          \
+  }                                                                        \
+                                                                           \
+  template <class XprA_t, class ArrayB_t, typename B_t>                    \
+  ArrayXpr<ArrayBinaryXpr<ArrayXpr<XprA_t>, ArrayRef<ArrayB_t, B_t>,       \
+                          name_##Op<typename XprA_t::value_t, B_t> > >     \
+  pow(const ArrayXpr<XprA_t>& a, const ArrayBase<ArrayB_t, B_t>& b) {      \
+    typedef ArrayBinaryXpr<ArrayXpr<XprA_t>, ArrayRef<ArrayB_t, B_t>,      \
+                           name_##Op<typename XprA_t::value_t, B_t> >      \
+        xpr_t;                                                             \
+    return ArrayXpr<xpr_t>(xpr_t(a, ArrayRef<ArrayB_t, B_t>(b)));          \
+  }                                                                        \
+                                                                           \
+  template <class XprA_t, class XprB_t>                                    \
+  ArrayXpr<ArrayBinaryXpr<                                                 \
+      ArrayXpr<XprA_t>, ArrayXpr<XprB_t>,                                  \
+      name_##Op<typename XprA_t::value_t, typename XprB_t::value_t> > >    \
+  pow(const ArrayXpr<XprA_t>& a, const ArrayXpr<XprB_t>& b) {              \
+    typedef ArrayBinaryXpr<                                                \
+        ArrayXpr<XprA_t>, ArrayXpr<XprB_t>,                                \
+        name_##Op<typename XprA_t::value_t, typename XprB_t::value_t> >    \
+        xpr_t;                                                             \
+    return ArrayXpr<xpr_t>(xpr_t(a, b));                                   \
+  }
+
+#define PETLIB_MAKE_POW_SCALAR_(name_, type_)                              \
+  template <class Array_t, typename A_t>                                   \
+  ArrayXpr<ArrayBinaryXpr<ArrayRef<Array_t, A_t>, ScalarRef<type_>,        \
+                          name_##Op<A_t, type_> > >                        \
+  pow(const ArrayBase<Array_t, A_t>& a, const type_& s) {                  \
+    typedef ArrayBinaryXpr<ArrayRef<Array_t, A_t>, ScalarRef<type_>,       \
+                           name_##Op<A_t, type_> >                         \
+        xpr_t;                                                             \
+    return ArrayXpr<xpr_t>(                                                \
+        xpr_t(ArrayRef<Array_t, A_t>(a), ScalarRef<type_>(s)));            \
+  }                                                                        \
+                                                                           \
+  template <class Array_t, typename A_t>                                   \
+  ArrayXpr<ArrayBinaryXpr<ArrayRef<Array_t, A_t>, ScalarRef<type_>,        \
+                          Rev##name_##Op<A_t, type_> > >                   \
+  pow(const type_& s, const ArrayBase<Array_t, A_t>& a) {                  \
+    typedef ArrayBinaryXpr<ArrayRef<Array_t, A_t>, ScalarRef<type_>,       \
+                           Rev##name_##Op<A_t, type_> >                    \
+        xpr_t;                                                             \
+    return ArrayXpr<xpr_t>(                                                \
+        xpr_t(ArrayRef<Array_t, A_t>(a), ScalarRef<type_>(s)));            \
+  }                                                                        \
+                                                                           \
+  template <class Xpr_t>                                                   \
+  ArrayXpr<ArrayBinaryXpr<ArrayXpr<Xpr_t>, ScalarRef<type_>,               \
+                          name_##Op<typename Xpr_t::value_t, type_> > >    \
+  pow(const ArrayXpr<Xpr_t>& a, const type_& s) {                          \
+    typedef ArrayBinaryXpr<ArrayXpr<Xpr_t>, ScalarRef<type_>,              \
+                           name_##Op<typename Xpr_t::value_t, type_> >     \
+        xpr_t;                                                             \
+    return ArrayXpr<xpr_t>(xpr_t(a, ScalarRef<type_>(s)));                 \
+  }                                                                        \
+                                                                           \
+  template <class Xpr_t>                                                   \
+  ArrayXpr<ArrayBinaryXpr<ArrayXpr<Xpr_t>, ScalarRef<type_>,               \
+                          Rev##name_##Op<typename Xpr_t::value_t, type_> > > \
+  pow(const type_& s, const ArrayXpr<Xpr_t>& a) {                          \
+    typedef ArrayBinaryXpr<ArrayXpr<Xpr_t>, ScalarRef<type_>,              \
+                           Rev##name_##Op<typename Xpr_t::value_t, type_> > \
+        xpr_t;                                                             \
+    return ArrayXpr<xpr_t>(xpr_t(a, ScalarRef<type_>(s)));                 \
+  }
+
+PETLIB_MAKE_OP_(Exp, exp)
+PETLIB_MAKE_OP_(Expm1, expm1)
+PETLIB_MAKE_OP_(Log, log)
+PETLIB_MAKE_OP_(Sin, sin)
+PETLIB_MAKE_OP_(Cos, cos)
+PETLIB_MAKE_OP_(Tanh, tanh)
+PETLIB_MAKE_OP_(Sqrt, sqrt)
+PETLIB_MAKE_POW_(Pow)
+PETLIB_MAKE_POW_SCALAR_(Pow, int)
+PETLIB_MAKE_POW_SCALAR_(Pow, float)
+PETLIB_MAKE_POW_SCALAR_(Pow, double)
+
+namespace fast {
+PETLIB_MAKE_OP_(FastExp, exp)
+PETLIB_MAKE_OP_(FastExpm1, expm1)
+PETLIB_MAKE_OP_(FastLog, log)
+PETLIB_MAKE_OP_(FastSin, sin)
+PETLIB_MAKE_OP_(FastCos, cos)
+PETLIB_MAKE_OP_(FastTanh, tanh)
+PETLIB_MAKE_OP_(FastSqrt, sqrt)
+PETLIB_MAKE_POW_(FastPow)
+PETLIB_MAKE_POW_SCALAR_(FastPow, int)
+PETLIB_MAKE_POW_SCALAR_(FastPow, float)
+PETLIB_MAKE_POW_SCALAR_(FastPow, double)
+}  // namespace fast
+
+#undef PETLIB_MAKE_POW_SCALAR_
+#undef PETLIB_MAKE_POW_
+#undef PETLIB_MAKE_OP_
 
 }  // namespace petlib
 
@@ -0,0 +1,504 @@
+#ifndef PETLIB_BANDED_HPP
+#define PETLIB_BANDED_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include <petlib_array.hpp>
+#include <petlib_matrix.hpp>
+#include <petlib_packed.hpp>
+#include <petlib_threads.hpp>
+
+//
+// Banded matrices and their solvers. Row i of a band with kl diagonals
+// below and ku above holds columns i - kl ... i + ku contiguously, the
+// element (i,j) at i ld + j - i + kl, so a row of the band is one unit
+// stride run for products, dots and eliminations alike.
+//  - TridiagonalMatrix, kl = ku = 1, solved by the Thomas algorithm.
+//    Many systems of one matrix are solved at once as the columns of a
+//    row major n x m Matrix, the systems side by side in the SIMD lanes.
+//  - TridiagonalBatch, m systems each with its own coefficients, all
+//    interleaved the same way. This is the inner loop of ADI.
+//  - BandMatrix, any kl and ku, factored by Band_LU_decomposition with
+//    partial pivoting, or Band_Cholesky_decomposition when symmetric
+//    positive definite.
+// The Thomas solves do not pivot. They are for the diagonally dominant
+// or positive definite systems the discretizations produce, anything
+// else goes through the banded LU.
+//
+namespace petlib {
+
+// 1 / d_k and w_k = c_k / d_k of the elimination of the tridiagonal t,
+// row k of t is (a_k, b_k, c_k). Returns 0, or k + 1 when d_k is zero.
+template <typename T>
+std::size_t thomas_decomp(std::size_t n, const T* t, T* f) noexcept {
+  T w = T(0);
+  for (std::size_t k = 0; k < n; ++k) {
+    const T d = t[3 * k + 1] - (k > 0 ? t[3 * k] * w : T(0));
+    if (d == T(0)) return k + 1;
+    const T r = T(1) / d;
+    w = t[3 * k + 2] * r;
+    f[2 * k] = r;
+    f[2 * k + 1] = w;
+  }
+  return 0;
+}
+
+// x = T^-1 x with the elimination of thomas_decomp
+template <typename T>
+void thomas_solve(std::size_t n, const T* t, const T* f, T* x) noexcept {
+  if (n == 0) return;
+  x[0] *= f[0];
+  for (std::size_t k = 1; k < n; ++k) x[k] = (x[k] - t[3 * k] * x[k - 1]) * f[2 * k];
+  for (std::size_t k = n - 1; k-- > 0;) x[k] -= f[2 * k + 1] * x[k + 1];
+}
+
+// the same on columns [lo, hi) of the n x m x at ldx, one system per
+// column. The sweeps run along the rows, unit stride over the systems,
+// in blocks of columns whose n rows stay in cache between the sweeps.
+template <typename T>
+void thomas_solve_columns(std::size_t n, const T* t, const T* f, T* x, std::size_t ldx,
+                          std::size_t lo, std::size_t hi) noexcept {
+  constexpr std::size_t sb = 256;
+  if (n == 0) return;
+  for (std::size_t s0 = lo; s0 < hi; s0 += sb) {
+    const std::size_t s1 = std::min(hi, s0 + sb);
+    {
+      const T r = f[0];
+      T* x0 = x + s0;
+      for (std::size_t s = 0; s < s1 - s0; ++s) x0[s] *= r;
+    }
+    for (std::size_t k = 1; k < n; ++k) {
+      const T a = t[3 * k], r = f[2 * k];
+      T* xk = x + k * ldx + s0;
+      const T* xp = xk - ldx;
+      for (std::size_t s = 0; s < s1 - s0; ++s) xk[s] = (xk[s] - a * xp[s]) * r;
+    }
+    for (std::size_t k = n - 1; k-- > 0;) {
+      const T w = f[2 * k + 1];
+      T* xk = x + k * ldx + s0;
+      const T* xn = xk + ldx;
+      for (std::size_t s = 0; s < s1 - s0; ++s) xk[s] -= w * xn[s];
+    }
+  }
+}
+
+// Columns [lo, hi) of m interleaved systems, element k of system s of
+// a, b, c and x at k ld + s. w is n x (hi - lo) workspace. No pivots are
+// checked, a zero one gives inf or nan in its own system only.
+template <typename T>
+void thomas_batch(std::size_t n, const T* a, const T* b, const T* c, T* x, std::size_t ld,
+                  std::size_t lo, std::size_t hi, T* w) noexcept {
+  constexpr std::size_t sb = 256;
+  if (n == 0) return;
+  for (std::size_t s0 = lo; s0 < hi; s0 += sb) {
+    const std::size_t m = std::min(hi, s0 + sb) - s0;
+    {
+      const T* b0 = b + s0;
+      const T* c0 = c + s0;
+      T* x0 = x + s0;
+      for (std::size_t s = 0; s < m; ++s) {
+        const T r = T(1) / b0[s];
+        w[s] = c0[s] * r;
+        x0[s] *= r;
+      }
+    }
+    for (std::size_t k = 1; k < n; ++k) {
+      const T* ak = a + k * ld + s0;
+      const T* bk = b + k * ld + s0;
+      const T* ck = c + k * ld + s0;
+      T* xk = x + k * ld + s0;
+      const T* xp = xk - ld;
+      T* wk = w + k * m;
+      const T* wp = wk - m;
+      for (std::size_t s = 0; s < m; ++s) {
+        const T r = T(1) / (bk[s] - ak[s] * wp[s]);
+        wk[s] = ck[s] * r;
+        xk[s] = (xk[s] - ak[s] * xp[s]) * r;
+      }
+    }
+    for (std::size_t k = n - 1; k-- > 0;) {
+      const T* wk = w + k * m;
+      T* xk = x + k * ld + s0;
+      const T* xn = xk + ld;
+      for (std::size_t s = 0; s < m; ++s) xk[s] -= wk[s] * xn[s];
+    }
+  }
+}
+
+// LU with partial pivoting of the n x n band in a, kl below and ku above
+// the diagonal in the first kl + ku + 1 places of each row. The row
+// exchanges widen U to kl + ku above, so ld >= 2 kl + ku + 1 and the
+// last kl places of every row are cleared here. Returns 0, or k + 1 for
+// a zero pivot in column k.
+template <typename T>
+std::size_t band_lu_decomp(std::size_t n, std::size_t kl, std::size_t ku, T* a, std::size_t ld,
+                           std::size_t* piv) noexcept {
+  auto row = [a, ld, kl](std::size_t i) { return a + i * ld + kl - i; };
+  for (std::size_t i = 0; i < n; ++i)
+    for (std::size_t j = kl + ku + 1; j < 2 * kl + ku + 1; ++j) a[i * ld + j] = T(0);
+  for (std::size_t k = 0; k < n; ++k) {
+    const std::size_t last = std::min(n - 1, k + kl), jend = std::min(n - 1, k + kl + ku);
+    std::size_t p = k;
+    T amax = std::abs(row(k)[k]);
+    for (std::size_t i = k + 1; i <= last; ++i)
+      if (std::abs(row(i)[k]) > amax) {
+        amax = std::abs(row(i)[k]);
+        p = i;
+      }
+    piv[k] = p;
+    if (amax == T(0)) return k + 1;
+    T* pk = row(k);
+    if (p != k) {
+      T* pp = row(p);
+      for (std::size_t j = k; j <= jend; ++j) std::swap(pk[j], pp[j]);
+    }
+    const T r = T(1) / pk[k];
+    for (std::size_t i = k + 1; i <= last; ++i) {
+      T* pi = row(i);
+      const T l = pi[k] * r;
+      pi[k] = l;
+      if (l != T(0))
+        for (std::size_t j = k + 1; j <= jend; ++j) pi[j] -= l * pk[j];
+    }
+  }
+  return 0;
+}
+
+// the columns of the n x m x at ldx solved with the factor of band_lu_decomp
+template <typename T>
+void band_lu_solve(std::size_t n, std::size_t kl, std::size_t ku, const T* lu, std::size_t ld,
+                   const std::size_t* piv, T* x, std::size_t m, std::size_t ldx) noexcept {
+  auto row = [lu, ld, kl](std::size_t i) { return lu + i * ld + kl - i; };
+  for (std::size_t k = 0; k < n; ++k) {
+    T* xk = x + k * ldx;
+    if (piv[k] != k) {
+      T* xp = x + piv[k] * ldx;
+      for (std::size_t c = 0; c < m; ++c) std::swap(xk[c], xp[c]);
+    }
+    for (std::size_t i = k + 1; i <= std::min(n - 1, k + kl); ++i) {
+      const T l = row(i)[k];
+      T* xi = x + i * ldx;
+      for (std::size_t c = 0; c < m; ++c) xi[c] -= l * xk[c];
+    }
+  }
+  for (std::size_t i = n; i-- > 0;) {
+    const T* ui = row(i);
+    T* xi = x + i * ldx;
+    for (std::size_t j = i + 1; j <= std::min(n - 1, i + kl + ku); ++j) {
+      const T u = ui[j];
+      const T* xj = x + j * ldx;
+      for (std::size_t c = 0; c < m; ++c) xi[c] -= u * xj[c];
+    }
+    const T d = T(1) / ui[i];
+    for (std::size_t c = 0; c < m; ++c) xi[c] *= d;
+  }
+}
+
+// Cholesky of the symmetric positive definite band with k diagonals
+// below, stored as its lower band, row i holding columns i - k ... i.
+// The Chol_i form of chol_decomp with the dots cut to the band. Returns
+// 0, or i + 1 when the pivot of row i is not positive.
+template <typename T>
+std::size_t band_chol_decomp(std::size_t n, std::size_t k, T* l, std::size_t ld) noexcept {
+  auto row = [l, ld, k](std::size_t i) { return l + i * ld + k - i; };
+  for (std::size_t i = 0; i < n; ++i) {
+    T* li = row(i);
+    const std::size_t lo = i > k ? i - k : 0;
+    for (std::size_t j = lo; j < i; ++j) {
+      const T* lj = row(j);
+      li[j] = (li[j] - packed::dot<T>(lo, j, li, lj)) / lj[j];
+    }
+    const T d = li[i] - packed::dot<T>(lo, i, li, li);
+    if (!(d > T(0))) return i + 1;
+    li[i] = std::sqrt(d);
+  }
+  return 0;
+}
+
+template <typename T>
+void band_chol_solve(std::size_t n, std::size_t k, const T* l, std::size_t ld, T* x) noexcept {
+  auto row = [l, ld, k](std::size_t i) { return l + i * ld + k - i; };
+  for (std::size_t i = 0; i < n; ++i) {
+    const T* li = row(i);
+    x[i] = (x[i] - packed::dot<T>(i > k ? i - k : 0, i, li, x)) / li[i];
+  }
+  for (std::size_t i = n; i-- > 0;) {
+    const T* li = row(i);
+    const T xi = x[i] / li[i];
+    x[i] = xi;
+    for (std::size_t j = i > k ? i - k : 0; j < i; ++j) x[j] -= li[j] * xi;
+  }
+}
+
+template <typename T>
+class TridiagonalMatrix : public MatrixBase<TridiagonalMatrix<T>, T> {
+ public:
+  typedef T value_t;
+  typedef std::size_t size_type;
+
+  explicit TridiagonalMatrix(size_type n_) : n(n_), t(n_, 3) { t = T(0); }
+  // the constant diagonals a, b, c of a Toeplitz matrix
+  TridiagonalMatrix(size_type n_, value_t a, value_t b, value_t c) : n(n_), t(n_, 3) {
+    T* p = t.data();
+    for (size_type k = 0; k < n; ++k) {
+      p[3 * k] = k > 0 ? a : T(0);
+      p[3 * k + 1] = b;
+      p[3 * k + 2] = k + 1 < n ? c : T(0);
+    }
+  }
+
+  size_type nrows() const noexcept { return n; }
+  size_type ncols() const noexcept { return n; }
+  size_type size() const noexcept { return n * n; }
+  size_type bytes() const noexcept { return 3 * n * sizeof(T); }
+
+  value_t operator()(size_type i, size_type j) const noexcept {
+    return i <= j + 1 && j <= i + 1 ? t(i, j + 1 - i) : value_t(0);
+  }
+  // |i - j| <= 1 only
+  T& operator()(size_type i, size_type j) {
+    assert(i < n && j < n && i <= j + 1 && j <= i + 1);
+    return t(i, j + 1 - i);
+  }
+
+  // the rows (a_i, b_i, c_i), a_0 and c_n-1 are zero
+  const Matrix<T>& rows() const noexcept { return t; }
+
+  Matrix<T> full() const {
+    Matrix<T> m(n, n);
+    m = T(0);
+    for (size_type i = 0; i < n; ++i)
+      for (size_type j = i > 0 ? i - 1 : 0; j < std::min(n, i + 2); ++j) m(i, j) = (*this)(i, j);
+    return m;
+  }
+
+  void multiply(const Array<T>& x, Array<T>& y, unsigned nthreads = 1) const {
+    const T* p = t.data();
+    const T* px = x.data();
+    T* py = y.data();
+    const unsigned nt = std::max(1u, threads_for(3 * n, stream_grain, nthreads));
+    run_threads(nt, [&](unsigned th) {
+      const size_type lo = th * n / nt, hi = (th + 1) * n / nt;
+      for (size_type i = lo; i < hi; ++i) {
+        T s = p[3 * i + 1] * px[i];
+        if (i > 0) s += p[3 * i] * px[i - 1];
+        if (i + 1 < n) s += p[3 * i + 2] * px[i + 1];
+        py[i] = s;
+      }
+    });
+  }
+
+  // x = T^-1 x by the Thomas algorithm
+  void solve(Array<T>& x) const {
+    std::vector<T> f(2 * n);
+    decomp(f.data());
+    thomas_solve<T>(n, t.data(), f.data(), x.data());
+  }
+
+  // the columns of x are independent right hand sides, solved together
+  // with the columns split over threads
+  void solve(Matrix<T>& x, unsigned nthreads = 1) const {
+    std::vector<T> f(2 * n);
+    decomp(f.data());
+    const size_type m = x.ncols();
+    T* px = x.data();
+    const unsigned nt = std::max(1u, std::min(threads_for(n * m, stream_grain, nthreads), unsigned((m + 255) / 256)));
+    run_threads(nt, [&](unsigned th) {
+      thomas_solve_columns<T>(n, t.data(), f.data(), px, m, th * m / nt, (th + 1) * m / nt);
+    });
+  }
+
+ private:
+  void decomp(T* f) const {
+    const size_type info = thomas_decomp<T>(n, t.data(), f);
+    if (info != 0) {
+      std::cerr << "zero pivot in TridiagonalMatrix::solve at row " << info - 1 << "\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  size_type n;
+  Matrix<T> t;
+};
+
+// m tridiagonal systems of size n, the coefficients of system s are
+// column s of the n x m sub, diag and super matrices
+template <typename T>
+class TridiagonalBatch {
+ public:
+  typedef T value_t;
+  typedef std::size_t size_type;
+
+  TridiagonalBatch(size_type n_, size_type m_) : n(n_), m(m_), a(n_, m_), b(n_, m_), c(n_, m_) {}
+
+  size_type size() const noexcept { return n; }
+  size_type count() const noexcept { return m; }
+
+  Matrix<T>& sub() noexcept { return a; }
+  Matrix<T>& diag() noexcept { return b; }
+  Matrix<T>& super() noexcept { return c; }
+  const Matrix<T>& sub() const noexcept { return a; }
+  const Matrix<T>& diag() const noexcept { return b; }
+  const Matrix<T>& super() const noexcept { return c; }
+
+  // column s of x is the right hand side of system s, overwritten with
+  // its solution
+  void solve(Matrix<T>& x, unsigned nthreads = 1) const {
+    const T* pa = a.data();
+    const T* pb = b.data();
+    const T* pc = c.data();
+    T* px = x.data();
+    const unsigned nt = std::max(1u, std::min(threads_for(n * m, stream_grain, nthreads), unsigned((m + 255) / 256)));
+    run_threads(nt, [&](unsigned th) {
+      std::vector<T> w(n * 256);
+      thomas_batch<T>(n, pa, pb, pc, px, m, th * m / nt, (th + 1) * m / nt, w.data());
+    });
+  }
+
+ private:
+  size_type n, m;
+  Matrix<T> a, b, c;
+};
+
+template <typename T>
+class BandMatrix : public MatrixBase<BandMatrix<T>, T> {
+ public:
+  typedef T value_t;
+  typedef std::size_t size_type;
+
+  BandMatrix(size_type n_, size_type kl_, size_type ku_) : n(n_), kl(kl_), ku(ku_), a(n_, kl_ + ku_ + 1) {
+    a = T(0);
+  }
+  // the band of m
+  BandMatrix(size_type kl_, size_type ku_, const Matrix<T>& m) : BandMatrix(m.nrows(), kl_, ku_) {
+    for (size_type i = 0; i < n; ++i)
+      for (size_type j = i > kl ? i - kl : 0; j < std::min(n, i + ku + 1); ++j) a(i, j + kl - i) = m(i, j);
+  }
+
+  size_type nrows() const noexcept { return n; }
+  size_type ncols() const noexcept { return n; }
+  size_type size() const noexcept { return n * n; }
+  size_type lower() const noexcept { return kl; }
+  size_type upper() const noexcept { return ku; }
+  size_type bytes() const noexcept { return a.size() * sizeof(T); }
+
+  value_t operator()(size_type i, size_type j) const noexcept {
+    return i <= j + kl && j <= i + ku ? a(i, j + kl - i) : value_t(0);
+  }
+  // i - kl <= j <= i + ku only
+  T& operator()(size_type i, size_type j) {
+    assert(i < n && j < n && i <= j + kl && j <= i + ku);
+    return a(i, j + kl - i);
+  }
+
+  // n x (kl + ku + 1), row i the columns i - kl ... i + ku
+  const Matrix<T>& band() const noexcept { return a; }
+
+  Matrix<T> full() const {
+    Matrix<T> m(n, n);
+    for (size_type i = 0; i < n; ++i)
+      for (size_type j = 0; j < n; ++j) m(i, j) = (*this)(i, j);
+    return m;
+  }
+
+  void multiply(const Array<T>& x, Array<T>& y, unsigned nthreads = 1) const {
+    const size_type ld = kl + ku + 1;
+    const T* p = a.data();
+    const T* px = x.data();
+    T* py = y.data();
+    const unsigned nt = std::max(1u, threads_for(n * ld, stream_grain, nthreads));
+    run_threads(nt, [&](unsigned th) {
+      const size_type lo = th * n / nt, hi = (th + 1) * n / nt;
+      for (size_type i = lo; i < hi; ++i) {
+        const size_type j0 = i > kl ? i - kl : 0, j1 = std::min(n, i + ku + 1);
+        py[i] = packed::dot<T>(j0, j1, p + i * ld + kl - i, px);
+      }
+    });
+  }
+
+ private:
+  size_type n, kl, ku;
+  Matrix<T> a;
+};
+
+template <typename T>
+class Band_LU_decomposition {
+ public:
+  typedef std::size_t size_type;
+
+  explicit Band_LU_decomposition(const BandMatrix<T>& arg)
+      : n(arg.nrows()), kl(arg.lower()), ku(arg.upper()), lu(n, 2 * kl + ku + 1), piv(n) {
+    const size_type w = kl + ku + 1, ld = 2 * kl + ku + 1;
+    const T* pa = arg.band().data();
+    T* p = lu.data();
+    for (size_type i = 0; i < n; ++i)
+      for (size_type j = 0; j < w; ++j) p[i * ld + j] = pa[i * w + j];
+    const size_type info = band_lu_decomp<T>(n, kl, ku, p, ld, piv.data());
+    if (info != 0) {
+      std::cerr << "singular matrix in Band_LU_decomposition at column " << info - 1 << "\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  size_type size() const noexcept { return n; }
+
+  Array<T> solve(const Array<T>& b) const {
+    Array<T> x(b);
+    band_lu_solve<T>(n, kl, ku, lu.data(), 2 * kl + ku + 1, piv.data(), x.data(), 1, 1);
+    return x;
+  }
+
+  Matrix<T> matrix_solve(const Matrix<T>& b) const {
+    Matrix<T> x(b);
+    band_lu_solve<T>(n, kl, ku, lu.data(), 2 * kl + ku + 1, piv.data(), x.data(), x.ncols(), x.ncols());
+    return x;
+  }
+
+ private:
+  size_type n, kl, ku;
+  Matrix<T> lu;
+  std::vector<size_type> piv;
+};
+
+// reads the lower band of a symmetric positive definite a
+template <typename T>
+class Band_Cholesky_decomposition {
+ public:
+  typedef std::size_t size_type;
+
+  explicit Band_Cholesky_decomposition(const BandMatrix<T>& arg)
+      : n(arg.nrows()), k(arg.lower()), l(n, k + 1) {
+    const size_type w = arg.lower() + arg.upper() + 1;
+    const T* pa = arg.band().data();
+    T* p = l.data();
+    for (size_type i = 0; i < n; ++i)
+      for (size_type j = 0; j <= k; ++j) p[i * (k + 1) + j] = pa[i * w + j];
+    const size_type info = band_chol_decomp<T>(n, k, p, k + 1);
+    if (info != 0) {
+      std::cerr << "non spd matrix in Band_Cholesky_decomposition at row " << info - 1 << "\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  size_type size() const noexcept { return n; }
+
+  Array<T> solve(const Array<T>& b) const {
+    Array<T> x(b);
+    band_chol_solve<T>(n, k, l.data(), k + 1, x.data());
+    return x;
+  }
+
+ private:
+  size_type n, k;
+  Matrix<T> l;
+};
+
+}  // namespace petlib
+#endif
@@ -0,0 +1,397 @@
+#ifndef PETLIB_BATCHED_HPP
+#define PETLIB_BATCHED_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <petlib_matrix.hpp>
+#include <petlib_threads.hpp>
+
+//
+// Many small matrices of one compile time size, factored and multiplied
+// together. A MatrixBatch keeps count R x C matrices in one buffer, in
+// groups of L interleaved matrices: element (i,j) of the L matrices of
+// a group is L consecutive values, matrix b in lane b % L. Every
+// operation on a matrix is then the same operation on L lanes at once,
+// a straight line of vector instructions with no shuffles, and the
+// sizes being constants the loops over i, j and k unroll.
+//
+// The kernels work a group at a time, the batch functions run them over
+// the groups split across threads. Factorizations report how many
+// matrices failed, singular for LU, not positive definite for Cholesky.
+// They carry on as LAPACK does and the failed lanes hold inf or nan, the
+// other matrices of their groups are not touched by it.
+//
+namespace petlib {
+
+template <typename T, std::size_t R, std::size_t C = R, std::size_t L = 8>
+class MatrixBatch {
+ public:
+  typedef T value_t;
+  typedef std::size_t size_type;
+  static constexpr size_type rows = R;
+  static constexpr size_type cols = C;
+  static constexpr size_type lanes = L;
+  static constexpr size_type group_size = R * C * L;
+
+  // count zero matrices, the last group padded to L with zeros
+  explicit MatrixBatch(size_type count) : nb(count), ng((count + L - 1) / L), a(ng, group_size) { a = T(0); }
+
+  size_type count() const noexcept { return nb; }
+  size_type groups() const noexcept { return ng; }
+  size_type bytes() const noexcept { return ng * group_size * sizeof(T); }
+
+  value_t operator()(size_type b, size_type i, size_type j) const noexcept {
+    return a.data()[(b / L) * group_size + (i * C + j) * L + b % L];
+  }
+  T& operator()(size_type b, size_type i, size_type j) {
+    return a.data()[(b / L) * group_size + (i * C + j) * L + b % L];
+  }
+
+  Matrix<T> matrix(size_type b) const {
+    Matrix<T> m(R, C);
+    for (size_type i = 0; i < R; ++i)
+      for (size_type j = 0; j < C; ++j) m(i, j) = (*this)(b, i, j);
+    return m;
+  }
+  void set(size_type b, const Matrix<T>& m) {
+    T* p = a.data() + (b / L) * group_size + b % L;
+    for (size_type i = 0; i < R; ++i)
+      for (size_type j = 0; j < C; ++j) p[(i * C + j) * L] = m(i, j);
+  }
+
+  // the groups one after the other, group g at g group_size
+  T* data() { return a.data(); }
+  const T* data() const noexcept { return a.data(); }
+
+ private:
+  size_type nb, ng;
+  Matrix<T> a;
+};
+
+// the row pivots of a batch of LU factors
+template <std::size_t N, std::size_t L = 8>
+using PivotBatch = MatrixBatch<std::int32_t, N, 1, L>;
+
+namespace batched {
+
+// c += alpha a b on a 1 x NR tile of rows, a and b at leading
+// dimensions LDA and LDB, c at LDC, all in elements of L lanes. The
+// loops are unrolled whole so the NR accumulators stay in registers.
+template <typename T, std::size_t L, std::size_t NR, std::size_t K, std::size_t LDB>
+inline void gemm_tile(T alpha, const T* __restrict__ a, const T* __restrict__ b, T* __restrict__ c) noexcept {
+  T acc[NR][L] = {};
+  for (std::size_t k = 0; k < K; ++k) {
+#pragma GCC unroll 8
+    for (std::size_t j = 0; j < NR; ++j)
+#pragma GCC unroll 16
+      for (std::size_t l = 0; l < L; ++l) acc[j][l] += a[k * L + l] * b[(k * LDB + j) * L + l];
+  }
+#pragma GCC unroll 8
+  for (std::size_t j = 0; j < NR; ++j)
+#pragma GCC unroll 16
+    for (std::size_t l = 0; l < L; ++l) c[j * L + l] += alpha * acc[j][l];
+}
+
+// c += alpha a b for one group, a is M x K, b K x N. A row of c is done
+// four columns at a time, a row of a is read once per four columns.
+template <typename T, std::size_t M, std::size_t N, std::size_t K, std::size_t L>
+void gemm_group(T alpha, const T* __restrict__ a, const T* __restrict__ b, T* __restrict__ c) noexcept {
+  constexpr std::size_t nr = 4, nt = N % nr;
+  for (std::size_t i = 0; i < M; ++i) {
+    for (std::size_t j = 0; j + nr <= N; j += nr)
+      gemm_tile<T, L, nr, K, N>(alpha, a + i * K * L, b + j * L, c + (i * N + j) * L);
+    if constexpr (nt > 0)
+      gemm_tile<T, L, nt, K, N>(alpha, a + i * K * L, b + (N - nt) * L, c + (i * N + N - nt) * L);
+  }
+}
+
+// LU with partial pivoting of one group, whole rows exchanged as in
+// getrf. The pivot rows are searched for on all lanes at once, selecting
+// by lane, and exchanged lane by lane. The elimination reads a copy of
+// the pivot row, which the compiler then knows is not one of the rows it
+// updates. bad[l] is set for a zero pivot.
+template <typename T, std::size_t N, std::size_t L>
+void lu_group(T* a, std::int32_t* piv, bool* bad) noexcept {
+  for (std::size_t k = 0; k < N; ++k) {
+    // the pivot rows as T, so the selects are on lanes of one width
+    T p[L], amax[L];
+    for (std::size_t l = 0; l < L; ++l) {
+      p[l] = T(k);
+      amax[l] = std::abs(a[(k * N + k) * L + l]);
+    }
+    for (std::size_t i = k + 1; i < N; ++i)
+      for (std::size_t l = 0; l < L; ++l) {
+        const T v = std::abs(a[(i * N + k) * L + l]);
+        const bool g = v > amax[l];
+        amax[l] = g ? v : amax[l];
+        p[l] = g ? T(i) : p[l];
+      }
+    for (std::size_t l = 0; l < L; ++l) {
+      piv[k * L + l] = std::int32_t(p[l]);
+      bad[l] = bad[l] || amax[l] == T(0);
+    }
+    for (std::size_t l = 0; l < L; ++l) {
+      const std::size_t i = piv[k * L + l];
+      if (i == k) continue;
+      T* __restrict__ x = a + k * N * L + l;
+      T* __restrict__ y = a + i * N * L + l;
+      for (std::size_t j = 0; j < N; ++j) std::swap(x[j * L], y[j * L]);
+    }
+    T u[N][L], r[L];
+    for (std::size_t j = k; j < N; ++j)
+      for (std::size_t l = 0; l < L; ++l) u[j][l] = a[(k * N + j) * L + l];
+    for (std::size_t l = 0; l < L; ++l) r[l] = T(1) / u[k][l];
+    for (std::size_t i = k + 1; i < N; ++i) {
+      T* ai = a + i * N * L;
+      T m[L];
+      for (std::size_t l = 0; l < L; ++l) {
+        m[l] = ai[k * L + l] * r[l];
+        ai[k * L + l] = m[l];
+      }
+      for (std::size_t j = k + 1; j < N; ++j)
+        for (std::size_t l = 0; l < L; ++l) ai[j * L + l] -= m[l] * u[j][l];
+    }
+  }
+}
+
+// right looking Cholesky of one group, the lower triangle is read and
+// overwritten with L. Column k is scaled into a copy that the update of
+// the trailing triangle reads. bad[l] is set for a pivot that is not
+// positive.
+template <typename T, std::size_t N, std::size_t L>
+void chol_group(T* a, bool* bad) noexcept {
+  for (std::size_t k = 0; k < N; ++k) {
+    T r[L], v[N][L];
+    for (std::size_t l = 0; l < L; ++l) {
+      const T d = a[(k * N + k) * L + l];
+      bad[l] = bad[l] || !(d > T(0));
+      const T s = std::sqrt(d);
+      a[(k * N + k) * L + l] = s;
+      r[l] = T(1) / s;
+    }
+    for (std::size_t i = k + 1; i < N; ++i)
+#pragma GCC unroll 16
+      for (std::size_t l = 0; l < L; ++l) {
+        v[i][l] = a[(i * N + k) * L + l] * r[l];
+        a[(i * N + k) * L + l] = v[i][l];
+      }
+    for (std::size_t i = k + 1; i < N; ++i) {
+      T* ai = a + i * N * L;
+      for (std::size_t j = k + 1; j <= i; ++j)
+#pragma GCC unroll 16
+        for (std::size_t l = 0; l < L; ++l) ai[j * L + l] -= v[i][l] * v[j][l];
+    }
+  }
+}
+
+// b = L^-1 b for the lower triangle of a, with a unit diagonal when
+// Unit, b is N x M. Row i of b is summed in registers.
+template <typename T, std::size_t N, std::size_t M, std::size_t L, bool Unit = false>
+void trsm_lower_group(const T* __restrict__ a, T* __restrict__ b) noexcept {
+  for (std::size_t i = 0; i < N; ++i) {
+    T x[M][L];
+    for (std::size_t j = 0; j < M; ++j)
+#pragma GCC unroll 16
+      for (std::size_t l = 0; l < L; ++l) x[j][l] = b[(i * M + j) * L + l];
+    for (std::size_t k = 0; k < i; ++k)
+      for (std::size_t j = 0; j < M; ++j)
+#pragma GCC unroll 16
+        for (std::size_t l = 0; l < L; ++l) x[j][l] -= a[(i * N + k) * L + l] * b[(k * M + j) * L + l];
+    T r[L];
+    for (std::size_t l = 0; l < L; ++l) r[l] = Unit ? T(1) : T(1) / a[(i * N + i) * L + l];
+    for (std::size_t j = 0; j < M; ++j)
+#pragma GCC unroll 16
+      for (std::size_t l = 0; l < L; ++l) b[(i * M + j) * L + l] = Unit ? x[j][l] : x[j][l] * r[l];
+  }
+}
+
+// b = U^-1 b for the upper triangle of a
+template <typename T, std::size_t N, std::size_t M, std::size_t L>
+void trsm_upper_group(const T* __restrict__ a, T* __restrict__ b) noexcept {
+  for (std::size_t i = N; i-- > 0;) {
+    T x[M][L];
+    for (std::size_t j = 0; j < M; ++j)
+#pragma GCC unroll 16
+      for (std::size_t l = 0; l < L; ++l) x[j][l] = b[(i * M + j) * L + l];
+    for (std::size_t k = i + 1; k < N; ++k)
+      for (std::size_t j = 0; j < M; ++j)
+#pragma GCC unroll 16
+        for (std::size_t l = 0; l < L; ++l) x[j][l] -= a[(i * N + k) * L + l] * b[(k * M + j) * L + l];
+    T r[L];
+    for (std::size_t l = 0; l < L; ++l) r[l] = T(1) / a[(i * N + i) * L + l];
+    for (std::size_t j = 0; j < M; ++j)
+#pragma GCC unroll 16
+      for (std::size_t l = 0; l < L; ++l) b[(i * M + j) * L + l] = x[j][l] * r[l];
+  }
+}
+
+// b = L'^-1 b for the lower triangle of a, row i of b is final when it
+// is reached and is taken from the rows above it
+template <typename T, std::size_t N, std::size_t M, std::size_t L>
+void trsm_lower_transpose_group(const T* __restrict__ a, T* __restrict__ b) noexcept {
+  for (std::size_t i = N; i-- > 0;) {
+    T x[M][L], r[L];
+    for (std::size_t l = 0; l < L; ++l) r[l] = T(1) / a[(i * N + i) * L + l];
+    for (std::size_t j = 0; j < M; ++j)
+#pragma GCC unroll 16
+      for (std::size_t l = 0; l < L; ++l) {
+        x[j][l] = b[(i * M + j) * L + l] * r[l];
+        b[(i * M + j) * L + l] = x[j][l];
+      }
+    for (std::size_t k = 0; k < i; ++k)
+      for (std::size_t j = 0; j < M; ++j)
+#pragma GCC unroll 16
+        for (std::size_t l = 0; l < L; ++l) b[(k * M + j) * L + l] -= a[(i * N + k) * L + l] * x[j][l];
+  }
+}
+
+// the row exchanges of lu_group applied to b, lane by lane
+template <typename T, std::size_t N, std::size_t M, std::size_t L>
+void permute_group(const std::int32_t* piv, T* b) noexcept {
+  for (std::size_t k = 0; k < N; ++k)
+    for (std::size_t l = 0; l < L; ++l) {
+      const std::size_t p = std::size_t(piv[k * L + l]);
+      if (p != k)
+        for (std::size_t j = 0; j < M; ++j) std::swap(b[(k * M + j) * L + l], b[(p * M + j) * L + l]);
+    }
+}
+
+// f(t, g0, g1) on thread t for ranges of the ng groups, work in multiply adds
+template <class F>
+void for_groups(std::size_t ng, std::size_t work, unsigned nthreads, const F& f) {
+  const unsigned nt = std::max(1u, std::min(threads_for(work, flop_grain, nthreads), unsigned(std::max<std::size_t>(ng, 1))));
+  run_threads(nt, [&](unsigned t) { f(t, t * ng / nt, (t + 1) * ng / nt); });
+}
+
+// the number of bad lanes that hold one of the count matrices
+template <std::size_t L>
+std::size_t count_bad(const bool* bad, std::size_t g, std::size_t count) noexcept {
+  std::size_t s = 0;
+  for (std::size_t l = 0; l < L; ++l) s += bad[l] && g * L + l < count ? 1 : 0;
+  return s;
+}
+
+// c += alpha a b for every matrix of the batches
+template <typename T, std::size_t M, std::size_t K, std::size_t N, std::size_t L>
+void gemm(T alpha, const MatrixBatch<T, M, K, L>& a, const MatrixBatch<T, K, N, L>& b, MatrixBatch<T, M, N, L>& c,
+          unsigned nthreads = 1) {
+  assert(a.count() == c.count() && b.count() == c.count());
+  const T* pa = a.data();
+  const T* pb = b.data();
+  T* pc = c.data();
+  const std::size_t ng = c.groups();
+  for_groups(ng, ng * M * N * K * L, nthreads, [&](unsigned, std::size_t g0, std::size_t g1) {
+    for (std::size_t g = g0; g < g1; ++g)
+      gemm_group<T, M, N, K, L>(alpha, pa + g * M * K * L, pb + g * K * N * L, pc + g * M * N * L);
+  });
+}
+
+// P A = L U in place, returns the number of singular matrices
+template <typename T, std::size_t N, std::size_t L>
+std::size_t lu_decomp(MatrixBatch<T, N, N, L>& a, PivotBatch<N, L>& piv, unsigned nthreads = 1) {
+  assert(piv.count() == a.count());
+  T* pa = a.data();
+  std::int32_t* pp = piv.data();
+  const std::size_t ng = a.groups();
+  std::vector<std::size_t> nbad(std::max(1u, nthreads), 0);
+  for_groups(ng, ng * N * N * N * L / 3, nthreads, [&](unsigned t, std::size_t g0, std::size_t g1) {
+    std::size_t s = 0;
+    for (std::size_t g = g0; g < g1; ++g) {
+      bool bad[L] = {};
+      lu_group<T, N, L>(pa + g * N * N * L, pp + g * N * L, bad);
+      s += count_bad<L>(bad, g, a.count());
+    }
+    nbad[t] = s;
+  });
+  std::size_t s = 0;
+  for (std::size_t x : nbad) s += x;
+  return s;
+}
+
+// b = A^-1 b with the factors of lu_decomp
+template <typename T, std::size_t N, std::size_t M, std::size_t L>
+void lu_solve(const MatrixBatch<T, N, N, L>& a, const PivotBatch<N, L>& piv, MatrixBatch<T, N, M, L>& b,
+              unsigned nthreads = 1) {
+  assert(a.count() == b.count() && piv.count() == b.count());
+  const T* pa = a.data();
+  const std::int32_t* pp = piv.data();
+  T* pb = b.data();
+  const std::size_t ng = b.groups();
+  for_groups(ng, ng * N * N * M * L, nthreads, [&](unsigned, std::size_t g0, std::size_t g1) {
+    for (std::size_t g = g0; g < g1; ++g) {
+      T* bg = pb + g * N * M * L;
+      permute_group<T, N, M, L>(pp + g * N * L, bg);
+      trsm_lower_group<T, N, M, L, true>(pa + g * N * N * L, bg);
+      trsm_upper_group<T, N, M, L>(pa + g * N * N * L, bg);
+    }
+  });
+}
+
+// A = L L' in place on the lower triangles, returns the number of
+// matrices that are not positive definite
+template <typename T, std::size_t N, std::size_t L>
+std::size_t chol_decomp(MatrixBatch<T, N, N, L>& a, unsigned nthreads = 1) {
+  T* pa = a.data();
+  const std::size_t ng = a.groups();
+  std::vector<std::size_t> nbad(std::max(1u, nthreads), 0);
+  for_groups(ng, ng * N * N * N * L / 6, nthreads, [&](unsigned t, std::size_t g0, std::size_t g1) {
+    std::size_t s = 0;
+    for (std::size_t g = g0; g < g1; ++g) {
+      bool bad[L] = {};
+      chol_group<T, N, L>(pa + g * N * N * L, bad);
+      s += count_bad<L>(bad, g, a.count());
+    }
+    nbad[t] = s;
+  });
+  std::size_t s = 0;
+  for (std::size_t x : nbad) s += x;
+  return s;
+}
+
+// b = A^-1 b with the factors of chol_decomp
+template <typename T, std::size_t N, std::size_t M, std::size_t L>
+void chol_solve(const MatrixBatch<T, N, N, L>& a, MatrixBatch<T, N, M, L>& b, unsigned nthreads = 1) {
+  assert(a.count() == b.count());
+  const T* pa = a.data();
+  T* pb = b.data();
+  const std::size_t ng = b.groups();
+  for_groups(ng, ng * N * N * M * L, nthreads, [&](unsigned, std::size_t g0, std::size_t g1) {
+    for (std::size_t g = g0; g < g1; ++g) {
+      trsm_lower_group<T, N, M, L>(pa + g * N * N * L, pb + g * N * M * L);
+      trsm_lower_transpose_group<T, N, M, L>(pa + g * N * N * L, pb + g * N * M * L);
+    }
+  });
+}
+
+// b = L^-1 b and b = U^-1 b for the lower and upper triangles of a
+template <typename T, std::size_t N, std::size_t M, std::size_t L>
+void trsm_lower(const MatrixBatch<T, N, N, L>& a, MatrixBatch<T, N, M, L>& b, unsigned nthreads = 1) {
+  assert(a.count() == b.count());
+  const T* pa = a.data();
+  T* pb = b.data();
+  const std::size_t ng = b.groups();
+  for_groups(ng, ng * N * N * M * L / 2, nthreads, [&](unsigned, std::size_t g0, std::size_t g1) {
+    for (std::size_t g = g0; g < g1; ++g) trsm_lower_group<T, N, M, L>(pa + g * N * N * L, pb + g * N * M * L);
+  });
+}
+
+template <typename T, std::size_t N, std::size_t M, std::size_t L>
+void trsm_upper(const MatrixBatch<T, N, N, L>& a, MatrixBatch<T, N, M, L>& b, unsigned nthreads = 1) {
+  assert(a.count() == b.count());
+  const T* pa = a.data();
+  T* pb = b.data();
+  const std::size_t ng = b.groups();
+  for_groups(ng, ng * N * N * M * L / 2, nthreads, [&](unsigned, std::size_t g0, std::size_t g1) {
+    for (std::size_t g = g0; g < g1; ++g) trsm_upper_group<T, N, M, L>(pa + g * N * N * L, pb + g * N * M * L);
+  });
+}
+
+}  // namespace batched
+}  // namespace petlib
+#endif
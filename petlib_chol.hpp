@@ -0,0 +1,210 @@
+#ifndef PETLIB_CHOL_HPP
+#define PETLIB_CHOL_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include <petlib_array.hpp>
+#include <petlib_gemm.hpp>
+#include <petlib_matrix.hpp>
+#include <petlib_packed.hpp>
+
+//
+// Cholesky factorization A = L L' of a symmetric positive definite row
+// major matrix, the row oriented Chol_i form of varray/petlib_tchol.hpp
+// with its BLAS calls written out. Row i of L is the solve of the rows
+// above it, so every inner loop is a dot product of two contiguous rows.
+// Only the lower triangle of A is read and it is overwritten with L.
+//
+// The same factorization runs in place on the packed SymmetricMatrix
+// types. In the rectangular full packed layout the trailing update of
+// A22 is a matrix product and A22 = L22 L22' is factored as U'U on the
+// upper triangle where it is stored.
+//
+namespace petlib {
+
+// returns 0, or k + 1 when the pivot of row k is not positive. row(i)
+// points at row i of the lower triangle.
+template <typename T, class Row>
+std::size_t chol_rows(std::size_t nr, const Row& row) noexcept {
+  for (std::size_t i = 0; i < nr; ++i) {
+    T* ai = row(i);
+    for (std::size_t j = 0; j < i; ++j) {
+      const T* aj = row(j);
+      ai[j] = (ai[j] - packed::dot<T>(0, j, ai, aj)) / aj[j];
+    }
+    const T d = ai[i] - packed::dot<T>(0, i, ai, ai);
+    if (!(d > T(0))) return i + 1;
+    ai[i] = std::sqrt(d);
+  }
+  return 0;
+}
+
+template <typename T>
+std::size_t chol_decomp(std::size_t nr, T* a, std::size_t lda) noexcept {
+  return chol_rows<T>(nr, [a, lda](std::size_t i) { return a + i * lda; });
+}
+
+// A = U'U, right looking on the upper triangle, row(b)[a] the element
+// a >= b of row b
+template <typename T, class Row>
+std::size_t chol_rows_upper(std::size_t nr, const Row& row) noexcept {
+  for (std::size_t k = 0; k < nr; ++k) {
+    T* uk = row(k);
+    if (!(uk[k] > T(0))) return k + 1;
+    const T d = std::sqrt(uk[k]);
+    const T di = T(1) / d;
+    uk[k] = d;
+    for (std::size_t a = k + 1; a < nr; ++a) uk[a] *= di;
+    for (std::size_t b = k + 1; b < nr; ++b) {
+      T* ub = row(b);
+      const T ukb = uk[b];
+      for (std::size_t a = b; a < nr; ++a) ub[a] -= ukb * uk[a];
+    }
+  }
+  return 0;
+}
+
+template <typename T>
+std::size_t chol_decomp(SymmetricMatrix<T, PackedLayout>& a) {
+  return chol_rows<T>(a.nrows(), packed::PackedRows<T>{a.data()});
+}
+
+template <typename T>
+std::size_t chol_decomp(SymmetricMatrix<T, RfpLayout>& a) {
+  const packed::RfpBlocks<T> r(a.data(), a.nrows());
+  const std::size_t n1 = r.n1, n2 = r.n2;
+  std::size_t info = chol_rows<T>(n1, [&r](std::size_t i) { return r.l11(i); });
+  if (info != 0) return info;
+  if (n2 == 0) return 0;
+  // L21 = A21 L11'^-1, each row a forward solve
+  for (std::size_t k = 0; k < n2; ++k) packed::trsv_lower(n1, [&r](std::size_t i) { return r.l11(i); }, r.l21(k));
+  // A22 -= L21 L21' on the upper triangle, blocks of rows right of the
+  // diagonal through L21', the diagonal blocks a row at a time
+  std::vector<T> lt(n1 * n2);
+  for (std::size_t k = 0; k < n2; ++k) {
+    const T* lk = r.l21(k);
+    for (std::size_t j = 0; j < n1; ++j) lt[j * n2 + k] = lk[j];
+  }
+  constexpr std::size_t mb = 32;
+  for (std::size_t b0 = 0; b0 < n2; b0 += mb) {
+    const std::size_t b1 = std::min(n2, b0 + mb);
+    for (std::size_t b = b0; b < b1; ++b)
+      gemm<T>(1, b1 - b, n1, T(-1), r.l21(b), n1, lt.data() + b, n2, r.u22(b) + b, n1);
+    if (b1 < n2)
+      gemm<T>(b1 - b0, n2 - b1, n1, T(-1), r.l21(b0), n1, lt.data() + b1, n2, r.u22(b0) + b1, n1);
+  }
+  info = chol_rows_upper<T>(n2, [&r](std::size_t b) { return r.u22(b); });
+  return info != 0 ? n1 + info : 0;
+}
+
+// the factor of a packed symmetric matrix in the same layout, a is
+// taken by value so a moved argument is factored in place
+template <typename T, class Layout>
+TriangularMatrix<T, Layout> cholesky(SymmetricMatrix<T, Layout> a) {
+  const std::size_t info = chol_decomp(a);
+  if (info != 0) {
+    std::cerr << "non spd matrix in cholesky at row " << info - 1 << "\n";
+    exit(EXIT_FAILURE);
+  }
+  return TriangularMatrix<T, Layout>(std::move(a));
+}
+
+// x = (L L')^-1 x with the factor of chol_decomp
+template <typename T>
+void chol_solve(std::size_t nr, const T* l, std::size_t lda, T* x) noexcept {
+  for (std::size_t i = 0; i < nr; ++i) {
+    const T* li = l + i * lda;
+    T s = x[i];
+    for (std::size_t k = 0; k < i; ++k) s -= li[k] * x[k];
+    x[i] = s / li[i];
+  }
+  for (std::size_t i = nr; i-- > 0;) {
+    const T* li = l + i * lda;
+    const T xi = x[i] / li[i];
+    x[i] = xi;
+    for (std::size_t k = 0; k < i; ++k) x[k] -= li[k] * xi;
+  }
+}
+
+template <typename T>
+class Cholesky_decomposition {
+ public:
+  typedef std::size_t size_type;
+
+  explicit Cholesky_decomposition(const Matrix<T>& arg)
+      : n(arg.nrows()), a(arg) {
+    const std::size_t info = chol_decomp<T>(n, a.data(), n);
+    if (info != 0) {
+      std::cerr << "non spd matrix in Cholesky_decomposition at row "
+                << info - 1 << "\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  size_type size() const noexcept { return n; }
+
+  Matrix<T> L() const {
+    Matrix<T> l(n, n);
+    const T* pa = a.data();
+    T* pl = l.data();
+    for (size_type i = 0; i < n; ++i)
+      for (size_type j = 0; j < n; ++j) pl[i * n + j] = j <= i ? pa[i * n + j] : T(0);
+    return l;
+  }
+
+  // the factor in packed storage, half the memory of L()
+  TriangularMatrix<T> lower() const { return TriangularMatrix<T>(a); }
+
+  Array<T> solve(const Array<T>& b) const {
+    Array<T> x(b.size());
+    const T* pb = b.data();
+    T* px = x.data();
+    for (size_type i = 0; i < n; ++i) px[i] = pb[i];
+    chol_solve<T>(n, a.data(), n, px);
+    return x;
+  }
+
+  // the columns of b solved at once, row by row so the loops stay unit stride
+  Matrix<T> matrix_solve(const Matrix<T>& b) const {
+    const size_type m = b.ncols();
+    Matrix<T> x(n, m);
+    const T* l = a.data();
+    const T* pb = b.data();
+    T* px = x.data();
+    for (size_type i = 0; i < n; ++i) {
+      T* xi = px + i * m;
+      for (size_type j = 0; j < m; ++j) xi[j] = pb[i * m + j];
+      for (size_type k = 0; k < i; ++k) {
+        const T lik = l[i * n + k];
+        const T* xk = px + k * m;
+        for (size_type j = 0; j < m; ++j) xi[j] -= lik * xk[j];
+      }
+      const T d = T(1) / l[i * n + i];
+      for (size_type j = 0; j < m; ++j) xi[j] *= d;
+    }
+    for (size_type i = n; i-- > 0;) {
+      T* xi = px + i * m;
+      const T d = T(1) / l[i * n + i];
+      for (size_type j = 0; j < m; ++j) xi[j] *= d;
+      for (size_type k = 0; k < i; ++k) {
+        const T lik = l[i * n + k];
+        T* xk = px + k * m;
+        for (size_type j = 0; j < m; ++j) xk[j] -= lik * xi[j];
+      }
+    }
+    return x;
+  }
+
+ private:
+  size_type n;
+  Matrix<T> a;
+};
+
+}  // namespace petlib
+#endif
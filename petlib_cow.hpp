@@ -0,0 +1,101 @@
+#ifndef PETLIB_COW_HPP
+#define PETLIB_COW_HPP
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <putils_vector/putils_shared_count.hpp>
+
+namespace petlib {
+
+//
+// Reference counted element buffer behind Array and Matrix.
+//   Copies share one buffer; a container that is about to
+//   write calls unshare() when shared() is true and gets a
+//   private copy. The buffer is a putils::rc_ptr, the count
+//   and the elements come from a single allocation.
+// A container that hands out a view or a raw pointer pins its
+//   buffer, which it then owns alone. Copying a pinned buffer
+//   copies the elements, so writes through the view cannot
+//   reach a later copy. The pin belongs to the owner, not to
+//   the elements, and lasts until the owner unpins it or is
+//   assigned another buffer; copies made after that share again.
+// The count is atomic so copies may live on different threads,
+//   a single container is not thread safe.
+//
+template <typename T>
+class CowBuffer {
+  typedef putils::rc_ptr<T> ptr_type;
+  typedef typename ptr_type::block_type block_type;
+
+  ptr_type p;
+  bool pinned_;
+
+  static ptr_type clone(const ptr_type& q) {
+    const std::size_t n = q.size();
+    block_type* b = block_type::allocate(std::allocator<T>(), n);
+    try {
+      std::uninitialized_copy_n(q.data(), n, b->data());
+    } catch (...) {
+      block_type::deallocate(b);
+      throw;
+    }
+    return ptr_type(b);
+  }
+
+ public:
+  CowBuffer() noexcept : p(), pinned_(false) {}
+
+  // elements default initialized like new T[n]
+  explicit CowBuffer(std::size_t n)
+      : p(n ? putils::make_rc_buffer<T>(n) : ptr_type()), pinned_(false) {}
+
+  CowBuffer(const CowBuffer& b) : p(b.pinned_ ? clone(b.p) : b.p), pinned_(false) {}
+
+  CowBuffer(CowBuffer&& b) noexcept : p(std::move(b.p)), pinned_(b.pinned_) {
+    b.pinned_ = false;
+  }
+
+  CowBuffer& operator=(const CowBuffer& b) {
+    if (this == &b) return *this;
+    p = b.pinned_ ? clone(b.p) : b.p;
+    pinned_ = false;
+    return *this;
+  }
+
+  CowBuffer& operator=(CowBuffer&& b) noexcept {
+    if (this != &b) {
+      p = std::move(b.p);
+      pinned_ = b.pinned_;
+      b.pinned_ = false;
+    }
+    return *this;
+  }
+
+  T* data() const noexcept { return p.data(); }
+  std::size_t size() const noexcept { return p.size(); }
+
+  // the fence pairs with the release of the other owners, their
+  // reads are done before we start writing
+  bool shared() const noexcept {
+    if (p.use_count() > 1) return true;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return false;
+  }
+  std::size_t use_count() const noexcept { return p.use_count(); }
+  bool same_buffer(const CowBuffer& b) const noexcept { return p == b.p; }
+  bool pinned() const noexcept { return pinned_ && p; }
+
+  // only the sole owner pins, see unshare
+  void pin() noexcept { pinned_ = true; }
+  void unpin() noexcept { pinned_ = false; }
+
+  // private copy of the elements, returns the new data pointer
+  T* unshare() {
+    p = clone(p);
+    pinned_ = false;
+    return p.data();
+  }
+};
+
+}  // namespace petlib
+#endif
@@ -0,0 +1,741 @@
+#ifndef PETLIB_EIGEN_HPP
+#define PETLIB_EIGEN_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include <petlib_array.hpp>
+#include <petlib_gemm.hpp>
+#include <petlib_matrix.hpp>
+#include <petlib_threads.hpp>
+
+//
+// Eigenvalues and eigenvectors of a dense symmetric row major Matrix.
+//
+// A = Q T Q' is reduced to a symmetric tridiagonal T by Householder
+// reflections nb at a time. The reflectors of a panel are built with
+// their updates to the rest of A delayed, the V and W of LAPACK's latrd,
+// and the trailing matrix gets them all at once as A -= V W' + W V', a
+// matrix product. The one matrix vector product per column that is left
+// is memory bound, it reads the upper triangle once and is split over
+// threads.
+//
+// T is then solved by
+//  - Cuppen's divide and conquer for all eigenpairs, with the deflation
+//    and secular equation of LAPACK's laed routines and the z of Gu and
+//    Eisenstat, so the vectors come out orthogonal. Each merge is a
+//    matrix product.
+//  - bisection on Sturm counts and inverse iteration for the lowest k,
+//    reorthogonalized within clusters, O(n k) for values and vectors.
+//
+// Q is applied to the vectors of T nb reflectors at a time in the compact
+// WY form I - V S V', two matrix products over column strips of the
+// vectors, one strip per thread.
+//
+namespace petlib {
+
+namespace eigen {
+
+// the reflector I - tau v v' taking (alpha, x) in v to beta e1, v[0] = 1
+// and x scaled to the rest of v in place
+template <typename T>
+T householder(std::size_t m, T* v, T& beta) noexcept {
+  const T alpha = v[0];
+  T xx = T(0);
+  for (std::size_t i = 1; i < m; ++i) xx += v[i] * v[i];
+  v[0] = T(1);
+  if (xx == T(0)) {
+    beta = alpha;
+    return T(0);
+  }
+  const T b = -std::copysign(std::sqrt(alpha * alpha + xx), alpha);
+  const T s = T(1) / (alpha - b);
+  for (std::size_t i = 1; i < m; ++i) v[i] *= s;
+  beta = b;
+  return (b - alpha) / b;
+}
+
+// Q' A Q = T for the symmetric n x n row major a, of which only the upper
+// triangle is read. The diagonal of T goes to d, the off diagonal to
+// e[0 .. n - 2]. Reflector j is I - tau[j] v v' with v in row j of a from
+// column j + 1 on, the rest of a is left as work.
+template <typename T>
+void tridiagonalize(std::size_t n, T* a, T* d, T* e, T* tau,
+                    std::size_t nb = 32, unsigned nthreads = 1) {
+  if (n == 0) return;
+  if (nb == 0) nb = 1;
+  std::vector<T> wv(2 * nb * n), vm(2 * nb * n), y(n);
+  for (std::size_t k0 = 0; k0 + 1 < n; k0 += nb) {
+    const std::size_t kb = std::min(nb, n - 1 - k0);
+    // rows 0 .. kb - 1 of wv are the W of the panel, rows kb .. 2 kb - 1 the V
+    T* wt = wv.data();
+    T* vt = wv.data() + kb * n;
+    std::fill(wv.begin(), wv.begin() + 2 * kb * n, T(0));
+    for (std::size_t p = 0; p < kb; ++p) {
+      const std::size_t j = k0 + p;
+      T* aj = a + j * n;
+      // row j as the panel so far left it
+      for (std::size_t q = 0; q < p; ++q) {
+        const T* vq = vt + q * n;
+        const T* wq = wt + q * n;
+        const T vj = vq[j], wj = wq[j];
+        for (std::size_t i = j; i < n; ++i) aj[i] -= vq[i] * wj + wq[i] * vj;
+      }
+      d[j] = aj[j];
+      const std::size_t m = n - j - 1;
+      T* v = aj + j + 1;
+      const T t = householder(m, v, e[j]);
+      tau[j] = t;
+      T* vp = vt + p * n;
+      T* wp = wt + p * n;
+      std::copy(v, v + m, vp + j + 1);
+      if (t == T(0)) continue;
+      // y = A22 v from the upper triangle, each row l adds to y[i > l] and
+      // dots into y[l]. The y of a thread sums its terms in the order a
+      // single thread would, so the bits do not depend on the split.
+      const unsigned nt = threads_for(m * m / 2, stream_grain, nthreads);
+      run_threads(nt, [&](unsigned th) {
+        const std::size_t lo = j + 1 + th * m / nt, hi = j + 1 + (th + 1) * m / nt;
+        for (std::size_t i = lo; i < hi; ++i) y[i] = T(0);
+        for (std::size_t l = j + 1; l < hi; ++l) {
+          const T* al = a + l * n;
+          const T vl = vp[l];
+          if (l < lo) {
+            for (std::size_t i = lo; i < hi; ++i) y[i] += al[i] * vl;
+            continue;
+          }
+          T acc[8] = {};
+          std::size_t i = l + 1;
+          for (; i + 8 <= hi; i += 8)
+            for (std::size_t r = 0; r < 8; ++r) {
+              acc[r] += al[i + r] * vp[i + r];
+              y[i + r] += al[i + r] * vl;
+            }
+          for (; i < hi; ++i) {
+            acc[(i - l - 1) & 7] += al[i] * vp[i];
+            y[i] += al[i] * vl;
+          }
+          for (; i < n && ((i - l - 1) & 7) != 0; ++i) acc[(i - l - 1) & 7] += al[i] * vp[i];
+          for (; i + 8 <= n; i += 8)
+            for (std::size_t r = 0; r < 8; ++r) acc[r] += al[i + r] * vp[i + r];
+          for (; i < n; ++i) acc[(i - l - 1) & 7] += al[i] * vp[i];
+          y[l] += al[l] * vl + (((acc[0] + acc[4]) + (acc[1] + acc[5])) + ((acc[2] + acc[6]) + (acc[3] + acc[7])));
+        }
+      });
+      for (std::size_t q = 0; q < p; ++q) {
+        const T* vq = vt + q * n;
+        const T* wq = wt + q * n;
+        T c1 = T(0), c2 = T(0);
+        for (std::size_t l = j + 1; l < n; ++l) {
+          c1 += wq[l] * vp[l];
+          c2 += vq[l] * vp[l];
+        }
+        for (std::size_t l = j + 1; l < n; ++l) y[l] -= vq[l] * c1 + wq[l] * c2;
+      }
+      T yv = T(0);
+      for (std::size_t l = j + 1; l < n; ++l) {
+        y[l] *= t;
+        yv += y[l] * vp[l];
+      }
+      const T alpha = -T(0.5) * t * yv;
+      for (std::size_t l = j + 1; l < n; ++l) wp[l] = y[l] + alpha * vp[l];
+    }
+    // A22 -= V W' + W V' on the upper triangle past the panel, in slabs
+    // of rows dealt to the threads in turn
+    const std::size_t r0 = k0 + kb;
+    if (r0 >= n) continue;
+    const std::size_t m = n - r0, kk = 2 * kb, mb = 64;
+    for (std::size_t i = r0; i < n; ++i) {
+      T* vi = vm.data() + (i - r0) * kk;
+      for (std::size_t q = 0; q < kb; ++q) {
+        vi[q] = vt[q * n + i];
+        vi[kb + q] = wt[q * n + i];
+      }
+    }
+    const std::size_t ns = (m + mb - 1) / mb;
+    const unsigned nt = std::min(threads_for(m * m * kk / 2, flop_grain, nthreads), unsigned(ns));
+    run_threads(nt, [&](unsigned th) {
+      for (std::size_t b = th; b < ns; b += nt) {
+        const std::size_t lo = b * mb, hi = std::min(m, lo + mb);
+        gemm<T>(hi - lo, m - lo, kk, T(-1), vm.data() + lo * kk, kk, wv.data() + r0 + lo, n,
+                a + (r0 + lo) * n + r0 + lo, n);
+      }
+    });
+  }
+  d[n - 1] = a[(n - 1) * n + n - 1];
+}
+
+// z = Q z for the n x m row major z at ldz, Q the product of the
+// reflectors tridiagonalize left in a and tau
+template <typename T>
+void apply_q(std::size_t n, const T* a, const T* tau, T* z, std::size_t m,
+             std::size_t ldz, std::size_t nb = 32, unsigned nthreads = 1) {
+  if (n < 2 || m == 0) return;
+  if (nb == 0) nb = 1;
+  std::vector<T> vt(nb * n), vc(nb * n), s(nb * nb), g(nb);
+  // the blocks of reflectors last to first
+  for (std::size_t j1 = n - 1; j1 > 0;) {
+    const std::size_t j0 = j1 > nb ? j1 - nb : 0, kb = j1 - j0;
+    // the rows from j0 + 1 on touched by the block, as rows and as columns
+    const std::size_t r0 = j0 + 1, mr = n - r0;
+    for (std::size_t p = 0; p < kb; ++p) {
+      const T* ap = a + (j0 + p) * n;
+      T* vp = vt.data() + p * mr;
+      for (std::size_t l = r0; l < n; ++l) vp[l - r0] = l > j0 + p ? ap[l] : T(0);
+      for (std::size_t l = 0; l < mr; ++l) vc[l * kb + p] = vp[l];
+    }
+    // S upper triangular with I - V S V' the product of the block
+    for (std::size_t p = 0; p < kb; ++p) {
+      const T* vp = vt.data() + p * mr;
+      for (std::size_t q = 0; q < p; ++q) {
+        const T* vq = vt.data() + q * mr;
+        T x = T(0);
+        for (std::size_t l = p; l < mr; ++l) x += vq[l] * vp[l];
+        g[q] = x;
+      }
+      for (std::size_t q = 0; q < p; ++q) {
+        T x = T(0);
+        for (std::size_t r = q; r < p; ++r) x += s[q * nb + r] * g[r];
+        s[q * nb + p] = -tau[j0 + p] * x;
+      }
+      s[p * nb + p] = tau[j0 + p];
+    }
+    // two products of kb x mr by mr x m
+    const unsigned nt = std::max(1u, std::min(threads_for(2 * kb * mr * m, flop_grain, nthreads),
+                                              unsigned((m + 15) / 16)));
+    run_threads(nt, [&](unsigned th) {
+      const std::size_t c0 = th * m / nt, cw = (th + 1) * m / nt - c0;
+      if (cw == 0) return;
+      std::vector<T> w(kb * cw, T(0));
+      T* zs = z + r0 * ldz + c0;
+      gemm<T>(kb, cw, mr, T(1), vt.data(), mr, zs, ldz, w.data(), cw);
+      for (std::size_t p = 0; p < kb; ++p) {
+        T* wp = w.data() + p * cw;
+        const T spp = s[p * nb + p];
+        for (std::size_t c = 0; c < cw; ++c) wp[c] *= spp;
+        for (std::size_t r = p + 1; r < kb; ++r) {
+          const T spr = s[p * nb + r];
+          const T* wr = w.data() + r * cw;
+          for (std::size_t c = 0; c < cw; ++c) wp[c] += spr * wr[c];
+        }
+      }
+      gemm<T>(mr, cw, kb, T(-1), vc.data(), kb, w.data(), cw, zs, ldz);
+    });
+    j1 = j0;
+  }
+}
+
+// Implicit QL with Wilkinson shifts on the tridiagonal d, e of length n
+// where e[i] couples i and i + 1, e is destroyed. The rotations are
+// accumulated in the columns of the n x n z at ldz unless z is null.
+// False when an eigenvalue takes more than 60 sweeps.
+template <typename T>
+bool tridiagonal_ql(std::size_t n, T* d, T* e, T* z, std::size_t ldz) noexcept {
+  if (n == 0) return true;
+  const T eps = std::numeric_limits<T>::epsilon();
+  e[n - 1] = T(0);
+  for (std::size_t l = 0; l < n; ++l) {
+    int iter = 0;
+    for (;;) {
+      std::size_t m = l;
+      for (; m + 1 < n; ++m) {
+        const T dd = std::fabs(d[m]) + std::fabs(d[m + 1]);
+        if (std::fabs(e[m]) <= eps * dd) break;
+      }
+      if (m == l) break;
+      if (++iter > 60) return false;
+      T g = (d[l + 1] - d[l]) / (T(2) * e[l]);
+      T r = std::hypot(g, T(1));
+      g = d[m] - d[l] + e[l] / (g + std::copysign(r, g));
+      T s = T(1), c = T(1), p = T(0);
+      bool split = false;
+      for (std::size_t i = m; i-- > l;) {
+        const T f = s * e[i], b = c * e[i];
+        r = std::hypot(f, g);
+        e[i + 1] = r;
+        if (r == T(0)) {
+          d[i + 1] -= p;
+          e[m] = T(0);
+          split = true;
+          break;
+        }
+        s = f / r;
+        c = g / r;
+        g = d[i + 1] - p;
+        r = (d[i] - g) * s + T(2) * c * b;
+        p = s * r;
+        d[i + 1] = g + p;
+        g = c * r - b;
+        if (z)
+          for (std::size_t k = 0; k < n; ++k) {
+            T* zk = z + k * ldz;
+            const T zf = zk[i + 1];
+            zk[i + 1] = s * zk[i] + c * zf;
+            zk[i] = c * zk[i] - s * zf;
+          }
+      }
+      if (split) continue;
+      d[l] -= p;
+      e[l] = g;
+      e[m] = T(0);
+    }
+  }
+  return true;
+}
+
+// Root j of 1 / r + sum_i z_i^2 / (d_i - x) = 0 for the ascending d and
+// r > 0, as d[org] + tau with d[org] the nearer pole so that the
+// differences d_i - x keep their digits. Two poles are fitted by value
+// and slope and the root of the fit taken, bisection when it falls out
+// of the bracket, the middle way of Li.
+template <typename T>
+void secular_root(std::size_t k, const T* d, const T* z, T r, std::size_t j,
+                  std::size_t& org, T& tau) noexcept {
+  const T eps = std::numeric_limits<T>::epsilon();
+  const T rinv = T(1) / r;
+  T lo, hi;
+  if (j + 1 < k) {
+    const T mid = T(0.5) * (d[j + 1] - d[j]);
+    T w = rinv;
+    for (std::size_t i = 0; i < k; ++i) w += z[i] * z[i] / ((d[i] - d[j]) - mid);
+    if (w >= T(0)) {
+      org = j;
+      lo = T(0);
+      hi = mid;
+    } else {
+      org = j + 1;
+      lo = -mid;
+      hi = T(0);
+    }
+  } else {
+    T zz = T(0);
+    for (std::size_t i = 0; i < k; ++i) zz += z[i] * z[i];
+    org = j;
+    lo = T(0);
+    hi = r * zz;
+  }
+  const T o = d[org];
+  tau = T(0.5) * (lo + hi);
+  for (int it = 0; it < 100; ++it) {
+    T psi = T(0), dpsi = T(0), phi = T(0), dphi = T(0);
+    for (std::size_t i = 0; i <= j; ++i) {
+      const T t = z[i] / ((d[i] - o) - tau);
+      psi += z[i] * t;
+      dpsi += t * t;
+    }
+    for (std::size_t i = j + 1; i < k; ++i) {
+      const T t = z[i] / ((d[i] - o) - tau);
+      phi += z[i] * t;
+      dphi += t * t;
+    }
+    const T w = rinv + psi + phi;
+    if (w == T(0)) break;
+    if (w < T(0))
+      lo = tau;
+    else
+      hi = tau;
+    if (std::fabs(w) <= T(8) * eps * (rinv + std::fabs(psi) + std::fabs(phi))) break;
+    const T pa = (d[j] - o) - tau;
+    const T bp = pa * pa * dpsi;
+    T s;
+    if (j + 1 < k) {
+      const T pb = (d[j + 1] - o) - tau;
+      const T be = pb * pb * dphi;
+      const T cc = rinv + (psi - bp / pa) + (phi - be / pb);
+      const T qb = cc * (pa + pb) + bp + be;
+      const T qc = cc * pa * pb + bp * pb + be * pa;
+      const T disc = qb * qb - T(4) * cc * qc;
+      if (disc < T(0)) {
+        s = T(0.5) * (lo + hi) - tau;
+      } else if (cc == T(0)) {
+        s = qc / qb;
+      } else {
+        const T q = T(0.5) * (qb + std::copysign(std::sqrt(disc), qb));
+        const T s1 = q / cc, s2 = qc / q;
+        s = s1 > pa && s1 < pb ? s1 : s2;
+      }
+    } else {
+      const T cc = rinv + (psi - bp / pa);
+      s = pa + bp / cc;
+    }
+    T tn = tau + s;
+    if (!(tn > lo && tn < hi)) tn = T(0.5) * (lo + hi);
+    if (tn == tau) break;
+    tau = tn;
+  }
+}
+
+// Merge the eigenpairs of the two halves of the n x n block at q, d,
+// each half solved for T1 - rho e e', T2 - rho e e', into those of T.
+template <typename T>
+void dc_merge(std::size_t n, std::size_t n1, T* d, T* q, std::size_t ldq, T rho,
+              unsigned nthreads) {
+  const T eps = std::numeric_limits<T>::epsilon();
+  std::vector<T> z(n), dv(n);
+  for (std::size_t i = 0; i < n; ++i) z[i] = i < n1 ? q[(n1 - 1) * ldq + i] : q[n1 * ldq + i];
+  // D + r z z' with r > 0, the signs of d flipped when rho < 0
+  const T sg = rho < T(0) ? T(-1) : T(1);
+  T zz = T(0), dmax = T(0);
+  for (std::size_t i = 0; i < n; ++i) zz += z[i] * z[i];
+  const T r = std::fabs(rho) * zz, zn = T(1) / std::sqrt(zz);
+  std::vector<std::size_t> idx(n);
+  std::iota(idx.begin(), idx.end(), std::size_t(0));
+  std::stable_sort(idx.begin(), idx.end(), [&](std::size_t a, std::size_t b) { return sg * d[a] < sg * d[b]; });
+  std::vector<T> zs(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    dv[i] = sg * d[idx[i]];
+    zs[i] = z[idx[i]] * zn;
+    dmax = std::max(dmax, std::fabs(dv[i]));
+  }
+  // deflate the small z and, by a rotation, one of two close poles
+  const T tol = T(8) * eps * std::max(dmax, r);
+  std::vector<std::size_t> keep, defl;
+  keep.reserve(n);
+  std::size_t prev = n;
+  for (std::size_t i = 0; i < n; ++i) {
+    if (r * std::fabs(zs[i]) <= tol) {
+      defl.push_back(i);
+      continue;
+    }
+    if (prev == n) {
+      prev = i;
+      continue;
+    }
+    const T t = std::hypot(zs[prev], zs[i]);
+    const T c = zs[i] / t, s = zs[prev] / t;
+    if (std::fabs(c * s * (dv[i] - dv[prev])) <= tol) {
+      const std::size_t cp = idx[prev], ci = idx[i];
+      for (std::size_t k = 0; k < n; ++k) {
+        T* qk = q + k * ldq;
+        const T qp = qk[cp], qi = qk[ci];
+        qk[cp] = c * qp - s * qi;
+        qk[ci] = s * qp + c * qi;
+      }
+      const T dp = dv[prev], di = dv[i];
+      dv[prev] = c * c * dp + s * s * di;
+      dv[i] = s * s * dp + c * c * di;
+      zs[prev] = T(0);
+      zs[i] = t;
+      defl.push_back(prev);
+    } else {
+      keep.push_back(prev);
+    }
+    prev = i;
+  }
+  if (prev != n) keep.push_back(prev);
+  std::stable_sort(keep.begin(), keep.end(), [&](std::size_t a, std::size_t b) { return dv[a] < dv[b]; });
+  const std::size_t k = keep.size();
+  // the columns reordered kept first, then deflated
+  std::vector<std::size_t> order(keep);
+  order.insert(order.end(), defl.begin(), defl.end());
+  {
+    std::vector<T> row(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      T* qi = q + i * ldq;
+      for (std::size_t c = 0; c < n; ++c) row[c] = qi[idx[order[c]]];
+      std::copy(row.begin(), row.end(), qi);
+    }
+  }
+  std::vector<T> dk(k), zk(k);
+  for (std::size_t i = 0; i < k; ++i) {
+    dk[i] = dv[keep[i]];
+    zk[i] = zs[keep[i]];
+  }
+  for (std::size_t i = k; i < n; ++i) d[i] = sg * dv[order[i]];
+  if (k == 0) return;
+  std::vector<std::size_t> org(k);
+  std::vector<T> tau(k);
+  for (std::size_t j = 0; j < k; ++j) secular_root<T>(k, dk.data(), zk.data(), r, j, org[j], tau[j]);
+  // lambda_j - d_i from the pole the root was found against
+  auto gap = [&](std::size_t j, std::size_t i) { return (dk[org[j]] - dk[i]) + tau[j]; };
+  // z recomputed from the roots, then the vectors of D + r z z'
+  std::vector<T> u(k * k), cn(k, T(0));
+  for (std::size_t i = 0; i < k; ++i) {
+    T p = gap(i, i) / r;
+    for (std::size_t j = 0; j < k; ++j)
+      if (j != i) p *= gap(j, i) / (dk[j] - dk[i]);
+    const T zh = std::copysign(std::sqrt(std::fabs(p)), zk[i]);
+    T* ui = u.data() + i * k;
+    for (std::size_t j = 0; j < k; ++j) {
+      ui[j] = -zh / gap(j, i);
+      cn[j] += ui[j] * ui[j];
+    }
+  }
+  for (std::size_t j = 0; j < k; ++j) cn[j] = T(1) / std::sqrt(cn[j]);
+  for (std::size_t i = 0; i < k; ++i)
+    for (std::size_t j = 0; j < k; ++j) u[i * k + j] *= cn[j];
+  for (std::size_t j = 0; j < k; ++j) d[j] = sg * (dk[org[j]] + tau[j]);
+  // the kept columns times u
+  std::vector<T> out(n * k, T(0));
+  const unsigned nt = threads_for(n * k * k, flop_grain, nthreads);
+  run_threads(nt, [&](unsigned th) {
+    const std::size_t lo = th * n / nt, hi = (th + 1) * n / nt;
+    gemm<T>(hi - lo, k, k, T(1), q + lo * ldq, ldq, u.data(), k, out.data() + lo * k, k);
+  });
+  for (std::size_t i = 0; i < n; ++i) std::copy(out.begin() + i * k, out.begin() + (i + 1) * k, q + i * ldq);
+}
+
+template <typename T>
+bool dc_solve(std::size_t n, T* d, const T* e, T* q, std::size_t ldq, unsigned nthreads) {
+  constexpr std::size_t leaf = 32;
+  if (n <= leaf) {
+    for (std::size_t i = 0; i < n; ++i)
+      for (std::size_t j = 0; j < n; ++j) q[i * ldq + j] = i == j ? T(1) : T(0);
+    T ee[leaf];
+    std::copy(e, e + n - 1, ee);
+    return tridiagonal_ql(n, d, ee, q, ldq);
+  }
+  // T = diag(T1, T2) + rho u u' with u = e_{n1 - 1} + e_{n1}
+  const std::size_t n1 = n / 2;
+  const T rho = e[n1 - 1];
+  d[n1 - 1] -= rho;
+  d[n1] -= rho;
+  if (!dc_solve(n1, d, e, q, ldq, nthreads)) return false;
+  if (!dc_solve(n - n1, d + n1, e + n1, q + n1 * ldq + n1, ldq, nthreads)) return false;
+  for (std::size_t i = 0; i < n; ++i) {
+    T* qi = q + i * ldq;
+    if (i < n1)
+      std::fill(qi + n1, qi + n, T(0));
+    else
+      std::fill(qi, qi + n1, T(0));
+  }
+  dc_merge(n, n1, d, q, ldq, rho, nthreads);
+  return true;
+}
+
+// All eigenpairs of the tridiagonal d, e by divide and conquer, d becomes
+// the ascending eigenvalues and column j of the n x n z at ldz the vector
+// of d[j]. False when a leaf does not converge.
+template <typename T>
+bool tridiagonal_dc(std::size_t n, T* d, const T* e, T* z, std::size_t ldz,
+                    unsigned nthreads = 1) {
+  if (n == 0) return true;
+  if (!dc_solve(n, d, e, z, ldz, nthreads)) return false;
+  std::vector<std::size_t> idx(n);
+  std::iota(idx.begin(), idx.end(), std::size_t(0));
+  std::stable_sort(idx.begin(), idx.end(), [&](std::size_t a, std::size_t b) { return d[a] < d[b]; });
+  std::vector<T> row(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    T* zi = z + i * ldz;
+    for (std::size_t j = 0; j < n; ++j) row[j] = zi[idx[j]];
+    std::copy(row.begin(), row.end(), zi);
+  }
+  for (std::size_t j = 0; j < n; ++j) row[j] = d[idx[j]];
+  std::copy(row.begin(), row.end(), d);
+  return true;
+}
+
+// the number of eigenvalues of the tridiagonal d, e below x, e2 = e^2
+template <typename T>
+std::size_t sturm_count(std::size_t n, const T* d, const T* e2, T x, T pivmin) noexcept {
+  T q = d[0] - x;
+  if (std::fabs(q) < pivmin) q = -pivmin;
+  std::size_t c = q < T(0);
+  for (std::size_t i = 1; i < n; ++i) {
+    q = d[i] - x - e2[i - 1] / q;
+    if (std::fabs(q) < pivmin) q = -pivmin;
+    c += q < T(0);
+  }
+  return c;
+}
+
+// The k lowest eigenpairs of the tridiagonal d, e: w gets the ascending
+// values and column j of the n x k z at ldz the vector of w[j]. The
+// values are bisected on Sturm counts, the vectors are two or three steps
+// of inverse iteration, orthogonalized against the rest of their cluster.
+// Clusters are independent and go to threads whole.
+template <typename T>
+void tridiagonal_lowest(std::size_t n, const T* d, const T* e, std::size_t k,
+                        T* w, T* z, std::size_t ldz, unsigned nthreads = 1) {
+  if (n == 0 || k == 0) return;
+  const T eps = std::numeric_limits<T>::epsilon();
+  std::vector<T> e2(n, T(0));
+  T gl = d[0], gu = d[0], emax = T(0);
+  for (std::size_t i = 0; i < n; ++i) {
+    const T ea = (i > 0 ? std::fabs(e[i - 1]) : T(0)) + (i + 1 < n ? std::fabs(e[i]) : T(0));
+    gl = std::min(gl, d[i] - ea);
+    gu = std::max(gu, d[i] + ea);
+    if (i + 1 < n) {
+      e2[i] = e[i] * e[i];
+      emax = std::max(emax, e2[i]);
+    }
+  }
+  const T tnorm = std::max(std::fabs(gl), std::fabs(gu));
+  const T pivmin = std::numeric_limits<T>::min() * std::max(T(1), emax);
+  gl -= T(2) * eps * tnorm + pivmin;
+  gu += T(2) * eps * tnorm + pivmin;
+  // floored for a zero T, where the pivots would be nudged to zero
+  const T atol = std::max(eps * tnorm, pivmin);
+  // some 64 halvings of n step Sturm counts a value, a division each step
+  const unsigned nt = std::max(1u, std::min(threads_for(n * k * 64, stream_grain, nthreads), unsigned(k)));
+  run_threads(nt, [&](unsigned th) {
+    for (std::size_t j = th * k / nt; j < (th + 1) * k / nt; ++j) {
+      T lo = gl, hi = gu;
+      while (hi - lo > T(2) * eps * std::max(std::fabs(lo), std::fabs(hi)) + atol) {
+        const T mid = T(0.5) * (lo + hi);
+        if (mid <= lo || mid >= hi) break;
+        if (sturm_count(n, d, e2.data(), mid, pivmin) > j)
+          hi = mid;
+        else
+          lo = mid;
+      }
+      w[j] = T(0.5) * (lo + hi);
+    }
+  });
+  // clusters, the vectors of eigenvalues closer than 1e-3 |T| are made orthogonal
+  const T ortol = std::max(T(1e-3) * tnorm, pivmin);
+  std::vector<std::size_t> first(1, 0);
+  for (std::size_t j = 1; j < k; ++j)
+    if (w[j] - w[j - 1] > ortol) first.push_back(j);
+  first.push_back(k);
+  const std::size_t nc = first.size() - 1;
+  std::vector<T> vt(k * n);
+  // a factorization and a few solves of n steps a vector
+  const unsigned nv = std::max(1u, std::min(threads_for(n * k * 16, stream_grain, nthreads), unsigned(nc)));
+  run_threads(nv, [&](unsigned th) {
+    std::vector<T> dl(n), dd(n), du(n), du2(n), x(n);
+    std::vector<unsigned char> piv(n);
+    for (std::size_t c = th * nc / nv; c < (th + 1) * nc / nv; ++c) {
+      T xprev = T(0);
+      for (std::size_t j = first[c]; j < first[c + 1]; ++j) {
+        // equal values are pulled apart so their factors differ
+        T xj = w[j];
+        if (j > first[c] && xj - xprev < T(10) * eps * std::fabs(xj)) xj = xprev + T(10) * eps * std::fabs(xj);
+        xprev = xj;
+        // T - xj I = L U with partial pivoting, zero pivots nudged to eps |T|
+        for (std::size_t i = 0; i < n; ++i) {
+          dd[i] = d[i] - xj;
+          if (i + 1 < n) dl[i] = du[i] = e[i];
+          du2[i] = T(0);
+        }
+        for (std::size_t i = 0; i + 1 < n; ++i) {
+          if (std::fabs(dd[i]) >= std::fabs(dl[i])) {
+            piv[i] = 0;
+            if (dd[i] == T(0)) dd[i] = atol;
+            const T f = dl[i] / dd[i];
+            dl[i] = f;
+            dd[i + 1] -= f * du[i];
+          } else {
+            piv[i] = 1;
+            const T f = dd[i] / dl[i];
+            dd[i] = dl[i];
+            dl[i] = f;
+            const T t = du[i];
+            du[i] = dd[i + 1];
+            dd[i + 1] = t - f * dd[i + 1];
+            if (i + 2 < n) {
+              du2[i] = du[i + 1];
+              du[i + 1] = -f * du[i + 1];
+            }
+          }
+        }
+        if (dd[n - 1] == T(0)) dd[n - 1] = atol;
+        std::uint64_t seed = 0x9e3779b97f4a7c15ull * (j + 1);
+        for (std::size_t i = 0; i < n; ++i) {
+          seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+          x[i] = T(double(seed >> 11) * 0x1.0p-53 - 0.5);
+        }
+        bool grown = false;
+        for (int it = 0; it < 5; ++it) {
+          for (std::size_t i = 0; i + 1 < n; ++i) {
+            if (piv[i] == 0) {
+              x[i + 1] -= dl[i] * x[i];
+            } else {
+              const T t = x[i];
+              x[i] = x[i + 1];
+              x[i + 1] = t - dl[i] * x[i];
+            }
+          }
+          x[n - 1] /= dd[n - 1];
+          if (n > 1) x[n - 2] = (x[n - 2] - du[n - 2] * x[n - 1]) / dd[n - 2];
+          for (std::size_t i = n > 2 ? n - 2 : 0; i-- > 0;)
+            x[i] = (x[i] - du[i] * x[i + 1] - du2[i] * x[i + 2]) / dd[i];
+          for (std::size_t i2 = first[c]; i2 < j; ++i2) {
+            const T* vi = vt.data() + i2 * n;
+            T s = T(0);
+            for (std::size_t i = 0; i < n; ++i) s += vi[i] * x[i];
+            for (std::size_t i = 0; i < n; ++i) x[i] -= s * vi[i];
+          }
+          // scaled first, pivots near pivmin grow x close to overflow
+          T xmax = T(0);
+          for (std::size_t i = 0; i < n; ++i) xmax = std::max(xmax, std::fabs(x[i]));
+          T xx = T(0);
+          for (std::size_t i = 0; i < n; ++i) {
+            x[i] /= xmax;
+            xx += x[i] * x[i];
+          }
+          const T nx = std::sqrt(xx);
+          for (std::size_t i = 0; i < n; ++i) x[i] /= nx;
+          // one more step once a solve has grown x by near 1 / (eps |T|)
+          if (grown) break;
+          grown = xmax * nx * atol * std::sqrt(T(n)) >= T(0.1);
+        }
+        std::copy(x.begin(), x.end(), vt.begin() + j * n);
+      }
+    }
+  });
+  for (std::size_t i = 0; i < n; ++i)
+    for (std::size_t j = 0; j < k; ++j) z[i * ldz + j] = vt[j * n + i];
+}
+
+}  // namespace eigen
+
+// A = Z diag(w) Z' for the symmetric arg, all of it or the nlowest lowest
+// eigenpairs. values() are ascending and column j of vectors() goes with
+// values()[j]. Only the upper triangle of arg is read.
+template <typename T>
+class Symmetric_eigen_decomposition {
+ public:
+  typedef std::size_t size_type;
+  static constexpr size_type block = 32;
+
+  explicit Symmetric_eigen_decomposition(const Matrix<T>& arg, size_type nlowest = 0,
+                                         unsigned nthreads = 1)
+      : n(arg.nrows()),
+        k(nlowest == 0 || nlowest > arg.nrows() ? arg.nrows() : nlowest),
+        w(k),
+        z(n, k) {
+    if (arg.ncols() != n) {
+      std::cerr << "non square matrix in Symmetric_eigen_decomposition\n";
+      exit(EXIT_FAILURE);
+    }
+    if (n == 0) return;
+    Matrix<T> a(arg);
+    T* pa = a.data();
+    std::vector<T> d(n), e(n), tau(n);
+    eigen::tridiagonalize<T>(n, pa, d.data(), e.data(), tau.data(), block, nthreads);
+    T* pw = w.data();
+    T* pz = z.data();
+    if (k == n) {
+      if (!eigen::tridiagonal_dc<T>(n, d.data(), e.data(), pz, k, nthreads)) {
+        std::cerr << "no convergence in Symmetric_eigen_decomposition\n";
+        exit(EXIT_FAILURE);
+      }
+      std::copy(d.begin(), d.end(), pw);
+    } else {
+      eigen::tridiagonal_lowest<T>(n, d.data(), e.data(), k, pw, pz, k, nthreads);
+    }
+    eigen::apply_q<T>(n, pa, tau.data(), pz, k, k, block, nthreads);
+  }
+
+  size_type size() const noexcept { return n; }
+  size_type count() const noexcept { return k; }
+  const Array<T>& values() const noexcept { return w; }
+  const Matrix<T>& vectors() const noexcept { return z; }
+
+ private:
+  size_type n;
+  size_type k;
+  Array<T> w;
+  Matrix<T> z;
+};
+
+}  // namespace petlib
+#endif
@@ -0,0 +1,70 @@
+#ifndef PETLIB_GEMM_HPP
+#define PETLIB_GEMM_HPP
+
+#include <algorithm>
+#include <cstddef>
+
+//
+// The dense matrix product the factorizations are built on, for row
+// major blocks with leading dimensions. Each element of c is summed in
+// the same order however the caller splits the rows and columns of c,
+// so the callers can split them over threads without changing any bits.
+//
+namespace petlib {
+
+// c += alpha a b for the row major m x k a and k x n b, c is m x n.
+// A 4 x 16 block of c is held over a 256 deep slice of k while the
+// 256 x 512 tile of b it reads stays in cache.
+template <typename T>
+void gemm(std::size_t m, std::size_t n, std::size_t k, T alpha, const T* a,
+          std::size_t lda, const T* b, std::size_t ldb, T* c,
+          std::size_t ldc) noexcept {
+  constexpr std::size_t mr = 4, nr = 16, kc = 256, nc = 512;
+  for (std::size_t jc = 0; jc < n; jc += nc) {
+    const std::size_t jw = std::min(nc, n - jc);
+    for (std::size_t pc = 0; pc < k; pc += kc) {
+      const std::size_t pw = std::min(kc, k - pc);
+      for (std::size_t i = 0; i < m; i += mr) {
+        const std::size_t iw = std::min(mr, m - i);
+        for (std::size_t j = jc; j < jc + jw; j += nr) {
+          const std::size_t w = std::min(nr, jc + jw - j);
+          if (iw == mr && w == nr) {
+            T acc[mr][nr] = {};
+            const T* a0 = a + i * lda + pc;
+            for (std::size_t p = 0; p < pw; ++p) {
+              const T* bp = b + (pc + p) * ldb + j;
+              const T x0 = a0[p], x1 = a0[lda + p], x2 = a0[2 * lda + p],
+                      x3 = a0[3 * lda + p];
+              for (std::size_t jj = 0; jj < nr; ++jj) {
+                acc[0][jj] += x0 * bp[jj];
+                acc[1][jj] += x1 * bp[jj];
+                acc[2][jj] += x2 * bp[jj];
+                acc[3][jj] += x3 * bp[jj];
+              }
+            }
+            for (std::size_t ii = 0; ii < mr; ++ii) {
+              T* ci = c + (i + ii) * ldc + j;
+              for (std::size_t jj = 0; jj < nr; ++jj) ci[jj] += alpha * acc[ii][jj];
+            }
+          } else {
+            // the same sums in the same order as the full block, so how
+            // the rows and columns are split does not change any bits
+            for (std::size_t ii = i; ii < i + iw; ++ii) {
+              T acc[nr] = {};
+              for (std::size_t p = pc; p < pc + pw; ++p) {
+                const T x = a[ii * lda + p];
+                const T* bp = b + p * ldb + j;
+                for (std::size_t jj = 0; jj < w; ++jj) acc[jj] += x * bp[jj];
+              }
+              T* ci = c + ii * ldc + j;
+              for (std::size_t jj = 0; jj < w; ++jj) ci[jj] += alpha * acc[jj];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace petlib
+#endif
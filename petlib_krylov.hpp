@@ -0,0 +1,674 @@
+#ifndef PETLIB_KRYLOV_HPP
+#define PETLIB_KRYLOV_HPP
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+#include <petlib_array.hpp>
+#include <petlib_chol.hpp>
+#include <petlib_matrix.hpp>
+#include <petlib_reduce.hpp>
+#include <petlib_threads.hpp>
+
+//
+// Krylov solvers for A x = b on petlib Arrays.
+//
+// A is anything that can form y = A x: a dense Matrix, any of the sparse
+// matrices, or a callable op(x, y). Preconditioners are the same kind of
+// thing and form z = M^-1 r, as Jacobi and BlockJacobi below do.
+//
+// The vector work of an iteration is done in as few sweeps as possible,
+// every axpy of a step and the dot products that follow it in the same
+// loop. The sweeps run over the fixed blocks of petlib_reduce.hpp, so the
+// iterates have the same bits on any number of threads.
+//  - cg and pcg run the classic recurrence on one thread, three sweeps
+//    and two reductions per iteration. On more threads they switch to
+//    the pipelined CG of Ghysels and Vanroose, one sweep and one
+//    reduction per iteration: the reductions are where the threads
+//    wait, but the sweep carries three more vectors, which makes it
+//    the slower of the two on one core. KrylovOptions::cg picks one
+//    for any thread count. The pipelined recurrences drift from the
+//    true residual, so when they say converged the true residual is
+//    checked and the iteration restarted from x if it is not there yet.
+//  - bicgstab has three reductions per iteration, the fewest of the
+//    classic recurrence.
+//  - gmres orthogonalizes with classical Gram-Schmidt done twice, all the
+//    dot products of a step in one sweep, three reductions per step
+//    however long the basis is, where modified Gram-Schmidt has j + 2.
+//
+namespace petlib {
+
+// the recurrence of cg and pcg, Auto is Classic on one thread
+enum class CgMethod { Auto, Classic, Pipelined };
+
+struct KrylovOptions {
+  double tol = 1.e-8;  // on |b - A x| / |b|
+  std::size_t max_iter = 1000;
+  std::size_t restart = 30;  // gmres basis size
+  unsigned nthreads = 1;
+  CgMethod cg = CgMethod::Auto;
+};
+
+struct KrylovResult {
+  std::size_t iterations = 0;
+  double residual = 0.0;  // |b - A x| / |b| when done
+  bool converged = false;
+};
+
+// M = I
+struct IdentityPreconditioner {};
+
+namespace krylov {
+
+// y = A x
+template <typename T, class A_t>
+void apply(const A_t& a, const Array<T>& x, Array<T>& y, unsigned nthreads) {
+  if constexpr (requires { a.multiply(x, y, nthreads); }) {
+    a.multiply(x, y, nthreads);
+  } else if constexpr (std::is_same_v<A_t, Matrix<T> >) {
+    const std::size_t n1 = a.nrows(), n2 = a.ncols();
+    const T* pa = a.data();
+    const T* px = x.data();
+    T* py = y.data();
+    const unsigned nt = threads_for(n1 * n2, stream_grain, nthreads);
+    run_threads(nt, [&](unsigned t) {
+      for (std::size_t i = t * n1 / nt; i < (t + 1) * n1 / nt; ++i) {
+        const T* ai = pa + i * n2;
+        T s = T(0);
+        for (std::size_t j = 0; j < n2; ++j) s += ai[j] * px[j];
+        py[i] = s;
+      }
+    });
+  } else {
+    a(x, y);
+  }
+}
+
+// f(lo, m, d) updates [lo, lo + m) and adds its share of K dot products
+// to d, the shares are summed in the fixed order of reduce::blocked
+template <std::size_t K, typename T, class F>
+std::array<T, K> sweep(std::size_t n, unsigned nthreads, const F& f) {
+  typedef std::array<T, K> part_t;
+  return reduce::blocked<part_t>(
+      n, nthreads,
+      [&](std::size_t lo, std::size_t m) {
+        part_t d;
+        d.fill(T(0));
+        f(lo, m, d);
+        return d;
+      },
+      [](part_t& a, const part_t& b) {
+        for (std::size_t k = 0; k < K; ++k) a[k] += b[k];
+      });
+}
+
+// r = b - A x, returns |r|^2
+template <typename T, class A_t>
+T residual(const A_t& a, const Array<T>& b, const Array<T>& x, Array<T>& r,
+           unsigned nthreads) {
+  apply(a, x, r, nthreads);
+  const T* pb = b.data();
+  T* pr = r.data();
+  return sweep<1, T>(b.size(), nthreads,
+                     [&](std::size_t lo, std::size_t m, std::array<T, 1>& d) {
+                       for (std::size_t i = lo; i < lo + m; ++i) {
+                         pr[i] = pb[i] - pr[i];
+                         d[0] += pr[i] * pr[i];
+                       }
+                     })[0];
+}
+
+template <typename T>
+T norm2(const Array<T>& x, unsigned nthreads) {
+  const T* px = x.data();
+  return sweep<1, T>(x.size(), nthreads,
+                     [&](std::size_t lo, std::size_t m, std::array<T, 1>& d) {
+                       for (std::size_t i = lo; i < lo + m; ++i) d[0] += px[i] * px[i];
+                     })[0];
+}
+
+}  // namespace krylov
+
+//
+// z = D^-1 r with D the diagonal of A
+//
+template <typename T>
+class Jacobi {
+ public:
+  explicit Jacobi(const Array<T>& diag) : d_(diag.size()) {
+    for (std::size_t i = 0; i < diag.size(); ++i) d_[i] = T(1) / diag[i];
+  }
+  // anything with nrows() and a(i, i)
+  template <class A_t>
+  explicit Jacobi(const A_t& a) : d_(a.nrows()) {
+    for (std::size_t i = 0; i < a.nrows(); ++i) d_[i] = T(1) / a(i, i);
+  }
+
+  void operator()(const Array<T>& r, Array<T>& z) const { z = d_ * r; }
+
+ private:
+  Array<T> d_;
+};
+
+//
+// z = D^-1 r with D the bs x bs blocks on the diagonal of A, each block
+// factored once with chol_decomp, the last block takes what is left
+//
+template <typename T>
+class BlockJacobi {
+ public:
+  template <class A_t>
+  BlockJacobi(const A_t& a, std::size_t bs)
+      : n(a.nrows()), bs_(bs), l_(((n + bs - 1) / bs) * bs * bs, T(0)) {
+    for (std::size_t lo = 0; lo < n; lo += bs_) {
+      const std::size_t m = std::min(bs_, n - lo);
+      T* l = l_.data() + lo * bs_;
+      for (std::size_t i = 0; i < m; ++i)
+        for (std::size_t j = 0; j <= i; ++j) l[i * bs_ + j] = a(lo + i, lo + j);
+      const std::size_t info = chol_decomp<T>(m, l, bs_);
+      if (info != 0) {
+        std::cerr << "non spd diagonal block at row " << lo + info - 1
+                  << " in BlockJacobi\n";
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  void operator()(const Array<T>& r, Array<T>& z) const {
+    const T* pr = r.data();
+    T* pz = z.data();
+    for (std::size_t i = 0; i < n; ++i) pz[i] = pr[i];
+    for (std::size_t lo = 0; lo < n; lo += bs_)
+      chol_solve<T>(std::min(bs_, n - lo), l_.data() + lo * bs_, bs_, pz + lo);
+  }
+
+ private:
+  std::size_t n, bs_;
+  std::vector<T> l_;
+};
+
+namespace krylov {
+
+inline bool pipelined(const KrylovOptions& opt) noexcept {
+  return opt.cg == CgMethod::Pipelined || (opt.cg == CgMethod::Auto && opt.nthreads > 1);
+}
+
+// classic preconditioned CG, with M = I the residual is its own z
+template <typename T, class A_t, class M_t>
+KrylovResult classic_cg(const A_t& a, const M_t& prec, const Array<T>& b, Array<T>& x,
+                        const KrylovOptions& opt) {
+  constexpr bool identity = std::is_same_v<M_t, IdentityPreconditioner>;
+  const std::size_t n = b.size();
+  const unsigned nt = opt.nthreads;
+  KrylovResult res;
+  const T bnorm = std::sqrt(norm2(b, nt));
+  if (bnorm == T(0)) {
+    x = T(0);
+    res.converged = true;
+    return res;
+  }
+  const T tol = T(opt.tol) * bnorm;
+  Array<T> r(n), z(identity ? 0 : n), p(n), q(n);
+  T rr = residual(a, b, x, r, nt);
+  while (res.iterations < opt.max_iter) {
+    // (re)start from the true residual
+    if constexpr (!identity) apply(prec, r, z, nt);
+    T* pr = r.data();
+    const T* pz = identity ? pr : z.data();
+    T* pp = p.data();
+    T rz = sweep<1, T>(n, nt, [&](std::size_t lo, std::size_t m, std::array<T, 1>& e) {
+             for (std::size_t i = lo; i < lo + m; ++i) {
+               pp[i] = pz[i];
+               e[0] += pr[i] * pz[i];
+             }
+           })[0];
+    while (std::sqrt(rr) > tol && res.iterations < opt.max_iter) {
+      apply(a, p, q, nt);
+      const T* pq = q.data();
+      const T alpha = rz / sweep<1, T>(n, nt, [&](std::size_t lo, std::size_t m, std::array<T, 1>& e) {
+                             for (std::size_t i = lo; i < lo + m; ++i) e[0] += pp[i] * pq[i];
+                           })[0];
+      T* px = x.data();
+      rr = sweep<1, T>(n, nt, [&](std::size_t lo, std::size_t m, std::array<T, 1>& e) {
+             for (std::size_t i = lo; i < lo + m; ++i) {
+               px[i] += alpha * pp[i];
+               pr[i] -= alpha * pq[i];
+               e[0] += pr[i] * pr[i];
+             }
+           })[0];
+      T rz1 = rr;
+      if constexpr (!identity) {
+        apply(prec, r, z, nt);
+        rz1 = sweep<1, T>(n, nt, [&](std::size_t lo, std::size_t m, std::array<T, 1>& e) {
+                for (std::size_t i = lo; i < lo + m; ++i) e[0] += pr[i] * pz[i];
+              })[0];
+      }
+      const T beta = rz1 / rz;
+      rz = rz1;
+      sweep<0, T>(n, nt, [&](std::size_t lo, std::size_t m, std::array<T, 0>&) {
+        for (std::size_t i = lo; i < lo + m; ++i) pp[i] = pz[i] + beta * pp[i];
+      });
+      ++res.iterations;
+    }
+    rr = residual(a, b, x, r, nt);
+    if (std::sqrt(rr) <= tol) break;
+  }
+  res.residual = double(std::sqrt(rr) / bnorm);
+  res.converged = std::sqrt(rr) <= tol;
+  return res;
+}
+
+}  // namespace krylov
+
+//
+// CG for symmetric positive definite A, x holds the first guess
+//
+template <typename T, class A_t>
+KrylovResult cg(const A_t& a, const Array<T>& b, Array<T>& x,
+                const KrylovOptions& opt = KrylovOptions()) {
+  if (!krylov::pipelined(opt)) return krylov::classic_cg(a, IdentityPreconditioner(), b, x, opt);
+  const std::size_t n = b.size();
+  const unsigned nt = opt.nthreads;
+  KrylovResult res;
+  const T bnorm = std::sqrt(krylov::norm2(b, nt));
+  if (bnorm == T(0)) {
+    x = T(0);
+    res.converged = true;
+    return res;
+  }
+  const T tol = T(opt.tol) * bnorm;
+  Array<T> r(n), w(n), p(n), s(n), z(n), q(n);
+  T rr = krylov::residual(a, b, x, r, nt);
+  while (res.iterations < opt.max_iter) {
+    // (re)start the recurrences from the true residual
+    krylov::apply(a, r, w, nt);
+    const T* pr = r.data();
+    const T* pw = w.data();
+    std::array<T, 2> d = krylov::sweep<2, T>(
+        n, nt, [&](std::size_t lo, std::size_t m, std::array<T, 2>& e) {
+          for (std::size_t i = lo; i < lo + m; ++i) {
+            e[0] += pr[i] * pr[i];
+            e[1] += pw[i] * pr[i];
+          }
+        });
+    T gamma = d[0], delta = d[1], gamma0 = T(1), alpha0 = T(1);
+    bool first = true;
+    p = T(0);
+    s = T(0);
+    z = T(0);
+    while (std::sqrt(rr) > tol && res.iterations < opt.max_iter) {
+      krylov::apply(a, w, q, nt);
+      const T beta = first ? T(0) : gamma / gamma0;
+      const T alpha = first ? gamma / delta : gamma / (delta - beta * gamma / alpha0);
+      T* px = x.data();
+      T* pr2 = r.data();
+      T* pw2 = w.data();
+      T* pp = p.data();
+      T* ps = s.data();
+      T* pz = z.data();
+      const T* pq = q.data();
+      d = krylov::sweep<2, T>(
+          n, nt, [&](std::size_t lo, std::size_t m, std::array<T, 2>& e) {
+            for (std::size_t i = lo; i < lo + m; ++i) {
+              pz[i] = pq[i] + beta * pz[i];
+              ps[i] = pw2[i] + beta * ps[i];
+              pp[i] = pr2[i] + beta * pp[i];
+              px[i] += alpha * pp[i];
+              pr2[i] -= alpha * ps[i];
+              pw2[i] -= alpha * pz[i];
+              e[0] += pr2[i] * pr2[i];
+              e[1] += pw2[i] * pr2[i];
+            }
+          });
+      gamma0 = gamma;
+      alpha0 = alpha;
+      gamma = d[0];
+      delta = d[1];
+      rr = gamma;
+      first = false;
+      ++res.iterations;
+    }
+    rr = krylov::residual(a, b, x, r, nt);
+    if (std::sqrt(rr) <= tol) break;
+  }
+  res.residual = double(std::sqrt(rr) / bnorm);
+  res.converged = std::sqrt(rr) <= tol;
+  return res;
+}
+
+//
+// preconditioned CG, M symmetric positive definite as well
+//
+template <typename T, class A_t, class M_t>
+KrylovResult pcg(const A_t& a, const M_t& prec, const Array<T>& b, Array<T>& x,
+                 const KrylovOptions& opt = KrylovOptions()) {
+  if constexpr (std::is_same_v<M_t, IdentityPreconditioner>) {
+    return cg(a, b, x, opt);
+  } else {
+    if (!krylov::pipelined(opt)) return krylov::classic_cg(a, prec, b, x, opt);
+    const std::size_t n = b.size();
+    const unsigned nt = opt.nthreads;
+    KrylovResult res;
+    const T bnorm = std::sqrt(krylov::norm2(b, nt));
+    if (bnorm == T(0)) {
+      x = T(0);
+      res.converged = true;
+      return res;
+    }
+    const T tol = T(opt.tol) * bnorm;
+    Array<T> r(n), u(n), w(n), mw(n), nw(n), p(n), s(n), q(n), z(n);
+    T rr = krylov::residual(a, b, x, r, nt);
+    while (res.iterations < opt.max_iter) {
+      krylov::apply(prec, r, u, nt);
+      krylov::apply(a, u, w, nt);
+      const T* pr = r.data();
+      const T* pu = u.data();
+      const T* pw = w.data();
+      std::array<T, 3> d = krylov::sweep<3, T>(
+          n, nt, [&](std::size_t lo, std::size_t m, std::array<T, 3>& e) {
+            for (std::size_t i = lo; i < lo + m; ++i) {
+              e[0] += pr[i] * pu[i];
+              e[1] += pw[i] * pu[i];
+              e[2] += pr[i] * pr[i];
+            }
+          });
+      T gamma = d[0], delta = d[1], gamma0 = T(1), alpha0 = T(1);
+      bool first = true;
+      p = T(0);
+      s = T(0);
+      q = T(0);
+      z = T(0);
+      while (std::sqrt(rr) > tol && res.iterations < opt.max_iter) {
+        krylov::apply(prec, w, mw, nt);
+        krylov::apply(a, mw, nw, nt);
+        const T beta = first ? T(0) : gamma / gamma0;
+        const T alpha = first ? gamma / delta : gamma / (delta - beta * gamma / alpha0);
+        T* px = x.data();
+        T* pr2 = r.data();
+        T* pu2 = u.data();
+        T* pw2 = w.data();
+        T* pp = p.data();
+        T* ps = s.data();
+        T* pq = q.data();
+        T* pz = z.data();
+        const T* pm = mw.data();
+        const T* pn = nw.data();
+        d = krylov::sweep<3, T>(
+            n, nt, [&](std::size_t lo, std::size_t m, std::array<T, 3>& e) {
+              for (std::size_t i = lo; i < lo + m; ++i) {
+                pz[i] = pn[i] + beta * pz[i];
+                pq[i] = pm[i] + beta * pq[i];
+                ps[i] = pw2[i] + beta * ps[i];
+                pp[i] = pu2[i] + beta * pp[i];
+                px[i] += alpha * pp[i];
+                pr2[i] -= alpha * ps[i];
+                pu2[i] -= alpha * pq[i];
+                pw2[i] -= alpha * pz[i];
+                e[0] += pr2[i] * pu2[i];
+                e[1] += pw2[i] * pu2[i];
+                e[2] += pr2[i] * pr2[i];
+              }
+            });
+        gamma0 = gamma;
+        alpha0 = alpha;
+        gamma = d[0];
+        delta = d[1];
+        rr = d[2];
+        first = false;
+        ++res.iterations;
+      }
+      rr = krylov::residual(a, b, x, r, nt);
+      if (std::sqrt(rr) <= tol) break;
+    }
+    res.residual = double(std::sqrt(rr) / bnorm);
+    res.converged = std::sqrt(rr) <= tol;
+    return res;
+  }
+}
+
+//
+// BiCGStab for general A, right preconditioned
+//
+template <typename T, class A_t, class M_t>
+KrylovResult bicgstab(const A_t& a, const M_t& prec, const Array<T>& b,
+                      Array<T>& x, const KrylovOptions& opt = KrylovOptions()) {
+  constexpr bool plain = std::is_same_v<M_t, IdentityPreconditioner>;
+  const std::size_t n = b.size();
+  const unsigned nt = opt.nthreads;
+  KrylovResult res;
+  const T bnorm = std::sqrt(krylov::norm2(b, nt));
+  if (bnorm == T(0)) {
+    x = T(0);
+    res.converged = true;
+    return res;
+  }
+  const T tol = T(opt.tol) * bnorm;
+  Array<T> r(n), r0(n), p(n), v(n), s(n), t(n);
+  Array<T> ph(plain ? 0 : n), sh(plain ? 0 : n);
+  const Array<T>& php = plain ? p : ph;
+  const Array<T>& shp = plain ? s : sh;
+  T rr = krylov::residual(a, b, x, r, nt);
+  r0 = r;
+  T rho = rr, alpha = T(1), omega = T(1), beta = T(0);
+  bool first = true;
+  while (std::sqrt(rr) > tol && res.iterations < opt.max_iter) {
+    T* pp = p.data();
+    T* pv = v.data();
+    T* pr = r.data();
+    T* ps = s.data();
+    T* pt = t.data();
+    T* px = x.data();
+    const T* pr0 = r0.data();
+    if (first) {
+      for (std::size_t i = 0; i < n; ++i) pp[i] = pr[i];
+    } else {
+      krylov::sweep<0, T>(
+          n, nt, [&](std::size_t lo, std::size_t m, std::array<T, 0>&) {
+            for (std::size_t i = lo; i < lo + m; ++i)
+              pp[i] = pr[i] + beta * (pp[i] - omega * pv[i]);
+          });
+    }
+    if constexpr (!plain) krylov::apply(prec, p, ph, nt);
+    krylov::apply(a, php, v, nt);
+    const T sigma = krylov::sweep<1, T>(
+        n, nt, [&](std::size_t lo, std::size_t m, std::array<T, 1>& e) {
+          for (std::size_t i = lo; i < lo + m; ++i) e[0] += pr0[i] * pv[i];
+        })[0];
+    if (sigma == T(0)) break;
+    alpha = rho / sigma;
+    const T ss = krylov::sweep<1, T>(
+        n, nt, [&](std::size_t lo, std::size_t m, std::array<T, 1>& e) {
+          for (std::size_t i = lo; i < lo + m; ++i) {
+            ps[i] = pr[i] - alpha * pv[i];
+            e[0] += ps[i] * ps[i];
+          }
+        })[0];
+    ++res.iterations;
+    if (std::sqrt(ss) <= tol) {
+      const T* pph = php.data();
+      for (std::size_t i = 0; i < n; ++i) px[i] += alpha * pph[i];
+      rr = ss;
+      break;
+    }
+    if constexpr (!plain) krylov::apply(prec, s, sh, nt);
+    krylov::apply(a, shp, t, nt);
+    const std::array<T, 2> ts = krylov::sweep<2, T>(
+        n, nt, [&](std::size_t lo, std::size_t m, std::array<T, 2>& e) {
+          for (std::size_t i = lo; i < lo + m; ++i) {
+            e[0] += pt[i] * ps[i];
+            e[1] += pt[i] * pt[i];
+          }
+        });
+    if (ts[1] == T(0)) break;
+    omega = ts[0] / ts[1];
+    const T* pph = php.data();
+    const T* psh = shp.data();
+    const std::array<T, 2> e2 = krylov::sweep<2, T>(
+        n, nt, [&](std::size_t lo, std::size_t m, std::array<T, 2>& e) {
+          for (std::size_t i = lo; i < lo + m; ++i) {
+            px[i] += alpha * pph[i] + omega * psh[i];
+            pr[i] = ps[i] - omega * pt[i];
+            e[0] += pr0[i] * pr[i];
+            e[1] += pr[i] * pr[i];
+          }
+        });
+    rr = e2[1];
+    if (omega == T(0) || e2[0] == T(0)) break;
+    beta = (e2[0] / rho) * (alpha / omega);
+    rho = e2[0];
+    first = false;
+  }
+  rr = krylov::residual(a, b, x, r, nt);
+  res.residual = double(std::sqrt(rr) / bnorm);
+  res.converged = std::sqrt(rr) <= tol;
+  return res;
+}
+
+template <typename T, class A_t>
+KrylovResult bicgstab(const A_t& a, const Array<T>& b, Array<T>& x,
+                      const KrylovOptions& opt = KrylovOptions()) {
+  return bicgstab(a, IdentityPreconditioner(), b, x, opt);
+}
+
+//
+// restarted GMRES for general A, right preconditioned
+//
+template <typename T, class A_t, class M_t>
+KrylovResult gmres(const A_t& a, const M_t& prec, const Array<T>& b,
+                   Array<T>& x, const KrylovOptions& opt = KrylovOptions()) {
+  constexpr bool plain = std::is_same_v<M_t, IdentityPreconditioner>;
+  const std::size_t n = b.size(), mr = std::max<std::size_t>(opt.restart, 1);
+  const unsigned nt = opt.nthreads;
+  KrylovResult res;
+  const T bnorm = std::sqrt(krylov::norm2(b, nt));
+  if (bnorm == T(0)) {
+    x = T(0);
+    res.converged = true;
+    return res;
+  }
+  const T tol = T(opt.tol) * bnorm;
+  std::vector<Array<T> > v(mr + 1, Array<T>(n));
+  std::vector<T*> pv(mr + 1);
+  for (std::size_t k = 0; k <= mr; ++k) pv[k] = v[k].data();
+  std::vector<T> h((mr + 1) * mr), cs(mr), sn(mr), g(mr + 1), y(mr);
+  Array<T> r(n), w(n), z(plain ? 0 : n);
+  typedef std::vector<T> part_t;
+  auto merge = [](part_t& u, const part_t& e) {
+    for (std::size_t k = 0; k < u.size(); ++k) u[k] += e[k];
+  };
+  T rr = krylov::residual(a, b, x, r, nt);
+  while (std::sqrt(rr) > tol && res.iterations < opt.max_iter) {
+    const T beta = std::sqrt(rr);
+    const T* pr = r.data();
+    for (std::size_t i = 0; i < n; ++i) pv[0][i] = pr[i] / beta;
+    std::fill(g.begin(), g.end(), T(0));
+    g[0] = beta;
+    std::size_t j = 0;
+    while (j < mr && res.iterations < opt.max_iter) {
+      // w = A M^-1 v_j
+      if constexpr (plain) {
+        krylov::apply(a, v[j], w, nt);
+      } else {
+        krylov::apply(prec, v[j], z, nt);
+        krylov::apply(a, z, w, nt);
+      }
+      T* pw = w.data();
+      const std::size_t nk = j + 1;
+      // c = V' w, then w -= V c with c2 = V' w, then w -= V c2 with |w|^2
+      const part_t c = reduce::blocked<part_t>(
+          n, nt,
+          [&](std::size_t lo, std::size_t m) {
+            part_t e(nk, T(0));
+            for (std::size_t k = 0; k < nk; ++k) {
+              const T* vk = pv[k];
+              for (std::size_t i = lo; i < lo + m; ++i) e[k] += vk[i] * pw[i];
+            }
+            return e;
+          },
+          merge);
+      const part_t c2 = reduce::blocked<part_t>(
+          n, nt,
+          [&](std::size_t lo, std::size_t m) {
+            part_t e(nk, T(0));
+            for (std::size_t k = 0; k < nk; ++k) {
+              const T* vk = pv[k];
+              for (std::size_t i = lo; i < lo + m; ++i) pw[i] -= c[k] * vk[i];
+            }
+            for (std::size_t k = 0; k < nk; ++k) {
+              const T* vk = pv[k];
+              for (std::size_t i = lo; i < lo + m; ++i) e[k] += vk[i] * pw[i];
+            }
+            return e;
+          },
+          merge);
+      const T ww = krylov::sweep<1, T>(
+          n, nt, [&](std::size_t lo, std::size_t m, std::array<T, 1>& e) {
+            for (std::size_t k = 0; k < nk; ++k) {
+              const T* vk = pv[k];
+              for (std::size_t i = lo; i < lo + m; ++i) pw[i] -= c2[k] * vk[i];
+            }
+            for (std::size_t i = lo; i < lo + m; ++i) e[0] += pw[i] * pw[i];
+          })[0];
+      T* hj = h.data() + j * (mr + 1);
+      for (std::size_t k = 0; k < nk; ++k) hj[k] = c[k] + c2[k];
+      hj[nk] = std::sqrt(ww);
+      if (hj[nk] != T(0)) {
+        const T inv = T(1) / hj[nk];
+        for (std::size_t i = 0; i < n; ++i) pv[nk][i] = pw[i] * inv;
+      }
+      // the new column through the old rotations and one new one
+      for (std::size_t k = 0; k < j; ++k) {
+        const T t0 = cs[k] * hj[k] + sn[k] * hj[k + 1];
+        hj[k + 1] = -sn[k] * hj[k] + cs[k] * hj[k + 1];
+        hj[k] = t0;
+      }
+      const T den = std::hypot(hj[j], hj[j + 1]);
+      cs[j] = den == T(0) ? T(1) : hj[j] / den;
+      sn[j] = den == T(0) ? T(0) : hj[j + 1] / den;
+      hj[j] = den;
+      hj[j + 1] = T(0);
+      g[j + 1] = -sn[j] * g[j];
+      g[j] = cs[j] * g[j];
+      ++res.iterations;
+      ++j;
+      if (std::fabs(g[j]) <= tol || den == T(0)) break;
+    }
+    // y = H^-1 g, x += M^-1 V y
+    for (std::size_t k = j; k-- > 0;) {
+      T s = g[k];
+      for (std::size_t l = k + 1; l < j; ++l) s -= h[l * (mr + 1) + k] * y[l];
+      y[k] = s / h[k * (mr + 1) + k];
+    }
+    T* pw = w.data();
+    krylov::sweep<0, T>(n, nt, [&](std::size_t lo, std::size_t m, std::array<T, 0>&) {
+      for (std::size_t i = lo; i < lo + m; ++i) pw[i] = T(0);
+      for (std::size_t k = 0; k < j; ++k) {
+        const T* vk = pv[k];
+        for (std::size_t i = lo; i < lo + m; ++i) pw[i] += y[k] * vk[i];
+      }
+    });
+    if constexpr (plain) {
+      x += w;
+    } else {
+      krylov::apply(prec, w, z, nt);
+      x += z;
+    }
+    rr = krylov::residual(a, b, x, r, nt);
+  }
+  res.residual = double(std::sqrt(rr) / bnorm);
+  res.converged = std::sqrt(rr) <= tol;
+  return res;
+}
+
+template <typename T, class A_t>
+KrylovResult gmres(const A_t& a, const Array<T>& b, Array<T>& x,
+                   const KrylovOptions& opt = KrylovOptions()) {
+  return gmres(a, IdentityPreconditioner(), b, x, opt);
+}
+
+}  // namespace petlib
+#endif
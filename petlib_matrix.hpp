@@ -6,6 +6,7 @@
 #include <petlib_array_ops.hpp>
 #include <petlib_io.hpp>
 #include <petlib_array.hpp>
+#include <petlib_cow.hpp>
 #include <petlib_math.hpp>
 
 namespace petlib {
@@ -316,10 +317,16 @@ template < typename T > class SubMatrix;
 
 template < typename T >
 class Matrix: public MatrixBase< Matrix<T>, T>  {
+   CowBuffer<T> buf_;
    T * data_;
    std::size_t n1;
    std::size_t n2;
    std::size_t ntot;
+   mutable bool own_;
+   // the source of a copy, which may be read on several threads at once
+   void disown() const noexcept {
+       std::atomic_ref<bool>(own_).store(false,std::memory_order_relaxed);
+   }
 public:   
    typedef T value_t;
    typedef T* pointer_t;
@@ -332,23 +339,27 @@ public:
    typedef std::ptrdiff_t difference_type;
    
     
-   Matrix(std::size_t n1_,std::size_t n2_):data_(new value_t[n1_*n2_]),n1(n1_),n2(n2_),ntot(n1_*n2_) {}
+   Matrix(std::size_t n1_,std::size_t n2_):buf_(n1_*n2_),data_(buf_.data()),n1(n1_),n2(n2_),ntot(n1_*n2_),own_(true) {}
    
-   Matrix()=default;
+   Matrix():buf_(),data_(nullptr),n1(0),n2(0),ntot(0),own_(true) {}
 
-   Matrix(const Matrix& m):data_(new value_t[m.ntot]),n1(m.n1),n2(m.n2),ntot(m.ntot) {
-       for (std::size_t i=0;i<n1;++i) {
-          std::copy(m.data_+i*n2,m.data_+i*n2+n2,data_+i*n2);
+   // shares the buffer of m until one of them writes, a pinned buffer
+   // is copied here instead
+   Matrix(const Matrix& m):buf_(m.buf_),data_(buf_.data()),n1(m.n1),n2(m.n2),ntot(m.ntot),own_(true) {
+       if (buf_.shared()) {
+           own_ = false;
+           m.disown();
        }
    }
 
-   Matrix(Matrix&& m):data_(m.data_),n1(m.n1),n2(m.n2),ntot(m.ntot) { 
+   Matrix(Matrix&& m):buf_(std::move(m.buf_)),data_(m.data_),n1(m.n1),n2(m.n2),ntot(m.ntot),own_(m.own_) { 
        m.data_ = nullptr;
        m.n1 = m.n2 = m.ntot = 0;
+       m.own_ = true;
    }
 
    template < class xpr_t >
-   Matrix(const MatrixXpr<xpr_t>& m):data_(new value_t[m.nrows()*m.ncols()]),n1(m.nrows()),n2(m.ncols()),ntot(m.nrows()*m.ncols()) {
+   Matrix(const MatrixXpr<xpr_t>& m):buf_(m.nrows()*m.ncols()),data_(buf_.data()),n1(m.nrows()),n2(m.ncols()),ntot(m.nrows()*m.ncols()),own_(true) {
        pointer_t dp = data_;
        for (size_type i = 0; i < n1 ; ++i) {
         for (size_type j = 0; j < n2;  ++j,++dp) {
@@ -357,7 +368,7 @@ public:
        }
    }
 
-   Matrix(const SubMatrix<value_t>& m):data_(new value_t[m.nrows()*m.ncols()]),n1(m.nrows()),n2(m.ncols()),ntot(m.nrows()*m.ncols()) {
+   Matrix(const SubMatrix<value_t>& m):buf_(m.nrows()*m.ncols()),data_(buf_.data()),n1(m.nrows()),n2(m.ncols()),ntot(m.nrows()*m.ncols()),own_(true) {
        pointer_t dp = data_;
        for (size_type i = 0; i < n1 ; ++i) {
         for (size_type j = 0; j < n2;  ++j,++dp) {
@@ -367,18 +378,25 @@ public:
    }
    
    ~Matrix() {
-       if (data_) delete [] data_;
+       data_ = nullptr;
        n1=n2=ntot=0;
    }
    
    Matrix& operator=(const Matrix& m) {
-       for (size_type i = 0; i < n1; ++i) {
-           std::copy(m.data_+i*m.n2,m.data_+ntot+i*m.n2,data_+i*n2); 
-       }
+       if (this == &m) return *this;
+       buf_ = m.buf_;
+       data_ = buf_.data();
+       n1 = m.n1;
+       n2 = m.n2;
+       ntot = m.ntot;
+       own_ = !buf_.shared();
+       if (!own_) m.disown();
        return *this;
    }
 
    Matrix& operator=(const SubMatrix<value_t>& m) {
+       detach();
+       buf_.unpin();
        pointer_t p = data_;
        for (size_type i = 0; i < n1; ++i) {
          for (size_type j = 0; j < n2; ++j, ++p) *p= m(i,j); 
@@ -387,36 +405,43 @@ public:
    }
 
    Matrix& operator=(Matrix&& m) {
+       buf_ = std::move(m.buf_);
        data_ = m.data_;
        n1 = m.n1;
        n2 = m.n2;
        ntot= m.ntot;
+       own_ = m.own_;
        m.data_=nullptr;
        m.n1 =0;
        m.n2 =0;
        m.ntot =0;
+       m.own_ = true;
        return *this;
    }
    
    Matrix& operator+=(const Matrix& m) {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] += m.data_[i*m.n2+j];
        return *this;
    }
    Matrix& operator-=(const Matrix& m) {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] -= m.data_[i*m.n2+j];
        return *this;
    }
    Matrix& operator*=(const Matrix& m) {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] *= m.data_[i*m.n2+j];
        return *this;
    }
    Matrix& operator/=(const Matrix& m) {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] /= m.data_[i*m.n2+j];
@@ -426,6 +451,7 @@ public:
    template < typename mat_type >   
    Matrix& operator = (const MatrixBase< mat_type, value_t>& m)
    {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] = m(i,j);
@@ -434,6 +460,7 @@ public:
    template < typename mat_type >   
    Matrix& operator += (const MatrixBase< mat_type, value_t>& m)
    {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] += m(i,j);
@@ -442,6 +469,7 @@ public:
    template < typename mat_type >   
    Matrix& operator -= (const MatrixBase< mat_type, value_t>& m)
    {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] -= m(i,j);
@@ -450,6 +478,7 @@ public:
    template < typename mat_type >   
    Matrix& operator *= (const MatrixBase< mat_type, value_t>& m)
    {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] *= m(i,j);
@@ -458,6 +487,7 @@ public:
    template < typename mat_type >   
    Matrix& operator /= (const MatrixBase< mat_type, value_t>& m)
    {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] /= m(i,j);
@@ -467,6 +497,7 @@ public:
    template < typename xpr_type >   
    Matrix& operator = (const MatrixXpr< xpr_type >& m)
    {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] = m(i,j);
@@ -475,6 +506,7 @@ public:
    template < typename xpr_type >   
    Matrix& operator += (const MatrixXpr< xpr_type >& m)
    {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] += m(i,j);
@@ -483,6 +515,7 @@ public:
    template < typename xpr_type >   
    Matrix& operator -= (const MatrixXpr< xpr_type >& m)
    {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] -= m(i,j);
@@ -491,6 +524,7 @@ public:
    template < typename xpr_type >   
    Matrix& operator *= (const MatrixXpr< xpr_type >& m)
    {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] *= m(i,j);
@@ -499,6 +533,7 @@ public:
    template < typename xpr_type >   
    Matrix& operator /= (const MatrixXpr< xpr_type >& m)
    {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] /= m(i,j);
@@ -506,6 +541,8 @@ public:
    }
       
    Matrix& operator=( value_t x) {
+       detach();
+       buf_.unpin();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] = x;
@@ -513,6 +550,7 @@ public:
    }
     
    Matrix& operator+=( value_t x) {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] += x;
@@ -520,6 +558,7 @@ public:
    }
     
    Matrix& operator-=( value_t x) {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] -= x;
@@ -527,6 +566,7 @@ public:
    }
    
    Matrix& operator*=( value_t x) {
+       detach();
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
           data_[i*n2+j] *= x;
@@ -534,6 +574,7 @@ public:
    }
    
    Matrix& operator/=( value_t x) {
+       detach();
        value_t xi  = value_t(1)/x;
        for (size_type i=0;i<n1;++i) 
         for (size_type j=0;j<n2;++j)
@@ -542,28 +583,28 @@ public:
    }
     
    SubMatrix<value_t> operator()(const Range& row_rng,const Range& col_rng) {
-       return SubMatrix(data_+row_rng.offset()*n2+col_rng.offset(),row_rng.size(),col_rng.size(),n2);
+       return SubMatrix(pin()+row_rng.offset()*n2+col_rng.offset(),row_rng.size(),col_rng.size(),n2);
    }
    
    value_t operator()(std::size_t i,std::size_t j) const { return data_[i*n2+j];}
    
-   reference_t operator()(std::size_t i,std::size_t j)  { return data_[i*n2+j];}
+   reference_t operator()(std::size_t i,std::size_t j)  { if (!own_) detach(); return data_[i*n2+j];}
 
-   pointer_t data() { return data_;}
+   pointer_t data() { return pin();}
    const_pointer_t data() const { return data_;} 
    
-   SubArray<value_t> row_array(std::size_t i) { return SubArray<value_t>(data_+i*n2,n2);}
-   SliceArray<value_t> col_array(std::size_t i) { return SliceArray<value_t>(data_+i,n1,n2);}
-   SliceArray<value_t> diag_array() { return SliceArray<value_t>(data_,n1,n2+1);}
+   SubArray<value_t> row_array(std::size_t i) { return SubArray<value_t>(pin()+i*n2,n2);}
+   SliceArray<value_t> col_array(std::size_t i) { return SliceArray<value_t>(pin()+i,n1,n2);}
+   SliceArray<value_t> diag_array() { return SliceArray<value_t>(pin(),n1,n2+1);}
 
-   RangeIterator<value_t> row_begin(std::size_t i) { return RangeIterator<value_t>(data_+i*n2,n2);}
-   SliceIterator<value_t> col_begin(std::size_t i) { return SliceIterator<value_t>(data_+i,n1,n2);}
+   RangeIterator<value_t> row_begin(std::size_t i) { return RangeIterator<value_t>(pin()+i*n2,n2);}
+   SliceIterator<value_t> col_begin(std::size_t i) { return SliceIterator<value_t>(pin()+i,n1,n2);}
    const RangeIterator<value_t> row_end(std::size_t i) const { return SubArray<value_t>(data_+i*n2+n2,n2);}
    const SliceIterator<value_t> col_end(std::size_t i) const { return SliceIterator<value_t>(data_+i+n2*n1,n1,n2);}
    const RangeIterator<value_t> row_cend(std::size_t i) const { return RangeIterator<value_t>(data_+i*n2,n2);}
    const SliceIterator<value_t> col_cend(std::size_t i) const { return SliceIterator<value_t>(data_+i,n1,n2);}
-   RangeIterator<value_t> row_cbegin(std::size_t i) { return SubArray<value_t>(data_+i*n2+n2,n2);}
-   SliceIterator<value_t> col_cbegin(std::size_t i) { return SliceIterator<value_t>(data_+i+n2*n1,n1,n2);}
+   RangeIterator<value_t> row_cbegin(std::size_t i) { return SubArray<value_t>(pin()+i*n2+n2,n2);}
+   SliceIterator<value_t> col_cbegin(std::size_t i) { return SliceIterator<value_t>(pin()+i+n2*n1,n1,n2);}
    
    std::size_t ncols() const { return n2;}
    std::size_t nrows() const { return n1;}
@@ -605,13 +646,16 @@ public:
    ////
    
    void swap_rows(std::size_t i,std::size_t j) {
+       detach();
        std::swap(data_+i*n2,data_+i*n2+n2,data_+j*n2);
    }
    void elim_row(std::size_t i,std::size_t j,const value_t c) {
+       detach();
        for (size_type k=0;k<n2;++k) data_[i*n2+k] -= data_[j*n2+k]*c;
    }
    
    void rotate_rows(std::size_t i,std::size_t j,value_t angle) {
+       detach();
        pointer_t p = data_ + i * n2;
        pointer_t q = data_ + j * n2;
        value_t cs = std::cos(angle);
@@ -629,19 +673,23 @@ public:
    }
    
    void fill_row(std::size_t j,const_pointer_t ptr) {
+       detach();
       std::copy(ptr,ptr+n2,data_+j*n2);
    }
    
    void scal_row(std::size_t i,const value_t factor) {
+       detach();
       pointer_t dp = data_ + i * n2;
       for (std::size_t j=0;j<n2;++j) dp[j] *= factor;
    }
    
    void swap_cols(std::size_t i,std::size_t j) {
+       detach();
        std::swap(SliceIterator<value_t>(data_+i,n2),SliceIterator(data_+i+n2*n1,n2),SliceIterator(data_+j,n2));
    }
    
    void elim_col(std::size_t i,std::size_t j,const value_t c) {
+       detach();
        pointer_t dpi = data_ + i;
        pointer_t dpj = data_ + j;
        for (std::size_t k=0;k<n1;++k) {
@@ -651,6 +699,7 @@ public:
        }
    }
    void  rotate_cols(std::size_t i,std::size_t j,value_t angle) {
+       detach();
        pointer_t p = data_ + i;
        pointer_t q = data_ + j;
        value_t cs = std::cos(angle);
@@ -671,11 +720,13 @@ public:
    }
    
    void fill_col(std::size_t j,const_pointer_t ptr) {
+       detach();
        SliceIterator<value_t> iter(data_+j,n2);
        std::copy(ptr,ptr+n1,iter);
    }
    
    void scal_col(std::size_t j,const value_t factor) {
+       detach();
        SliceIterator<value_t> iter(data_+j,n2);
        const SliceIterator<value_t> iend(data_+j+n2,n2);
        for ( ;iter!=iend;++iter) {
@@ -711,18 +762,21 @@ public:
    }
        
    void scal_diag(const value_t& c) {
+       detach();
        SliceIterator<value_t> p(data_,n2+1);  
        const SliceIterator<value_t> pend(data_+n1*n2+n1,n2+1);
        for (;p!=pend;++p) { p *= c; }
    }
    
    void assign_diag(const_pointer_t ptr) {
+       detach();
        SliceIterator<value_t> p(data_,n2+1);  
        std::copy(ptr,ptr+n1,p);    
    }
    
    void assign_diag(const value_t& c)
    {
+       detach();
        SliceIterator<value_t> p(data_,n2+1);  
        const SliceIterator<value_t> pend(data_+n1*n2+n1,n2+1);
        for (;p!=pend;++p) { p = c; }   
@@ -740,11 +794,39 @@ public:
    }
    
    void resize(std::size_t new_n1,std::size_t new_n2) {
-       if (data_) delete [] data_;
-       data_=new value_t[new_n1*new_n2];
+       buf_ = CowBuffer<T>(new_n1*new_n2);
+       data_ = buf_.data();
        n1 = new_n1;
        n2 = new_n2;
+       ntot = new_n1*new_n2;
+       own_ = true;
    }
+
+   ////
+   //   Copy on write. Copies share the elements; every member that
+   //     can write through data_ first calls detach, which copies
+   //     them once if another Matrix still holds the buffer. own_ is
+   //     set while none does, so element access tests it and is then
+   //     a plain load or store. Views, iterators and data() pin the
+   //     buffer as well, copies made while it is pinned copy the
+   //     elements. The pin lasts until the next assignment to or
+   //     resize of the Matrix, the views are not to be used after it.
+   //     A reference from operator() is not to be held across a copy.
+   ////
+   void detach() {
+       if (own_) return;
+       if (buf_.shared()) data_ = buf_.unshare();
+       own_ = true;
+   }
+   pointer_t pin() {
+       detach();
+       buf_.pin();
+       return data_;
+   }
+   bool is_shared() const { return buf_.shared();}
+   bool is_pinned() const { return buf_.pinned();}
+   std::size_t use_count() const { return buf_.use_count();}
+   bool shares_storage(const Matrix& m) const { return buf_.same_buffer(m.buf_);}
    
    value_t norm() const {
        value_t sum(0);
@@ -0,0 +1,623 @@
+#ifndef PETLIB_PACKED_HPP
+#define PETLIB_PACKED_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <petlib_array.hpp>
+#include <petlib_cow.hpp>
+#include <petlib_gemm.hpp>
+#include <petlib_matrix.hpp>
+#include <petlib_threads.hpp>
+
+//
+// Symmetric and lower triangular n x n matrices that keep only the lower
+// triangle, n (n + 1) / 2 elements, in one of two layouts:
+//  - PackedLayout, row i of the triangle at i (i + 1) / 2. Every row is
+//    contiguous, so the row oriented kernels run at unit stride, but
+//    there are no rectangular blocks for matrix products.
+//  - RfpLayout, the rectangular full packed format of Gustavson et al.
+//    written row major. With n1 = n - n / 2 and n2 = n / 2 the triangle
+//      | L11      |
+//      | L21  L22 |
+//    lies in an n1 wide rectangle: L11 as its lower triangle, L22' as the
+//    upper triangle beside it, and under both L21 as a plain n2 x n1
+//    block, so the largest products are matrix products.
+//
+// Both are matrix expressions through MatrixBase, s(i,j) reads the whole
+// matrix. Assigning an expression to them evaluates the lower triangle
+// only. Products and solves run on the stored triangle, half the memory
+// traffic of the full Matrix.
+//
+namespace petlib {
+
+struct PackedLayout {
+  static std::size_t index(std::size_t, std::size_t i, std::size_t j) noexcept {
+    return i * (i + 1) / 2 + j;
+  }
+};
+
+// n1 columns, L11 and L21 start at row s = 1 - n % 2, L22' at column 1 - s
+struct RfpLayout {
+  static std::size_t index(std::size_t n, std::size_t i, std::size_t j) noexcept {
+    const std::size_t n1 = n - n / 2, s = 1 - n % 2;
+    return j < n1 ? (i + s) * n1 + j : (j - n1) * n1 + (i - n1) + 1 - s;
+  }
+};
+
+namespace packed {
+
+// acc[j % 8] += a[j] x[j] for j in [b, e). The lane of a term is fixed by
+// its index, so the sum does not depend on where a caller splits a row.
+template <typename T>
+void dot_lanes(T* acc, std::size_t b, std::size_t e, const T* a, const T* x) noexcept {
+  std::size_t j = b;
+  for (; j < e && (j & 7) != 0; ++j) acc[j & 7] += a[j] * x[j];
+  for (; j + 8 <= e; j += 8)
+    for (std::size_t r = 0; r < 8; ++r) acc[r] += a[j + r] * x[j + r];
+  for (; j < e; ++j) acc[j & 7] += a[j] * x[j];
+}
+
+// the same with y[j] += a[j] xi on the way, a is read once for both
+template <typename T>
+void dot_axpy_lanes(T* acc, std::size_t b, std::size_t e, const T* a, const T* x,
+                    T* y, T xi) noexcept {
+  std::size_t j = b;
+  for (; j < e && (j & 7) != 0; ++j) {
+    acc[j & 7] += a[j] * x[j];
+    y[j] += a[j] * xi;
+  }
+  for (; j + 8 <= e; j += 8)
+    for (std::size_t r = 0; r < 8; ++r) {
+      acc[r] += a[j + r] * x[j + r];
+      y[j + r] += a[j + r] * xi;
+    }
+  for (; j < e; ++j) {
+    acc[j & 7] += a[j] * x[j];
+    y[j] += a[j] * xi;
+  }
+}
+
+template <typename T>
+T lanes_sum(const T* acc) noexcept {
+  return ((acc[0] + acc[4]) + (acc[1] + acc[5])) + ((acc[2] + acc[6]) + (acc[3] + acc[7]));
+}
+
+template <typename T>
+T dot(std::size_t b, std::size_t e, const T* a, const T* x) noexcept {
+  T acc[8] = {};
+  dot_lanes(acc, b, e, a, x);
+  return lanes_sum(acc);
+}
+
+// y[lo, hi) += A x for the symmetric m x m A whose lower triangle has its
+// row i at row(i). Row i dots into y[i] and adds its column to y[j < i].
+// Rows go in order, so y[i] sums the same terms in the same order on any
+// split, and one thread reads the triangle once.
+template <typename T, class Row>
+void symv_lower(std::size_t m, const Row& row, const T* x, T* y, std::size_t lo,
+                std::size_t hi) noexcept {
+  for (std::size_t i = lo; i < m; ++i) {
+    const T* ai = row(i);
+    const T xi = x[i];
+    if (i < hi) {
+      T acc[8] = {};
+      dot_lanes(acc, 0, lo, ai, x);
+      dot_axpy_lanes(acc, lo, i, ai, x, y, xi);
+      dot_lanes(acc, i, i + 1, ai, x);
+      y[i] += lanes_sum(acc);
+    } else {
+      for (std::size_t j = lo; j < hi; ++j) y[j] += ai[j] * xi;
+    }
+  }
+}
+
+// the same for an upper triangle with row(b)[a] the element a >= b of row b
+template <typename T, class Row>
+void symv_upper(std::size_t m, const Row& row, const T* x, T* y, std::size_t lo,
+                std::size_t hi) noexcept {
+  for (std::size_t b = 0; b < hi; ++b) {
+    const T* ub = row(b);
+    const T xb = x[b];
+    if (b >= lo) {
+      T acc[8] = {};
+      dot_lanes(acc, b, b + 1, ub, x);
+      dot_axpy_lanes(acc, b + 1, hi, ub, x, y, xb);
+      dot_lanes(acc, hi, m, ub, x);
+      y[b] += lanes_sum(acc);
+    } else {
+      for (std::size_t a = lo; a < hi; ++a) y[a] += ub[a] * xb;
+    }
+  }
+}
+
+// x = L^-1 x and x = L'^-1 x for the lower triangle of rows row(i)
+template <typename T, class Row>
+void trsv_lower(std::size_t m, const Row& row, T* x) noexcept {
+  for (std::size_t i = 0; i < m; ++i) {
+    const T* li = row(i);
+    x[i] = (x[i] - dot(0, i, li, x)) / li[i];
+  }
+}
+
+template <typename T, class Row>
+void trsv_lower_transpose(std::size_t m, const Row& row, T* x) noexcept {
+  for (std::size_t i = m; i-- > 0;) {
+    const T* li = row(i);
+    const T xi = x[i] / li[i];
+    x[i] = xi;
+    for (std::size_t k = 0; k < i; ++k) x[k] -= li[k] * xi;
+  }
+}
+
+// x = U'^-1 x and x = U^-1 x for the upper triangle of rows row(b)
+template <typename T, class Row>
+void trsv_upper_transpose(std::size_t m, const Row& row, T* x) noexcept {
+  for (std::size_t b = 0; b < m; ++b) {
+    const T* ub = row(b);
+    const T xb = x[b] / ub[b];
+    x[b] = xb;
+    for (std::size_t a = b + 1; a < m; ++a) x[a] -= ub[a] * xb;
+  }
+}
+
+template <typename T, class Row>
+void trsv_upper(std::size_t m, const Row& row, T* x) noexcept {
+  for (std::size_t b = m; b-- > 0;) {
+    const T* ub = row(b);
+    x[b] = (x[b] - dot(b + 1, m, ub, x)) / ub[b];
+  }
+}
+
+// The four solves on the m x nc rows of X at ldx, each row an axpy
+template <typename T, class Row>
+void trsm_lower(std::size_t m, const Row& row, T* x, std::size_t nc, std::size_t ldx) noexcept {
+  for (std::size_t i = 0; i < m; ++i) {
+    const T* li = row(i);
+    T* xi = x + i * ldx;
+    for (std::size_t k = 0; k < i; ++k) {
+      const T lik = li[k];
+      const T* xk = x + k * ldx;
+      for (std::size_t c = 0; c < nc; ++c) xi[c] -= lik * xk[c];
+    }
+    const T d = T(1) / li[i];
+    for (std::size_t c = 0; c < nc; ++c) xi[c] *= d;
+  }
+}
+
+template <typename T, class Row>
+void trsm_lower_transpose(std::size_t m, const Row& row, T* x, std::size_t nc,
+                          std::size_t ldx) noexcept {
+  for (std::size_t i = m; i-- > 0;) {
+    const T* li = row(i);
+    T* xi = x + i * ldx;
+    const T d = T(1) / li[i];
+    for (std::size_t c = 0; c < nc; ++c) xi[c] *= d;
+    for (std::size_t k = 0; k < i; ++k) {
+      const T lik = li[k];
+      T* xk = x + k * ldx;
+      for (std::size_t c = 0; c < nc; ++c) xk[c] -= lik * xi[c];
+    }
+  }
+}
+
+template <typename T, class Row>
+void trsm_upper_transpose(std::size_t m, const Row& row, T* x, std::size_t nc,
+                          std::size_t ldx) noexcept {
+  for (std::size_t b = 0; b < m; ++b) {
+    const T* ub = row(b);
+    T* xb = x + b * ldx;
+    const T d = T(1) / ub[b];
+    for (std::size_t c = 0; c < nc; ++c) xb[c] *= d;
+    for (std::size_t a = b + 1; a < m; ++a) {
+      const T uba = ub[a];
+      T* xa = x + a * ldx;
+      for (std::size_t c = 0; c < nc; ++c) xa[c] -= uba * xb[c];
+    }
+  }
+}
+
+template <typename T, class Row>
+void trsm_upper(std::size_t m, const Row& row, T* x, std::size_t nc, std::size_t ldx) noexcept {
+  for (std::size_t b = m; b-- > 0;) {
+    const T* ub = row(b);
+    T* xb = x + b * ldx;
+    for (std::size_t a = b + 1; a < m; ++a) {
+      const T uba = ub[a];
+      const T* xa = x + a * ldx;
+      for (std::size_t c = 0; c < nc; ++c) xb[c] -= uba * xa[c];
+    }
+    const T d = T(1) / ub[b];
+    for (std::size_t c = 0; c < nc; ++c) xb[c] *= d;
+  }
+}
+
+// The rows of the packed triangle, and of the three blocks of the
+// rectangular full packed one
+template <typename T>
+struct PackedRows {
+  T* p;
+  T* operator()(std::size_t i) const noexcept { return p + i * (i + 1) / 2; }
+};
+
+template <typename T>
+struct RfpBlocks {
+  T* p;
+  std::size_t n1, n2, s;
+  explicit RfpBlocks(T* p0, std::size_t n) noexcept : p(p0), n1(n - n / 2), n2(n / 2), s(1 - n % 2) {}
+  // row i of L11, row r of L21, and row b of L22' indexed by column
+  T* l11(std::size_t i) const noexcept { return p + (i + s) * n1; }
+  T* l21(std::size_t r) const noexcept { return p + (n1 + s + r) * n1; }
+  T* u22(std::size_t b) const noexcept { return p + b * n1 + 1 - s; }
+};
+
+}  // namespace packed
+
+// the elements and copy on write of both packed types
+template <typename T, class Layout>
+class PackedStorage {
+ public:
+  typedef T value_t;
+  typedef T* pointer_t;
+  typedef const T* const_pointer_t;
+  typedef std::size_t size_type;
+  typedef Layout layout_t;
+
+  PackedStorage() : buf_(), data_(nullptr), n(0), own_(true) {}
+  explicit PackedStorage(size_type n_) : buf_(n_ * (n_ + 1) / 2), data_(buf_.data()), n(n_), own_(true) {}
+  PackedStorage(const PackedStorage& a) : buf_(a.buf_), data_(buf_.data()), n(a.n), own_(true) {
+    if (buf_.shared()) {
+      own_ = false;
+      a.disown();
+    }
+  }
+  PackedStorage(PackedStorage&& a) : buf_(std::move(a.buf_)), data_(a.data_), n(a.n), own_(a.own_) {
+    a.data_ = nullptr;
+    a.n = 0;
+    a.own_ = true;
+  }
+  PackedStorage& operator=(const PackedStorage& a) {
+    if (this == &a) return *this;
+    buf_ = a.buf_;
+    data_ = buf_.data();
+    n = a.n;
+    own_ = !buf_.shared();
+    if (!own_) a.disown();
+    return *this;
+  }
+  PackedStorage& operator=(PackedStorage&& a) {
+    if (this != &a) {
+      buf_ = std::move(a.buf_);
+      data_ = a.data_;
+      n = a.n;
+      own_ = a.own_;
+      a.data_ = nullptr;
+      a.n = 0;
+      a.own_ = true;
+    }
+    return *this;
+  }
+
+  size_type nrows() const noexcept { return n; }
+  size_type ncols() const noexcept { return n; }
+  size_type size() const noexcept { return n * n; }
+  size_type packed_size() const noexcept { return n * (n + 1) / 2; }
+  size_type bytes() const noexcept { return packed_size() * sizeof(T); }
+
+  // pins the buffer as Matrix::data does, until the next assignment
+  pointer_t data() {
+    detach();
+    buf_.pin();
+    return data_;
+  }
+  const_pointer_t data() const noexcept { return data_; }
+
+  void detach() {
+    if (own_) return;
+    if (buf_.shared()) data_ = buf_.unshare();
+    own_ = true;
+  }
+  bool is_shared() const noexcept { return buf_.shared(); }
+
+ protected:
+  // element i >= j of the lower triangle
+  value_t lower(size_type i, size_type j) const noexcept { return data_[Layout::index(n, i, j)]; }
+  T& lower(size_type i, size_type j) noexcept { return data_[Layout::index(n, i, j)]; }
+
+  // m is square and of the same order, the constructors from a Matrix
+  // come through here as well
+  template <class M, class Op>
+  void update_lower(const M& m, Op op) {
+    assert(m.nrows() == n && m.ncols() == n);
+    detach();
+    for (size_type i = 0; i < n; ++i)
+      for (size_type j = 0; j <= i; ++j) op(lower(i, j), m(i, j));
+  }
+  template <class Op>
+  void update_all(Op op) {
+    detach();
+    for (size_type k = 0; k < packed_size(); ++k) op(data_[k]);
+  }
+
+  void disown() const noexcept {
+    std::atomic_ref<bool>(own_).store(false, std::memory_order_relaxed);
+  }
+
+  CowBuffer<T> buf_;
+  T* data_;
+  size_type n;
+  mutable bool own_;
+};
+
+template <typename T, class Layout = PackedLayout>
+class SymmetricMatrix : public MatrixBase<SymmetricMatrix<T, Layout>, T>,
+                        public PackedStorage<T, Layout> {
+  typedef PackedStorage<T, Layout> base_t;
+  using base_t::n;
+  using base_t::data_;
+
+ public:
+  typedef T value_t;
+  typedef std::size_t size_type;
+  using base_t::nrows;
+  using base_t::ncols;
+  using base_t::size;
+
+  SymmetricMatrix() : base_t() {}
+  explicit SymmetricMatrix(size_type n_) : base_t(n_) {}
+  // the lower triangle of m
+  explicit SymmetricMatrix(const Matrix<T>& m) : base_t(m.nrows()) { *this = m; }
+  template <class xpr_t>
+  explicit SymmetricMatrix(const MatrixXpr<xpr_t>& m) : base_t(m.nrows()) {
+    *this = m;
+  }
+
+  value_t operator()(size_type i, size_type j) const noexcept {
+    return i >= j ? this->lower(i, j) : this->lower(j, i);
+  }
+  T& operator()(size_type i, size_type j) {
+    if (!this->own_) this->detach();
+    return i >= j ? this->lower(i, j) : this->lower(j, i);
+  }
+
+  template <class mat_t>
+  SymmetricMatrix& operator=(const MatrixBase<mat_t, value_t>& m) {
+    this->update_lower(m, [](T& a, value_t b) { a = b; });
+    this->buf_.unpin();
+    return *this;
+  }
+  template <class mat_t>
+  SymmetricMatrix& operator+=(const MatrixBase<mat_t, value_t>& m) {
+    this->update_lower(m, [](T& a, value_t b) { a += b; });
+    return *this;
+  }
+  template <class mat_t>
+  SymmetricMatrix& operator-=(const MatrixBase<mat_t, value_t>& m) {
+    this->update_lower(m, [](T& a, value_t b) { a -= b; });
+    return *this;
+  }
+  template <class xpr_t>
+  SymmetricMatrix& operator=(const MatrixXpr<xpr_t>& m) {
+    this->update_lower(m, [](T& a, value_t b) { a = b; });
+    this->buf_.unpin();
+    return *this;
+  }
+  template <class xpr_t>
+  SymmetricMatrix& operator+=(const MatrixXpr<xpr_t>& m) {
+    this->update_lower(m, [](T& a, value_t b) { a += b; });
+    return *this;
+  }
+  template <class xpr_t>
+  SymmetricMatrix& operator-=(const MatrixXpr<xpr_t>& m) {
+    this->update_lower(m, [](T& a, value_t b) { a -= b; });
+    return *this;
+  }
+  SymmetricMatrix& operator=(value_t x) {
+    this->update_all([x](T& a) { a = x; });
+    this->buf_.unpin();
+    return *this;
+  }
+  SymmetricMatrix& operator*=(value_t x) {
+    this->update_all([x](T& a) { a *= x; });
+    return *this;
+  }
+  SymmetricMatrix& operator/=(value_t x) {
+    const value_t xi = value_t(1) / x;
+    this->update_all([xi](T& a) { a *= xi; });
+    return *this;
+  }
+
+  Matrix<T> full() const {
+    Matrix<T> m(n, n);
+    T* p = m.data();
+    for (size_type i = 0; i < n; ++i)
+      for (size_type j = 0; j <= i; ++j) p[i * n + j] = p[j * n + i] = this->lower(i, j);
+    return m;
+  }
+
+  // y = A x, SYMV. The rows of y are split over threads, each reads what
+  // it needs of the triangle, and y has the same bits on any number.
+  void multiply(const Array<T>& x, Array<T>& y, unsigned nthreads = 1) const {
+    assert(x.size() == n && y.size() == n);
+    const T* px = x.data();
+    T* py = y.data();
+    const unsigned nt = std::max(1u, std::min(threads_for(this->packed_size(), stream_grain, nthreads), unsigned(n)));
+    if constexpr (std::is_same_v<Layout, RfpLayout>) {
+      const packed::RfpBlocks<const T> r(data_, n);
+      const T* x2 = px + r.n1;
+      T* y2 = py + r.n1;
+      run_threads(nt, [&](unsigned t) {
+        const size_type lo1 = t * r.n1 / nt, hi1 = (t + 1) * r.n1 / nt;
+        const size_type lo2 = t * r.n2 / nt, hi2 = (t + 1) * r.n2 / nt;
+        for (size_type i = lo1; i < hi1; ++i) py[i] = T(0);
+        packed::symv_lower(r.n1, [&r](size_type i) { return r.l11(i); }, px, py, lo1, hi1);
+        // L21 x1 fused with L21' x2 on the rows this thread owns
+        for (size_type k = 0; k < r.n2; ++k) {
+          const T* a = r.l21(k);
+          const T xk = x2[k];
+          if (k >= lo2 && k < hi2) {
+            T acc[8] = {};
+            packed::dot_lanes(acc, 0, lo1, a, px);
+            packed::dot_axpy_lanes(acc, lo1, hi1, a, px, py, xk);
+            packed::dot_lanes(acc, hi1, r.n1, a, px);
+            y2[k] = packed::lanes_sum(acc);
+          } else {
+            for (size_type i = lo1; i < hi1; ++i) py[i] += a[i] * xk;
+          }
+        }
+        packed::symv_upper(r.n2, [&r](size_type b) { return r.u22(b); }, x2, y2, lo2, hi2);
+      });
+    } else {
+      const packed::PackedRows<const T> rows{data_};
+      run_threads(nt, [&](unsigned t) {
+        const size_type lo = t * n / nt, hi = (t + 1) * n / nt;
+        for (size_type i = lo; i < hi; ++i) py[i] = T(0);
+        packed::symv_lower(n, rows, px, py, lo, hi);
+      });
+    }
+  }
+};
+
+// Lower triangular, the form of a Cholesky factor
+template <typename T, class Layout = PackedLayout>
+class TriangularMatrix : public MatrixBase<TriangularMatrix<T, Layout>, T>,
+                         public PackedStorage<T, Layout> {
+  typedef PackedStorage<T, Layout> base_t;
+  using base_t::n;
+  using base_t::data_;
+
+ public:
+  typedef T value_t;
+  typedef std::size_t size_type;
+  using base_t::nrows;
+  using base_t::ncols;
+  using base_t::size;
+
+  TriangularMatrix() : base_t() {}
+  explicit TriangularMatrix(size_type n_) : base_t(n_) {}
+  explicit TriangularMatrix(const Matrix<T>& m) : base_t(m.nrows()) { *this = m; }
+  template <class xpr_t>
+  explicit TriangularMatrix(const MatrixXpr<xpr_t>& m) : base_t(m.nrows()) {
+    *this = m;
+  }
+  // takes over the elements of the lower triangle of a, as a Cholesky
+  // factorization in place leaves them
+  explicit TriangularMatrix(SymmetricMatrix<T, Layout>&& a) : base_t(std::move(static_cast<base_t&>(a))) {}
+
+  value_t operator()(size_type i, size_type j) const noexcept {
+    return i >= j ? this->lower(i, j) : value_t(0);
+  }
+  // i >= j only
+  T& operator()(size_type i, size_type j) {
+    assert(i >= j);
+    if (!this->own_) this->detach();
+    return this->lower(i, j);
+  }
+
+  template <class mat_t>
+  TriangularMatrix& operator=(const MatrixBase<mat_t, value_t>& m) {
+    this->update_lower(m, [](T& a, value_t b) { a = b; });
+    this->buf_.unpin();
+    return *this;
+  }
+  template <class xpr_t>
+  TriangularMatrix& operator=(const MatrixXpr<xpr_t>& m) {
+    this->update_lower(m, [](T& a, value_t b) { a = b; });
+    this->buf_.unpin();
+    return *this;
+  }
+  TriangularMatrix& operator*=(value_t x) {
+    this->update_all([x](T& a) { a *= x; });
+    return *this;
+  }
+
+  Matrix<T> full() const {
+    Matrix<T> m(n, n);
+    T* p = m.data();
+    for (size_type i = 0; i < n; ++i)
+      for (size_type j = 0; j < n; ++j) p[i * n + j] = j <= i ? this->lower(i, j) : T(0);
+    return m;
+  }
+
+  // x = L^-1 x, TRSV
+  void solve(Array<T>& x) const {
+    assert(x.size() == n);
+    T* px = x.data();
+    if constexpr (std::is_same_v<Layout, RfpLayout>) {
+      const packed::RfpBlocks<const T> r(data_, n);
+      T* x2 = px + r.n1;
+      packed::trsv_lower(r.n1, [&r](size_type i) { return r.l11(i); }, px);
+      for (size_type k = 0; k < r.n2; ++k) x2[k] -= packed::dot(0, r.n1, r.l21(k), px);
+      packed::trsv_upper_transpose(r.n2, [&r](size_type b) { return r.u22(b); }, x2);
+    } else {
+      packed::trsv_lower(n, packed::PackedRows<const T>{data_}, px);
+    }
+  }
+
+  // x = L'^-1 x
+  void solve_transpose(Array<T>& x) const {
+    assert(x.size() == n);
+    T* px = x.data();
+    if constexpr (std::is_same_v<Layout, RfpLayout>) {
+      const packed::RfpBlocks<const T> r(data_, n);
+      T* x2 = px + r.n1;
+      packed::trsv_upper(r.n2, [&r](size_type b) { return r.u22(b); }, x2);
+      for (size_type k = 0; k < r.n2; ++k) {
+        const T* a = r.l21(k);
+        const T xk = x2[k];
+        for (size_type i = 0; i < r.n1; ++i) px[i] -= a[i] * xk;
+      }
+      packed::trsv_lower_transpose(r.n1, [&r](size_type i) { return r.l11(i); }, px);
+    } else {
+      packed::trsv_lower_transpose(n, packed::PackedRows<const T>{data_}, px);
+    }
+  }
+
+  // X = L^-1 X for the columns of X at once, TRSM. The L21 X1 of the
+  // rectangular layout is a matrix product.
+  void solve(Matrix<T>& x) const {
+    assert(x.nrows() == n);
+    const size_type m = x.ncols();
+    T* px = x.data();
+    if constexpr (std::is_same_v<Layout, RfpLayout>) {
+      const packed::RfpBlocks<const T> r(data_, n);
+      T* x2 = px + r.n1 * m;
+      packed::trsm_lower(r.n1, [&r](size_type i) { return r.l11(i); }, px, m, m);
+      if (r.n2 > 0) gemm<T>(r.n2, m, r.n1, T(-1), r.l21(0), r.n1, px, m, x2, m);
+      packed::trsm_upper_transpose(r.n2, [&r](size_type b) { return r.u22(b); }, x2, m, m);
+    } else {
+      packed::trsm_lower(n, packed::PackedRows<const T>{data_}, px, m, m);
+    }
+  }
+
+  // X = L'^-1 X
+  void solve_transpose(Matrix<T>& x) const {
+    assert(x.nrows() == n);
+    const size_type m = x.ncols();
+    T* px = x.data();
+    if constexpr (std::is_same_v<Layout, RfpLayout>) {
+      const packed::RfpBlocks<const T> r(data_, n);
+      T* x2 = px + r.n1 * m;
+      packed::trsm_upper(r.n2, [&r](size_type b) { return r.u22(b); }, x2, m, m);
+      for (size_type k = 0; k < r.n2; ++k) {
+        const T* a = r.l21(k);
+        const T* xk = x2 + k * m;
+        for (size_type i = 0; i < r.n1; ++i) {
+          const T aik = a[i];
+          T* xi = px + i * m;
+          for (size_type c = 0; c < m; ++c) xi[c] -= aik * xk[c];
+        }
+      }
+      packed::trsm_lower_transpose(r.n1, [&r](size_type i) { return r.l11(i); }, px, m, m);
+    } else {
+      packed::trsm_lower_transpose(n, packed::PackedRows<const T>{data_}, px, m, m);
+    }
+  }
+};
+
+}  // namespace petlib
+#endif
@@ -0,0 +1,558 @@
+#ifndef PETLIB_REDUCE_HPP
+#define PETLIB_REDUCE_HPP
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <petlib_vmath.hpp>
+
+//
+// Sums and dot products for Array.
+//   Fast         eight independent accumulators
+//   Pairwise     pairwise sums down to leaves of 64 terms, the error
+//                grows like log n instead of n
+//   Compensated  Neumaier's variant of Kahan summation in four lanes,
+//                a dot product also collects the rounding error of
+//                every product
+//   Binned       the terms are split on a fixed grid of three bins
+//                (Demmel and Nguyen) and every bin is summed exactly,
+//                so the result does not depend on the order of the
+//                terms at all
+//
+//   The terms are cut in blocks of block_size, every block is reduced
+//   on its own and the block results are combined in a fixed pairwise
+//   order. The result of every mode is the same on any number of
+//   threads. The modes rely on IEEE rounding, do not build them with
+//   -ffast-math.
+//
+namespace petlib {
+
+enum class SumMode { Fast, Pairwise, Compensated, Binned };
+
+namespace reduce {
+
+constexpr std::size_t block_size = 4096;
+
+// the rounding error of the product p = x * y
+template <typename T>
+inline T product_error(T x, T y, T p) noexcept {
+  if constexpr (std::is_same<T, float>::value) {
+    return T(double(x) * double(y) - double(p));
+  } else if constexpr (std::is_same<T, double>::value) {
+    double lo;
+    vmath::two_prod(x, y, lo);
+    return lo;
+  } else if constexpr (std::is_floating_point<T>::value) {
+    return std::fma(x, y, -p);
+  } else {
+    return T(0);
+  }
+}
+
+template <typename T, class A>
+struct SumTerms {
+  static constexpr bool has_error = false;
+  A a;
+  T operator()(std::size_t i) const noexcept { return T(a[i]); }
+  T error(std::size_t, T) const noexcept { return T(0); }
+};
+
+template <typename T, class A, class B>
+struct DotTerms {
+  static constexpr bool has_error = true;
+  A a;
+  B b;
+  T operator()(std::size_t i) const noexcept { return T(a[i]) * T(b[i]); }
+  T error(std::size_t i, T p) const noexcept {
+    return product_error<T>(T(a[i]), T(b[i]), p);
+  }
+};
+
+template <typename T, class F>
+T lanes_sum(const F& f, std::size_t lo, std::size_t n) noexcept {
+  T a0(0), a1(0), a2(0), a3(0), a4(0), a5(0), a6(0), a7(0);
+  std::size_t i = lo;
+  const std::size_t hi = lo + n;
+  for (; i + 8 <= hi; i += 8) {
+    a0 += f(i);
+    a1 += f(i + 1);
+    a2 += f(i + 2);
+    a3 += f(i + 3);
+    a4 += f(i + 4);
+    a5 += f(i + 5);
+    a6 += f(i + 6);
+    a7 += f(i + 7);
+  }
+  for (; i < hi; ++i) a0 += f(i);
+  return ((a0 + a1) + (a2 + a3)) + ((a4 + a5) + (a6 + a7));
+}
+
+template <typename T, class F>
+T pairwise_sum(const F& f, std::size_t lo, std::size_t n) noexcept {
+  if (n <= 64) return lanes_sum<T>(f, lo, n);
+  // split on a multiple of 8 so the leaves keep full lanes
+  const std::size_t h = (n / 16) * 8;
+  return pairwise_sum<T>(f, lo, h) + pairwise_sum<T>(f, lo + h, n - h);
+}
+
+// s + c, c collects the rounding errors of the additions into s. Knuth's
+// two sum has no compare, the lanes pipeline without branches.
+template <typename T>
+struct Compensated {
+  T s, c;
+
+  void add(T x, T e) noexcept {
+    const T t = s + x;
+    const T b = t - s;
+    c += ((s - (t - b)) + (x - b)) + e;
+    s = t;
+  }
+  void merge(const Compensated& b) noexcept { add(b.s, b.c); }
+  T value() const noexcept { return s + c; }
+};
+
+template <typename T, class F>
+Compensated<T> compensated_sum(const F& f, std::size_t lo,
+                               std::size_t n) noexcept {
+  Compensated<T> a0{T(0), T(0)}, a1{T(0), T(0)}, a2{T(0), T(0)},
+      a3{T(0), T(0)};
+  auto put = [&f](Compensated<T>& a, std::size_t i) {
+    const T x = f(i);
+    a.add(x, f.error(i, x));
+  };
+  std::size_t i = lo;
+  const std::size_t hi = lo + n;
+  for (; i + 4 <= hi; i += 4) {
+    put(a0, i);
+    put(a1, i + 1);
+    put(a2, i + 2);
+    put(a3, i + 3);
+  }
+  for (; i < hi; ++i) put(a0, i);
+  a0.merge(a1);
+  a2.merge(a3);
+  a0.merge(a2);
+  return a0;
+}
+
+//
+// Binned sums. With m = 1.5 2^E and |r| < 2^(E-1), q = (m + r) - m is
+// r rounded to a multiple of 2^(E-p+1), p the precision, exactly. Any
+// n such q sum exactly as long as n |r| < 2^(E-1), and r - q goes on
+// to the next bin, W = p - 2 - log2 n bits lower. The grid depends
+// only on max |term| and the number of terms. float terms are binned
+// in double.
+//
+template <typename T>
+struct Binned {
+  typedef typename std::conditional<std::is_same<T, float>::value, double,
+                                    T>::type acc_t;
+  // binned_sum spells the three bins out
+  static constexpr int nbins = 3;
+  acc_t m[nbins];
+  acc_t s[nbins];
+  acc_t scale;
+  int shift;
+
+  Binned() noexcept : scale(1), shift(0) {
+    for (int k = 0; k < nbins; ++k) m[k] = s[k] = acc_t(0);
+  }
+
+  Binned(T amax, std::size_t nterms) noexcept : scale(1), shift(0) {
+    typedef std::numeric_limits<acc_t> lim;
+    int lgn = 0;
+    while ((std::size_t(1) << lgn) < nterms) ++lgn;
+    int e = (amax > T(0) ? std::ilogb(acc_t(amax)) : lim::min_exponent) + 2 + lgn;
+    // keep 1.5 2^E finite, the terms are scaled down by a power of 2
+    if (e > lim::max_exponent - 2) {
+      shift = e - (lim::max_exponent - 2);
+      e -= shift;
+      scale = std::ldexp(acc_t(1), -shift);
+    }
+    const int w = lim::digits - 2 - lgn;
+    for (int k = 0; k < nbins; ++k) {
+      const int ek = std::max(e - k * w, lim::min_exponent - 1);
+      m[k] = std::ldexp(acc_t(1.5), ek);
+      s[k] = acc_t(0);
+    }
+  }
+
+  void add(T x) noexcept {
+    acc_t r = acc_t(x) * scale;
+    for (int k = 0; k < nbins; ++k) {
+      const acc_t q = (m[k] + r) - m[k];
+      s[k] += q;
+      r -= q;
+    }
+  }
+  void merge(const Binned& b) noexcept {
+    for (int k = 0; k < nbins; ++k) s[k] += b.s[k];
+  }
+  T value() const noexcept {
+    acc_t v = s[nbins - 1];
+    for (int k = nbins - 2; k >= 0; --k) v += s[k];
+    return T(std::ldexp(v, shift));
+  }
+};
+
+template <typename T, class F>
+Binned<T> binned_sum(const Binned<T>& grid, const F& f, std::size_t lo,
+                     std::size_t n) noexcept {
+  typedef typename Binned<T>::acc_t acc_t;
+  const acc_t m0 = grid.m[0], m1 = grid.m[1], m2 = grid.m[2];
+  const acc_t sc = grid.scale;
+  // two lanes per bin
+  acc_t s0 = 0, s1 = 0, s2 = 0, t0 = 0, t1 = 0, t2 = 0;
+  auto put = [&](acc_t& b0, acc_t& b1, acc_t& b2, T x) {
+    acc_t r = acc_t(x) * sc;
+    acc_t q = (m0 + r) - m0;
+    b0 += q;
+    r -= q;
+    q = (m1 + r) - m1;
+    b1 += q;
+    r -= q;
+    b2 += (m2 + r) - m2;
+  };
+  auto term = [&](acc_t& b0, acc_t& b1, acc_t& b2, std::size_t i) {
+    const T x = f(i);
+    put(b0, b1, b2, x);
+    if constexpr (F::has_error) put(b0, b1, b2, f.error(i, x));
+  };
+  std::size_t i = lo;
+  const std::size_t hi = lo + n;
+  for (; i + 2 <= hi; i += 2) {
+    term(s0, s1, s2, i);
+    term(t0, t1, t2, i + 1);
+  }
+  if (i < hi) term(s0, s1, s2, i);
+  Binned<T> acc(grid);
+  acc.s[0] = s0 + t0;
+  acc.s[1] = s1 + t1;
+  acc.s[2] = s2 + t2;
+  return acc;
+}
+
+//
+// max |term|. For double the magnitudes are compared as integers, which
+// orders them the same way and compiles to conditional moves; a nan
+// comes out larger than inf.
+//
+template <typename T, class F>
+T max_abs(const F& f, std::size_t lo, std::size_t n) noexcept {
+  if constexpr (std::is_same<T, double>::value) {
+    const std::uint64_t mask = ~(std::uint64_t(1) << 63);
+    std::uint64_t a0 = 0, a1 = 0;
+    auto put = [&](std::uint64_t& a, std::size_t i) {
+      const T x = f(i);
+      std::uint64_t u = vmath::as_bits(x) & mask;
+      a = u > a ? u : a;
+      if constexpr (F::has_error) {
+        u = vmath::as_bits(f.error(i, x)) & mask;
+        a = u > a ? u : a;
+      }
+    };
+    std::size_t i = lo;
+    const std::size_t hi = lo + n;
+    for (; i + 2 <= hi; i += 2) {
+      put(a0, i);
+      put(a1, i + 1);
+    }
+    if (i < hi) put(a0, i);
+    return vmath::from_bits(a0 > a1 ? a0 : a1);
+  } else {
+    T a(0);
+    for (std::size_t i = lo; i < lo + n; ++i) {
+      const T x = f(i);
+      const T ax = std::abs(x);
+      a = ax > a ? ax : a;
+      if constexpr (F::has_error) {
+        const T ae = std::abs(f.error(i, x));
+        a = ae > a ? ae : a;
+      }
+      a = x != x ? x : a;
+    }
+    return a;
+  }
+}
+
+//
+// Block results combined as the leaves of a binary tree, the same tree
+// for one thread or many. merge(a, b) folds b into a.
+//
+template <class Part_t, class Block_t, class Merge_t>
+Part_t blocked(std::size_t n, unsigned nthreads, const Block_t& block,
+               const Merge_t& merge) {
+  const std::size_t nb = (n + block_size - 1) / block_size;
+  auto run = [&](std::size_t b) {
+    const std::size_t lo = b * block_size;
+    return block(lo, std::min(block_size, n - lo));
+  };
+  std::vector<Part_t> parts;
+  if (nthreads > 1 && nb > 1) {
+    parts.resize(nb);
+    const std::size_t nt = std::min<std::size_t>(nthreads, nb);
+    std::vector<std::thread> pool;
+    for (std::size_t t = 0; t < nt; ++t) {
+      pool.emplace_back([&, t]() {
+        for (std::size_t b = t * nb / nt; b < (t + 1) * nb / nt; ++b)
+          parts[b] = run(b);
+      });
+    }
+    for (auto& th : pool) th.join();
+  }
+  // a stack of subtrees, two of the same height are merged at once
+  std::pair<Part_t, int> stack[64];
+  int top = 0;
+  for (std::size_t b = 0; b < nb; ++b) {
+    Part_t p = parts.empty() ? run(b) : parts[b];
+    int h = 0;
+    while (top > 0 && stack[top - 1].second == h) {
+      merge(stack[top - 1].first, p);
+      p = stack[--top].first;
+      ++h;
+    }
+    stack[top++] = std::make_pair(p, h);
+  }
+  if (top == 0) return block(0, 0);
+  Part_t r = stack[--top].first;
+  while (top > 0) {
+    merge(stack[top - 1].first, r);
+    r = stack[--top].first;
+  }
+  return r;
+}
+
+template <typename T, class F>
+T reduce(const F& f, std::size_t n, SumMode mode, unsigned nthreads) {
+  auto add = [](T& a, const T& b) { a += b; };
+  // integer sums are exact, they take the fast path
+  if constexpr (std::is_floating_point<T>::value) {
+    if (mode == SumMode::Compensated) {
+      return blocked<Compensated<T> >(
+                 n, nthreads,
+                 [&](std::size_t lo, std::size_t m) {
+                   return compensated_sum<T>(f, lo, m);
+                 },
+                 [](Compensated<T>& a, const Compensated<T>& b) {
+                   a.merge(b);
+                 })
+          .value();
+    }
+    if (mode == SumMode::Binned) {
+      const T amax = blocked<T>(
+          n, nthreads,
+          [&](std::size_t lo, std::size_t m) { return max_abs<T>(f, lo, m); },
+          [](T& a, const T& b) { a = b > a ? b : a; });
+      // inf and nan come out the same in any order
+      if (std::isfinite(amax)) {
+        const Binned<T> grid(amax, F::has_error ? 2 * n : n);
+        return blocked<Binned<T> >(
+                   n, nthreads,
+                   [&](std::size_t lo, std::size_t m) {
+                     return binned_sum<T>(grid, f, lo, m);
+                   },
+                   [](Binned<T>& a, const Binned<T>& b) { a.merge(b); })
+            .value();
+      }
+    }
+  }
+  if (mode == SumMode::Pairwise) {
+    return blocked<T>(n, nthreads,
+                      [&](std::size_t lo, std::size_t m) {
+                        return pairwise_sum<T>(f, lo, m);
+                      },
+                      add);
+  }
+  return blocked<T>(n, nthreads,
+                    [&](std::size_t lo, std::size_t m) {
+                      return lanes_sum<T>(f, lo, m);
+                    },
+                    add);
+}
+
+template <typename T>
+T sum(const T* x, std::size_t n, SumMode mode = SumMode::Fast,
+      unsigned nthreads = 1) {
+  return reduce<T>(SumTerms<T, const T*>{x}, n, mode, nthreads);
+}
+
+template <typename T>
+T dot(const T* x, const T* y, std::size_t n, SumMode mode = SumMode::Fast,
+      unsigned nthreads = 1) {
+  return reduce<T>(DotTerms<T, const T*, const T*>{x, y}, n, mode, nthreads);
+}
+
+}  // namespace reduce
+
+//
+// Several statistics in one sweep. The wanted ones are a mask of Stat
+// bits, only their code is compiled into the loop. amin and amax are
+// the elements of smallest and largest magnitude, as Array::amin and
+// Array::amax, and ties go to the first index as with max_element.
+//
+struct Stat {
+  static constexpr unsigned min = 1u;
+  static constexpr unsigned max = 2u;
+  static constexpr unsigned amin = 4u;
+  static constexpr unsigned amax = 8u;
+  static constexpr unsigned index_min = 16u;
+  static constexpr unsigned index_max = 32u;
+  static constexpr unsigned index_amin = 64u;
+  static constexpr unsigned index_amax = 128u;
+  static constexpr unsigned sum = 256u;
+  static constexpr unsigned norm = 512u;
+  static constexpr unsigned all = 1023u;
+};
+
+template <typename T>
+struct Stats {
+  static constexpr std::size_t npos = std::size_t(-1);
+  std::size_t count = 0;
+  T min = T(0), max = T(0), amin = T(0), amax = T(0);
+  std::size_t index_min = npos, index_max = npos;
+  std::size_t index_amin = npos, index_amax = npos;
+  T sum = T(0), sumsq = T(0);
+  // |amin| and |amax|
+  T abs_min = T(0), abs_max = T(0);
+
+  T norm() const noexcept { return std::sqrt(sumsq); }
+  T mean() const noexcept { return count ? sum / T(count) : T(0); }
+};
+
+namespace reduce {
+
+template <unsigned What, typename T>
+inline void stats_first(Stats<T>& s, T x, std::size_t i) noexcept {
+  s.count = 1;
+  s.min = s.max = s.amin = s.amax = x;
+  s.abs_min = s.abs_max = x < T(0) ? T(-x) : x;
+  s.index_min = s.index_max = s.index_amin = s.index_amax = i;
+  if constexpr ((What & Stat::sum) != 0) s.sum = x;
+  if constexpr ((What & Stat::norm) != 0) s.sumsq = x * x;
+}
+
+template <unsigned What, typename T>
+inline void stats_step(Stats<T>& s, T x, std::size_t i) noexcept {
+  constexpr bool want_min = (What & (Stat::min | Stat::index_min)) != 0;
+  constexpr bool want_max = (What & (Stat::max | Stat::index_max)) != 0;
+  constexpr bool want_amin = (What & (Stat::amin | Stat::index_amin)) != 0;
+  constexpr bool want_amax = (What & (Stat::amax | Stat::index_amax)) != 0;
+  // selects rather than branches, the data decides nothing
+  ++s.count;
+  if constexpr (want_min) {
+    const bool c = x < s.min;
+    s.min = c ? x : s.min;
+    if constexpr ((What & Stat::index_min) != 0) s.index_min = c ? i : s.index_min;
+  }
+  if constexpr (want_max) {
+    const bool c = x > s.max;
+    s.max = c ? x : s.max;
+    if constexpr ((What & Stat::index_max) != 0) s.index_max = c ? i : s.index_max;
+  }
+  if constexpr (want_amin || want_amax) {
+    const T ax = x < T(0) ? T(-x) : x;
+    if constexpr (want_amin) {
+      const bool c = ax < s.abs_min;
+      s.abs_min = c ? ax : s.abs_min;
+      s.amin = c ? x : s.amin;
+      if constexpr ((What & Stat::index_amin) != 0) s.index_amin = c ? i : s.index_amin;
+    }
+    if constexpr (want_amax) {
+      const bool c = ax > s.abs_max;
+      s.abs_max = c ? ax : s.abs_max;
+      s.amax = c ? x : s.amax;
+      if constexpr ((What & Stat::index_amax) != 0) s.index_amax = c ? i : s.index_amax;
+    }
+  }
+  if constexpr ((What & Stat::sum) != 0) s.sum += x;
+  if constexpr ((What & Stat::norm) != 0) s.sumsq += x * x;
+}
+
+// fold b into a, b holds later or interleaved indices, ties go to the
+// smaller index
+template <unsigned What, typename T>
+inline void stats_merge(Stats<T>& a, const Stats<T>& b) noexcept {
+  if (b.count == 0) return;
+  if (a.count == 0) {
+    a = b;
+    return;
+  }
+  a.count += b.count;
+  if (b.min < a.min || (b.min == a.min && b.index_min < a.index_min)) {
+    a.min = b.min;
+    a.index_min = b.index_min;
+  }
+  if (b.max > a.max || (b.max == a.max && b.index_max < a.index_max)) {
+    a.max = b.max;
+    a.index_max = b.index_max;
+  }
+  if (b.abs_min < a.abs_min ||
+      (b.abs_min == a.abs_min && b.index_amin < a.index_amin)) {
+    a.abs_min = b.abs_min;
+    a.amin = b.amin;
+    a.index_amin = b.index_amin;
+  }
+  if (b.abs_max > a.abs_max ||
+      (b.abs_max == a.abs_max && b.index_amax < a.index_amax)) {
+    a.abs_max = b.abs_max;
+    a.amax = b.amax;
+    a.index_amax = b.index_amax;
+  }
+  a.sum += b.sum;
+  a.sumsq += b.sumsq;
+}
+
+// four interleaved lanes, lane j starts on the element lo + j
+template <unsigned What, typename T, class F>
+Stats<T> stats_block(const F& f, std::size_t lo, std::size_t n) noexcept {
+  Stats<T> s0, s1, s2, s3;
+  std::size_t i = lo;
+  const std::size_t hi = lo + n;
+  if (n >= 4) {
+    stats_first<What>(s0, T(f(i)), i);
+    stats_first<What>(s1, T(f(i + 1)), i + 1);
+    stats_first<What>(s2, T(f(i + 2)), i + 2);
+    stats_first<What>(s3, T(f(i + 3)), i + 3);
+    for (i += 4; i + 4 <= hi; i += 4) {
+      stats_step<What>(s0, T(f(i)), i);
+      stats_step<What>(s1, T(f(i + 1)), i + 1);
+      stats_step<What>(s2, T(f(i + 2)), i + 2);
+      stats_step<What>(s3, T(f(i + 3)), i + 3);
+    }
+  }
+  for (; i < hi; ++i) {
+    if (s0.count == 0)
+      stats_first<What>(s0, T(f(i)), i);
+    else
+      stats_step<What>(s0, T(f(i)), i);
+  }
+  stats_merge<What>(s0, s1);
+  stats_merge<What>(s2, s3);
+  stats_merge<What>(s0, s2);
+  return s0;
+}
+
+// all the statistics of What over f(0) ... f(n-1) in one sweep
+template <unsigned What, typename T, class F>
+Stats<T> reduce_many(const F& f, std::size_t n, unsigned nthreads = 1) {
+  return blocked<Stats<T> >(
+      n, nthreads,
+      [&](std::size_t lo, std::size_t m) {
+        return stats_block<What, T>(f, lo, m);
+      },
+      [](Stats<T>& a, const Stats<T>& b) { stats_merge<What>(a, b); });
+}
+
+template <unsigned What, typename T>
+Stats<T> stats(const T* x, std::size_t n, unsigned nthreads = 1) {
+  return reduce_many<What, T>(SumTerms<T, const T*>{x}, n, nthreads);
+}
+
+}  // namespace reduce
+}  // namespace petlib
+#endif
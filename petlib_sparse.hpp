@@ -0,0 +1,550 @@
+#ifndef PETLIB_SPARSE_HPP
+#define PETLIB_SPARSE_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <petlib_array.hpp>
+#include <petlib_matrix.hpp>
+#include <petlib_threads.hpp>
+
+//
+// Sparse matrices in compressed row (CSR), compressed column (CSC) and
+// block compressed row (BSR) form, built from coordinate triplets.
+//
+// Products with a vector write into a petlib Array, products with a dense
+// row major Matrix into a Matrix. The rows are split over threads by their
+// number of nonzeros, each thread writes its own rows, so y = A x has the
+// same bits on any number of threads. The inner loops are plain loops over
+// contiguous values and column indices, gathers on x, that the compiler
+// vectorizes where its tuning allows. The product with the transpose
+// scatters, every thread adds into its own copy of y and the copies are
+// summed in a fixed order.
+//
+// The column index type is a template parameter, 32 bit indices take a
+// third less memory traffic than 64 bit ones for double values.
+//
+namespace petlib {
+
+namespace sparse {
+
+// first row of part t of nt when rows are split by their share of ptr
+inline std::size_t split_rows(const std::size_t* ptr, std::size_t nrows,
+                              unsigned t, unsigned nt) noexcept {
+  if (t == 0) return 0;
+  if (t == nt) return nrows;
+  const std::size_t target = ptr[nrows] / nt * t + ptr[nrows] % nt * t / nt;
+  return std::size_t(std::lower_bound(ptr, ptr + nrows + 1, target) - ptr);
+}
+
+}  // namespace sparse
+
+//
+// entries (row, col, value) in any order, repeated positions are summed
+// when compressed
+//
+template <typename T, typename I = int>
+struct CooMatrix {
+  typedef T value_t;
+  typedef I index_t;
+
+  std::size_t nrows, ncols;
+  std::vector<I> row, col;
+  std::vector<T> val;
+
+  CooMatrix(std::size_t n1, std::size_t n2) : nrows(n1), ncols(n2) {}
+
+  void add(std::size_t i, std::size_t j, const T& v) {
+    assert(i < nrows && j < ncols);
+    row.push_back(I(i));
+    col.push_back(I(j));
+    val.push_back(v);
+  }
+  void reserve(std::size_t nz) {
+    row.reserve(nz);
+    col.reserve(nz);
+    val.reserve(nz);
+  }
+  std::size_t nnz() const noexcept { return val.size(); }
+};
+
+template <typename T, typename I = int>
+class CsrMatrix {
+ public:
+  typedef T value_t;
+  typedef I index_t;
+  typedef std::size_t size_type;
+
+  CsrMatrix() : n1(0), n2(0), ptr_(1, 0) {}
+
+  CsrMatrix(size_type nrows, size_type ncols, std::vector<size_type> ptr,
+            std::vector<I> col, std::vector<T> val)
+      : n1(nrows), n2(ncols), ptr_(std::move(ptr)), col_(std::move(col)),
+        val_(std::move(val)) {
+    assert(ptr_.size() == n1 + 1 && col_.size() == ptr_[n1] &&
+           val_.size() == ptr_[n1]);
+  }
+
+  // counting sort of the triplets on their row, each thread counting and
+  // placing its own share, then the rows sorted on their columns and
+  // repeated entries summed
+  explicit CsrMatrix(const CooMatrix<T, I>& a, unsigned nthreads = 1)
+      : n1(a.nrows), n2(a.ncols), ptr_(a.nrows + 1, 0) {
+    const size_type nz = a.nnz();
+    const unsigned nt = threads_for(nz, stream_grain, nthreads);
+    std::vector<size_type> cnt(size_type(nt) * n1, 0);
+    run_threads(nt, [&](unsigned t) {
+      size_type* c = cnt.data() + size_type(t) * n1;
+      for (size_type k = t * nz / nt; k < (t + 1) * nz / nt; ++k) ++c[a.row[k]];
+    });
+    // cnt becomes the place of the first entry of each row and thread
+    size_type off = 0;
+    for (size_type i = 0; i < n1; ++i) {
+      ptr_[i] = off;
+      for (unsigned t = 0; t < nt; ++t) {
+        const size_type c = cnt[t * n1 + i];
+        cnt[t * n1 + i] = off;
+        off += c;
+      }
+    }
+    ptr_[n1] = off;
+    std::vector<I> col(nz);
+    std::vector<T> val(nz);
+    run_threads(nt, [&](unsigned t) {
+      size_type* c = cnt.data() + size_type(t) * n1;
+      for (size_type k = t * nz / nt; k < (t + 1) * nz / nt; ++k) {
+        const size_type j = c[a.row[k]]++;
+        col[j] = a.col[k];
+        val[j] = a.val[k];
+      }
+    });
+    // sort and sum up each row in place, then close the gaps
+    std::vector<size_type> len(n1);
+    run_threads(nt, [&](unsigned t) {
+      std::vector<std::pair<I, T> > e;
+      for (size_type i = t * n1 / nt; i < (t + 1) * n1 / nt; ++i) {
+        const size_type lo = ptr_[i], hi = ptr_[i + 1];
+        e.clear();
+        for (size_type k = lo; k < hi; ++k) e.emplace_back(col[k], val[k]);
+        std::stable_sort(e.begin(), e.end(),
+                         [](const std::pair<I, T>& x, const std::pair<I, T>& y) {
+                           return x.first < y.first;
+                         });
+        size_type m = lo;
+        for (size_type k = 0; k < e.size(); ++k) {
+          if (m > lo && col[m - 1] == e[k].first) {
+            val[m - 1] += e[k].second;
+          } else {
+            col[m] = e[k].first;
+            val[m++] = e[k].second;
+          }
+        }
+        len[i] = m - lo;
+      }
+    });
+    std::vector<size_type> ptr(n1 + 1, 0);
+    for (size_type i = 0; i < n1; ++i) ptr[i + 1] = ptr[i] + len[i];
+    col_.resize(ptr[n1]);
+    val_.resize(ptr[n1]);
+    run_threads(nt, [&](unsigned t) {
+      for (size_type i = t * n1 / nt; i < (t + 1) * n1 / nt; ++i) {
+        std::copy(col.begin() + ptr_[i], col.begin() + ptr_[i] + len[i],
+                  col_.begin() + ptr[i]);
+        std::copy(val.begin() + ptr_[i], val.begin() + ptr_[i] + len[i],
+                  val_.begin() + ptr[i]);
+      }
+    });
+    ptr_.swap(ptr);
+  }
+
+  size_type nrows() const noexcept { return n1; }
+  size_type ncols() const noexcept { return n2; }
+  size_type nnz() const noexcept { return val_.size(); }
+  const size_type* row_ptr() const noexcept { return ptr_.data(); }
+  const I* col_index() const noexcept { return col_.data(); }
+  const T* values() const noexcept { return val_.data(); }
+  T* values() noexcept { return val_.data(); }
+
+  // the entry at (i, j), zero if it is not stored
+  T operator()(size_type i, size_type j) const noexcept {
+    const I* lo = col_.data() + ptr_[i];
+    const I* hi = col_.data() + ptr_[i + 1];
+    const I* p = std::lower_bound(lo, hi, I(j));
+    return (p != hi && *p == I(j)) ? val_[p - col_.data()] : T(0);
+  }
+
+  // bytes that one product with a vector has to stream at the least
+  size_type bytes() const noexcept {
+    return nnz() * (sizeof(T) + sizeof(I)) + (n1 + 1) * sizeof(size_type) +
+           (n1 + n2) * sizeof(T);
+  }
+
+  // y = A x
+  void multiply(const Array<T>& x, Array<T>& y, unsigned nthreads = 1) const {
+    assert(x.size() == n2 && y.size() == n1);
+    const T* px = x.data();
+    T* py = y.data();
+    const unsigned nt = threads_for(nnz(), stream_grain, nthreads);
+    run_threads(nt, [&](unsigned t) {
+      multiply_rows(px, py, sparse::split_rows(ptr_.data(), n1, t, nt),
+                    sparse::split_rows(ptr_.data(), n1, t + 1, nt));
+    });
+  }
+
+  // Y = A X with X of ncols rows
+  void multiply(const Matrix<T>& x, Matrix<T>& y, unsigned nthreads = 1) const {
+    assert(x.nrows() == n2 && y.nrows() == n1 && y.ncols() == x.ncols());
+    const size_type m = x.ncols();
+    const T* px = x.data();
+    T* py = y.data();
+    const unsigned nt = threads_for(nnz() * m, stream_grain, nthreads);
+    run_threads(nt, [&](unsigned t) {
+      const size_type lo = sparse::split_rows(ptr_.data(), n1, t, nt);
+      const size_type hi = sparse::split_rows(ptr_.data(), n1, t + 1, nt);
+      for (size_type i = lo; i < hi; ++i) {
+        T* yi = py + i * m;
+        for (size_type j = 0; j < m; ++j) yi[j] = T(0);
+        for (size_type k = ptr_[i]; k < ptr_[i + 1]; ++k) {
+          const T a = val_[k];
+          const T* xk = px + size_type(col_[k]) * m;
+          for (size_type j = 0; j < m; ++j) yi[j] += a * xk[j];
+        }
+      }
+    });
+  }
+
+  // y = A' x
+  void multiply_transpose(const Array<T>& x, Array<T>& y,
+                          unsigned nthreads = 1) const {
+    assert(x.size() == n1 && y.size() == n2);
+    const T* px = x.data();
+    T* py = y.data();
+    const unsigned nt = threads_for(nnz(), stream_grain, nthreads);
+    if (nt == 1) {
+      for (size_type j = 0; j < n2; ++j) py[j] = T(0);
+      scatter_rows(px, py, 0, n1);
+      return;
+    }
+    std::vector<T> part(size_type(nt - 1) * n2, T(0));
+    run_threads(nt, [&](unsigned t) {
+      T* yt = t == 0 ? py : part.data() + size_type(t - 1) * n2;
+      if (t == 0)
+        for (size_type j = 0; j < n2; ++j) yt[j] = T(0);
+      scatter_rows(px, yt, sparse::split_rows(ptr_.data(), n1, t, nt),
+                   sparse::split_rows(ptr_.data(), n1, t + 1, nt));
+    });
+    run_threads(nt, [&](unsigned t) {
+      for (size_type j = t * n2 / nt; j < (t + 1) * n2 / nt; ++j)
+        for (unsigned s = 1; s < nt; ++s) py[j] += part[(s - 1) * n2 + j];
+    });
+  }
+
+  // A' as a matrix of its own, the columns come out sorted
+  CsrMatrix transpose() const {
+    std::vector<size_type> ptr(n2 + 1, 0);
+    for (size_type k = 0; k < nnz(); ++k) ++ptr[size_type(col_[k]) + 1];
+    for (size_type j = 0; j < n2; ++j) ptr[j + 1] += ptr[j];
+    std::vector<size_type> next(ptr.begin(), ptr.end() - 1);
+    std::vector<I> col(nnz());
+    std::vector<T> val(nnz());
+    for (size_type i = 0; i < n1; ++i) {
+      for (size_type k = ptr_[i]; k < ptr_[i + 1]; ++k) {
+        const size_type p = next[col_[k]]++;
+        col[p] = I(i);
+        val[p] = val_[k];
+      }
+    }
+    return CsrMatrix(n2, n1, std::move(ptr), std::move(col), std::move(val));
+  }
+
+ private:
+  size_type n1, n2;
+  std::vector<size_type> ptr_;
+  std::vector<I> col_;
+  std::vector<T> val_;
+
+  void multiply_rows(const T* x, T* y, size_type lo, size_type hi) const noexcept {
+    const size_type* ptr = ptr_.data();
+    const I* col = col_.data();
+    const T* val = val_.data();
+    for (size_type i = lo; i < hi; ++i) {
+      T s = T(0);
+      for (size_type k = ptr[i]; k < ptr[i + 1]; ++k) s += val[k] * x[col[k]];
+      y[i] = s;
+    }
+  }
+
+  void scatter_rows(const T* x, T* y, size_type lo, size_type hi) const noexcept {
+    const size_type* ptr = ptr_.data();
+    const I* col = col_.data();
+    const T* val = val_.data();
+    for (size_type i = lo; i < hi; ++i) {
+      const T xi = x[i];
+      for (size_type k = ptr[i]; k < ptr[i + 1]; ++k) y[col[k]] += val[k] * xi;
+    }
+  }
+};
+
+//
+// compressed columns, kept as the CSR form of the transpose
+//
+template <typename T, typename I = int>
+class CscMatrix {
+ public:
+  typedef T value_t;
+  typedef I index_t;
+  typedef std::size_t size_type;
+
+  explicit CscMatrix(const CooMatrix<T, I>& a, unsigned nthreads = 1)
+      : t_(transposed(a), nthreads) {}
+  explicit CscMatrix(const CsrMatrix<T, I>& a) : t_(a.transpose()) {}
+
+  size_type nrows() const noexcept { return t_.ncols(); }
+  size_type ncols() const noexcept { return t_.nrows(); }
+  size_type nnz() const noexcept { return t_.nnz(); }
+  const size_type* col_ptr() const noexcept { return t_.row_ptr(); }
+  const I* row_index() const noexcept { return t_.col_index(); }
+  const T* values() const noexcept { return t_.values(); }
+  T operator()(size_type i, size_type j) const noexcept { return t_(j, i); }
+  size_type bytes() const noexcept { return t_.bytes(); }
+
+  // y = A x scatters down the columns
+  void multiply(const Array<T>& x, Array<T>& y, unsigned nthreads = 1) const {
+    t_.multiply_transpose(x, y, nthreads);
+  }
+  // y = A' x gathers, one dot product per column
+  void multiply_transpose(const Array<T>& x, Array<T>& y,
+                          unsigned nthreads = 1) const {
+    t_.multiply(x, y, nthreads);
+  }
+  CsrMatrix<T, I> to_csr() const { return t_.transpose(); }
+
+ private:
+  CsrMatrix<T, I> t_;
+
+  static CooMatrix<T, I> transposed(const CooMatrix<T, I>& a) {
+    CooMatrix<T, I> b(a.ncols, a.nrows);
+    b.row = a.col;
+    b.col = a.row;
+    b.val = a.val;
+    return b;
+  }
+};
+
+//
+// dense B x B blocks in compressed block rows, the blocks are row major.
+// The block size is fixed at compile time so the block products unroll,
+// nrows and ncols have to be multiples of it.
+//
+template <typename T, int B, typename I = int>
+class BsrMatrix {
+ public:
+  typedef T value_t;
+  typedef I index_t;
+  typedef std::size_t size_type;
+  static constexpr size_type bs = size_type(B);
+  static constexpr size_type bsq = size_type(B) * size_type(B);
+
+  explicit BsrMatrix(const CooMatrix<T, I>& a, unsigned nthreads = 1)
+      : BsrMatrix(CsrMatrix<T, I>(a, nthreads), nthreads) {}
+
+  // the block columns of a block row are the columns of its B rows
+  // divided by B, collected with a marker array per thread
+  explicit BsrMatrix(const CsrMatrix<T, I>& a, unsigned nthreads = 1)
+      : n1(a.nrows() / bs), n2(a.ncols() / bs), ptr_(a.nrows() / bs + 1, 0) {
+    if (a.nrows() % bs != 0 || a.ncols() % bs != 0) {
+      std::cerr << "BsrMatrix " << a.nrows() << " x " << a.ncols()
+                << " is not made of " << B << " x " << B << " blocks\n";
+      exit(EXIT_FAILURE);
+    }
+    const size_type* rp = a.row_ptr();
+    const I* ci = a.col_index();
+    const T* v = a.values();
+    const unsigned nt = threads_for(a.nnz(), stream_grain, nthreads);
+    std::vector<std::vector<I> > rows(n1);
+    run_threads(nt, [&](unsigned t) {
+      std::vector<char> mark(n2, 0);
+      for (size_type ib = t * n1 / nt; ib < (t + 1) * n1 / nt; ++ib) {
+        std::vector<I>& r = rows[ib];
+        for (size_type k = rp[ib * bs]; k < rp[ib * bs + bs]; ++k) {
+          const size_type jb = size_type(ci[k]) / bs;
+          if (!mark[jb]) {
+            mark[jb] = 1;
+            r.push_back(I(jb));
+          }
+        }
+        for (I jb : r) mark[jb] = 0;
+        std::sort(r.begin(), r.end());
+      }
+    });
+    for (size_type ib = 0; ib < n1; ++ib) ptr_[ib + 1] = ptr_[ib] + rows[ib].size();
+    col_.resize(ptr_[n1]);
+    val_.assign(ptr_[n1] * bsq, T(0));
+    run_threads(nt, [&](unsigned t) {
+      for (size_type ib = t * n1 / nt; ib < (t + 1) * n1 / nt; ++ib) {
+        const std::vector<I>& r = rows[ib];
+        std::copy(r.begin(), r.end(), col_.begin() + ptr_[ib]);
+        for (size_type ii = 0; ii < bs; ++ii) {
+          const size_type i = ib * bs + ii;
+          for (size_type k = rp[i]; k < rp[i + 1]; ++k) {
+            const size_type jb = size_type(ci[k]) / bs;
+            const size_type p = ptr_[ib] + size_type(
+                std::lower_bound(r.begin(), r.end(), I(jb)) - r.begin());
+            val_[p * bsq + ii * bs + size_type(ci[k]) % bs] = v[k];
+          }
+        }
+      }
+    });
+  }
+
+  size_type nrows() const noexcept { return n1 * bs; }
+  size_type ncols() const noexcept { return n2 * bs; }
+  size_type nblocks() const noexcept { return col_.size(); }
+  // the stored entries, zeros inside the blocks included
+  size_type nnz() const noexcept { return val_.size(); }
+  const size_type* row_ptr() const noexcept { return ptr_.data(); }
+  const I* col_index() const noexcept { return col_.data(); }
+  const T* values() const noexcept { return val_.data(); }
+
+  T operator()(size_type i, size_type j) const noexcept {
+    const I* lo = col_.data() + ptr_[i / bs];
+    const I* hi = col_.data() + ptr_[i / bs + 1];
+    const I* p = std::lower_bound(lo, hi, I(j / bs));
+    if (p == hi || *p != I(j / bs)) return T(0);
+    return val_[size_type(p - col_.data()) * bsq + (i % bs) * bs + j % bs];
+  }
+
+  size_type bytes() const noexcept {
+    return nnz() * sizeof(T) + nblocks() * sizeof(I) +
+           (n1 + 1) * sizeof(size_type) + (n1 + n2) * bs * sizeof(T);
+  }
+
+  // y = A x
+  void multiply(const Array<T>& x, Array<T>& y, unsigned nthreads = 1) const {
+    assert(x.size() == ncols() && y.size() == nrows());
+    const T* px = x.data();
+    T* py = y.data();
+    const unsigned nt = threads_for(nnz(), stream_grain, nthreads);
+    run_threads(nt, [&](unsigned t) {
+      const size_type lo = sparse::split_rows(ptr_.data(), n1, t, nt);
+      const size_type hi = sparse::split_rows(ptr_.data(), n1, t + 1, nt);
+      for (size_type ib = lo; ib < hi; ++ib) {
+        T s[B];
+        for (size_type ii = 0; ii < bs; ++ii) s[ii] = T(0);
+        for (size_type k = ptr_[ib]; k < ptr_[ib + 1]; ++k) {
+          const T* a = val_.data() + k * bsq;
+          const T* xk = px + size_type(col_[k]) * bs;
+          for (size_type ii = 0; ii < bs; ++ii)
+            for (size_type jj = 0; jj < bs; ++jj) s[ii] += a[ii * bs + jj] * xk[jj];
+        }
+        for (size_type ii = 0; ii < bs; ++ii) py[ib * bs + ii] = s[ii];
+      }
+    });
+  }
+
+  // Y = A X with X of ncols rows
+  void multiply(const Matrix<T>& x, Matrix<T>& y, unsigned nthreads = 1) const {
+    assert(x.nrows() == ncols() && y.nrows() == nrows() && y.ncols() == x.ncols());
+    const size_type m = x.ncols();
+    const T* px = x.data();
+    T* py = y.data();
+    const unsigned nt = threads_for(nnz() * m, stream_grain, nthreads);
+    run_threads(nt, [&](unsigned t) {
+      const size_type lo = sparse::split_rows(ptr_.data(), n1, t, nt);
+      const size_type hi = sparse::split_rows(ptr_.data(), n1, t + 1, nt);
+      for (size_type ib = lo; ib < hi; ++ib) {
+        T* yb = py + ib * bs * m;
+        for (size_type j = 0; j < bs * m; ++j) yb[j] = T(0);
+        for (size_type k = ptr_[ib]; k < ptr_[ib + 1]; ++k) {
+          const T* a = val_.data() + k * bsq;
+          const T* xb = px + size_type(col_[k]) * bs * m;
+          for (size_type ii = 0; ii < bs; ++ii)
+            for (size_type jj = 0; jj < bs; ++jj) {
+              const T aij = a[ii * bs + jj];
+              for (size_type j = 0; j < m; ++j) yb[ii * m + j] += aij * xb[jj * m + j];
+            }
+        }
+      }
+    });
+  }
+
+  // y = A' x
+  void multiply_transpose(const Array<T>& x, Array<T>& y,
+                          unsigned nthreads = 1) const {
+    assert(x.size() == nrows() && y.size() == ncols());
+    const T* px = x.data();
+    T* py = y.data();
+    const size_type n = ncols();
+    const unsigned nt = threads_for(nnz(), stream_grain, nthreads);
+    std::vector<T> part(size_type(nt - 1) * n, T(0));
+    run_threads(nt, [&](unsigned t) {
+      T* yt = t == 0 ? py : part.data() + size_type(t - 1) * n;
+      if (t == 0)
+        for (size_type j = 0; j < n; ++j) yt[j] = T(0);
+      const size_type lo = sparse::split_rows(ptr_.data(), n1, t, nt);
+      const size_type hi = sparse::split_rows(ptr_.data(), n1, t + 1, nt);
+      for (size_type ib = lo; ib < hi; ++ib) {
+        const T* xb = px + ib * bs;
+        for (size_type k = ptr_[ib]; k < ptr_[ib + 1]; ++k) {
+          const T* a = val_.data() + k * bsq;
+          T* yk = yt + size_type(col_[k]) * bs;
+          for (size_type ii = 0; ii < bs; ++ii)
+            for (size_type jj = 0; jj < bs; ++jj) yk[jj] += a[ii * bs + jj] * xb[ii];
+        }
+      }
+    });
+    if (nt > 1) {
+      run_threads(nt, [&](unsigned t) {
+        for (size_type j = t * n / nt; j < (t + 1) * n / nt; ++j)
+          for (unsigned s = 1; s < nt; ++s) py[j] += part[(s - 1) * n + j];
+      });
+    }
+  }
+
+ private:
+  size_type n1, n2;
+  std::vector<size_type> ptr_;
+  std::vector<I> col_;
+  std::vector<T> val_;
+};
+
+//
+// the finite difference Laplacian with Dirichlet boundaries on an
+// nx x ny x nz grid, the 5 point stencil when nz is 1, x runs fastest.
+// With dof > 1 every grid point carries dof coupled unknowns, a dense
+// dof x dof block at each stencil point, for the block formats.
+//
+template <typename T, typename I = int>
+CooMatrix<T, I> poisson(std::size_t nx, std::size_t ny, std::size_t nz = 1,
+                        std::size_t dof = 1) {
+  const std::size_t np = nx * ny * nz, n = np * dof;
+  CooMatrix<T, I> a(n, n);
+  a.reserve(np * (nz > 1 ? 7 : 5) * dof * dof);
+  auto block = [&](std::size_t p, std::size_t q, T diag) {
+    for (std::size_t r = 0; r < dof; ++r)
+      for (std::size_t c = 0; c < dof; ++c)
+        a.add(p * dof + r, q * dof + c,
+              r == c ? diag : diag / T(4 * (1 + r + c)));
+  };
+  const T centre = T(nz > 1 ? 6 : 4);
+  for (std::size_t k = 0; k < nz; ++k)
+    for (std::size_t j = 0; j < ny; ++j)
+      for (std::size_t i = 0; i < nx; ++i) {
+        const std::size_t p = (k * ny + j) * nx + i;
+        if (k > 0) block(p, p - nx * ny, T(-1));
+        if (j > 0) block(p, p - nx, T(-1));
+        if (i > 0) block(p, p - 1, T(-1));
+        block(p, p, centre);
+        if (i + 1 < nx) block(p, p + 1, T(-1));
+        if (j + 1 < ny) block(p, p + nx, T(-1));
+        if (k + 1 < nz) block(p, p + nx * ny, T(-1));
+      }
+  return a;
+}
+
+}  // namespace petlib
+#endif
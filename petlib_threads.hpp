@@ -0,0 +1,47 @@
+#ifndef PETLIB_THREADS_HPP
+#define PETLIB_THREADS_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+//
+// Fork join over a few threads for the kernels that split their work.
+//
+// Starting and joining a thread costs some tens of microseconds, so a
+// kernel takes one more thread only for every grain units of its work.
+// What a unit costs depends on the kernel: a value streamed through memory
+// once, a nonzero of a sparse product or an element of a band, takes about
+// a nanosecond, a multiply add of a dense kernel working out of registers
+// and cache a small fraction of that. The callers count their work in one
+// of the two units and pass the grain that goes with it.
+//
+namespace petlib {
+
+// values streamed through memory worth a thread
+constexpr std::size_t stream_grain = 32768;
+// multiply adds of a dense kernel worth a thread
+constexpr std::size_t flop_grain = 262144;
+
+// f(t) on threads t = 0 ... nt - 1, t = 0 runs on the caller
+template <class F>
+void run_threads(unsigned nt, const F& f) {
+  if (nt <= 1) {
+    f(0u);
+    return;
+  }
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < nt; ++t) pool.emplace_back(f, t);
+  f(0u);
+  for (auto& th : pool) th.join();
+}
+
+// threads for work units at one per grain, at least one, at most nthreads
+inline unsigned threads_for(std::size_t work, std::size_t grain, unsigned nthreads) noexcept {
+  const std::size_t most = work / grain + 1;
+  return unsigned(std::min<std::size_t>(nthreads == 0 ? 1 : nthreads, most));
+}
+
+}  // namespace petlib
+#endif
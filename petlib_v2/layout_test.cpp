@@ -0,0 +1,224 @@
+#include <chrono>
+#include <iostream>
+#include <petlib.hpp>
+
+using petlib::MultiArrayOrder;
+typedef std::array<std::size_t,3> index3;
+
+double elapsed(const std::chrono::steady_clock::time_point& ts)
+{
+   std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+   return d.count();
+}
+
+// every flat index is hit once and maps back to its indices
+template < MultiArrayOrder order >
+bool check_indexer(const petlib::Indexer<order>& idx) {
+   std::size_t n = idx.TotalExtent();
+   std::vector<int> hit(n,0);
+   bool ok = true;
+   index3 i,j;
+   for (i[0]=0;i[0]<idx.Extent(0);++i[0])
+      for (i[1]=0;i[1]<idx.Extent(1);++i[1])
+         for (i[2]=0;i[2]<idx.Extent(2);++i[2]) {
+            std::size_t f = idx.IndicesToFlatIndex(i);
+            if (f >= n) return false;
+            ++hit[f];
+            idx.FlatIndexToIndices(f,j);
+            ok = ok && i == j;
+         }
+   for (std::size_t f=0;f<n;++f) ok = ok && hit[f] == 1;
+   return ok;
+}
+
+bool check() {
+   bool ok = true;
+   petlib::Indexer<MultiArrayOrder::Tiled> ti({ 10, 7, 13 },4);
+   ok = ok && check_indexer(ti) && ti.NumberOfBricks() == 3*2*4;
+   petlib::Indexer<MultiArrayOrder::Morton> mi({ 8, 4, 16 });
+   ok = ok && check_indexer(mi);
+   ok = ok && mi.IndicesToFlatIndex({ 0, 0, 1 }) == 1 && mi.IndicesToFlatIndex({ 0, 1, 0 }) == 2
+      && mi.IndicesToFlatIndex({ 1, 0, 0 }) == 4;
+   // neighbour steps only touch the bits of their axis, and wrap
+   for (std::size_t k=0;k<3;++k) {
+      index3 i = { 5, 3, 9 };
+      index3 ip = i,im = i;
+      ip[k] = (i[k]+1) % mi.Extent(k);
+      im[k] = (i[k]+mi.Extent(k)-1) % mi.Extent(k);
+      std::size_t f = mi.IndicesToFlatIndex(i);
+      ok = ok && mi.Next(f,k) == mi.IndicesToFlatIndex(ip) && mi.Prev(f,k) == mi.IndicesToFlatIndex(im);
+   }
+   {
+      // round trip through every layout
+      petlib::Tensor<double,3> a(10,7,13);
+      petlib::RandomFill< double*, double >(a.data(),a.size());
+      petlib::Tensor<double,3,MultiArrayOrder::Tiled> t(petlib::Indexer<MultiArrayOrder::Tiled>({ 10, 7, 13 },4));
+      t = a;
+      ok = ok && t(9,6,12) == a(9,6,12) && t(3,5,1) == a(3,5,1) && t.Sum() == t.Sum();
+      petlib::Tensor<double,3,MultiArrayOrder::Fortran> f(t);
+      petlib::Tensor<double,3> b(f);
+      bool same = true;
+      for (std::size_t i=0;i<a.size();++i) same = same && a[i] == b[i];
+      ok = ok && same && f(10,7,13) == a(9,6,12);
+      petlib::Tensor<double,3,MultiArrayOrder::Tiled> u(t);
+      u += t;
+      ok = ok && u(4,4,4) == 2.0 * a(4,4,4);
+      // the indexed walk follows storage
+      std::size_t next = 0;
+      t.ForEachIndexed([&](const index3& i,double& x) {
+         ok = ok && &x == t.data() + next++ && x == a(i);
+      });
+      ok = ok && next == a.size();
+      petlib::Tensor<double,3,MultiArrayOrder::Morton> m(8,4,16);
+      next = 0;
+      m.ForEachIndexed([&](const index3& i,double& x) {
+         ok = ok && &x == m.data() + next++ && mi.IndicesToFlatIndex(i) == next-1;
+         x = double(i[0]*100 + i[1]*10 + i[2]);
+      });
+      petlib::Tensor<double,3,MultiArrayOrder::ColMajor> c(m);
+      ok = ok && c(7,3,15) == 745.0 && m(7,3,15) == 745.0;
+   }
+   return ok;
+}
+
+//
+// out = sum of the six neighbours - 6 u over the interior points.
+// The neighbours are always added in the same order so every layout
+// gives bit identical results.
+//
+inline double stencil(double c,double xm,double xp,double ym,double yp,double zm,double zp) {
+   return ((((xm + xp) + ym) + yp) + zm) + zp - 6.0 * c;
+}
+
+// strided layouts, the loops follow the memory order of the tensor
+template < MultiArrayOrder order >
+void stencil_strided(const petlib::Tensor<double,3,order>& u, petlib::Tensor<double,3,order>& out) {
+   const auto ax = u.View().MemoryOrder();
+   const std::size_t n = u.Extent(0);
+   const std::size_t s0 = u.Stride(0),s1 = u.Stride(1),s2 = u.Stride(2);
+   const std::size_t sa = u.Stride(ax[2]),sb = u.Stride(ax[1]),sc = u.Stride(ax[0]);
+   const double* up = u.data();
+   double* op = out.data();
+   for (std::size_t a=1;a<n-1;++a)
+      for (std::size_t b=1;b<n-1;++b) {
+         std::size_t f = a*sa + b*sb + sc;
+         for (std::size_t c=1;c<n-1;++c,f+=sc)
+            op[f] = stencil(up[f],up[f-s0],up[f+s0],up[f-s1],up[f+s1],up[f-s2],up[f+s2]);
+      }
+}
+
+// brick by brick. A row along the last axis is contiguous in its brick
+// and in the bricks across the i and j faces, so each row needs at most
+// four neighbour rows; the bricks across the k faces are the ones just
+// before and after in storage.
+void stencil_tiled(const petlib::Tensor<double,3,MultiArrayOrder::Tiled>& u,
+                   petlib::Tensor<double,3,MultiArrayOrder::Tiled>& out) {
+   const std::size_t n = u.Extent(0);
+   const auto& idx = u.GetIndexer();
+   const double* u0 = u.data();
+   double* o0 = out.data();
+   u.ForEachBrick([&](const std::size_t* lo,const std::size_t* ext,const double* p) {
+      const std::size_t e0 = ext[0],e1 = ext[1],e2 = ext[2];
+      const std::size_t bs0 = e1*e2,bs1 = e2;
+      const std::size_t tm = lo[2] ? idx.BrickSize():0;
+      const std::size_t tp = lo[2]+e2 < n ? idx.BrickExtent(2,lo[2]+e2):0;
+      const double* pm = p - e0*e1*tm;
+      const double* pp = p + e0*e1*e2;
+      const std::size_t ib = lo[0] ? 0:1,ie = lo[0]+e0 == n ? e0-1:e0;
+      const std::size_t jb = lo[1] ? 0:1,je = lo[1]+e1 == n ? e1-1:e1;
+      const std::size_t kb = lo[2] ? 0:1,ke = lo[2]+e2 == n ? e2-1:e2;
+      double* q = o0 + (p - u0);
+      for (std::size_t i=ib;i<ie;++i)
+         for (std::size_t j=jb;j<je;++j) {
+            const std::size_t g0 = lo[0]+i,g1 = lo[1]+j;
+            const double* row = p + i*bs0 + j*bs1;
+            const double* xm = i > 0 ? row-bs0:u0+idx.IndicesToFlatIndex({ g0-1, g1, lo[2] });
+            const double* xp = i+1 < e0 ? row+bs0:u0+idx.IndicesToFlatIndex({ g0+1, g1, lo[2] });
+            const double* ym = j > 0 ? row-bs1:u0+idx.IndicesToFlatIndex({ g0, g1-1, lo[2] });
+            const double* yp = j+1 < e1 ? row+bs1:u0+idx.IndicesToFlatIndex({ g0, g1+1, lo[2] });
+            const double zl = tm ? pm[(i*e1 + j)*tm + tm-1]:0.0;
+            const double zr = tp ? pp[(i*e1 + j)*tp]:0.0;
+            double* qrow = q + i*bs0 + j*bs1;
+            if (kb == 0 && ke > 0) qrow[0] = stencil(row[0],xm[0],xp[0],ym[0],yp[0],zl,e2 > 1 ? row[1]:zr);
+            for (std::size_t k=1;k<e2-1;++k)
+               qrow[k] = stencil(row[k],xm[k],xp[k],ym[k],yp[k],row[k-1],row[k+1]);
+            if (ke == e2 && e2 > 1) qrow[e2-1] = stencil(row[e2-1],xm[e2-1],xp[e2-1],ym[e2-1],yp[e2-1],row[e2-2],zr);
+         }
+   });
+}
+
+// Z order, one dilated table lookup per index and neighbours by
+// stepping the bits of one axis
+void stencil_morton(const petlib::Tensor<double,3,MultiArrayOrder::Morton>& u,
+                    petlib::Tensor<double,3,MultiArrayOrder::Morton>& out) {
+   const std::size_t n = u.Extent(0);
+   const auto& idx = u.GetIndexer();
+   const double* up = u.data();
+   double* op = out.data();
+   for (std::size_t i=1;i<n-1;++i)
+      for (std::size_t j=1;j<n-1;++j) {
+         const std::size_t fij = idx.Dilated(0,i) | idx.Dilated(1,j);
+         for (std::size_t k=1;k<n-1;++k) {
+            const std::size_t f = fij | idx.Dilated(2,k);
+            op[f] = stencil(up[f],up[idx.Prev(f,0)],up[idx.Next(f,0)],up[idx.Prev(f,1)],
+                            up[idx.Next(f,1)],up[idx.Prev(f,2)],up[idx.Next(f,2)]);
+         }
+      }
+}
+
+template < MultiArrayOrder order, class F >
+double run(const petlib::Tensor<double,3>& u0, const petlib::Tensor<double,3,order>& proto,
+           int nrep, F kernel, petlib::Tensor<double,3>& res) {
+   petlib::Tensor<double,3,order> u(proto),out(proto);
+   u = u0;
+   out = 0.0;
+   auto ts = std::chrono::steady_clock::now();
+   for (int r=0;r<nrep;++r) kernel(u,out);
+   double tm = elapsed(ts);
+   res = out;
+   return tm;
+}
+
+int main() {
+   bool ok = check();
+   {
+      // bricks of 4 on 13 points leave clipped bricks one point thick
+      petlib::Tensor<double,3> u(13,13,13),ref(13,13,13),res(13,13,13);
+      petlib::RandomFill< double*, double >(u.data(),u.size());
+      run(u,u,1,stencil_strided<MultiArrayOrder::RowMajor>,ref);
+      petlib::Tensor<double,3,MultiArrayOrder::Tiled> pt(petlib::Indexer<MultiArrayOrder::Tiled>({ 13, 13, 13 },4));
+      run(u,pt,1,stencil_tiled,res);
+      for (std::size_t i=0;i<ref.size();++i) ok = ok && ref[i] == res[i];
+   }
+   const std::size_t n = 128;
+   const int nrep = 10;
+   petlib::Tensor<double,3> u(n,n,n);
+   petlib::RandomFill< double*, double >(u.data(),u.size());
+   petlib::Tensor<double,3> ref(n,n,n),res(n,n,n);
+   std::cout << nrep << " sweeps of a 7 point stencil on a " << n << "^3 grid, seconds\n";
+   std::cout << "  RowMajor " << run(u,u,nrep,stencil_strided<MultiArrayOrder::RowMajor>,ref) << "\n";
+   auto same = [&]() {
+      bool s = true;
+      for (std::size_t i=0;i<ref.size();++i) s = s && ref[i] == res[i];
+      return s;
+   };
+   petlib::Tensor<double,3,MultiArrayOrder::ColMajor> pc(n,n,n);
+   std::cout << "  ColMajor " << run(u,pc,nrep,stencil_strided<MultiArrayOrder::ColMajor>,res) << "\n";
+   ok = ok && same();
+   petlib::Tensor<double,3,MultiArrayOrder::Fortran> pf(n,n,n);
+   std::cout << "  Fortran  " << run(u,pf,nrep,stencil_strided<MultiArrayOrder::Fortran>,res) << "\n";
+   ok = ok && same();
+   petlib::Tensor<double,3,MultiArrayOrder::IDE> pi(n,n,n);
+   std::cout << "  IDE      " << run(u,pi,nrep,stencil_strided<MultiArrayOrder::IDE>,res) << "\n";
+   ok = ok && same();
+   for (std::size_t b : { 8, 16, 32 }) {
+      petlib::Tensor<double,3,MultiArrayOrder::Tiled> pt(petlib::Indexer<MultiArrayOrder::Tiled>({ n, n, n },b));
+      std::cout << "  Tiled " << b << (b < 10 ? "  ":" ") << run(u,pt,nrep,stencil_tiled,res) << "\n";
+      ok = ok && same();
+   }
+   petlib::Tensor<double,3,MultiArrayOrder::Morton> pm(n,n,n);
+   std::cout << "  Morton   " << run(u,pm,nrep,stencil_morton,res) << "\n";
+   ok = ok && same();
+   std::cout << (ok ? "layout test passed\n" : "layout test FAILED\n");
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
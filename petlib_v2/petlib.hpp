@@ -5,3 +5,5 @@
 #include <petlib_array_expr.hpp>
 #include <petlib_array.hpp>
 #include <petlib_array_random.hpp>
+#include <petlib_indexer.hpp>
+#include <petlib_tensor.hpp>
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <iomanip>
 #include <cmath>
+#include <type_traits>
 
 namespace petlib {
 
@@ -60,6 +61,18 @@ PETLIB_EXPR_OP(Pos,+)
 #undef PETLIB_EXPR_OP
 
 
+//
+// Storage layout of an operand. Expressions pair elements by flat
+// index, so both sides of a binary expression need the same layout.
+// void, the default, is flat storage and goes with any layout.
+//
+template < class A > struct ExprLayout { typedef void type; };
+
+template < class A, class B >
+inline constexpr bool SameExprLayout = std::is_void_v< typename ExprLayout<A>::type > ||
+    std::is_void_v< typename ExprLayout<B>::type > ||
+    std::is_same_v< typename ExprLayout<A>::type, typename ExprLayout<B>::type >;
+
 template < typename Tp, class Array_t > 
 struct ArrayRef {
     typedef std::size_t size_type;
@@ -132,6 +145,8 @@ struct ArrayBinExpr {
     Arg1 a;
     Arg2 b;
     
+    static_assert(SameExprLayout< Arg1, Arg2 >,"operands have different storage layouts");
+
     ArrayBinExpr(const Arg1& a0,const Arg2& b0) noexcept:a(a0),b(b0) {}
     size_type size() const noexcept { return a.size();}
     return_type operator[](size_type i) const noexcept {
@@ -152,6 +167,14 @@ struct ArrayUnExpr {
     }
 };
 
+template < typename Tp, class A > struct ExprLayout< ArrayRef< Tp, A > >: ExprLayout< A > {};
+template < typename Tp, class X > struct ExprLayout< ArrayExpr< Tp, X > >: ExprLayout< X > {};
+template < class Op_t, class A > struct ExprLayout< ArrayUnExpr< Op_t, A > >: ExprLayout< A > {};
+template < class Op_t, class A, class B > struct ExprLayout< ArrayBinExpr< Op_t, A, B > > {
+    typedef std::conditional_t< std::is_void_v< typename ExprLayout<A>::type >,
+        typename ExprLayout<B>::type, typename ExprLayout<A>::type > type;
+};
+
 #define PETLIB_EXPR_OP(OP,SYM)\
 template < typename T, class A, class B > \
 inline  ArrayExpr< T, \
@@ -1,224 +1,448 @@
-
-
+#ifndef PETLIB_INDEXER_HPP
+#define PETLIB_INDEXER_HPP
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <initializer_list>
+#include <iostream>
+#include <vector>
 
 namespace petlib {
 
+//
+// RowMajor  - last index fastest, zero based
+// ColMajor  - first index fastest, zero based
+// Fortran   - first index fastest, indices start at 1
+// IDE       - last index fastest, indices start at 1
+// Tiled     - row major bricks of row major elements, zero based
+// Morton    - Z order, index bits interleaved, zero based
+//
 enum class MultiArrayOrder: std::uint8_t {
     RowMajor=0,
     ColMajor=1,
     Fortran=2,
-    IDE=3
+    IDE=3,
+    Tiled=4,
+    Morton=5
 };
 
+template < MultiArrayOrder order > struct OrderTraits;
 
-template < enum petlib::MultiArrayOrder > 
-class Indexer
+template <> struct OrderTraits< MultiArrayOrder::RowMajor > {
+    static constexpr bool last_fastest = true;
+    static constexpr std::size_t base = 0;
+    static constexpr bool strided = true;
+};
+template <> struct OrderTraits< MultiArrayOrder::ColMajor > {
+    static constexpr bool last_fastest = false;
+    static constexpr std::size_t base = 0;
+    static constexpr bool strided = true;
+};
+template <> struct OrderTraits< MultiArrayOrder::Fortran > {
+    static constexpr bool last_fastest = false;
+    static constexpr std::size_t base = 1;
+    static constexpr bool strided = true;
+};
+template <> struct OrderTraits< MultiArrayOrder::IDE > {
+    static constexpr bool last_fastest = true;
+    static constexpr std::size_t base = 1;
+    static constexpr bool strided = true;
+};
+template <> struct OrderTraits< MultiArrayOrder::Tiled > {
+    static constexpr bool last_fastest = true;
+    static constexpr std::size_t base = 0;
+    static constexpr bool strided = false;
+};
+template <> struct OrderTraits< MultiArrayOrder::Morton > {
+    static constexpr bool last_fastest = true;
+    static constexpr std::size_t base = 0;
+    static constexpr bool strided = false;
+};
+
+//
+// Maps up to five indices to a flat offset and back. The strides
+// are computed once by the constructors, unused dimensions have
+// extent 1 and stride 0 so the flat index sums stay branch free.
+//
+template < MultiArrayOrder order >
+class Indexer {
 public:
-{   typedef std::size_t size_type;
+    typedef std::size_t size_type;
+    static constexpr size_type max_dims = 5;
+    static constexpr size_type base = OrderTraits< order >::base;
 
-    Indexer( const std::initializer_list<size_type>& ilist) noexcept {
-        ndim = ilist.size();
-        tsize = 1;
-        for (auto i=0;i<ndim;++i) {
-            dims[i] = ilist[i];
-            tsize *= ilist[i];
-        }
-        SetStrides();
+    Indexer() noexcept:ndim(0),tsize(0),dims{},strs{} {}
+
+    Indexer( std::initializer_list<size_type> ilist) noexcept {
+        SetDims(ilist.size(),ilist.begin());
     }
-    template < size_type nd >
+    template < std::size_t nd >
     Indexer( const std::array<size_type, nd>& dims_in) noexcept {
-        ndim = nd;
-        tsize = 1;
-        for (auto i=0;i<nd;++i) {
-            dims[i] = dims_in[i];
-            tsize *= dims_in[i];
-        }    
-        SetStrides();
+        static_assert(nd <= max_dims,"Indexer supports at most 5 dimensions");
+        SetDims(nd,dims_in.data());
     }
-    Indexer( std::size_t ndims_in, const size_type * dims_in) {
-        ndim = ndims_in;
-        tsize = 1;
-        for (auto i=0;i<nd;++i) {
-            dims[i] = dims_in[i];
-            tsize *= dims_in[i];
-        }        
-        SetStrides();
+    Indexer( size_type ndims_in, const size_type * dims_in) noexcept {
+        SetDims(ndims_in,dims_in);
     }
-    Indexer( const std::vector<size_type>& dims_in) {
-        ndim = dims_in.size();
-        tsize = 1;
-        for (auto i=0;i<nd;++i) {
-            dims[i] = dims_in[i];
-            tsize *= dims_in[i];
-        }        
-        SetStrides();
+    Indexer( const std::vector<size_type>& dims_in) noexcept {
+        SetDims(dims_in.size(),dims_in.data());
     }
-    
+
     constexpr size_type IndicesToFlatIndex( const size_type* ind ) const noexcept {
-        std::size_t f= ind[0]*strs[0] + ind[1]*strs[1] + ind[2]*strs[2] + ind[3]*strs[3]  + ind[4] * strs[4] + ind[5] * sts[5];
+        size_type f = 0;
+        for (size_type k=0;k<ndim;++k) f += (ind[k]-base)*strs[k];
         return f;
     }
-    constexpr size_type IndicesToFlatIndex( const std::array<size_type,5>& ind) const noexcept {
-        std::size_t f= ind[0]*strs[0] + ind[1]*strs[1] + ind[2]*strs[2] + ind[3]*strs[3]  + ind[4] * strs[4] + ind[5] * sts[5];
-        return f;    
-    }
-    constexpr size_type IndicesToFlatIndex( const std::vector<size_type>& ind ) const noexcept {
-        std::size_t f= ind[0]*strs[0] + ind[1]*strs[1] + ind[2]*strs[2] + ind[3]*strs[3]  + ind[4] * strs[4] + ind[5] * sts[5];
-        return f;        
-    }
-    constexpr size_type IndicesToFlatIndex( const std::initializer_list<size_type>& ind) const noexcept {
-        std::size_t f= ind[0]*strs[0] + ind[1]*strs[1] + ind[2]*strs[2] + ind[3]*strs[3]  + ind[4] * strs[4] + ind[5] * sts[5];
-        return f;        
-    }
-    void FlatIndexToIndices( size_type flatIndex,size_type* ind ) const noexcept ;
-    void FlatIndexToIndices( size_type flatIndex,std::array<size_type,5>& ind) const noexcept;  
-    void FlatIndexToIndices( size_type flatIndex,std::vector<size_type>& ind ) const noexcept;
-    
-    size_type NumberOfDimensions() const noexcept { return ndim;}
-    size_type MaxDimensions() const noexcept { return 5;}
-    size_type Extent( size_type i ) const noexcept { return dims[i];}
-    size_type TotalExtent() const noexcept { return tsize;}
-    std::array<size_type,5> GetExtents() const noexcept {
-        return to_array(dims);
-    }
-private:        
-    void SetStrides() noexcept;    
-    size_type ndim,tsize;
-    std::array< size_t, 5 > dims;
-    std::array< size_t, 5 > strs;
-};
+    template < std::size_t nd >
+    constexpr size_type IndicesToFlatIndex( const std::array<size_type,nd>& ind) const noexcept {
+        size_type f = 0;
+        for (size_type k=0;k<nd;++k) f += (ind[k]-base)*strs[k];
+        return f;
+    }
+    size_type IndicesToFlatIndex( const std::vector<size_type>& ind ) const noexcept {
+        return IndicesToFlatIndex(ind.data());
+    }
+    constexpr size_type IndicesToFlatIndex( std::initializer_list<size_type> ind) const noexcept {
+        return IndicesToFlatIndex(ind.begin());
+    }
+
+    constexpr void FlatIndexToIndices( size_type flat_index, size_type* ind ) const noexcept {
+        for (size_type i=0;i<ndim;++i) {
+            const size_type k = OrderTraits< order >::last_fastest ? ndim-1-i:i;
+            ind[k] = flat_index % dims[k] + base;
+            flat_index /= dims[k];
+        }
+    }
+    template < std::size_t nd >
+    constexpr void FlatIndexToIndices( size_type flat_index, std::array<size_type,nd>& ind) const noexcept {
+        FlatIndexToIndices(flat_index,ind.data());
+    }
+    void FlatIndexToIndices( size_type flat_index, std::vector<size_type>& ind ) const noexcept {
+        ind.resize(ndim);
+        FlatIndexToIndices(flat_index,ind.data());
+    }
 
+    constexpr size_type NumberOfDimensions() const noexcept { return ndim;}
+    constexpr size_type MaxDimensions() const noexcept { return max_dims;}
+    constexpr size_type Extent( size_type i ) const noexcept { return dims[i];}
+    constexpr size_type Stride( size_type i ) const noexcept { return strs[i];}
+    constexpr size_type TotalExtent() const noexcept { return tsize;}
+    constexpr std::array<size_type,max_dims> GetExtents() const noexcept { return dims;}
+    constexpr std::array<size_type,max_dims> GetStrides() const noexcept { return strs;}
 
-constexpr void Indexer< MultiArrayOrder::RowMajor>::SetStrides() noexcept {
-    std::size_type st = 1;
-    for (std::size_t i=0;i<ndim;++i) {
-        std::size_t k=ndim-1-i;
-        strs[k] = st;
-        st *= dims[k];
+    constexpr bool operator==(const Indexer& x) const noexcept {
+        return ndim == x.ndim && dims == x.dims;
     }
-    tsize = st;
-}
+    constexpr bool operator!=(const Indexer& x) const noexcept { return !(*this == x);}
 
-constexpr void Indexer< MultiArrayOrder::ColMajor>::SetStrides() noexcept {
-    std::size_type st = 1;
-    for (std::size_t k=0;k<ndim;++k) {
-        strs[k] = st;
-        st *= dims[k];
+private:
+    void SetDims( size_type nd, const size_type* dims_in) noexcept {
+        if (nd > max_dims) nd = max_dims;
+        ndim = nd;
+        for (size_type k=0;k<max_dims;++k) {
+            dims[k] = (k < nd) ? dims_in[k]:1;
+            strs[k] = 0;
+        }
+        SetStrides();
     }
-    tsize = st;
-}
 
-constexpr void Indexer< MultiArrayOrder::Fortran >::SetStrides() noexcept {
-    std::size_type st = 1;
-    for (std::size_t k=0;k<ndim;++k) {
-        strs[k] = st;
-        st *= dims[k];
+    void SetStrides() noexcept {
+        size_type st = 1;
+        for (size_type i=0;i<ndim;++i) {
+            const size_type k = OrderTraits< order >::last_fastest ? ndim-1-i:i;
+            strs[k] = st;
+            st *= dims[k];
+        }
+        tsize = st;
     }
-    tsize = st;
-}
 
-constexpr void Indexer< MultiArrayOrder::IDE >::SetStrides() noexcept {
-    std::size_type st = 1;
-    for (std::size_t i=0;i<ndim;++i) {
-        std::size_t k = ndim-1-i;
-        strs[k] = st;
-        st *= dims[k];
+    size_type ndim,tsize;
+    std::array< size_type, max_dims > dims;
+    std::array< size_type, max_dims > strs;
+};
+
+//
+// Bricks of edge BrickSize() (a power of 2), bricks in row major
+// order and the elements of a brick row major. Bricks on the high
+// faces are clipped to the extents, so storage is exactly the
+// product of the extents and no padding enters flat reductions.
+// The elements of one brick are contiguous, ForEachBrick walks the
+// bricks in storage order.
+//
+template <>
+class Indexer< MultiArrayOrder::Tiled > {
+public:
+    typedef std::size_t size_type;
+    static constexpr size_type max_dims = 5;
+    static constexpr size_type base = 0;
+    static constexpr size_type default_brick = 8;
+
+    Indexer() noexcept:ndim(0),tsize(0),lg(0),dims{},tail{} {}
+
+    Indexer( std::initializer_list<size_type> ilist, size_type brick=default_brick) noexcept {
+        SetDims(ilist.size(),ilist.begin(),brick);
+    }
+    template < std::size_t nd >
+    Indexer( const std::array<size_type, nd>& dims_in, size_type brick=default_brick) noexcept {
+        static_assert(nd <= max_dims,"Indexer supports at most 5 dimensions");
+        SetDims(nd,dims_in.data(),brick);
+    }
+    Indexer( size_type ndims_in, const size_type * dims_in, size_type brick=default_brick) noexcept {
+        SetDims(ndims_in,dims_in,brick);
+    }
+    Indexer( const std::vector<size_type>& dims_in, size_type brick=default_brick) noexcept {
+        SetDims(dims_in.size(),dims_in.data(),brick);
     }
-    tsize = st;
-}
 
-constexpr void Indexer< MultiArrayOrder::RowMajor>::FlatIndexToIndices( std::size_t flat_index, std::size_t *ix) const noexcept {
-    for (std::size_t i=0;i<ndim;++i) {
-        std::size_t k=ndim-1-i;
-        ix[k] = (flat_index % dims[k]);
-        flat_index /= dims[k];
+    // offset of the brick slab along each axis plus the row major
+    // offset inside the (possibly clipped) brick
+    size_type IndicesToFlatIndex( const size_type* ind ) const noexcept {
+        const size_type mask = BrickSize()-1;
+        size_type f = 0, inner = 0, tprod = 1;
+        for (size_type k=0;k<ndim;++k) {
+            const size_type lo = ind[k] & ~mask;
+            const size_type t = BrickExtent(k,lo);
+            f += tprod*lo*tail[k];
+            tprod *= t;
+            inner = inner*t + (ind[k] & mask);
+        }
+        return f + inner;
+    }
+    template < std::size_t nd >
+    size_type IndicesToFlatIndex( const std::array<size_type,nd>& ind) const noexcept {
+        return IndicesToFlatIndex(ind.data());
+    }
+    size_type IndicesToFlatIndex( const std::vector<size_type>& ind ) const noexcept {
+        return IndicesToFlatIndex(ind.data());
+    }
+    size_type IndicesToFlatIndex( std::initializer_list<size_type> ind) const noexcept {
+        return IndicesToFlatIndex(ind.begin());
     }
 
-}
+    void FlatIndexToIndices( size_type flat_index, size_type* ind ) const noexcept {
+        size_type tprod = 1;
+        size_type t[max_dims];
+        for (size_type k=0;k<ndim;++k) {
+            const size_type slab = tprod*BrickSize()*tail[k];
+            const size_type b = flat_index/slab;
+            flat_index -= b*slab;
+            ind[k] = b << lg;
+            t[k] = BrickExtent(k,ind[k]);
+            tprod *= t[k];
+        }
+        for (size_type i=0;i<ndim;++i) {
+            const size_type k = ndim-1-i;
+            ind[k] += flat_index % t[k];
+            flat_index /= t[k];
+        }
+    }
+    template < std::size_t nd >
+    void FlatIndexToIndices( size_type flat_index, std::array<size_type,nd>& ind) const noexcept {
+        FlatIndexToIndices(flat_index,ind.data());
+    }
+    void FlatIndexToIndices( size_type flat_index, std::vector<size_type>& ind ) const noexcept {
+        ind.resize(ndim);
+        FlatIndexToIndices(flat_index,ind.data());
+    }
 
-constexpr void Indexer< MultiArrayOrder::ColMajor>::FlatIndexToIndices( std::size_t flat_index, std::size_t *ix) const noexcept {
-    for (std::size_t k=0;k<ndim;++k) {
-        ix[k] = flat_index % dims[k];
-        flat_index /= dims[k];
+    // f(lo,ext,offset) for every brick in storage order, lo and ext
+    // are the first index and the extents of the brick
+    template < class F >
+    void ForEachBrick(F f) const {
+        if (tsize == 0) return;
+        size_type lo[max_dims] = {};
+        size_type ext[max_dims];
+        for (size_type k=0;k<ndim;++k) ext[k] = BrickExtent(k,0);
+        size_type off = 0;
+        for (;;) {
+            f(static_cast<const size_type*>(lo),static_cast<const size_type*>(ext),off);
+            size_type vol = 1;
+            for (size_type k=0;k<ndim;++k) vol *= ext[k];
+            off += vol;
+            size_type k = ndim;
+            while (k-- > 0) {
+                lo[k] += BrickSize();
+                if (lo[k] < dims[k]) {
+                    ext[k] = BrickExtent(k,lo[k]);
+                    break;
+                }
+                lo[k] = 0;
+                ext[k] = BrickExtent(k,0);
+            }
+            if (k == size_type(-1)) return;
+        }
     }
-}
 
-constexpr void Indexer< MultiArrayOrder::Fortran >::FlatIndexToIndices( std::size_t flat_index, std::size_t *ix) const noexcept {
-    for (std::size_t k=0;k<ndim;++k) {
-        ix[k] = flat_index % dims[k] + 1;
-        flat_index /= dims[k];
+    constexpr size_type NumberOfDimensions() const noexcept { return ndim;}
+    constexpr size_type MaxDimensions() const noexcept { return max_dims;}
+    constexpr size_type Extent( size_type i ) const noexcept { return dims[i];}
+    constexpr size_type TotalExtent() const noexcept { return tsize;}
+    constexpr std::array<size_type,max_dims> GetExtents() const noexcept { return dims;}
+    constexpr size_type BrickSize() const noexcept { return size_type(1) << lg;}
+    // extent along axis k of the brick starting at lo
+    constexpr size_type BrickExtent( size_type k, size_type lo) const noexcept {
+        return (dims[k]-lo < BrickSize()) ? dims[k]-lo:BrickSize();
+    }
+    size_type NumberOfBricks() const noexcept {
+        size_type nb = 1;
+        for (size_type k=0;k<ndim;++k) nb *= (dims[k]+BrickSize()-1) >> lg;
+        return nb;
     }
-}
 
-constexpr void Indexer< MultiArrayOrder::IDE >::FlatIndexToIndices( std::size_t flat_index, std::size_t *ix) const noexcept {
-    for (std::size_t i=0;i<ndim;++i) {
-        std::size_t k = ndim-1-i;
-        ix[k] = flat_index % dims[k] + 1;
-        flat_index /= dims[k];
+    constexpr bool operator==(const Indexer& x) const noexcept {
+        return ndim == x.ndim && lg == x.lg && dims == x.dims;
     }
-}
+    constexpr bool operator!=(const Indexer& x) const noexcept { return !(*this == x);}
 
-constexpr void Indexer< MultiArrayOrder::RowMajor>::FlatIndexToIndices( std::size_t flat_index, std::array<std::size_t,5>& ix) const noexcept {
-    for (std::size_t i=0;i<ndim;++i) {
-        std::size_t k=ndim-1-i;
-        ix[k] = (flat_index % dims[k]);
-        flat_index /= dims[k];
+private:
+    void SetDims( size_type nd, const size_type* dims_in, size_type brick) noexcept {
+        if (nd > max_dims) nd = max_dims;
+        ndim = nd;
+        lg = 0;
+        while ((size_type(1) << lg) < brick) ++lg;
+        for (size_type k=0;k<max_dims;++k) dims[k] = (k < nd) ? dims_in[k]:1;
+        size_type st = 1;
+        for (size_type i=0;i<max_dims;++i) {
+            const size_type k = max_dims-1-i;
+            tail[k] = st;
+            if (k < nd) st *= dims[k];
+        }
+        tsize = st;
     }
-}
 
-constexpr void Indexer< MultiArrayOrder::ColMajor>::FlatIndexToIndices( std::size_t flat_index, std::array<std::size_t,5>& ix) const noexcept {
-    for (std::size_t k=0;k<ndim;++k) {
-        ix[k] = flat_index % dims[k];
-        flat_index /= dims[k];
+    size_type ndim,tsize,lg;
+    std::array< size_type, max_dims > dims;
+    // product of the extents after axis k
+    std::array< size_type, max_dims > tail;
+};
+
+//
+// Z order. Each extent must be a power of 2, they need not be equal;
+// axes run out of bits at different levels and the remaining ones
+// keep interleaving, the last axis owns the lowest bit.
+// The flat index is the or of one dilated table entry per axis, so
+// moving to a neighbour only touches the bits of that axis.
+//
+template <>
+class Indexer< MultiArrayOrder::Morton > {
+public:
+    typedef std::size_t size_type;
+    static constexpr size_type max_dims = 5;
+    static constexpr size_type base = 0;
+
+    Indexer() noexcept:ndim(0),tsize(0),dims{},mask{},nbits{},pos{},dil{} {}
+
+    Indexer( std::initializer_list<size_type> ilist) {
+        SetDims(ilist.size(),ilist.begin());
+    }
+    template < std::size_t nd >
+    Indexer( const std::array<size_type, nd>& dims_in) {
+        static_assert(nd <= max_dims,"Indexer supports at most 5 dimensions");
+        SetDims(nd,dims_in.data());
+    }
+    Indexer( size_type ndims_in, const size_type * dims_in) {
+        SetDims(ndims_in,dims_in);
+    }
+    Indexer( const std::vector<size_type>& dims_in) {
+        SetDims(dims_in.size(),dims_in.data());
     }
-}
 
-constexpr void Indexer< MultiArrayOrder::Fortran >::FlatIndexToIndices( std::size_t flat_index, std::array<std::size_t,5>& ix) const noexcept {
-    for (std::size_t k=0;k<ndim;++k) {
-        ix[k] = flat_index % dims[k] + 1;
-        flat_index /= dims[k];
+    size_type IndicesToFlatIndex( const size_type* ind ) const noexcept {
+        size_type f = 0;
+        for (size_type k=0;k<ndim;++k) f |= dil[k][ind[k]];
+        return f;
+    }
+    template < std::size_t nd >
+    size_type IndicesToFlatIndex( const std::array<size_type,nd>& ind) const noexcept {
+        return IndicesToFlatIndex(ind.data());
+    }
+    size_type IndicesToFlatIndex( const std::vector<size_type>& ind ) const noexcept {
+        return IndicesToFlatIndex(ind.data());
+    }
+    size_type IndicesToFlatIndex( std::initializer_list<size_type> ind) const noexcept {
+        return IndicesToFlatIndex(ind.begin());
     }
-}
 
-constexpr void Indexer< MultiArrayOrder::IDE >::FlatIndexToIndices( std::size_t flat_index, std::array<std::size_t,5>& ix) const noexcept {
-    for (std::size_t i=0;i<ndim;++i) {
-        std::size_t k = ndim-1-i;
-        ix[k] = flat_index % dims[k] + 1;
-        flat_index /= dims[k];
+    void FlatIndexToIndices( size_type flat_index, size_type* ind ) const noexcept {
+        for (size_type k=0;k<ndim;++k) {
+            size_type i = 0;
+            for (size_type b=0;b<nbits[k];++b) i |= ((flat_index >> pos[k][b]) & 1) << b;
+            ind[k] = i;
+        }
+    }
+    template < std::size_t nd >
+    void FlatIndexToIndices( size_type flat_index, std::array<size_type,nd>& ind) const noexcept {
+        FlatIndexToIndices(flat_index,ind.data());
+    }
+    void FlatIndexToIndices( size_type flat_index, std::vector<size_type>& ind ) const noexcept {
+        ind.resize(ndim);
+        FlatIndexToIndices(flat_index,ind.data());
     }
-}
 
-constexpr void Indexer< MultiArrayOrder::RowMajor>::FlatIndexToIndices( std::size_t flat_index, std::vector<std::size_t>& ix) const noexcept {
-    for (std::size_t i=0;i<ndim;++i) {
-        std::size_t k=ndim-1-i;
-        ix[k] = (flat_index % dims[k]);
-        flat_index /= dims[k];
+    // bits of index i of axis k in their flat positions
+    size_type Dilated( size_type k, size_type i) const noexcept { return dil[k][i];}
+    size_type AxisMask( size_type k) const noexcept { return mask[k];}
+    // neighbours along axis k, periodic at the faces
+    size_type Next( size_type flat, size_type k) const noexcept {
+        return (((flat | ~mask[k]) + 1) & mask[k]) | (flat & ~mask[k]);
+    }
+    size_type Prev( size_type flat, size_type k) const noexcept {
+        return (((flat & mask[k]) - 1) & mask[k]) | (flat & ~mask[k]);
     }
 
-}
+    constexpr size_type NumberOfDimensions() const noexcept { return ndim;}
+    constexpr size_type MaxDimensions() const noexcept { return max_dims;}
+    constexpr size_type Extent( size_type i ) const noexcept { return dims[i];}
+    constexpr size_type TotalExtent() const noexcept { return tsize;}
+    constexpr std::array<size_type,max_dims> GetExtents() const noexcept { return dims;}
 
-constexpr void Indexer< MultiArrayOrder::ColMajor>::FlatIndexToIndices( std::size_t flat_index, std::vector<std::size_t>& ix) const noexcept {
-    for (std::size_t k=0;k<ndim;++k) {
-        ix[k] = flat_index % dims[k];
-        flat_index /= dims[k];
+    bool operator==(const Indexer& x) const noexcept {
+        return ndim == x.ndim && dims == x.dims;
     }
-}
+    bool operator!=(const Indexer& x) const noexcept { return !(*this == x);}
 
-constexpr void Indexer< MultiArrayOrder::Fortran >::FlatIndexToIndices( std::size_t flat_index, std::vector<std::size_t>& ix) const noexcept {
-    for (std::size_t k=0;k<ndim;++k) {
-        ix[k] = flat_index % dims[k] + 1;
-        flat_index /= dims[k];
+private:
+    void SetDims( size_type nd, const size_type* dims_in) {
+        if (nd > max_dims) nd = max_dims;
+        ndim = nd;
+        tsize = 1;
+        size_type maxbits = 0;
+        for (size_type k=0;k<max_dims;++k) {
+            dims[k] = (k < nd) ? dims_in[k]:1;
+            if (dims[k] == 0 || (dims[k] & (dims[k]-1)) != 0) {
+                std::cerr << "Morton Indexer extent " << dims[k] << " is not a power of 2\n";
+                exit(EXIT_FAILURE);
+            }
+            nbits[k] = 0;
+            while ((size_type(1) << nbits[k]) < dims[k]) ++nbits[k];
+            if (nbits[k] > maxbits) maxbits = nbits[k];
+            tsize *= dims[k];
+        }
+        size_type p = 0;
+        for (size_type b=0;b<maxbits;++b) {
+            for (size_type i=0;i<nd;++i) {
+                const size_type k = nd-1-i;
+                if (b < nbits[k]) pos[k][b] = p++;
+            }
+        }
+        for (size_type k=0;k<max_dims;++k) {
+            dil[k].assign(dims[k],0);
+            for (size_type i=0;i<dims[k];++i) {
+                size_type d = 0;
+                for (size_type b=0;b<nbits[k];++b) d |= ((i >> b) & 1) << pos[k][b];
+                dil[k][i] = d;
+            }
+            mask[k] = dil[k][dims[k]-1];
+        }
     }
-}
 
-constexpr void Indexer< MultiArrayOrder::IDE >::FlatIndexToIndices( std::size_t flat_index, std::vector<std::size_t>& ix) const noexcept {
-    for (std::size_t i=0;i<ndim;++i) {
-        std::size_t k = ndim-1-i;
-        ix[k] = flat_index % dims[k] + 1;
-        flat_index /= dims[k];
-    }
-}
+    size_type ndim,tsize;
+    std::array< size_type, max_dims > dims;
+    std::array< size_type, max_dims > mask;
+    std::array< size_type, max_dims > nbits;
+    std::array< std::array< size_type, 64 >, max_dims > pos;
+    std::array< std::vector< size_type >, max_dims > dil;
+};
 
 }
 #endif
-
@@ -0,0 +1,583 @@
+#ifndef PETLIB_TENSOR_HPP
+#define PETLIB_TENSOR_HPP
+#include <petlib_iterator.hpp>
+#include <petlib_array_expr.hpp>
+#include <petlib_alloc.hpp>
+#include <petlib_indexer.hpp>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <type_traits>
+#include <utility>
+
+namespace petlib {
+
+template < typename Tp, std::size_t N, MultiArrayOrder order > class Tensor;
+template < typename Tp, std::size_t N > class TensorView;
+
+//
+// Strided window into tensor storage. Views never own memory and
+// index from zero whatever the order of the tensor they came from.
+// Loops over a view run in memory order, the axis with the smallest
+// stride is always the innermost one.
+//
+template < typename Tp, std::size_t N >
+class TensorView {
+public:
+    static_assert(N > 0 && N <= Indexer<MultiArrayOrder::RowMajor>::max_dims,"TensorView rank must be 1 to 5");
+    typedef std::remove_const_t<Tp> value_type;
+    typedef Tp& reference;
+    typedef const Tp& const_reference;
+    typedef Tp* pointer;
+    typedef const Tp* const_pointer;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::array< size_type, N > index_type;
+    static constexpr size_type rank = N;
+
+    TensorView(pointer p, const index_type& ext, const index_type& str) noexcept:
+        m_ptr(p),m_ext(ext),m_str(str) {}
+
+    // views are handles, a copy points at the same elements
+    TensorView(const TensorView&) = default;
+
+    template < typename... Idx >
+    reference operator()(Idx... i) const noexcept {
+        static_assert(sizeof...(Idx) == N,"wrong number of indices");
+        const size_type ind[N] = { size_type(i)... };
+        size_type f = 0;
+        for (size_type k=0;k<N;++k) f += ind[k]*m_str[k];
+        return m_ptr[f];
+    }
+    reference operator()(const index_type& ind) const noexcept {
+        size_type f = 0;
+        for (size_type k=0;k<N;++k) f += ind[k]*m_str[k];
+        return m_ptr[f];
+    }
+
+    constexpr pointer data() const noexcept { return m_ptr;}
+    constexpr size_type Extent(size_type k) const noexcept { return m_ext[k];}
+    constexpr size_type Stride(size_type k) const noexcept { return m_str[k];}
+    constexpr const index_type& Extents() const noexcept { return m_ext;}
+    constexpr const index_type& Strides() const noexcept { return m_str;}
+    size_type size() const noexcept {
+        size_type n = 1;
+        for (size_type k=0;k<N;++k) n *= m_ext[k];
+        return n;
+    }
+    constexpr bool empty() const noexcept { return size()==0;}
+    template < typename U >
+    bool SameShape(const TensorView< U, N >& v) const noexcept { return m_ext == v.Extents();}
+
+    // rank N-1 view with axis fixed at i
+    TensorView< Tp, N-1 > SliceAt(size_type axis, size_type i) const noexcept {
+        static_assert(N > 1,"cannot slice a rank 1 view");
+        std::array< size_type, N-1 > e,s;
+        for (size_type k=0,j=0;k<N;++k) {
+            if (k == axis) continue;
+            e[j] = m_ext[k];
+            s[j++] = m_str[k];
+        }
+        return TensorView< Tp, N-1 >(m_ptr + i*m_str[axis],e,s);
+    }
+    // same rank view of the block r[0] x r[1] x ...
+    TensorView SubTensor(const std::array< Range, N >& r) const noexcept {
+        index_type e;
+        size_type off = 0;
+        for (size_type k=0;k<N;++k) {
+            e[k] = r[k].size();
+            off += r[k].offset()*m_str[k];
+        }
+        return TensorView(m_ptr + off,e,m_str);
+    }
+
+    // axes ordered from the smallest stride to the largest
+    index_type MemoryOrder() const noexcept {
+        index_type ax;
+        for (size_type k=0;k<N;++k) ax[k] = N-1-k;
+        std::stable_sort(ax.begin(),ax.end(),
+            [this](size_type a,size_type b) { return m_str[a] < m_str[b];});
+        return ax;
+    }
+
+    // f(element) for every element in memory order
+    template < class F >
+    void ForEach(F f) const {
+        if (empty()) return;
+        const index_type ax = MemoryOrder();
+        const size_type n0 = m_ext[ax[0]];
+        const size_type s0 = m_str[ax[0]];
+        index_type cnt{};
+        pointer p = m_ptr;
+        for (;;) {
+            pointer q = p;
+            for (size_type i=0;i<n0;++i,q+=s0) f(*q);
+            if (!Advance(ax,cnt,p)) return;
+        }
+    }
+
+    // f(indices,element) in memory order
+    template < class F >
+    void ForEachIndexed(F f) const {
+        if (empty()) return;
+        const index_type ax = MemoryOrder();
+        const size_type a0 = ax[0];
+        const size_type n0 = m_ext[a0];
+        const size_type s0 = m_str[a0];
+        index_type cnt{};
+        pointer p = m_ptr;
+        for (;;) {
+            index_type ind = cnt;
+            pointer q = p;
+            for (size_type i=0;i<n0;++i,q+=s0) {
+                ind[a0] = i;
+                f(static_cast<const index_type&>(ind),*q);
+            }
+            if (!Advance(ax,cnt,p)) return;
+        }
+    }
+
+    // f(element,element of v) over two views of the same shape, in the
+    // memory order of this view
+    template < typename U, class F >
+    void ForEachWith(const TensorView< U, N >& v, F f) const {
+        assert(m_ext == v.Extents());
+        if (empty()) return;
+        const index_type ax = MemoryOrder();
+        const size_type n0 = m_ext[ax[0]];
+        const size_type s0 = m_str[ax[0]];
+        const size_type t0 = v.Stride(ax[0]);
+        index_type cnt{};
+        pointer p = m_ptr;
+        U* pv = v.data();
+        for (;;) {
+            pointer q = p;
+            U* qv = pv;
+            for (size_type i=0;i<n0;++i,q+=s0,qv+=t0) f(*q,*qv);
+            size_type k=1;
+            for (;k<N;++k) {
+                const size_type a = ax[k];
+                p += m_str[a];
+                pv += v.Stride(a);
+                if (++cnt[a] < m_ext[a]) break;
+                p -= m_str[a]*m_ext[a];
+                pv -= v.Stride(a)*m_ext[a];
+                cnt[a] = 0;
+            }
+            if (k == N) return;
+        }
+    }
+
+    const TensorView& operator=(const_reference v) const noexcept {
+        ForEach([&v](reference x) { x = v;});
+        return *this;
+    }
+    template < typename U >
+    const TensorView& operator=(const TensorView< U, N >& v) const noexcept {
+        ForEachWith(v,[](reference x,const U& y) { x = y;});
+        return *this;
+    }
+    const TensorView& operator=(const TensorView& v) const noexcept {
+        ForEachWith(v,[](reference x,const_reference y) { x = y;});
+        return *this;
+    }
+
+#define PETLIB_MAKE_OP(SYM)\
+    const TensorView& operator SYM (const_reference v) const noexcept {\
+        ForEach([&v](reference x) { x SYM v;});\
+        return *this;\
+    }\
+     \
+    template < typename U > \
+    const TensorView& operator SYM (const TensorView< U, N >& v) const noexcept {\
+        ForEachWith(v,[](reference x,const U& y) { x SYM y;});\
+        return *this;\
+    }
+
+PETLIB_MAKE_OP(+=)
+PETLIB_MAKE_OP(-=)
+PETLIB_MAKE_OP(*=)
+PETLIB_MAKE_OP(/=)
+#undef PETLIB_MAKE_OP
+
+    value_type Sum() const noexcept {
+        value_type s = value_type(0);
+        ForEach([&s](const_reference x) { s += x;});
+        return s;
+    }
+
+    operator TensorView< const Tp, N >() const noexcept {
+        return TensorView< const Tp, N >(m_ptr,m_ext,m_str);
+    }
+
+private:
+    // odometer over the outer axes, false when the walk is done
+    bool Advance(const index_type& ax, index_type& cnt, pointer& p) const noexcept {
+        for (size_type k=1;k<N;++k) {
+            const size_type a = ax[k];
+            p += m_str[a];
+            if (++cnt[a] < m_ext[a]) return true;
+            p -= m_str[a]*m_ext[a];
+            cnt[a] = 0;
+        }
+        return false;
+    }
+
+    pointer m_ptr;
+    index_type m_ext;
+    index_type m_str;
+};
+
+// expressions only combine tensors of one rank and order
+template < std::size_t N, MultiArrayOrder order > struct TensorLayout {};
+template < typename Tp, std::size_t N, MultiArrayOrder order >
+struct ExprLayout< Tensor< Tp, N, order > > { typedef TensorLayout< N, order > type; };
+
+//
+// Dense rank N tensor. The Indexer computes the strides once, element
+// access is a dot product of the indices with them. Element wise
+// arithmetic goes through the ArrayExpr templates on the flat storage,
+// operands must have the same extents and order, mixing orders does
+// not compile.
+// Fortran and IDE orders index from 1.
+// Tiled and Morton orders have no strides, elements are found through
+// the Indexer and there are no views; ForEach and ForEachIndexed still
+// walk the storage in order, brick by brick for Tiled.
+//
+template < typename Tp, std::size_t N, MultiArrayOrder order = MultiArrayOrder::RowMajor >
+class Tensor: public ArrayBase< Tp, Tensor< Tp, N, order > > {
+public:
+    static_assert(N > 0 && N <= Indexer<order>::max_dims,"Tensor rank must be 1 to 5");
+    typedef Tp value_type;
+    typedef Tp& reference;
+    typedef const Tp& const_reference;
+    typedef Tp* pointer;
+    typedef const Tp* const_pointer;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef Tp* iterator;
+    typedef const Tp* const_iterator;
+    typedef std::array< size_type, N > index_type;
+    typedef petlib::AlignedAllocator< value_type > allocator_type;
+    typedef petlib::Indexer< order > indexer_type;
+    typedef TensorView< Tp, N > view_type;
+    typedef TensorView< const Tp, N > const_view_type;
+    static constexpr size_type rank = N;
+    static constexpr size_type base = indexer_type::base;
+    static constexpr bool strided = OrderTraits< order >::strided;
+
+    Tensor():m_ptr(nullptr),m_size(0),m_idx(),m_alloc() {}
+
+    explicit Tensor(const index_type& ext):m_ptr(nullptr),m_size(0),m_idx(ext),m_alloc() {
+        m_size = m_idx.TotalExtent();
+        m_ptr = m_alloc.allocate(m_size);
+    }
+
+    // layout parameters such as the brick size come with the indexer
+    explicit Tensor(const indexer_type& idx):m_ptr(nullptr),m_size(idx.TotalExtent()),m_idx(idx),m_alloc() {
+        m_ptr = m_alloc.allocate(m_size);
+    }
+
+    Tensor(const index_type& ext,const_reference v):Tensor(ext) {
+        petlib::Fill< iterator, value_type >(m_ptr,v,m_size);
+    }
+
+    template < typename... Ext, typename = std::enable_if_t< sizeof...(Ext) == N &&
+        (std::is_integral_v<Ext> && ...) > >
+    explicit Tensor(Ext... ext):Tensor(index_type{ size_type(ext)... }) {}
+
+    Tensor(const Tensor& t):Tensor(t.m_idx) {
+        petlib::Copy< iterator, const_iterator >(m_ptr,t.cbegin(),m_size);
+    }
+
+    Tensor(Tensor&& t) noexcept:m_ptr(t.m_ptr),m_size(t.m_size),m_idx(t.m_idx),m_alloc() {
+        t.m_ptr = nullptr;
+        t.m_size = 0;
+        t.m_idx = indexer_type();
+    }
+
+    // copy out of a view or a tensor in another order
+    template < typename U >
+    explicit Tensor(const TensorView< U, N >& v):Tensor(v.Extents()) {
+        View() = v;
+    }
+    template < MultiArrayOrder other >
+    explicit Tensor(const Tensor< Tp, N, other >& t):Tensor(t.Extents()) {
+        AssignFrom(t);
+    }
+
+    template < class X >
+    Tensor(const index_type& ext,const ArrayExpr< Tp, X >& x):Tensor(ext) {
+        ExprCopy< Tp, iterator, X >(m_ptr,x,m_size);
+    }
+
+    ~Tensor() {
+        if (m_ptr) m_alloc.deallocate(m_ptr,m_size);
+    }
+
+    template < typename... Idx >
+    reference operator()(Idx... i) noexcept {
+        static_assert(sizeof...(Idx) == N,"wrong number of indices");
+        return m_ptr[Offset(i...)];
+    }
+    template < typename... Idx >
+    const_reference operator()(Idx... i) const noexcept {
+        static_assert(sizeof...(Idx) == N,"wrong number of indices");
+        return m_ptr[Offset(i...)];
+    }
+    reference operator()(const index_type& ind) noexcept { return m_ptr[m_idx.IndicesToFlatIndex(ind)];}
+    const_reference operator()(const index_type& ind) const noexcept { return m_ptr[m_idx.IndicesToFlatIndex(ind)];}
+
+    // flat element access in storage order
+    reference operator[](size_type i) noexcept { return m_ptr[i];}
+    const_reference operator[](size_type i) const noexcept { return m_ptr[i];}
+
+    constexpr bool empty() const noexcept { return m_size==0;}
+    constexpr pointer data() noexcept { return m_ptr;}
+    constexpr const_pointer data() const noexcept { return m_ptr;}
+    constexpr size_type size() const noexcept { return m_size;}
+    constexpr iterator begin() noexcept { return m_ptr;}
+    constexpr iterator end() noexcept { return (m_ptr+m_size);}
+    constexpr const_iterator begin() const noexcept { return m_ptr;}
+    constexpr const_iterator end() const noexcept { return (m_ptr+m_size);}
+    constexpr const_iterator cbegin() const noexcept { return m_ptr;}
+    constexpr const_iterator cend() const noexcept { return (m_ptr+m_size);}
+
+    constexpr const indexer_type& GetIndexer() const noexcept { return m_idx;}
+    constexpr size_type Extent(size_type k) const noexcept { return m_idx.Extent(k);}
+    constexpr size_type Stride(size_type k) const noexcept {
+        static_assert(strided,"Tiled and Morton tensors have no strides");
+        return m_idx.Stride(k);
+    }
+    index_type Extents() const noexcept {
+        index_type e;
+        for (size_type k=0;k<N;++k) e[k] = m_idx.Extent(k);
+        return e;
+    }
+    index_type Strides() const noexcept {
+        static_assert(strided,"Tiled and Morton tensors have no strides");
+        index_type s;
+        for (size_type k=0;k<N;++k) s[k] = m_idx.Stride(k);
+        return s;
+    }
+    template < MultiArrayOrder other >
+    bool SameShape(const Tensor< Tp, N, other >& t) const noexcept { return Extents() == t.Extents();}
+
+    view_type View() noexcept { return view_type(m_ptr,Extents(),Strides());}
+    const_view_type View() const noexcept { return const_view_type(m_ptr,Extents(),Strides());}
+
+    // rank N-1 view with axis fixed at i, i counts from the order base
+    TensorView< Tp, N-1 > SliceAt(size_type axis, size_type i) noexcept {
+        return View().SliceAt(axis,i-base);
+    }
+    TensorView< const Tp, N-1 > SliceAt(size_type axis, size_type i) const noexcept {
+        return View().SliceAt(axis,i-base);
+    }
+    view_type SubTensor(std::array< Range, N > r) noexcept {
+        for (auto& x : r) x.m_off -= base;
+        return View().SubTensor(r);
+    }
+    const_view_type SubTensor(std::array< Range, N > r) const noexcept {
+        for (auto& x : r) x.m_off -= base;
+        return View().SubTensor(r);
+    }
+
+    // storage is contiguous, memory order is the flat order
+    template < class F >
+    void ForEach(F f) {
+        for (size_type i=0;i<m_size;++i) f(m_ptr[i]);
+    }
+    template < class F >
+    void ForEach(F f) const {
+        for (size_type i=0;i<m_size;++i) f(static_cast<const_reference>(m_ptr[i]));
+    }
+    // f(indices,element) in memory order, indices count from the order base
+    template < class F >
+    void ForEachIndexed(F f) {
+        WalkIndexed(m_ptr,f);
+    }
+    template < class F >
+    void ForEachIndexed(F f) const {
+        WalkIndexed(static_cast<const_pointer>(m_ptr),f);
+    }
+
+    // f(lo,ext,brick) for the bricks of a Tiled tensor in storage order,
+    // brick points at the ext[0] x ext[1] x ... row major elements
+    // starting at index lo
+    template < class F >
+    void ForEachBrick(F f) {
+        static_assert(order == MultiArrayOrder::Tiled,"ForEachBrick needs a Tiled tensor");
+        m_idx.ForEachBrick([this,&f](const size_type* lo,const size_type* ext,size_type off) {
+            f(lo,ext,m_ptr+off);
+        });
+    }
+    template < class F >
+    void ForEachBrick(F f) const {
+        static_assert(order == MultiArrayOrder::Tiled,"ForEachBrick needs a Tiled tensor");
+        m_idx.ForEachBrick([this,&f](const size_type* lo,const size_type* ext,size_type off) {
+            f(lo,ext,static_cast<const_pointer>(m_ptr+off));
+        });
+    }
+
+    void Resize(const index_type& ext) {
+        indexer_type idx(ext);
+        if (idx.TotalExtent() != m_size) {
+            if (m_ptr) m_alloc.deallocate(m_ptr,m_size);
+            m_size = idx.TotalExtent();
+            m_ptr = m_alloc.allocate(m_size);
+        }
+        m_idx = idx;
+    }
+
+    Tensor& operator=(const Tensor& t) {
+        if (this != &t) {
+            if (m_idx != t.m_idx) {
+                if (t.m_size != m_size) {
+                    if (m_ptr) m_alloc.deallocate(m_ptr,m_size);
+                    m_ptr = m_alloc.allocate(t.m_size);
+                    m_size = t.m_size;
+                }
+                m_idx = t.m_idx;
+            }
+            petlib::Copy< iterator, const_iterator >(m_ptr,t.cbegin(),m_size);
+        }
+        return *this;
+    }
+    Tensor& operator=(Tensor&& t) noexcept {
+        std::swap(m_ptr,t.m_ptr);
+        std::swap(m_size,t.m_size);
+        std::swap(m_idx,t.m_idx);
+        return *this;
+    }
+    // a tensor or view of other extents resizes this one
+    template < MultiArrayOrder other >
+    Tensor& operator=(const Tensor< Tp, N, other >& t) {
+        if (Extents() != t.Extents()) Resize(t.Extents());
+        AssignFrom(t);
+        return *this;
+    }
+    // a view into this tensor is copied out before the storage changes
+    template < typename U >
+    Tensor& operator=(const TensorView< U, N >& v) {
+        const bool alias = v.data() >= m_ptr && v.data() < m_ptr+m_size;
+        if (alias || Extents() != v.Extents()) {
+            Tensor t(v);
+            return *this = std::move(t);
+        }
+        View() = v;
+        return *this;
+    }
+    template < class X >
+    Tensor& operator=(const ArrayExpr< value_type, X >& x) noexcept {
+        assert(x.size() == m_size);
+        petlib::ExprCopy< value_type, iterator, X >(m_ptr,x,m_size);
+        return *this;
+    }
+    Tensor& operator=(const_reference v) noexcept {
+        petlib::Fill< iterator, value_type >(m_ptr,v,m_size);
+        return *this;
+    }
+
+#define PETLIB_MAKE_OP(NAME,SYM)\
+    Tensor& operator SYM (const Tensor& t) noexcept {\
+        assert(Extents() == t.Extents());\
+        NAME ## Copy< iterator, const_iterator >(m_ptr,t.cbegin(),m_size);\
+        return *this;\
+    }\
+     \
+    template < class X > \
+    Tensor& operator SYM (const ArrayExpr< value_type, X >& x) noexcept {\
+        assert(x.size() == m_size);\
+        Expr ## NAME ## Copy< value_type, iterator, X >(m_ptr,x,m_size);\
+        return *this;\
+    }\
+     \
+    Tensor& operator SYM (const_reference v) noexcept {\
+        NAME ## Fill< iterator, value_type >(m_ptr,v,m_size);\
+        return *this;\
+    }
+
+PETLIB_MAKE_OP(Add,+=)
+PETLIB_MAKE_OP(Sub,-=)
+PETLIB_MAKE_OP(Mul,*=)
+PETLIB_MAKE_OP(Div,/=)
+#undef PETLIB_MAKE_OP
+
+    value_type Sum() const noexcept {
+        value_type s = value_type(0);
+        for (size_type i=0;i<m_size;++i) s += m_ptr[i];
+        return s;
+    }
+    value_type Norm() const noexcept { return petlib::Norm2<value_type,const_pointer>(m_ptr,m_size);}
+    value_type Max() const noexcept { return petlib::MaxValue<value_type,const_pointer>(m_ptr,m_size);}
+    value_type Min() const noexcept { return petlib::MinValue<value_type,const_pointer>(m_ptr,m_size);}
+
+private:
+    template < typename... Idx >
+    size_type Offset(Idx... i) const noexcept {
+        const size_type ind[N] = { size_type(i)... };
+        if constexpr (strided) {
+            size_type f = 0;
+            for (size_type k=0;k<N;++k) f += (ind[k]-base)*m_idx.Stride(k);
+            return f;
+        } else {
+            return m_idx.IndicesToFlatIndex(ind);
+        }
+    }
+
+    template < typename P, class F >
+    void WalkIndexed(P ptr, F& f) const {
+        if constexpr (strided) {
+            TensorView< std::remove_pointer_t<P>, N >(ptr,Extents(),Strides()).ForEachIndexed(
+                [&f](const index_type& ind,decltype(*ptr) x) { f(Rebase(ind),x);});
+        } else if constexpr (order == MultiArrayOrder::Tiled) {
+            m_idx.ForEachBrick([ptr,&f](const size_type* lo,const size_type* ext,size_type off) {
+                index_type ind;
+                for (size_type k=0;k<N;++k) ind[k] = lo[k];
+                P p = ptr+off;
+                for (;;) {
+                    f(static_cast<const index_type&>(ind),*p++);
+                    size_type k = N;
+                    while (k-- > 0) {
+                        if (++ind[k] < lo[k]+ext[k]) break;
+                        ind[k] = lo[k];
+                    }
+                    if (k == size_type(-1)) return;
+                }
+            });
+        } else {
+            index_type ind;
+            for (size_type i=0;i<m_size;++i) {
+                m_idx.FlatIndexToIndices(i,ind);
+                f(static_cast<const index_type&>(ind),ptr[i]);
+            }
+        }
+    }
+
+    // element by element copy from a tensor in another order, in the
+    // storage order of the source
+    template < MultiArrayOrder other >
+    void AssignFrom(const Tensor< Tp, N, other >& t) noexcept {
+        if constexpr (strided && OrderTraits< other >::strided) {
+            View() = t.View();
+        } else {
+            t.ForEachIndexed([this](const index_type& ind,const_reference x) {
+                index_type i;
+                for (size_type k=0;k<N;++k) i[k] = ind[k] - Tensor< Tp, N, other >::base + base;
+                (*this)(i) = x;
+            });
+        }
+    }
+    static index_type Rebase(index_type ind) noexcept {
+        for (auto& x : ind) x += base;
+        return ind;
+    }
+
+    pointer m_ptr;
+    size_type m_size;
+    indexer_type m_idx;
+    allocator_type m_alloc;
+};
+
+}
+#endif
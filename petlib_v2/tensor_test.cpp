@@ -0,0 +1,109 @@
+#include <chrono>
+#include <iostream>
+#include <petlib.hpp>
+#include <petlib_tensor.hpp>
+
+double elapsed(const std::chrono::steady_clock::time_point& ts)
+{
+   std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+   return d.count();
+}
+
+bool check() {
+   bool ok = true;
+   {
+      petlib::Tensor<double,3> a(2,3,4);
+      ok = ok && a.size() == 24 && a.Stride(0) == 12 && a.Stride(1) == 4 && a.Stride(2) == 1;
+      for (std::size_t i=0;i<a.size();++i) a[i] = double(i);
+      ok = ok && a(1,2,3) == 23.0 && a(0,1,0) == 4.0;
+      // a fortran tensor indexes from 1 with the first index fastest
+      petlib::Tensor<double,3,petlib::MultiArrayOrder::Fortran> f(a);
+      ok = ok && f.Stride(0) == 1 && f(2,3,4) == 23.0 && f(1,2,1) == 4.0 && f[1] == 12.0;
+      std::array<std::size_t,3> ind;
+      f.GetIndexer().FlatIndexToIndices(1,ind);
+      ok = ok && ind[0] == 2 && ind[1] == 1 && ind[2] == 1;
+      // fixing the middle axis leaves a strided 2 x 4 view
+      auto s = a.SliceAt(1,2);
+      ok = ok && s.Extent(0) == 2 && s.Extent(1) == 4 && s(1,3) == 23.0;
+      s = 0.0;
+      ok = ok && a(1,2,3) == 0.0 && a(1,1,3) == 19.0;
+      auto fs = f.SliceAt(0,2);
+      ok = ok && fs(1,2) == 18.0 && fs.MemoryOrder()[0] == 0;
+      auto r = a.SubTensor({ petlib::Range(1,1), petlib::Range(0,2), petlib::Range(1,2) });
+      ok = ok && r.size() == 4 && r(0,1,1) == a(1,1,2);
+      // every element is visited once, the indices agree with operator()
+      double sum = 0.0;
+      f.ForEachIndexed([&](const std::array<std::size_t,3>& i,double x) {
+         ok = ok && x == f(i[0],i[1],i[2]);
+         sum += x;
+      });
+      ok = ok && sum == f.Sum();
+   }
+   {
+      petlib::Tensor<double,4> a(3,4,5,6),b(3,4,5,6),c(3,4,5,6);
+      petlib::RandomFill< double*, double >(a.data(),a.size());
+      petlib::RandomFill< double*, double >(b.data(),b.size());
+      c = a * b + 2.0 * a;
+      c -= a;
+      ok = ok && c(2,3,4,5) == a(2,3,4,5) * b(2,3,4,5) + 2.0 * a(2,3,4,5) - a(2,3,4,5);
+      // copy between layouts keeps the logical element
+      petlib::Tensor<double,4,petlib::MultiArrayOrder::ColMajor> d(c);
+      ok = ok && d(1,2,3,4) == c(1,2,3,4) && d.Sum() != 0.0;
+      petlib::Tensor<double,4> e;
+      e = std::move(c);
+      ok = ok && c.empty() && e(1,2,3,4) == d(1,2,3,4);
+      auto v = e.SliceAt(3,1).SliceAt(0,2);
+      v += d.SliceAt(3,1).SliceAt(0,2);
+      ok = ok && e(2,3,4,1) == 2.0 * d(2,3,4,1) && e(2,3,4,0) == d(2,3,4,0);
+   }
+   {
+      // assignment from another order or a view takes its extents
+      petlib::Tensor<double,2> a(2,3),b(5,4);
+      petlib::Tensor<double,1> r(7);
+      for (std::size_t i=0;i<a.size();++i) a[i] = double(i);
+      petlib::Tensor<double,2,petlib::MultiArrayOrder::ColMajor> f(4,4);
+      f = a;
+      ok = ok && f.Extent(0) == 2 && f.Extent(1) == 3 && f.size() == 6 && f(1,2) == 5.0;
+      r = a.SliceAt(0,1);
+      ok = ok && r.Extent(0) == 3 && r.size() == 3 && r(2) == 5.0;
+      b = f;
+      ok = ok && b.Extent(0) == 2 && b(1,0) == 3.0;
+      // a view of itself, the old storage is freed only after the copy
+      petlib::Tensor<double,3> c(3,4,5);
+      for (std::size_t i=0;i<c.size();++i) c[i] = double(i);
+      const double c112 = c(1,1,2);
+      c = c.SubTensor({ petlib::Range(1,1), petlib::Range(0,2), petlib::Range(1,2) });
+      ok = ok && c.Extent(0) == 1 && c.Extent(1) == 2 && c.size() == 4 && c(0,1,1) == c112;
+   }
+   return ok;
+}
+
+//
+// Sum over a column major grid: an i,j,k loop nest with k innermost
+// strides through memory, ForEach always walks it contiguously.
+//
+int main() {
+   bool ok = check();
+   const std::size_t n = 256;
+   petlib::Tensor<double,3,petlib::MultiArrayOrder::ColMajor> g(n,n,n);
+   for (std::size_t i=0;i<g.size();++i) g[i] = double(i % 7);
+   const int nrep = 5;
+   double s1 = 0.0,s2 = 0.0,s3 = 0.0;
+   auto ts = std::chrono::steady_clock::now();
+   for (int r=0;r<nrep;++r)
+      for (std::size_t i=0;i<n;++i)
+         for (std::size_t j=0;j<n;++j)
+            for (std::size_t k=0;k<n;++k) s1 += g(i,j,k);
+   double tnest = elapsed(ts);
+   ts = std::chrono::steady_clock::now();
+   for (int r=0;r<nrep;++r) g.View().ForEach([&s2](double x) { s2 += x;});
+   double tview = elapsed(ts);
+   ts = std::chrono::steady_clock::now();
+   for (int r=0;r<nrep;++r) g.ForEach([&s3](double x) { s3 += x;});
+   double tflat = elapsed(ts);
+   ok = ok && s1 == s2 && s2 == s3;
+   std::cout << nrep << " sums of a " << n << "^3 column major tensor, seconds\n";
+   std::cout << "  i,j,k nest " << tnest << " view ForEach " << tview << " flat ForEach " << tflat << "\n";
+   std::cout << (ok ? "tensor test passed\n" : "tensor test FAILED\n");
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
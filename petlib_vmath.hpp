@@ -0,0 +1,708 @@
+#ifndef PETLIB_VMATH_HPP
+#define PETLIB_VMATH_HPP
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+//
+// Elementary functions for the array expressions.
+//   Every kernel is straight line code on doubles and 64 bit integers:
+//   argument reduction, a polynomial and selects for the special
+//   values. There are no calls and no branches, so a loop over an
+//   ArrayXpr vectorizes. g++ needs -O3 -fno-trapping-math before it
+//   if-converts the selects, -fno-math-errno for the sqrt of the
+//   precise tier, and 64 bit integer vector ops (-march=x86-64-v3)
+//   for all but exp and sqrt.
+//
+//   Largest errors measured in double over random arguments, against
+//   long double libm:
+//
+//     precise           ulp    domain
+//     exp               1      all
+//     expm1             1.2    all
+//     log               1      all
+//     sin, cos          1      all
+//     tanh              2.2    all
+//     pow               1.5    all
+//     sqrt              0.5    all
+//
+//     fast (namespace fast): relative error below 2^-22 (two float ulp)
+//     for exp, expm1, log, sin, cos, tanh and sqrt, pow below
+//     2^-22 (1 + |y log x|) for x > 0.
+//
+//   float arguments run through the double kernels and round once,
+//   long double goes to libm.
+//
+// sin and cos are too big for the inliner, the loops calling them
+// only vectorize with the whole reduction inlined
+#if defined(__GNUC__)
+#define PETLIB_VMATH_INLINE inline __attribute__((always_inline))
+#else
+#define PETLIB_VMATH_INLINE inline
+#endif
+
+namespace petlib {
+namespace vmath {
+
+inline std::uint64_t as_bits(double x) noexcept {
+  std::uint64_t u;
+  std::memcpy(&u, &x, sizeof(u));
+  return u;
+}
+
+inline double from_bits(std::uint64_t u) noexcept {
+  double x;
+  std::memcpy(&x, &u, sizeof(x));
+  return x;
+}
+
+// 2^n for -1022 <= n <= 1024, 1024 gives inf
+inline double pow2(std::int64_t n) noexcept {
+  return from_bits(std::uint64_t(n + 1023) << 52);
+}
+
+inline double copy_sign(double x, double s) noexcept {
+  const std::uint64_t m = std::uint64_t(1) << 63;
+  return from_bits((as_bits(x) & ~m) | (as_bits(s) & m));
+}
+
+inline double abs(double x) noexcept {
+  return from_bits(as_bits(x) & ~(std::uint64_t(1) << 63));
+}
+
+constexpr double shifter = 0x1.8p52;
+constexpr double log2e = 1.44269504088896338700e+00;
+constexpr double ln2_hi = 6.93147180369123816490e-01;
+constexpr double ln2_lo = 1.90821492927058770002e-10;
+constexpr double nan = std::numeric_limits<double>::quiet_NaN();
+constexpr double inf = std::numeric_limits<double>::infinity();
+
+// round x to the nearest integer n, |x| < 2^51
+inline double round_int(double x, std::int64_t& n) noexcept {
+  const double t = x + shifter;
+  n = std::int64_t(as_bits(t) - as_bits(shifter));
+  return t - shifter;
+}
+
+// e^r - 1 - r for |r| <= ln2/2, Taylor to r^13
+inline double expm1_tail(double r) noexcept {
+  double p = 1.0 / 6227020800.0;
+  p = p * r + 1.0 / 479001600.0;
+  p = p * r + 1.0 / 39916800.0;
+  p = p * r + 1.0 / 3628800.0;
+  p = p * r + 1.0 / 362880.0;
+  p = p * r + 1.0 / 40320.0;
+  p = p * r + 1.0 / 5040.0;
+  p = p * r + 1.0 / 720.0;
+  p = p * r + 1.0 / 120.0;
+  p = p * r + 1.0 / 24.0;
+  p = p * r + 1.0 / 6.0;
+  p = p * r + 0.5;
+  return r * r * p;
+}
+
+inline double expm1_poly(double r) noexcept { return r + expm1_tail(r); }
+
+// e^(hi+lo), lo is a small correction to hi
+inline double exp_dd(double hi, double lo) noexcept {
+  hi = hi > 709.8 ? 709.8 : hi;
+  hi = hi < -745.2 ? -745.2 : hi;
+  std::int64_t n;
+  const double dn = round_int(hi * log2e, n);
+  const double r = ((hi - dn * ln2_hi) + lo) - dn * ln2_lo;
+  const double p = 1.0 + expm1_poly(r);
+  // two steps so results in the subnormal range round only once
+  const std::int64_t n1 = n >> 1;
+  return p * pow2(n1) * pow2(n - n1);
+}
+
+inline double exp(double x) noexcept { return exp_dd(x, 0.0); }
+
+inline double two_sum(double a, double b, double& lo) noexcept {
+  const double s = a + b;
+  const double bb = s - a;
+  lo = (a - (s - bb)) + (b - bb);
+  return s;
+}
+
+//
+// expm1: with x = n ln2 + r the result is s r + (s - 1) + s (r^2 p + c),
+// s = 2^n and c the rounding error of r. The first two terms are exact
+// and summed exactly, so for n = +-1, where they cancel, the error
+// stays below one ulp.
+//
+inline double expm1(double x) noexcept {
+  x = x > 709.8 ? 709.8 : x;
+  x = x < -40.0 ? -40.0 : x;
+  std::int64_t n;
+  const double dn = round_int(x * log2e, n);
+  const double hi = x - dn * ln2_hi;
+  const double lo = dn * ln2_lo;
+  const double r = hi - lo;
+  const double c = (hi - r) - lo;
+  const double q = expm1_tail(r);
+  // near the overflow threshold 2^n alone is inf, the -1 is lost anyway
+  const double big = (1.0 + (r + q)) * pow2(n >> 1) * pow2(n - (n >> 1));
+  const double s = pow2(n > 56 ? 0 : n);
+  double e;
+  const double h = two_sum(s * r, s - 1.0, e);
+  const double v = h + (e + s * (q + c));
+  return n > 56 ? big : v;
+}
+
+//
+// log, the reduction and the polynomial of fdlibm:
+//   x = 2^k m, sqrt(2)/2 <= m < sqrt(2), f = m - 1, s = f/(2+f)
+//
+constexpr double Lg1 = 6.666666666666735130e-01;
+constexpr double Lg2 = 3.999999999940941908e-01;
+constexpr double Lg3 = 2.857142874366239149e-01;
+constexpr double Lg4 = 2.222219843214978396e-01;
+constexpr double Lg5 = 1.818357216161805012e-01;
+constexpr double Lg6 = 1.531383769920937332e-01;
+constexpr double Lg7 = 1.479819860511658591e-01;
+
+// m - 1 and k for x > 0, subnormals are scaled first
+inline double log_reduce(double x, double& dk) noexcept {
+  const bool sub = x < DBL_MIN;
+  const double xs = sub ? x * 0x1p54 : x;
+  std::uint64_t u = as_bits(xs);
+  u += std::uint64_t(0x3ff00000 - 0x3fe6a09e) << 32;
+  const std::int64_t k = std::int64_t(u >> 52) - 0x3ff - (sub ? 54 : 0);
+  u = (u & 0x000fffffffffffffULL) + 0x3fe6a09e00000000ULL;
+  // k to double through the shifter, int64 conversions do not vectorize
+  dk = from_bits(as_bits(shifter) + std::uint64_t(k)) - shifter;
+  return from_bits(u) - 1.0;
+}
+
+// log special values, r is the result for finite x > 0
+inline double log_special(double x, double r) noexcept {
+  r = x < 0.0 ? nan : r;
+  r = x == 0.0 ? -inf : r;
+  r = x == inf ? inf : r;
+  return x != x ? x : r;
+}
+
+inline double log(double x) noexcept {
+  double dk;
+  const double f = log_reduce(x, dk);
+  const double s = f / (2.0 + f);
+  const double z = s * s;
+  const double w = z * z;
+  const double t1 = w * (Lg2 + w * (Lg4 + w * Lg6));
+  const double t2 = z * (Lg1 + w * (Lg3 + w * (Lg5 + w * Lg7)));
+  const double R = t2 + t1;
+  const double hfsq = 0.5 * f * f;
+  const double r = s * (hfsq + R) + dk * ln2_lo - hfsq + f + dk * ln2_hi;
+  return log_special(x, r);
+}
+
+// exact product as an unevaluated pair hi + lo. With fma available the
+// compiler contracts the Dekker split and breaks it, so use fma itself.
+inline double two_prod(double a, double b, double& lo) noexcept {
+  const double p = a * b;
+#ifdef FP_FAST_FMA
+  lo = std::fma(a, b, -p);
+#else
+  const double as = 134217729.0 * a;
+  const double bs = 134217729.0 * b;
+  const double ah = as - (as - a);
+  const double bh = bs - (bs - b);
+  const double al = a - ah;
+  const double bl = b - bh;
+  lo = ((ah * bh - p) + ah * bl + al * bh) + al * bl;
+#endif
+  return p;
+}
+
+//
+// log(x) = hi + lo to about 2^-66 relative, finite x > 0. Same
+// reduction as log, s = f/(2+f) is carried as sh + sl and
+//   log m = 2s + 2/3 s^3 + s^5 (2/5 + 2/7 s^2 + ... + 2/27 s^22)
+// with the first two terms in double double.
+//
+constexpr double two_third_hi = 6.66666666666666629659e-01;
+constexpr double two_third_lo = 3.70074341541718826165e-17;
+
+inline double log_dd(double x, double& lo) noexcept {
+  double dk;
+  const double f = log_reduce(x, dk);
+  double dl;
+  const double d = two_sum(2.0, f, dl);
+  const double sh = f / d;
+  double pl;
+  const double ph = two_prod(sh, d, pl);
+  const double sl = ((f - ph) - pl - sh * dl) / d;
+  double zl;
+  const double zh = two_prod(sh, sh, zl);
+  double cl;
+  const double ch = two_prod(zh, sh, cl);
+  cl += zl * sh;
+  double tl;
+  const double th = two_prod(ch, two_third_hi, tl);
+  tl += ch * two_third_lo + cl * two_third_hi;
+  double p = 2.0 / 27.0;
+  p = p * zh + 2.0 / 25.0;
+  p = p * zh + 2.0 / 23.0;
+  p = p * zh + 2.0 / 21.0;
+  p = p * zh + 2.0 / 19.0;
+  p = p * zh + 2.0 / 17.0;
+  p = p * zh + 2.0 / 15.0;
+  p = p * zh + 2.0 / 13.0;
+  p = p * zh + 2.0 / 11.0;
+  p = p * zh + 2.0 / 9.0;
+  p = p * zh + 2.0 / 7.0;
+  p = p * zh + 2.0 / 5.0;
+  const double small = tl + ch * zh * p + 2.0 * sl * (1.0 + zh) + dk * ln2_lo;
+  double l1;
+  const double a = two_sum(dk * ln2_hi, 2.0 * sh, l1);
+  double l2;
+  const double b = two_sum(a, th, l2);
+  double l3;
+  const double hi = two_sum(b, l1 + l2 + small, l3);
+  lo = l3;
+  return hi;
+}
+
+// |y| rounded to an integer, from 2^52 on every double is one
+inline double round_abs(double y) noexcept {
+  const double ay = abs(y);
+  return ay < 0x1p52 ? (ay + 0x1p52) - 0x1p52 : ay;
+}
+
+//
+// sign and special values of pow, r is |x|^y computed through logs.
+// Only selects, && and || on the conditions stop the vectorizer.
+//
+inline double pow_special(double x, double y, double r) noexcept {
+  const double ax = abs(x);
+  const double ay = abs(y);
+  const double h = 0.5 * ay;
+  // the sign of x for odd integer y, +1 otherwise
+  const double sx = round_abs(y) == ay ? (round_abs(h) == h ? 1.0 : x) : 1.0;
+  r = x < 0.0 ? (round_abs(y) == ay ? copy_sign(r, sx) : nan) : r;
+  // signed zeros and infinities of x
+  const double z = y > 0.0 ? 0.0 : inf;
+  const double zi = y > 0.0 ? inf : 0.0;
+  r = ax == 0.0 ? copy_sign(z, sx) : r;
+  r = ax == inf ? copy_sign(zi, sx) : r;
+  // |x| == 1 with y = +-inf gives 1
+  r = ay == inf ? (ax == 1.0 ? 1.0 : r) : r;
+  r = x != x ? nan : r;
+  r = y != y ? nan : r;
+  r = y == 0.0 ? 1.0 : r;
+  r = x == 1.0 ? 1.0 : r;
+  return r;
+}
+
+inline double pow(double x, double y) noexcept {
+  const double ax = abs(x);
+  double lo;
+  const double lh = log_dd(ax, lo);
+  double zl;
+  const double zh = two_prod(y, lh, zl);
+  zl += y * lo;
+  // y log|x| beyond the range of exp, keep it away from inf - inf
+  const bool big = !(abs(zh) < 1e4);
+  const double r = exp_dd(big ? copy_sign(1e4, zh) : zh, big ? 0.0 : zl);
+  return pow_special(x, y, r);
+}
+
+//
+// sin and cos: x = n pi/2 + (r + rl), |r| <= pi/4. Cody-Waite
+// reduction with pi/2 in four parts, exact to the tail rl for
+// |n| < 2^20; the fdlibm kernels take the tail into account.
+// Larger arguments go through a Payne-Hanek reduction, computed for
+// every lane and selected so the loops stay free of branches. The
+// expression loops test a chunk of arguments first and call sin_small
+// and cos_small, the Cody-Waite path alone, when none is larger.
+//
+constexpr double two_over_pi = 6.36619772367581382433e-01;
+constexpr double pio2_1 = 1.57079632673412561417e+00;
+constexpr double pio2_1t = 6.07710050650619224932e-11;
+constexpr double pio2_2 = 6.07710050630396597660e-11;
+constexpr double pio2_3 = 2.02226624871116645580e-21;
+constexpr double pio2_3t = 8.47842766036889956997e-32;
+constexpr double trig_max = 1647099.3291652855;
+constexpr double pio2_hi = 1.57079632679489655800e+00;
+constexpr double pio2_lo = 6.12323399573676603587e-17;
+
+// 2/pi in 24 bit digits
+inline constexpr std::uint32_t two_over_pi_digits[] = {
+    0xA2F983, 0x6E4E44, 0x1529FC, 0x2757D1, 0xF534DD, 0xC0DB62, 0x95993C, 0x439041,
+    0xFE5163, 0xABDEBB, 0xC561B7, 0x246E3A, 0x424DD2, 0xE00649, 0x2EEA09, 0xD1921C,
+    0xFE1DEB, 0x1CB129, 0xA73EE8, 0x8235F5, 0x2EBB44, 0x84E99C, 0x7026B4, 0x5F7E41,
+    0x3991D6, 0x398353, 0x39F49C, 0x845F8B, 0xBDF928, 0x3B1FF8, 0x97FFDE, 0x05980F,
+    0xEF2F11, 0x8B5A0A, 0x6D1F6D, 0x367ECF, 0x27CB09, 0xB74F46, 0x3F669E, 0x5FEA2D,
+    0x7527BA, 0xC7EBE5, 0xF17B3D, 0x0739F7, 0x8A5292, 0xEA6BFB, 0x5FB11F, 0x8D5D08,
+    0x560330, 0x46FC7B, 0x6BABF0, 0xCFBC20, 0x9AF436, 0x1DA9E3, 0x91615E, 0xE61B08,
+    0x659985, 0x5F14A0, 0x68408D, 0xFFD880, 0x4D7327, 0x310606, 0x1556CA, 0x73A8C9,
+    0x60E27B, 0xC08C6B
+};
+
+// bit i of 2/pi, weight 2^-i
+constexpr std::uint64_t two_over_pi_bit(int i) noexcept {
+  if (i < 1) return 0;
+  return (two_over_pi_digits[(i - 1) / 24] >> (23 - (i - 1) % 24)) & 1;
+}
+
+//
+// For |x| = xs 2^e, xs in [1,2) and 20 <= e <= 1023: the bits of 2/pi
+// from weight 2^(54-e) on in four pieces of 53, each scaled by 2^e.
+// The bits before give multiples of 8 in |x| 2/pi and are left out.
+//
+struct rempi_table_t {
+  double u[4 * 1004];
+};
+
+constexpr rempi_table_t make_rempi_table() noexcept {
+  rempi_table_t t{};
+  for (int e = 20; e <= 1023; ++e) {
+    for (int k = 0; k < 4; ++k) {
+      const int first = e - 54 + 53 * k;
+      std::uint64_t v = 0;
+      for (int i = first; i < first + 53; ++i) v = (v << 1) | two_over_pi_bit(i);
+      // the last bit has weight 2^(2 - 53 k)
+      double s = double(v);
+      for (int p = 0; p < 53 * k; ++p) s *= 0.5;
+      t.u[4 * (e - 20) + k] = 4.0 * s;
+    }
+  }
+  return t;
+}
+
+inline constexpr rempi_table_t rempi_table = make_rempi_table();
+
+// floor of 0 <= v < 2^52
+inline double floor_pos(double v) noexcept {
+  const double t = (v + 0x1p52) - 0x1p52;
+  return t > v ? t - 1.0 : t;
+}
+
+// nearest integer to |v| < 2^51
+inline double nearest(double v) noexcept { return (v + shifter) - shifter; }
+
+//
+// Payne-Hanek for trig_max < |x| <= DBL_MAX, other arguments give a
+// result that is not used. |x| = xs 2^e and k is the table row. The
+// products of xs with the pieces are exact as pairs and the integer
+// parts are taken out as they come, here those of the first piece:
+// the rest a, |a| <= 1/2, is exact and dn is an integer below 2^4.
+//
+PETLIB_VMATH_INLINE double reduce_pio2_head(double x, double& xs, std::int64_t& k, double& dn) noexcept {
+  // the exponent is clamped to [20, 1023], a constant would split the
+  // loop into a path with folded table lookups that does not vectorize
+  const std::uint64_t m = as_bits(x) & ((std::uint64_t(1) << 52) - 1);
+  std::int64_t ex = std::int64_t((as_bits(x) >> 52) & 0x7ff);
+  ex = ex < 1043 ? 1043 : ex;
+  ex = ex > 2046 ? 2046 : ex;
+  xs = from_bits(m | (std::uint64_t(1023) << 52));
+  k = 4 * (ex - 1043);
+  double l0;
+  double h0 = two_prod(xs, rempi_table.u[k], l0);
+  // h0 < 2^56 modulo 8, h0 and l0 are multiples of 2^-50
+  const double g = h0 * 0.125;
+  h0 -= 8.0 * (g < 0x1p52 ? floor_pos(g) : g);
+  const double d0 = nearest(h0);
+  double a = (h0 - d0) + l0;
+  const double d1 = nearest(a);
+  dn = d0 + d1;
+  return a - d1;
+}
+
+//
+// The rest of the pieces summed without rounding down to 2^-103, so
+// the double closest to a multiple of pi/2, 2^-61 away, keeps its
+// precision.
+//
+PETLIB_VMATH_INLINE double reduce_pio2_large(double x, std::int64_t& n, double& rl) noexcept {
+  double xs, dn;
+  std::int64_t k;
+  const double a = reduce_pio2_head(x, xs, k, dn);
+  double l1, l2;
+  const double h1 = two_prod(xs, rempi_table.u[k + 1], l1);
+  const double h2 = two_prod(xs, rempi_table.u[k + 2], l2);
+  const double h3 = xs * rempi_table.u[k + 3];
+  double e;
+  double s = two_sum(a, h1, e);
+  const double d2 = nearest(s);
+  s -= d2;
+  // s + e + l1, multiples of 2^-103 below 1, as q + r exactly
+  double pe, qe;
+  const double p = two_sum(e, l1, pe);
+  const double q = two_sum(s, p, qe);
+  const double r = qe + pe;
+  double we;
+  const double w = two_sum(q, h2, we);
+  const double lo = ((r + we) + l2) + h3;
+  // times pi/2
+  double pl;
+  const double ph = two_prod(w, pio2_hi, pl);
+  pl += w * pio2_lo + lo * pio2_hi;
+  const double y = ph + pl;
+  rl = (ph - y) + pl;
+  round_int(dn + d2, n);
+  // odd in x
+  const double sg = copy_sign(1.0, x);
+  n = x < 0.0 ? -n : n;
+  rl *= sg;
+  return y * sg;
+}
+
+constexpr double S1 = -1.66666666666666324348e-01;
+constexpr double S2 = 8.33333333332248946124e-03;
+constexpr double S3 = -1.98412698298579493134e-04;
+constexpr double S4 = 2.75573137070700676789e-06;
+constexpr double S5 = -2.50507602534068634195e-08;
+constexpr double S6 = 1.58969099521155010221e-10;
+constexpr double C1 = 4.16666666666666019037e-02;
+constexpr double C2 = -1.38888888888741095749e-03;
+constexpr double C3 = 2.48015872894767294178e-05;
+constexpr double C4 = -2.75573143513906633035e-07;
+constexpr double C5 = 2.08757232129817482790e-09;
+constexpr double C6 = -1.13596475577881948265e-11;
+
+inline double sin_kernel(double r, double rl) noexcept {
+  const double z = r * r;
+  const double v = z * r;
+  const double p = S2 + z * (S3 + z * (S4 + z * (S5 + z * S6)));
+  return r - ((z * (0.5 * rl - v * p) - rl) - v * S1);
+}
+
+inline double cos_kernel(double r, double rl) noexcept {
+  const double z = r * r;
+  const double p = z * (C1 + z * (C2 + z * (C3 + z * (C4 + z * (C5 + z * C6)))));
+  const double hz = 0.5 * z;
+  const double w = 1.0 - hz;
+  return w + (((1.0 - w) - hz) + (z * p - r * rl));
+}
+
+// Cody-Waite for |x| <= trig_max
+PETLIB_VMATH_INLINE double reduce_pio2_small(double x, std::int64_t& n, double& rl) noexcept {
+  const double dn = round_int(x * two_over_pi, n);
+  // the products with pio2_1, pio2_2 and pio2_3 are exact
+  double e;
+  const double r = two_sum(x - dn * pio2_1, -dn * pio2_2, e);
+  const double lo = (e - dn * pio2_3) - dn * pio2_3t;
+  const double y = r + lo;
+  rl = (r - y) + lo;
+  return y;
+}
+
+PETLIB_VMATH_INLINE double reduce_pio2(double x, std::int64_t& n, double& rl) noexcept {
+  const bool big = abs(x) > trig_max;
+  const double y = reduce_pio2_small(big ? 0.0 : x, n, rl);
+  std::int64_t nb;
+  double rlb;
+  const double yb = reduce_pio2_large(x, nb, rlb);
+  n = big ? nb : n;
+  rl = big ? rlb : rl;
+  return big ? yb : y;
+}
+
+inline double negate_if(double x, std::int64_t flag) noexcept {
+  return from_bits(as_bits(x) ^ (std::uint64_t(flag & 1) << 63));
+}
+
+// sin of x = n pi/2 + (r + rl)
+PETLIB_VMATH_INLINE double sin_reduced(double r, double rl, std::int64_t n) noexcept {
+  const double s = sin_kernel(r, rl);
+  const double c = cos_kernel(r, rl);
+  return negate_if((n & 1) ? c : s, n >> 1);
+}
+
+PETLIB_VMATH_INLINE double sin(double x) noexcept {
+  std::int64_t n;
+  double rl;
+  const double r = reduce_pio2(x, n, rl);
+  const double v = sin_reduced(r, rl, n);
+  return abs(x) <= DBL_MAX ? v : nan;
+}
+
+PETLIB_VMATH_INLINE double cos(double x) noexcept {
+  std::int64_t n;
+  double rl;
+  const double r = reduce_pio2(x, n, rl);
+  const double v = sin_reduced(r, rl, n + 1);
+  return abs(x) <= DBL_MAX ? v : nan;
+}
+
+// sin and cos for |x| <= trig_max or nan
+PETLIB_VMATH_INLINE double sin_small(double x) noexcept {
+  std::int64_t n;
+  double rl;
+  const double r = reduce_pio2_small(x, n, rl);
+  return sin_reduced(r, rl, n);
+}
+
+PETLIB_VMATH_INLINE double cos_small(double x) noexcept {
+  std::int64_t n;
+  double rl;
+  const double r = reduce_pio2_small(x, n, rl);
+  return sin_reduced(r, rl, n + 1);
+}
+
+inline double tanh(double x) noexcept {
+  double ax = abs(x);
+  ax = ax > 22.0 ? 22.0 : ax;
+  const double e = expm1(2.0 * ax);
+  return copy_sign(e / (e + 2.0), x);
+}
+
+inline double sqrt(double x) noexcept { return std::sqrt(x); }
+
+//
+// fast tier: shorter polynomials and two part reductions
+//
+namespace fast {
+
+// e^r - 1 for |r| <= ln2/2, Taylor to r^7
+inline double expm1_poly(double r) noexcept {
+  double p = 1.0 / 5040.0;
+  p = p * r + 1.0 / 720.0;
+  p = p * r + 1.0 / 120.0;
+  p = p * r + 1.0 / 24.0;
+  p = p * r + 1.0 / 6.0;
+  p = p * r + 0.5;
+  return r + r * r * p;
+}
+
+inline double exp(double x) noexcept {
+  const double xc = x < -708.0 ? -708.0 : (x > 709.8 ? 709.8 : x);
+  std::int64_t n;
+  const double dn = round_int(xc * log2e, n);
+  const double r = (xc - dn * ln2_hi) - dn * ln2_lo;
+  const double v = (1.0 + expm1_poly(r)) * pow2(n >> 1) * pow2(n - (n >> 1));
+  return x < -708.0 ? 0.0 : v;
+}
+
+inline double expm1(double x) noexcept {
+  x = x > 709.8 ? 709.8 : x;
+  x = x < -40.0 ? -40.0 : x;
+  std::int64_t n;
+  const double dn = round_int(x * log2e, n);
+  const double r = (x - dn * ln2_hi) - dn * ln2_lo;
+  const double q = expm1_poly(r);
+  const double big = (1.0 + q) * pow2(n >> 1) * pow2(n - (n >> 1));
+  const double s = pow2(n);
+  return n > 56 ? big : s * q + (s - 1.0);
+}
+
+// log m = 2 atanh s to s^9
+inline double log(double x) noexcept {
+  double dk;
+  const double f = log_reduce(x, dk);
+  const double s = f / (2.0 + f);
+  const double z = s * s;
+  const double p = 2.0 + z * (2.0 / 3.0 + z * (2.0 / 5.0 + z * (2.0 / 7.0 + z * (2.0 / 9.0))));
+  const double r = dk * ln2_hi + (s * p + dk * ln2_lo);
+  return log_special(x, r);
+}
+
+inline double sin_kernel(double r) noexcept {
+  const double z = r * r;
+  return r + z * r * (S1 + z * (S2 + z * (S3 + z * S4)));
+}
+
+inline double cos_kernel(double r) noexcept {
+  const double z = r * r;
+  return 1.0 - 0.5 * z + z * z * (C1 + z * (C2 + z * (C3 + z * C4)));
+}
+
+// 2^-83 absolute is enough for the fast kernels
+PETLIB_VMATH_INLINE double reduce_pio2_large(double x, std::int64_t& n) noexcept {
+  double xs, dn;
+  std::int64_t k;
+  const double a = reduce_pio2_head(x, xs, k, dn);
+  double l1;
+  const double h1 = two_prod(xs, rempi_table.u[k + 1], l1);
+  double e;
+  double s = two_sum(a, h1, e);
+  const double d2 = nearest(s);
+  s -= d2;
+  s += (e + l1) + xs * rempi_table.u[k + 2];
+  round_int(dn + d2, n);
+  n = x < 0.0 ? -n : n;
+  return s * pio2_hi * copy_sign(1.0, x);
+}
+
+PETLIB_VMATH_INLINE double reduce_pio2_small(double x, std::int64_t& n) noexcept {
+  const double dn = round_int(x * two_over_pi, n);
+  return (x - dn * pio2_1) - dn * pio2_1t;
+}
+
+PETLIB_VMATH_INLINE double reduce_pio2(double x, std::int64_t& n) noexcept {
+  const bool big = abs(x) > trig_max;
+  const double y = reduce_pio2_small(big ? 0.0 : x, n);
+  std::int64_t nb;
+  const double yb = reduce_pio2_large(x, nb);
+  n = big ? nb : n;
+  return big ? yb : y;
+}
+
+PETLIB_VMATH_INLINE double sin_reduced(double r, std::int64_t n) noexcept {
+  return negate_if((n & 1) ? cos_kernel(r) : sin_kernel(r), n >> 1);
+}
+
+PETLIB_VMATH_INLINE double sin(double x) noexcept {
+  std::int64_t n;
+  const double r = reduce_pio2(x, n);
+  const double v = sin_reduced(r, n);
+  return abs(x) <= DBL_MAX ? v : nan;
+}
+
+PETLIB_VMATH_INLINE double cos(double x) noexcept {
+  std::int64_t n;
+  const double r = reduce_pio2(x, n);
+  const double v = sin_reduced(r, n + 1);
+  return abs(x) <= DBL_MAX ? v : nan;
+}
+
+PETLIB_VMATH_INLINE double sin_small(double x) noexcept {
+  std::int64_t n;
+  const double r = reduce_pio2_small(x, n);
+  return sin_reduced(r, n);
+}
+
+PETLIB_VMATH_INLINE double cos_small(double x) noexcept {
+  std::int64_t n;
+  const double r = reduce_pio2_small(x, n);
+  return sin_reduced(r, n + 1);
+}
+
+inline double tanh(double x) noexcept {
+  double ax = abs(x);
+  ax = ax > 22.0 ? 22.0 : ax;
+  const double e = expm1(2.0 * ax);
+  return copy_sign(e / (e + 2.0), x);
+}
+
+// x/sqrt(x) from the bit level estimate of 1/sqrt(x) and three
+// Newton steps, no sqrt instruction so no errno either
+inline double sqrt(double x) noexcept {
+  const bool sub = x < DBL_MIN;
+  const double xs = sub ? x * 0x1p108 : x;
+  double y = from_bits(0x5fe6eb50c7b537a9ULL - (as_bits(xs) >> 1));
+  const double hx = 0.5 * xs;
+  y = y * (1.5 - hx * y * y);
+  y = y * (1.5 - hx * y * y);
+  y = y * (1.5 - hx * y * y);
+  double r = xs * y * (sub ? 0x1p-54 : 1.0);
+  r = x == inf ? inf : r;
+  r = x < 0.0 ? nan : r;
+  return x == 0.0 ? x : r;
+}
+
+inline double pow(double x, double y) noexcept {
+  const double z = y * log(abs(x));
+  const bool big = !(abs(z) < 1e4);
+  return pow_special(x, y, exp(big ? copy_sign(1e4, z) : z));
+}
+
+}  // namespace fast
+
+}  // namespace vmath
+}  // namespace petlib
+#endif
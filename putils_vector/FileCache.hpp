@@ -1,198 +1,589 @@
+#pragma once
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <filesystem>
 #include <iostream>
+#include <mutex>
+#include <regex>
+#include <span>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
+#include "FileCacheCodec.hpp"
+
 namespace putils {
 
+/////////////////////////////////////////////////////
+//  Out of core byte stream spilled to numbered segment
+//    files prefix0.DAT prefix1.DAT ... of at most
+//    max_file_size bytes each, optionally striped over
+//    several directories.
+//  Data is staged through num_buffers buffers of
+//    buffer_size bytes. With one buffer every rollover
+//    blocks on the fwrite/fread. With two or more a
+//    background I/O thread writes the full buffers while
+//    the caller fills the next one, and on the read side
+//    reads ahead into the free buffers so getData only
+//    waits when it outruns the disk.
+//  A cache that never filled its first buffer is kept in
+//    memory and never touches the disk. Data put after a
+//    Close is appended to it.
+//  RewindMapped starts a read pass that maps the segments
+//    instead, see mapData.
+//  SetCodec compresses every staged buffer as one block,
+//    see FileCacheCodec.hpp. Blocks are then framed with a
+//    header, never split over two segments and the segments
+//    are named prefix0.ZDAT ... With num_workers threads the
+//    blocks are encoded and decoded in parallel while the
+//    segment I/O stays in order. Compression is off unless
+//    SetCodec is called and it costs CPU time: on one core
+//    the shuffle codecs run at about 1 GB/s for doubles and
+//    plain LZ of raw doubles at a third of that, so it pays
+//    on disks slower than that or with spare cores.
+//  putRecord frames the data in typed records and keeps an
+//    index of them (offset, count, type, crc32) that is saved
+//    next to the segments as prefix.IDX, getRecord then reads
+//    record k straight from its segment.
+/////////////////////////////////////////////////////
 struct FileCache {
-  FILE **fp;
-  char *buffer;
-  std::size_t buffer_size;
-  long curr_file;
-  std::string prefix;
-  bool reading;
-  bool has_ferror;
-  bool end_of_cache;
-  bool perserve;
-  constexpr long MAX_CACHE_FILE_SIZE = 1048576 * 1024 * 32;
-  constexpr long MAX_BUFFER_SIZE = 1048576 * 1024;
+  static constexpr std::size_t MAX_CACHE_FILE_SIZE = 1048576UL * 1024 * 32;
+  static constexpr std::size_t MAX_BUFFER_SIZE = 1048576UL * 1024;
 
   FileCache() = delete;
+  FileCache(const FileCache &) = delete;
+  FileCache &operator=(const FileCache &) = delete;
 
-  FileCache(const std::filesystem::path dir_path,
+  FileCache(const std::filesystem::path &dir_path,
             const std::string &file_prefix_,
-            std::size_t bufferSize = MAX_BUFFER_SIZE)
-      : fp(nullptr),
-        buffer(nullptr),
-        buffer_size(bufferSize),
-        curr_file(-1),
-        prefix(dir_path + file_prefix_),
+            std::size_t bufferSize = MAX_BUFFER_SIZE,
+            std::size_t numBuffers = 1,
+            std::size_t maxFileSize = MAX_CACHE_FILE_SIZE)
+      : FileCache(std::vector<std::filesystem::path>(1, dir_path),
+                  file_prefix_, bufferSize, numBuffers, maxFileSize) {}
+
+  /////////////////////////////////////////////////////
+  //  Stripe the segments round robin over several
+  //    directories, segment i goes to dir_paths[i % n].
+  //    Put each directory on its own disk and read the
+  //    cache back with one Reader per disk.
+  /////////////////////////////////////////////////////
+  FileCache(const std::vector<std::filesystem::path> &dir_paths,
+            const std::string &file_prefix_,
+            std::size_t bufferSize = MAX_BUFFER_SIZE,
+            std::size_t numBuffers = 1,
+            std::size_t maxFileSize = MAX_CACHE_FILE_SIZE)
+      : buffer_size(bufferSize ? bufferSize : 1),
+        num_buffers(numBuffers ? numBuffers : 1),
+        max_file_size(maxFileSize ? maxFileSize : MAX_CACHE_FILE_SIZE),
+        prefixes(),
         reading(false),
         has_ferror(false),
         end_of_cache(false),
         perserve(false) {
-    std::filesystem::create_directory(dir_path);
-    fp = (FILE **)malloc(sizeof(FILE *));
-    buffer = new char[buffer_size];
-    curr_file = -1;
-    open_memstream();
-  }
-
-  FileCache(const std::filesystem::path dir)
-      : fp(nullptr),
-        buffer(nullptr),
-        buffer_size(0),
-        curr_file(-1),
-        prefix(dir),
+    if (dir_paths.empty()) {
+      std::cerr << "FileCache needs at least one directory\n";
+      exit(EXIT_FAILURE);
+    }
+    for (auto &d : dir_paths) {
+      std::filesystem::create_directories(d);
+      prefixes.push_back((d / file_prefix_).string());
+    }
+    allocate_buffers();
+    reset_for_writing();
+  }
+
+  // open a cache left on disk by a perserved FileCache for reading
+  explicit FileCache(const std::filesystem::path &dir,
+                     std::size_t bufferSize = MAX_BUFFER_SIZE,
+                     std::size_t numBuffers = 1)
+      : FileCache(std::vector<std::filesystem::path>(1, dir), bufferSize,
+                  numBuffers) {}
+
+  // the stripe directories must be given in the order they were written
+  explicit FileCache(const std::vector<std::filesystem::path> &dirs,
+                     std::size_t bufferSize = MAX_BUFFER_SIZE,
+                     std::size_t numBuffers = 1)
+      : buffer_size(bufferSize ? bufferSize : 1),
+        num_buffers(numBuffers ? numBuffers : 1),
+        max_file_size(MAX_CACHE_FILE_SIZE),
+        prefixes(),
         reading(true),
         has_ferror(false),
         end_of_cache(false),
-        perserve(false) {
-    std::filesystem::dir_(dir);
-    std::filesystem::directory_iterator iter(dir);
-    std::filesystem::director_entry f0(*iter);
-    if (!f0.is_regular_file()) {
-      std::cerr << "Weird file in cache directory not a regular file\n";
+        perserve(true) {
+    // The prefix may end in a digit itself, so it is read off
+    //   segment 0, which is named prefix0 in the first directory.
+    //   Every other segment has to be prefix followed by a
+    //   number written without leading zeros.
+    const std::regex seg_name("(.*)\\.(Z?)DAT");
+    std::vector<std::vector<std::pair<std::string, std::size_t>>> names(
+        dirs.size());
+    for (std::size_t id = 0; id < dirs.size(); ++id) {
+      for (auto &p : std::filesystem::directory_iterator(dirs[id])) {
+        if (!p.is_regular_file()) {
+          std::cerr << "Weird file in cache directory not a regular file\n";
+          std::cerr << p.path() << "\n";
+          exit(EXIT_FAILURE);
+        }
+        std::smatch m;
+        std::string name = p.path().filename().string();
+        if (!std::regex_match(name, m, seg_name)) continue;
+        names[id].emplace_back(name, p.file_size());
+      }
+    }
+    std::string stem;
+    std::size_t nstems = 0;
+    for (auto &c : names[0]) {
+      std::smatch m;
+      std::regex_match(c.first, m, seg_name);
+      const std::string base = m[1];
+      if (base.empty() || base.back() != '0') continue;
+      const std::string cand = base.substr(0, base.size() - 1);
+      const bool zdat = m[2].length() != 0;
+      bool all = true;
+      for (auto &v : names)
+        for (auto &n : v) all = all && segment_number(n.first, cand, zdat) >= 0;
+      if (!all) continue;
+      stem = cand;
+      framed = zdat;
+      ++nstems;
+    }
+    if (nstems > 1 || (nstems == 0 && !names[0].empty())) {
+      std::cerr << "More than one cache in directory " << dirs[0] << "\n";
       exit(EXIT_FAILURE);
     }
-    std::filesystem::path p0(f0.path());
-    prefix = p0.filename();
-    buffer_size = p0.file_size();
-    for (auto &p : iter) {
-      if (!p.is_regular_file()) {
-        std::cerr << "Weird file in cache directory not a regular file\n";
-        std::cerr << p.filename() << "\n";
+    std::vector<std::pair<long, std::size_t>> segs;
+    for (std::size_t id = 0; id < dirs.size(); ++id) {
+      for (auto &n : names[id]) {
+        long no = segment_number(n.first, stem, framed);
+        if (no < 0) {
+          std::cerr << "More than one cache in directory " << dirs[id] << "\n";
+          exit(EXIT_FAILURE);
+        }
+        if (std::size_t(no) % dirs.size() != id) {
+          std::cerr << "Cache segment " << n.first << " in the wrong stripe "
+                    << dirs[id] << "\n";
+          exit(EXIT_FAILURE);
+        }
+        segs.emplace_back(no, n.second);
+      }
+    }
+    std::sort(segs.begin(), segs.end());
+    for (std::size_t i = 0; i < segs.size(); ++i) {
+      if (segs[i].first != long(i)) {
+        std::cerr << "Cache segment " << i << " missing\n";
         exit(EXIT_FAILURE);
       }
-      size_t sz = p.file_size();
-      fsizes.push_back(sz);
+      fsizes.push_back(segs[i].second);
+      total_bytes += segs[i].second;
+      if (segs[i].second > max_file_size) max_file_size = segs[i].second;
     }
-    fp = (FILE **)malloc(sizeof(FILE *));
-    buffer = new char[buffer_size];
-    curr_file = -1;
-    open_memstream();
+    num_files = fsizes.size();
+    for (auto &d : dirs) prefixes.push_back((d / stem).string());
+    allocate_buffers();
+    in_memory = false;
+    read_index();
+    Rewind();
   }
 
   ~FileCache() {
-    close();
-    if (!perserve)
+    Close();
+    stop_io_thread();
+    ra_close();
+    if (!perserve) {
       RemoveFiles();
-    else {
-      std::string name = generate_filename(0);
-      *fp = Fopen(name, "w");
-      Fwrite(buffer, 1, fsize[0], *fp);
-      fclose(*fp);
+    } else if (in_memory && mem_size) {
+      framed = false;
+      FILE *f = Fopen(generate_filename(0).c_str(), "w");
+      Fwrite(bufs[0].data(), 1, mem_size, f);
+      fclose(f);
     }
-    delete[] buffer;
-    free(fp);
   }
 
   void SetPerserve() { perserve = true; }
 
-  void Open(std::string &openstr = std::string("r+")) {
-    if (*fp) fclose(*fp);
-    curr_file = 0;
-    *fp = Fmemopen(reinterpret_cast<void *>(buffer), bsize, openstr.c_str());
+  /////////////////////////////////////////////////////
+  //  Compress the cache with codec, width is the size of
+  //    the values for the shuffle codecs. With more than one
+  //    buffer numWorkers threads share the encoding and the
+  //    decoding. Only allowed before any data is put.
+  /////////////////////////////////////////////////////
+  void SetCodec(CacheCodec codec_, std::size_t width = sizeof(double),
+                std::size_t numWorkers = 1) {
+    if (reading || !in_memory || apos || !fsizes.empty()) {
+      std::cerr << "the codec must be set on an empty cache\n";
+      exit(EXIT_FAILURE);
+    }
+    stop_io_thread();
+    codec = codec_;
+    codec_width = width ? width : 1;
+    num_workers = numWorkers ? numWorkers : 1;
+    framed = codec != CacheCodec::None;
+    allocate_buffers();
   }
 
+  /////////////////////////////////////////////////////
+  //  Finish the current pass. Writing flushes every
+  //    staged buffer to disk, reading drops the read ahead.
+  /////////////////////////////////////////////////////
   void Close() {
-    if (!*fp) return;
     if (reading) {
-      close_current_input_file();
-      curr_file = -1;
+      stop_prefetch();
+      close_input();
+      unmap_segments();
+      mapped = false;
     } else {
-      close_current_output_file();
-      curr_file = -1;
+      if (active >= 0 && apos) {
+        if (in_memory) {
+          mem_size = apos;
+        } else {
+          submit_write_buffer();
+        }
+      }
+      wait_io_idle();
+      close_output();
+      active = -1;
+      apos = 0;
+      if (!records.empty()) write_index();
     }
   }
 
   template <typename T>
-  constexpr size_t getData(T *data_ptr, size_t n) {
-    long pos = ftellg(*fp);
-    long f_end = fsizes[curr_file];
-    size_t dsize = sizeof(T) * n;
-    size_t left = f_end - pos;
-    if (dsize <= left) {
-      size_t nrd = Fread(data_ptr, sizeof(T), n, *fp);
-      if (nrd != n) has_ferror = true;
-      return nrd;
-    } else {
-      size_t n_now = left / sizeof(T);
-      if (n_now) {
-        size_t n_rd = Fread(data_ptr, sizeof(T), n_now, *fp);
-        if (n_rd != n_now) {
-          has_ferror = true;
-          return n_rd;
+  size_t getData(T *data_ptr, size_t n) {
+    char *dst = reinterpret_cast<char *>(data_ptr);
+    size_t bytes = sizeof(T) * n;
+    if (mapped) return mapped_copy(dst, bytes) / sizeof(T);
+    size_t done = 0;
+    while (done < bytes) {
+      if (active < 0 || apos == fill[active]) {
+        if (!next_read_buffer()) {
+          end_of_cache = true;
+          break;
         }
       }
-      if ((curr_file + 1L) == fsizes.size()) {
-        end_of_cache = true;
-        return n_now;
-      }
-      close_current_input_file();
-      open_new_file_for_reading();
-      size_t nex = getData<T>(data_ptr + n_now, (n - n_now));
-      return (n_now + nex);
+      size_t k = std::min(bytes - done, fill[active] - apos);
+      std::memcpy(dst + done, bufs[active].data() + apos, k);
+      apos += k;
+      done += k;
+    }
+    return done / sizeof(T);
+  }
+
+  /////////////////////////////////////////////////////
+  //  Zero copy read during a RewindMapped pass.
+  //  Returns up to n values straight out of the mapped segment,
+  //    fewer at the end of a segment and none at the end of the
+  //    cache. A value split over two segments is returned alone
+  //    through a bounce buffer. The span stays valid until the
+  //    next call that moves past its segment, Rewind or Close.
+  //  Values are aligned when the cache holds a single type
+  //    and the segment size is a multiple of its size.
+  /////////////////////////////////////////////////////
+  template <typename T>
+  std::span<const T> mapData(size_t n) {
+    if (!mapped) {
+      std::cerr << "mapData needs a RewindMapped pass\n";
+      exit(EXIT_FAILURE);
+    }
+    if (in_memory) {
+      size_t k = std::min(n, (fill[0] - apos) / sizeof(T));
+      const T *p = reinterpret_cast<const T *>(bufs[0].data() + apos);
+      apos += k * sizeof(T);
+      if (k < n) end_of_cache = true;
+      return std::span<const T>(p, k);
     }
+    while (map_ptr && map_pos == map_len) advance_map();
+    if (!map_ptr) {
+      end_of_cache = true;
+      return std::span<const T>();
+    }
+    size_t avail = (map_len - map_pos) / sizeof(T);
+    if (avail == 0) {
+      bounce.resize(sizeof(T));
+      if (mapped_copy(bounce.data(), sizeof(T)) != sizeof(T))
+        return std::span<const T>();
+      return std::span<const T>(reinterpret_cast<const T *>(bounce.data()), 1);
+    }
+    size_t k = std::min(n, avail);
+    const T *p = reinterpret_cast<const T *>(map_ptr + map_pos);
+    map_pos += k * sizeof(T);
+    return std::span<const T>(p, k);
   }
 
   template <typename T>
-  constexpr size_t putData(T *data_ptr, size_t n) {
+  size_t putData(const T *data_ptr, size_t n) {
     if (reading) {
       std::cerr << "need to close cache and clear to put data!\n";
       exit(EXIT_FAILURE);
     }
-    long pos = ftellg(*fp);
-    long f_end = MAX_CACHE_FILE_SIZE;
-    size_t dsize = sizeof(T) * n;
-    size_t left = f_end - pos;
-    if (dsize <= left) {
-      size_t nwr = Fwrite(data_ptr, sizeof(T), n, *fp);
-      if (nwr != n) has_ferror = true;
-      return nwr;
-    } else {
-      size_t n_now = left / sizeof(T);
-      if (n_now) {
-        size_t nwr = Fwrite(data_ptr, sizeof(T), n_now, *fp);
-        if (nwr != n_now) {
-          has_ferror = true;
-          return nwr;
-        }
-      }
-      close_current_output_file();
-      open_new_file_for_writing();
-      size_t nex = putData<T>(data_ptr + n_now, (n - n_now));
-      return (n_now + nex);
+    const char *src = reinterpret_cast<const char *>(data_ptr);
+    size_t bytes = sizeof(T) * n;
+    size_t done = 0;
+    while (done < bytes) {
+      if (active < 0) acquire_write_buffer();
+      size_t k = std::min(bytes - done, buffer_size - apos);
+      std::memcpy(bufs[active].data() + apos, src + done, k);
+      apos += k;
+      done += k;
+      if (apos == buffer_size) submit_write_buffer();
     }
+    put_pos += bytes;
+    return n;
   }
 
-  constexpr void ClearError() {
+  void ClearError() {
     has_ferror = false;
     end_of_cache = false;
   }
 
-  constexpr bool EndOfCache() const noexcept { return end_of_cache; }
+  bool EndOfCache() const noexcept { return end_of_cache; }
+  bool Error() const noexcept { return has_ferror; }
+  bool Reading() const noexcept { return reading; }
+  bool Writing() const noexcept { return !reading; }
+  size_t NumberOfFiles() const noexcept { return num_files.load(); }
+  size_t NumberOfBuffers() const noexcept { return num_buffers; }
+  CacheCodec Codec() const noexcept { return codec; }
+  size_t TotalSize() const noexcept {
+    return in_memory ? mem_size : total_bytes.load();
+  }
+  bool Perserve() const noexcept { return perserve; }
+  bool InMemory() const noexcept { return in_memory; }
+  const std::string &Prefix() const noexcept { return prefixes[0]; }
+  size_t NumberOfStripes() const noexcept { return prefixes.size(); }
 
-  constexpr bool Error() const noexcept { return has_ferror; }
+  /////////////////////////////////////////////////////
+  //  Independent reader over the segments s with
+  //    s % num_readers == id. It has its own file handle and
+  //    buffers, so several threads can read a closed cache at
+  //    once, each with a Reader of its own. With one reader per
+  //    stripe directory every thread stays on its own disk.
+  //  getData stops at the end of the current segment and
+  //    NextSegment moves on to the next segment owned, so the
+  //    data should be written in records that do not straddle
+  //    segments (maxFileSize a multiple of the record size).
+  /////////////////////////////////////////////////////
+  class Reader {
+   public:
+    Reader(const FileCache &cache_, std::size_t id_, std::size_t num_readers)
+        : cache(&cache_),
+          id(id_),
+          stride(num_readers ? num_readers : 1),
+          seg(-1),
+          fp(nullptr),
+          pos(0),
+          bfill(0),
+          bpos(0) {
+      if (cache->framed) {
+        buf.resize(cache->buffer_size);
+        zbuf.resize(lz_bound(cache->buffer_size));
+        tbuf.resize(cache->buffer_size);
+      }
+    }
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+    Reader(Reader &&r) noexcept
+        : cache(r.cache),
+          id(r.id),
+          stride(r.stride),
+          seg(r.seg),
+          fp(r.fp),
+          pos(r.pos),
+          buf(std::move(r.buf)),
+          zbuf(std::move(r.zbuf)),
+          tbuf(std::move(r.tbuf)),
+          bfill(r.bfill),
+          bpos(r.bpos) {
+      r.fp = nullptr;
+    }
+    ~Reader() {
+      if (fp) fclose(fp);
+    }
 
-  constexpr bool Reading() const noexcept { return reading; }
-  constexpr bool Writing() const noexcept { return !reading; }
-  constexpr size_t NumberOfFiles() const noexcept { return fsizes.size(); }
-  constexpr size_t TotalSize() const noexcept {
-    size_t sum = 0;
-    for (auto i = 0; i < fsizes.size(); ++i) sum += fsizes[i];
-    return sum;
+    // open the next segment owned by this reader, false when done
+    bool NextSegment() {
+      if (fp) fclose(fp);
+      fp = nullptr;
+      seg = (seg < 0) ? long(id) : seg + long(stride);
+      pos = bfill = bpos = 0;
+      if (std::size_t(seg) >= NumberOfSegments()) return false;
+      if (!cache->in_memory) {
+        fp = Fopen(cache->generate_filename(seg).c_str(), "r");
+        setvbuf(fp, nullptr, _IONBF, 0);
+      }
+      return true;
+    }
+
+    long Segment() const noexcept { return seg; }
+    std::size_t SegmentSize() const noexcept {
+      return cache->in_memory ? cache->mem_size : cache->fsizes[seg];
+    }
+    std::size_t NumberOfSegments() const noexcept {
+      if (cache->in_memory) return cache->mem_size ? 1 : 0;
+      return cache->fsizes.size();
+    }
+    bool EndOfSegment() const noexcept {
+      return pos == SegmentSize() && bpos == bfill;
+    }
+
+    // read up to n values from the current segment
+    template <typename T>
+    size_t getData(T *data_ptr, size_t n) {
+      if (seg < 0 || std::size_t(seg) >= NumberOfSegments()) return 0;
+      char *dst = reinterpret_cast<char *>(data_ptr);
+      size_t bytes = sizeof(T) * n;
+      size_t done = 0;
+      if (cache->in_memory) {
+        done = std::min(bytes, cache->mem_size - pos);
+        std::memcpy(dst, cache->bufs[0].data() + pos, done);
+        pos += done;
+      } else if (!cache->framed) {
+        done = Fread(dst, 1, std::min(bytes, SegmentSize() - pos), fp);
+        pos += done;
+      } else {
+        while (done < bytes) {
+          if (bpos == bfill && !next_block()) break;
+          size_t k = std::min(bytes - done, bfill - bpos);
+          std::memcpy(dst + done, buf.data() + bpos, k);
+          bpos += k;
+          done += k;
+        }
+      }
+      return done / sizeof(T);
+    }
+
+   private:
+    const FileCache *cache;
+    std::size_t id;
+    std::size_t stride;
+    long seg;
+    FILE *fp;
+    std::size_t pos;
+    std::vector<char> buf;
+    std::vector<char> zbuf;
+    std::vector<char> tbuf;
+    std::size_t bfill;
+    std::size_t bpos;
+
+    bool next_block() {
+      block_header h;
+      if (pos + sizeof(h) > SegmentSize()) return false;
+      if (Fread(&h, sizeof(h), 1, fp) != 1 || h.raw_size > buf.size() ||
+          h.stored_size > zbuf.size() ||
+          Fread(zbuf.data(), 1, h.stored_size, fp) != h.stored_size ||
+          !codec_decode(CacheCodec(h.codec), h.width, zbuf.data(),
+                        h.stored_size, buf.data(), h.raw_size, tbuf.data())) {
+        std::cerr << "corrupt block in cache segment " << seg << "\n";
+        pos = SegmentSize();
+        return false;
+      }
+      pos += sizeof(h) + h.stored_size;
+      bfill = h.raw_size;
+      bpos = 0;
+      return true;
+    }
+  };
+
+  // the cache must be closed for writing first
+  Reader MakeReader(std::size_t id, std::size_t num_readers) const {
+    if (!reading && active >= 0) {
+      std::cerr << "Close the cache before making readers\n";
+      exit(EXIT_FAILURE);
+    }
+    return Reader(*this, id, num_readers);
+  }
+
+  // one entry of the record index
+  struct RecordInfo {
+    std::uint64_t offset;  // byte offset in the cache stream
+    std::uint64_t count;
+    std::uint32_t type_size;
+    std::uint32_t type_code;
+    std::uint32_t tag;
+    std::uint32_t checksum;
+  };
+
+  // small codes for the arithmetic types, 0 for anything else
+  template <typename T>
+  static constexpr std::uint32_t TypeCode() noexcept {
+    if constexpr (std::is_same_v<T, char>) return 1;
+    if constexpr (std::is_same_v<T, std::int32_t>) return 2;
+    if constexpr (std::is_same_v<T, std::uint32_t>) return 3;
+    if constexpr (std::is_same_v<T, std::int64_t>) return 4;
+    if constexpr (std::is_same_v<T, std::uint64_t>) return 5;
+    if constexpr (std::is_same_v<T, float>) return 6;
+    if constexpr (std::is_same_v<T, double>) return 7;
+    return 0;
+  }
+
+  /////////////////////////////////////////////////////
+  //  Put n values as record NumberOfRecords(), tag is free
+  //    for the caller. Returns the record number.
+  /////////////////////////////////////////////////////
+  template <typename T>
+  std::size_t putRecord(const T *data_ptr, size_t n, std::uint32_t tag = 0) {
+    RecordInfo r;
+    r.offset = put_pos;
+    r.count = n;
+    r.type_size = sizeof(T);
+    r.type_code = TypeCode<T>();
+    r.tag = tag;
+    r.checksum = crc32(data_ptr, sizeof(T) * n);
+    putData(data_ptr, n);
+    records.push_back(r);
+    return records.size() - 1;
+  }
+
+  size_t NumberOfRecords() const noexcept { return records.size(); }
+  const RecordInfo &Record(std::size_t k) const noexcept { return records[k]; }
+
+  /////////////////////////////////////////////////////
+  //  Random access read of record k into data_ptr (room for
+  //    n values) without touching the rest of the cache.
+  //    Returns the number of values read, 0 if the type does
+  //    not match, and sets Error when the checksum fails.
+  //  On a compressed cache the blocks holding the record are
+  //    decoded, a smaller bufferSize makes random reads cheaper.
+  //  Needs a closed cache, not thread safe, use one FileCache
+  //    per thread for concurrent random reads.
+  /////////////////////////////////////////////////////
+  template <typename T>
+  size_t getRecord(std::size_t k, T *data_ptr, size_t n) {
+    if (!reading && active >= 0) {
+      std::cerr << "Close the cache before reading records\n";
+      exit(EXIT_FAILURE);
+    }
+    if (k >= records.size()) return 0;
+    const RecordInfo &r = records[k];
+    if (r.type_size != sizeof(T) || r.type_code != TypeCode<T>()) {
+      std::cerr << "record " << k << " does not hold this type\n";
+      return 0;
+    }
+    size_t m = std::min<size_t>(n, r.count);
+    if (!read_at(r.offset, reinterpret_cast<char *>(data_ptr), sizeof(T) * m))
+      has_ferror = true;
+    if (m == r.count && crc32(data_ptr, sizeof(T) * m) != r.checksum) {
+      std::cerr << "checksum mismatch in record " << k << "\n";
+      has_ferror = true;
+    }
+    return m;
   }
-  constexpr bool Perserve() const noexcept { return perserve; }
-  constexpr bool InMemory() const noexcept { return fsizes.size() == 1; }
-  constexpr void RemoveFiles() const noexcept {
-    close();
-    for (auto i = 0; i < fsizes.size(); ++i) {
+
+  void RemoveFiles() {
+    for (size_t i = 0; i < fsizes.size(); ++i) {
+      std::error_code ec;
       std::filesystem::path p = generate_filename(i);
       std::filesystem::remove(p, ec);
       if (ec) {
@@ -200,138 +591,745 @@ struct FileCache {
                   << "\n";
       }
     }
+    std::error_code ec;
+    std::filesystem::remove(index_filename(), ec);
+  }
+
+  /////////////////////////////////////////////////////
+  //  Finish the current pass and start reading from the
+  //    beginning of the cache
+  /////////////////////////////////////////////////////
+  void Rewind() {
+    Close();
+    ClearError();
+    in_file = 0;
+    in_pos = 0;
+    active = -1;
+    apos = 0;
+    mapped = false;
+    std::unique_lock<std::mutex> lock(mtx);
+    reading = true;
+    free_q.clear();
+    full_q.clear();
+    if (in_memory) {
+      fill[0] = mem_size;
+      active = 0;
+      input_done = true;
+      return;
+    }
+    for (size_t i = 0; i < num_buffers; ++i) free_q.push_back(int(i));
+    read_seq = 0;
+    consume_seq = 0;
+    input_done = fsizes.empty();
+    lock.unlock();
+    cv.notify_all();
   }
-  constexpr void Rewind() noexcept {
-    clearerr();
-    if (mode == WRITE) {
-      close_current_output_file();
+
+  /////////////////////////////////////////////////////
+  //  Finish the current pass and start a read pass over
+  //    memory mapped segments. The segment being read is
+  //    advised MADV_SEQUENTIAL, the next one is mapped ahead
+  //    with MADV_WILLNEED and a segment is unmapped as soon as
+  //    the pass leaves it. getData copies straight out of the
+  //    mapping and mapData hands out spans into it.
+  /////////////////////////////////////////////////////
+  void RewindMapped() {
+    if (framed && !in_memory) {
+      std::cerr << "a compressed cache can not be mapped\n";
+      exit(EXIT_FAILURE);
+    }
+    Close();
+    ClearError();
+    active = -1;
+    apos = 0;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      reading = true;
+      input_done = true;
+      free_q.clear();
+      full_q.clear();
     }
-    if (mode == READ) {
-      close_current_input_file();
+    mapped = true;
+    if (in_memory) {
+      fill[0] = mem_size;
+      return;
     }
-    curr_file = -1;
-    open_new_file_for_reading();
+    map_file = 0;
+    next_ptr = map_segment(0, next_len);
+    advance_map();
   }
 
-  constexpr void Clear() noexcept {
-    curr_file = -1;
+  // throw away the contents and start writing again
+  void Clear() {
+    Close();
+    ra_close();
+    RemoveFiles();
     fsizes.clear();
-    open_new_file_for_writing();
+    num_files = 0;
+    total_bytes = 0;
+    reset_for_writing();
   }
 
-  constexpr std::string Prefix() const noexcept { return prefix; }
-
  private:
-  std::string generate_filename(long no) {
-    std::string fname = prefix;
+  // header in front of every block of a compressed cache
+  struct block_header {
+    std::uint64_t raw_size;
+    std::uint64_t stored_size;
+    std::uint32_t codec;
+    std::uint32_t width;
+  };
+
+  std::size_t buffer_size;
+  std::size_t num_buffers;
+  std::size_t max_file_size;
+  std::vector<std::string> prefixes;
+  bool reading;
+  bool has_ferror;
+  bool end_of_cache;
+  bool perserve;
+  bool in_memory = true;
+  std::size_t mem_size = 0;
+  std::vector<std::size_t> fsizes;
+  // segment count and bytes, fsizes grows on the I/O side while
+  // the caller may ask for these
+  std::atomic<std::size_t> num_files{0};
+  std::atomic<std::size_t> total_bytes{0};
+  // staging buffers, active is the one the caller works on
+  std::vector<std::vector<char>> bufs;
+  std::vector<std::size_t> fill;
+  int active = -1;
+  std::size_t apos = 0;
+  // block codec, zbufs hold the encoded blocks and tbufs scratch
+  CacheCodec codec = CacheCodec::None;
+  std::size_t codec_width = sizeof(double);
+  std::size_t num_workers = 1;
+  bool framed = false;
+  std::vector<std::vector<char>> zbufs;
+  std::vector<std::vector<char>> tbufs;
+  std::vector<block_header> zhead;
+  // output segment being appended, owned by the I/O side
+  FILE *out_fp = nullptr;
+  // input position, owned by the I/O side
+  FILE *in_fp = nullptr;
+  std::size_t in_file = 0;
+  std::size_t in_pos = 0;
+  // background workers, free_q and full_q hold buffer indices and
+  // seq orders the blocks so the segment I/O stays sequential
+  std::vector<std::thread> workers;
+  std::mutex mtx;
+  std::mutex read_mtx;
+  std::condition_variable cv;
+  std::deque<int> free_q;
+  std::deque<int> full_q;
+  std::vector<std::size_t> seq;
+  std::size_t next_seq = 0;
+  std::size_t write_seq = 0;
+  std::size_t read_seq = 0;
+  std::size_t consume_seq = 0;
+  int io_busy = 0;
+  bool io_error = false;
+  bool input_done = true;
+  bool quit = false;
+  // mapped read pass, the current segment map_file - 1 and the next one
+  bool mapped = false;
+  const char *map_ptr = nullptr;
+  std::size_t map_len = 0;
+  std::size_t map_pos = 0;
+  const char *next_ptr = nullptr;
+  std::size_t next_len = 0;
+  std::size_t map_file = 0;
+  std::vector<char> bounce;
+  // record index, and for a framed cache where every block starts
+  struct block_info {
+    std::uint64_t offset;  // byte offset in the cache stream
+    std::uint64_t segment;
+    std::uint64_t file_offset;
+    std::uint64_t raw_size;
+  };
+  std::uint64_t put_pos = 0;
+  std::uint64_t block_pos = 0;
+  std::vector<RecordInfo> records;
+  std::vector<block_info> blocks;
+  // random access state of getRecord
+  FILE *ra_fp = nullptr;
+  long ra_seg = -1;
+  long ra_block = -1;
+  std::vector<char> ra_buf;
+  std::vector<char> ra_zbuf;
+
+  bool async() const noexcept { return num_buffers > 1; }
+
+  // the segment number of name if it is stem<number>.DAT (.ZDAT when
+  // framed), otherwise -1
+  static long segment_number(const std::string &name, const std::string &stem,
+                             bool zdat) {
+    const std::string ext = zdat ? ".ZDAT" : ".DAT";
+    if (name.size() <= stem.size() + ext.size() ||
+        name.compare(0, stem.size(), stem) != 0 ||
+        name.compare(name.size() - ext.size(), ext.size(), ext) != 0)
+      return -1;
+    const std::string digits =
+        name.substr(stem.size(), name.size() - stem.size() - ext.size());
+    if (digits.size() > 18 || (digits.size() > 1 && digits[0] == '0'))
+      return -1;
+    for (char c : digits)
+      if (c < '0' || c > '9') return -1;
+    return std::stol(digits);
+  }
+
+  std::string generate_filename(long no) const {
+    std::string fname = prefixes[std::size_t(no) % prefixes.size()];
     fname += std::to_string(no);
-    fname += ".DAT";
+    fname += framed ? ".ZDAT" : ".DAT";
     return fname;
   }
 
-  void open_memstream_buffer() {
-    if (reading) {
-      *fp = Fmemopen(reinterpret_cast<void *>(buffer), bsize, "r");
-    } else {
-      *fp = Fmemopen(reinterpret_cast<void *>(buffer), bsize, "w");
-    }
+  void allocate_buffers() {
+    bufs.resize(num_buffers);
+    for (auto &b : bufs) b.resize(buffer_size);
+    fill.assign(num_buffers, 0);
+    seq.assign(num_buffers, 0);
+    zhead.assign(num_buffers, block_header{});
+    zbufs.resize(framed ? num_buffers : 0);
+    tbufs.resize(framed ? num_buffers : 0);
+    for (auto &b : zbufs) b.resize(lz_bound(buffer_size));
+    for (auto &b : tbufs) b.resize(buffer_size);
+    if (!async()) return;
+    quit = false;
+    std::size_t nw = framed ? num_workers : 1;
+    for (std::size_t i = 0; i < nw; ++i)
+      workers.emplace_back(&FileCache::io_loop, this);
   }
 
-  void open_new_file_for_writing() {
+  void reset_for_writing() {
+    in_memory = true;
+    mem_size = 0;
+    active = -1;
+    apos = 0;
+    ClearError();
+    std::lock_guard<std::mutex> lock(mtx);
     reading = false;
-    if (*fp) {
-      fclose(*fp);
-    }
-    if (curr_file == -1) {
-      open_memstream_buffer();
-      curr_file = 0;
-      fsizes.size() = 0;
-      fsizes.clear();
-    } else {
-      curr_file += 1;
-      std::string new_name = generate_filename(curr_file);
-      *fp = Fopen(new_name.c_str(), "w");
-      if (fsizes.size() > curr_file)
-        fsizes[curr_file] = 0;
-      else
-        fsizes.push_back(0L);
+    free_q.clear();
+    full_q.clear();
+    for (size_t i = 0; i < num_buffers; ++i) free_q.push_back(int(i));
+    next_seq = 0;
+    write_seq = 0;
+    put_pos = 0;
+    block_pos = 0;
+    records.clear();
+    blocks.clear();
+    ra_block = -1;
+  }
+
+  void stop_io_thread() {
+    if (workers.empty()) return;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      quit = true;
     }
+    cv.notify_all();
+    for (auto &w : workers) w.join();
+    workers.clear();
   }
-  void open_new_file_for_reading() {
-    reading = true;
-    if (*fp) {
-      fclose(*fp);
+
+  /////////////////////////////////////////////////////
+  //  While writing a worker encodes a full buffer then waits
+  //    for its turn to append it. While reading a worker loads
+  //    the next block in turn into a free buffer, then decodes
+  //    it alongside the others.
+  /////////////////////////////////////////////////////
+  void io_loop() {
+    std::unique_lock<std::mutex> lock(mtx);
+    for (;;) {
+      cv.wait(lock, [this] {
+        if (quit) return true;
+        if (!reading) return !full_q.empty();
+        return !input_done && !free_q.empty();
+      });
+      if (quit) return;
+      if (!reading) {
+        int b = full_q.front();
+        full_q.pop_front();
+        ++io_busy;
+        lock.unlock();
+        encode_block(b);
+        lock.lock();
+        cv.wait(lock, [this, b] { return write_seq == seq[b]; });
+        lock.unlock();
+        bool ok = store_block(b);
+        lock.lock();
+        --io_busy;
+        ++write_seq;
+        if (!ok) io_error = true;
+        free_q.push_back(b);
+      } else {
+        int b = free_q.front();
+        free_q.pop_front();
+        ++io_busy;
+        lock.unlock();
+        std::size_t s;
+        std::size_t nr;
+        bool at_end;
+        bool ok;
+        {
+          std::lock_guard<std::mutex> rlock(read_mtx);
+          s = read_seq++;
+          nr = load_block(b, ok);
+          at_end = in_file >= fsizes.size();
+        }
+        ok = decode_block(b) && ok;
+        lock.lock();
+        --io_busy;
+        if (!ok) io_error = true;
+        if (at_end) input_done = true;
+        if (nr) {
+          seq[b] = s;
+          full_q.push_back(b);
+        } else {
+          free_q.push_back(b);
+        }
+      }
+      cv.notify_all();
+    }
+  }
+
+  void wait_io_idle() {
+    if (!async()) return;
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this] { return !io_busy && full_q.empty(); });
+    if (io_error) has_ferror = true;
+  }
+
+  void stop_prefetch() {
+    if (!async()) return;
+    std::unique_lock<std::mutex> lock(mtx);
+    input_done = true;
+    cv.wait(lock, [this] { return !io_busy; });
+  }
+
+  void acquire_write_buffer() {
+    // a pass closed while the cache was still in memory left its data
+    // in buffer 0, which was never handed back, so carry on after it
+    if (in_memory && mem_size) {
+      active = 0;
+      apos = mem_size;
+      mem_size = 0;
+      return;
+    }
+    if (!async()) {
+      active = 0;
+      apos = 0;
+      return;
+    }
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this] { return !free_q.empty(); });
+    active = free_q.front();
+    free_q.pop_front();
+    apos = 0;
+    if (io_error) has_ferror = true;
+  }
+
+  void submit_write_buffer() {
+    in_memory = false;
+    fill[active] = apos;
+    if (!async()) {
+      encode_block(active);
+      if (!store_block(active)) has_ferror = true;
+      apos = 0;
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      seq[active] = next_seq++;
+      full_q.push_back(active);
     }
-    if (curr_file == -1) {
-            open_memstream_buffer(std:string("r");    
-            curr_file = 0;
+    cv.notify_all();
+    active = -1;
+    apos = 0;
+  }
+
+  bool next_read_buffer() {
+    if (in_memory) return false;
+    if (!async()) {
+      bool ok;
+      std::size_t nr = load_block(0, ok);
+      if (!ok) has_ferror = true;
+      if (nr == 0) return false;
+      if (!decode_block(0)) has_ferror = true;
+      active = 0;
+      apos = 0;
+      return true;
+    }
+    std::unique_lock<std::mutex> lock(mtx);
+    if (active >= 0) {
+      free_q.push_back(active);
+      active = -1;
+      cv.notify_all();
+    }
+    auto next = full_q.end();
+    cv.wait(lock, [this, &next] {
+      next = std::find_if(full_q.begin(), full_q.end(),
+                          [this](int b) { return seq[b] == consume_seq; });
+      return next != full_q.end() || (input_done && !io_busy);
+    });
+    if (io_error) has_ferror = true;
+    if (next == full_q.end()) return false;
+    active = *next;
+    full_q.erase(next);
+    ++consume_seq;
+    apos = 0;
+    return true;
+  }
+
+  // compress buffer b into zbufs[b], stored as it is if it does not shrink
+  void encode_block(int b) {
+    if (!framed) return;
+    block_header &h = zhead[b];
+    h.raw_size = fill[b];
+    h.width = std::uint32_t(codec_width);
+    std::size_t nz = codec_encode(codec, codec_width, bufs[b].data(), fill[b],
+                                  zbufs[b].data(), zbufs[b].size(),
+                                  tbufs[b].data());
+    if (nz) {
+      h.codec = std::uint32_t(codec);
+      h.stored_size = nz;
     } else {
-      curr_file += 1;
-      std::string new_name = generate_filename(curr_file);
-      *fp = Fopen(new_name.c_str(), "r");
+      h.codec = std::uint32_t(CacheCodec::None);
+      h.stored_size = fill[b];
     }
   }
-  void close_current_output_file() {
-    long fpos = ftellg(*fp);
-    fclose(*fp);
-    fsizes.push_back(fpos);
+
+  bool store_block(int b) {
+    if (!framed) return write_block(bufs[b].data(), fill[b]);
+    const block_header &h = zhead[b];
+    const char *payload =
+        (h.codec == std::uint32_t(CacheCodec::None)) ? bufs[b].data()
+                                                     : zbufs[b].data();
+    // a block is never split over two segments
+    std::size_t total = sizeof(block_header) + h.stored_size;
+    if (out_fp && fsizes.back() + total > max_file_size) close_output();
+    block_info bi;
+    bi.offset = block_pos;
+    bi.segment = out_fp ? fsizes.size() - 1 : fsizes.size();
+    bi.file_offset = out_fp ? fsizes.back() : 0;
+    bi.raw_size = h.raw_size;
+    blocks.push_back(bi);
+    block_pos += h.raw_size;
+    return write_block(reinterpret_cast<const char *>(&h),
+                       sizeof(block_header), false) &&
+           write_block(payload, h.stored_size, false);
   }
-  void close_current_input_file() { fclose(*fp); }
 
-  constexpr FILE *Fopen(const char *restrict name,
-                        const char *restrict mode) noexcept {
-    FILE *fp = fopen(name, mode);
-    if (fp == nullptr) {
-      int err = errno;
-      std::cerr << "Unable to open the file " << name << " in mode " << mode
-                << "\n";
-      std::cerr << "Error " << strerror(errno);
+  // read the next block into buffer b (raw) or zbufs[b] (framed)
+  std::size_t load_block(int b, bool &ok) {
+    ok = true;
+    if (!framed) {
+      fill[b] = read_block(bufs[b].data(), buffer_size);
+      return fill[b];
+    }
+    block_header &h = zhead[b];
+    std::size_t nr = read_block(reinterpret_cast<char *>(&h), sizeof(h));
+    if (nr == 0) {
+      fill[b] = 0;
+      return 0;
+    }
+    if (nr != sizeof(h) || h.raw_size > buffer_size ||
+        h.stored_size > zbufs[b].size() ||
+        read_block(zbufs[b].data(), h.stored_size) != h.stored_size) {
+      std::cerr << "corrupt block in cache " << prefixes[0] << "\n";
+      h.raw_size = h.stored_size = 0;
+      h.codec = std::uint32_t(CacheCodec::None);
+      fill[b] = 0;
+      ok = false;
+      return 0;
+    }
+    return sizeof(h) + h.stored_size;
+  }
+
+  bool decode_block(int b) {
+    if (!framed) return true;
+    const block_header &h = zhead[b];
+    fill[b] = h.raw_size;
+    if (!codec_decode(CacheCodec(h.codec), h.width, zbufs[b].data(),
+                      h.stored_size, bufs[b].data(), h.raw_size,
+                      tbufs[b].data())) {
+      std::cerr << "failed to decode block in cache " << prefixes[0] << "\n";
+      fill[b] = 0;
+      return false;
+    }
+    return true;
+  }
+
+  std::string index_filename() const { return prefixes[0] + ".IDX"; }
+
+  // index file: magic, record and block counts, records, blocks
+  void write_index() {
+    const char magic[8] = {'P', 'F', 'C', 'I', 'D', 'X', '0', '1'};
+    std::uint64_t nrec = records.size();
+    std::uint64_t nblk = blocks.size();
+    FILE *f = Fopen(index_filename().c_str(), "w");
+    bool ok = Fwrite(magic, 1, 8, f) == 8 && Fwrite(&nrec, 8, 1, f) == 1 &&
+              Fwrite(&nblk, 8, 1, f) == 1 &&
+              Fwrite(records.data(), sizeof(RecordInfo), nrec, f) == nrec &&
+              Fwrite(blocks.data(), sizeof(block_info), nblk, f) == nblk;
+    if (fclose(f) != 0 || !ok) has_ferror = true;
+  }
+
+  void read_index() {
+    FILE *f = fopen(index_filename().c_str(), "r");
+    if (!f) return;
+    char magic[8];
+    std::uint64_t nrec = 0;
+    std::uint64_t nblk = 0;
+    bool ok = fread(magic, 1, 8, f) == 8 &&
+              std::memcmp(magic, "PFCIDX01", 8) == 0 &&
+              fread(&nrec, 8, 1, f) == 1 && fread(&nblk, 8, 1, f) == 1;
+    if (ok) {
+      records.resize(nrec);
+      blocks.resize(nblk);
+      ok = fread(records.data(), sizeof(RecordInfo), nrec, f) == nrec &&
+           fread(blocks.data(), sizeof(block_info), nblk, f) == nblk;
+    }
+    fclose(f);
+    if (!ok) {
+      std::cerr << "corrupt cache index " << index_filename() << "\n";
+      records.clear();
+      blocks.clear();
+      has_ferror = true;
+    }
+  }
+
+  void ra_open(long segment) {
+    if (ra_seg == segment) return;
+    if (ra_fp) fclose(ra_fp);
+    ra_fp = Fopen(generate_filename(segment).c_str(), "r");
+    setvbuf(ra_fp, nullptr, _IONBF, 0);
+    ra_seg = segment;
+  }
+
+  void ra_close() {
+    if (ra_fp) fclose(ra_fp);
+    ra_fp = nullptr;
+    ra_seg = -1;
+    ra_block = -1;
+  }
+
+  // read n bytes starting at byte off of the cache stream
+  bool read_at(std::uint64_t off, char *dst, std::size_t n) {
+    if (in_memory) {
+      if (off + n > mem_size) return false;
+      std::memcpy(dst, bufs[0].data() + off, n);
+      return true;
+    }
+    while (n) {
+      std::size_t k;
+      if (!framed) {
+        // segments are back to back in the stream
+        std::size_t seg = 0;
+        std::uint64_t start = 0;
+        while (seg < fsizes.size() && start + fsizes[seg] <= off)
+          start += fsizes[seg++];
+        if (seg == fsizes.size()) return false;
+        ra_open(long(seg));
+        k = std::min<std::uint64_t>(n, start + fsizes[seg] - off);
+        if (fseek(ra_fp, long(off - start), SEEK_SET) != 0 ||
+            Fread(dst, 1, k, ra_fp) != k)
+          return false;
+      } else {
+        auto it = std::upper_bound(
+            blocks.begin(), blocks.end(), off,
+            [](std::uint64_t o, const block_info &b) { return o < b.offset; });
+        if (it == blocks.begin()) return false;
+        long ib = long(it - blocks.begin()) - 1;
+        if (ib != ra_block && !ra_decode(ib)) return false;
+        const block_info &bi = blocks[ib];
+        if (off >= bi.offset + bi.raw_size) return false;
+        k = std::min<std::uint64_t>(n, bi.offset + bi.raw_size - off);
+        std::memcpy(dst, ra_buf.data() + (off - bi.offset), k);
+      }
+      off += k;
+      dst += k;
+      n -= k;
+    }
+    return true;
+  }
+
+  // decode block ib into ra_buf
+  bool ra_decode(long ib) {
+    const block_info &bi = blocks[ib];
+    block_header h;
+    ra_open(long(bi.segment));
+    if (fseek(ra_fp, long(bi.file_offset), SEEK_SET) != 0 ||
+        Fread(&h, sizeof(h), 1, ra_fp) != 1 || h.raw_size != bi.raw_size)
+      return false;
+    ra_buf.resize(h.raw_size);
+    ra_zbuf.resize(h.stored_size);
+    std::vector<char> scratch(h.raw_size);
+    if (Fread(ra_zbuf.data(), 1, h.stored_size, ra_fp) != h.stored_size ||
+        !codec_decode(CacheCodec(h.codec), h.width, ra_zbuf.data(),
+                      h.stored_size, ra_buf.data(), h.raw_size,
+                      scratch.data()))
+      return false;
+    ra_block = ib;
+    return true;
+  }
+
+  // map segment i read only, nullptr past the end of the cache
+  const char *map_segment(std::size_t i, std::size_t &len) {
+    len = 0;
+    if (i >= fsizes.size()) return nullptr;
+    len = fsizes[i];
+    if (len == 0) return nullptr;
+    std::string name = generate_filename(long(i));
+    int fd = open(name.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "Unable to open the file " << name << "\n";
+      std::cerr << "Error " << strerror(errno) << "\n";
       exit(EXIT_FAILURE);
     }
-    return fp;
+    void *p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      std::cerr << "Unable to map the file " << name << "\n";
+      std::cerr << "Error " << strerror(errno) << "\n";
+      exit(EXIT_FAILURE);
+    }
+    madvise(p, len, MADV_WILLNEED);
+    return static_cast<const char *>(p);
+  }
+
+  // drop the current segment and move on to the one mapped ahead
+  void advance_map() {
+    if (map_ptr) munmap(const_cast<char *>(map_ptr), map_len);
+    map_ptr = next_ptr;
+    map_len = next_len;
+    map_pos = 0;
+    next_ptr = nullptr;
+    next_len = 0;
+    if (!map_ptr) return;
+    madvise(const_cast<char *>(map_ptr), map_len, MADV_SEQUENTIAL);
+    ++map_file;
+    next_ptr = map_segment(map_file, next_len);
+  }
+
+  void unmap_segments() {
+    if (map_ptr) munmap(const_cast<char *>(map_ptr), map_len);
+    if (next_ptr) munmap(const_cast<char *>(next_ptr), next_len);
+    map_ptr = next_ptr = nullptr;
+    map_len = next_len = map_pos = 0;
+  }
+
+  size_t mapped_copy(char *dst, size_t bytes) {
+    if (in_memory) {
+      size_t k = std::min(bytes, fill[0] - apos);
+      std::memcpy(dst, bufs[0].data() + apos, k);
+      apos += k;
+      if (k < bytes) end_of_cache = true;
+      return k;
+    }
+    size_t done = 0;
+    while (done < bytes) {
+      while (map_ptr && map_pos == map_len) advance_map();
+      if (!map_ptr) {
+        end_of_cache = true;
+        break;
+      }
+      size_t k = std::min(bytes - done, map_len - map_pos);
+      std::memcpy(dst + done, map_ptr + map_pos, k);
+      map_pos += k;
+      done += k;
+    }
+    return done;
+  }
+
+  // append n bytes to the cache, rolling over to a new segment when full
+  // unless split is false, then the segment may end up larger
+  bool write_block(const char *p, size_t n, bool split = true) {
+    while (n) {
+      if (!out_fp) {
+        fsizes.push_back(0);
+        ++num_files;
+        out_fp = Fopen(generate_filename(long(fsizes.size() - 1)).c_str(), "w");
+        setvbuf(out_fp, nullptr, _IONBF, 0);
+      }
+      size_t k = split ? std::min(n, max_file_size - fsizes.back()) : n;
+      size_t nw = Fwrite(p, 1, k, out_fp);
+      fsizes.back() += nw;
+      total_bytes += nw;
+      if (nw != k) return false;
+      if (fsizes.back() >= max_file_size && split) close_output();
+      p += k;
+      n -= k;
+    }
+    return true;
+  }
+
+  // read up to n bytes continuing across segments, 0 at the end
+  size_t read_block(char *p, size_t n) {
+    size_t done = 0;
+    while (done < n && in_file < fsizes.size()) {
+      if (!in_fp) {
+        in_fp = Fopen(generate_filename(long(in_file)).c_str(), "r");
+        setvbuf(in_fp, nullptr, _IONBF, 0);
+      }
+      size_t k = std::min(n - done, fsizes[in_file] - in_pos);
+      size_t nr = Fread(p + done, 1, k, in_fp);
+      done += nr;
+      in_pos += nr;
+      if (nr != k) return done;
+      if (in_pos == fsizes[in_file]) {
+        close_input();
+        ++in_file;
+        in_pos = 0;
+      }
+    }
+    return done;
+  }
+
+  void close_output() {
+    if (!out_fp) return;
+    fclose(out_fp);
+    out_fp = nullptr;
+  }
+
+  void close_input() {
+    if (!in_fp) return;
+    fclose(in_fp);
+    in_fp = nullptr;
   }
-  constexpr FILE *Fmemopen(void *buff, size_t size, const char *mode) noexcept {
-    FILE *fp = fmemopen(buff, size, mode);
+
+  static FILE *Fopen(const char *name, const char *mode) noexcept {
+    FILE *fp = fopen(name, mode);
     if (fp == nullptr) {
-      int err = errno;
-      std::cerr << "Unable to open the mem file of size " << size << " in mode "
-                << mode << "\n";
-      std::cerr << "Error " << strerror(errno);
+      std::cerr << "Unable to open the file " << name << " in mode " << mode
+                << "\n";
+      std::cerr << "Error " << strerror(errno) << "\n";
       exit(EXIT_FAILURE);
     }
     return fp;
   }
 
-  constexpr size_t Fread(void *restrict buffer, size_t size_, size_t count,
-                         FILE *restrict fptr) {
+  static size_t Fread(void *buffer, size_t size_, size_t count, FILE *fptr) {
     size_t nr = fread(buffer, size_, count, fptr);
     if (nr != count) {
       if (feof(fptr)) {
         std::cerr << "end of file reached in Fread\n";
         std::cerr << "warning check the return code\n";
-        has_ferror = true;
       } else if (ferror(fptr)) {
         std::cerr << "error in reading file " << strerror(errno) << "\n";
-        has_ferror = true;
       }
     }
     return nr;
   }
-  constexpr size_t Fwrite(void *restrict buffer, size_t size_, size_t count,
-                          FILE *restrict fptr) {
+
+  static size_t Fwrite(const void *buffer, size_t size_, size_t count,
+                       FILE *fptr) {
     size_t nw = fwrite(buffer, size_, count, fptr);
     if (nw != count) {
-      if (feof(fptr)) {
-        std::cerr << "end of file reached in Fwrite\n";
-        std::cerr << "warning check the return code\n";
-        has_ferror = true;
-      } else if (ferror(fptr)) {
-        std::cerr << "error in writing file " << strerror(errno) << "\n";
-        has_ferror = true;
-      }
+      std::cerr << "error in writing file " << strerror(errno) << "\n";
     }
     return nw;
   }
 };
 
-}  // namespace putils
\ No newline at end of file
+}  // namespace putils
@@ -0,0 +1,359 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace putils {
+
+/////////////////////////////////////////////////////
+//  Block codecs for FileCache segments.
+//  LZ is a byte oriented LZ77 in the style of LZ4: a
+//    token with the literal and match lengths, the
+//    literals, a 16 bit offset, lengths over 15 continue
+//    in bytes of 255. It runs at memory speed rather than
+//    for ratio.
+//  For floating point data the shuffle variants first
+//    transpose the block so byte k of every value is stored
+//    together, the exponent bytes then form long runs. The
+//    delta variant also xors each value with the one before
+//    so slowly varying values leave mostly zero bytes.
+//    Both steps are exact, no codec loses information.
+/////////////////////////////////////////////////////
+enum class CacheCodec : std::uint32_t {
+  None = 0,
+  LZ = 1,
+  ShuffleLZ = 2,
+  DeltaShuffleLZ = 3
+};
+
+namespace codec_detail {
+
+inline std::uint32_t read32(const unsigned char *p) noexcept {
+  std::uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+inline std::uint64_t read64(const unsigned char *p) noexcept {
+  std::uint64_t v;
+  std::memcpy(&v, p, 8);
+  return v;
+}
+
+// number of equal leading bytes of a and b, at most limit
+inline std::size_t match_length(const unsigned char *a, const unsigned char *b,
+                                std::size_t limit) noexcept {
+  std::size_t len = 0;
+  while (len + 8 <= limit) {
+    std::uint64_t x = read64(a + len) ^ read64(b + len);
+    if (x) {
+      if constexpr (std::endian::native == std::endian::little)
+        return len + (std::countr_zero(x) >> 3);
+      else
+        return len + (std::countl_zero(x) >> 3);
+    }
+    len += 8;
+  }
+  while (len < limit && a[len] == b[len]) ++len;
+  return len;
+}
+
+// transpose the 8x8 bytes of 8 little endian words in place
+inline void transpose8(std::uint64_t *a) noexcept {
+  for (int r = 0; r < 4; ++r) {
+    std::uint64_t t = ((a[r] >> 32) ^ a[r + 4]) & 0x00000000FFFFFFFFULL;
+    a[r + 4] ^= t;
+    a[r] ^= t << 32;
+  }
+  for (int r : {0, 1, 4, 5}) {
+    std::uint64_t t = ((a[r] >> 16) ^ a[r + 2]) & 0x0000FFFF0000FFFFULL;
+    a[r + 2] ^= t;
+    a[r] ^= t << 16;
+  }
+  for (int r : {0, 2, 4, 6}) {
+    std::uint64_t t = ((a[r] >> 8) ^ a[r + 1]) & 0x00FF00FF00FF00FFULL;
+    a[r + 1] ^= t;
+    a[r] ^= t << 8;
+  }
+}
+
+inline std::uint32_t lz_hash(std::uint32_t v) noexcept {
+  return (v * 2654435761U) >> 18;
+}
+
+// lengths of 15 and more continue in bytes of 255
+inline unsigned char *put_length(unsigned char *op, std::size_t len) noexcept {
+  while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = (unsigned char)len;
+  return op;
+}
+
+inline bool get_length(const unsigned char *&ip, const unsigned char *iend,
+                       std::size_t &len) noexcept {
+  unsigned char b;
+  do {
+    if (ip >= iend) return false;
+    b = *ip++;
+    len += b;
+  } while (b == 255);
+  return true;
+}
+
+}  // namespace codec_detail
+
+/////////////////////////////////////////////////////
+//  CRC-32 (IEEE 802.3, reflected 0xEDB88320) of n bytes,
+//    pass the previous value to continue a running checksum
+/////////////////////////////////////////////////////
+inline std::uint32_t crc32(const void *data, std::size_t n,
+                           std::uint32_t crc = 0) noexcept {
+  static const std::vector<std::uint32_t> table = [] {
+    std::vector<std::uint32_t> t(256);
+    for (std::uint32_t i = 0; i < 256; ++i) {
+      std::uint32_t c = i;
+      for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    return t;
+  }();
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  crc = ~crc;
+  for (std::size_t i = 0; i < n; ++i) crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+// worst case size of lz_compress output
+inline std::size_t lz_bound(std::size_t n) noexcept {
+  return n + n / 255 + 16;
+}
+
+/////////////////////////////////////////////////////
+//  Compress n bytes into out, returns the compressed size
+//    or 0 if it does not fit in cap bytes.
+/////////////////////////////////////////////////////
+inline std::size_t lz_compress(const char *src, std::size_t n, char *dst,
+                               std::size_t cap) {
+  using namespace codec_detail;
+  const unsigned char *in = reinterpret_cast<const unsigned char *>(src);
+  unsigned char *out = reinterpret_cast<unsigned char *>(dst);
+  unsigned char *op = out;
+  unsigned char *const oend = out + cap;
+  std::vector<std::uint32_t> table(1 << 14, 0);
+  std::size_t ip = 0;
+  std::size_t anchor = 0;
+  auto emit = [&](std::size_t lit, std::size_t off,
+                  std::size_t mlen) -> bool {
+    std::size_t need = 1 + lit + lit / 255 + 1 + 2 + mlen / 255 + 1;
+    if (std::size_t(oend - op) < need) return false;
+    unsigned char *token = op++;
+    *token = (unsigned char)((lit < 15 ? lit : 15) << 4);
+    if (lit >= 15) op = put_length(op, lit - 15);
+    std::memcpy(op, in + anchor, lit);
+    op += lit;
+    if (mlen == 0) return true;
+    *op++ = (unsigned char)(off & 0xff);
+    *op++ = (unsigned char)(off >> 8);
+    std::size_t ml = mlen - 4;
+    *token |= (unsigned char)(ml < 15 ? ml : 15);
+    if (ml >= 15) op = put_length(op, ml - 15);
+    return true;
+  };
+  if (n >= 8) {
+    const std::size_t ilimit = n - 4;
+    while (ip < ilimit) {
+      std::uint32_t seq = read32(in + ip);
+      std::uint32_t h = lz_hash(seq);
+      std::size_t ref = table[h];
+      table[h] = std::uint32_t(ip + 1);
+      if (ref && ip + 1 - ref <= 65535 && read32(in + ref - 1) == seq) {
+        --ref;
+        std::size_t len = 4 + match_length(in + ref + 4, in + ip + 4, n - ip - 4);
+        if (!emit(ip - anchor, ip - ref, len)) return 0;
+        ip += len;
+        anchor = ip;
+      } else {
+        // skip faster through incompressible data
+        ip += 1 + ((ip - anchor) >> 6);
+      }
+    }
+  }
+  if (!emit(n - anchor, 0, 0)) return 0;
+  return std::size_t(op - out);
+}
+
+/////////////////////////////////////////////////////
+//  Decompress exactly raw bytes, false on corrupt input
+/////////////////////////////////////////////////////
+inline bool lz_decompress(const char *src, std::size_t n, char *dst,
+                          std::size_t raw) {
+  using namespace codec_detail;
+  const unsigned char *ip = reinterpret_cast<const unsigned char *>(src);
+  const unsigned char *const iend = ip + n;
+  unsigned char *const out = reinterpret_cast<unsigned char *>(dst);
+  unsigned char *op = out;
+  unsigned char *const oend = out + raw;
+  while (ip < iend) {
+    unsigned char token = *ip++;
+    std::size_t lit = token >> 4;
+    if (lit == 15 && !get_length(ip, iend, lit)) return false;
+    if (std::size_t(iend - ip) < lit || std::size_t(oend - op) < lit)
+      return false;
+    std::memcpy(op, ip, lit);
+    ip += lit;
+    op += lit;
+    if (ip == iend) break;
+    if (iend - ip < 2) return false;
+    std::size_t off = std::size_t(ip[0]) | (std::size_t(ip[1]) << 8);
+    ip += 2;
+    std::size_t mlen = token & 15;
+    if (mlen == 15 && !get_length(ip, iend, mlen)) return false;
+    mlen += 4;
+    if (off == 0 || off > std::size_t(op - out) ||
+        std::size_t(oend - op) < mlen)
+      return false;
+    const unsigned char *m = op - off;
+    if (off >= mlen) {
+      std::memcpy(op, m, mlen);
+      op += mlen;
+    } else {
+      // overlapping match, the copied span doubles every pass
+      std::size_t dist = off;
+      std::size_t left = mlen;
+      while (left) {
+        std::size_t c = std::min(dist, left);
+        std::memcpy(op, op - dist, c);
+        op += c;
+        left -= c;
+        dist += c;
+      }
+    }
+  }
+  return op == oend;
+}
+
+namespace codec_detail {
+
+// shuffle of whole groups of 8 doubles as 8x8 byte transposes,
+//   returns the number of values done
+inline std::size_t shuffle8(const unsigned char *src, std::size_t nv,
+                            unsigned char *dst, bool delta) noexcept {
+  if constexpr (std::endian::native != std::endian::little) return 0;
+  std::uint64_t prev = 0;
+  std::size_t i = 0;
+  for (; i + 8 <= nv; i += 8) {
+    std::uint64_t a[8];
+    for (int j = 0; j < 8; ++j) {
+      std::uint64_t v = read64(src + (i + j) * 8);
+      a[j] = delta ? v ^ prev : v;
+      prev = v;
+    }
+    transpose8(a);
+    for (int k = 0; k < 8; ++k) std::memcpy(dst + k * nv + i, &a[k], 8);
+  }
+  return i;
+}
+
+inline std::size_t unshuffle8(const unsigned char *src, std::size_t nv,
+                              unsigned char *dst, bool delta) noexcept {
+  if constexpr (std::endian::native != std::endian::little) return 0;
+  std::uint64_t prev = 0;
+  std::size_t i = 0;
+  for (; i + 8 <= nv; i += 8) {
+    std::uint64_t a[8];
+    for (int k = 0; k < 8; ++k) a[k] = read64(src + k * nv + i);
+    transpose8(a);
+    for (int j = 0; j < 8; ++j) {
+      if (delta) a[j] = prev ^= a[j];
+      std::memcpy(dst + (i + j) * 8, &a[j], 8);
+    }
+  }
+  return i;
+}
+
+}  // namespace codec_detail
+
+// byte k of value i goes to k * nvalues + i, a tail shorter than width is kept.
+//   With delta value i is first xored with value i - 1.
+inline void byte_shuffle(const char *in, std::size_t n, std::size_t width,
+                         char *out, bool delta = false) noexcept {
+  const unsigned char *src = reinterpret_cast<const unsigned char *>(in);
+  unsigned char *dst = reinterpret_cast<unsigned char *>(out);
+  const std::size_t nv = n / width;
+  std::size_t i0 = (width == 8) ? codec_detail::shuffle8(src, nv, dst, delta) : 0;
+  for (std::size_t k = 0; k < width; ++k) {
+    const unsigned char *p = src + i0 * width + k;
+    for (std::size_t i = i0; i < nv; ++i, p += width)
+      dst[k * nv + i] = (delta && i) ? *p ^ *(p - width) : *p;
+  }
+  if (n > nv * width) std::memcpy(out + nv * width, in + nv * width, n - nv * width);
+}
+
+inline void byte_unshuffle(const char *in, std::size_t n, std::size_t width,
+                           char *out, bool delta = false) noexcept {
+  const unsigned char *src = reinterpret_cast<const unsigned char *>(in);
+  unsigned char *dst = reinterpret_cast<unsigned char *>(out);
+  const std::size_t nv = n / width;
+  std::size_t i0 = (width == 8) ? codec_detail::unshuffle8(src, nv, dst, delta) : 0;
+  for (std::size_t k = 0; k < width; ++k) {
+    unsigned char *p = dst + i0 * width + k;
+    for (std::size_t i = i0; i < nv; ++i, p += width)
+      *p = (delta && i) ? src[k * nv + i] ^ *(p - width) : src[k * nv + i];
+  }
+  if (n > nv * width) std::memcpy(out + nv * width, in + nv * width, n - nv * width);
+}
+
+/////////////////////////////////////////////////////
+//  Encode n bytes of in into out (cap bytes), scratch must
+//    hold n bytes. in is left unchanged. Returns the encoded
+//    size or 0 when the block does not shrink and should be
+//    stored as it is.
+/////////////////////////////////////////////////////
+inline std::size_t codec_encode(CacheCodec codec, std::size_t width,
+                                const char *in, std::size_t n, char *out,
+                                std::size_t cap, char *scratch) {
+  if (width == 0) width = 1;
+  switch (codec) {
+    case CacheCodec::None:
+      return 0;
+    case CacheCodec::LZ:
+      return lz_compress(in, n, out, std::min(cap, n));
+    case CacheCodec::ShuffleLZ:
+      byte_shuffle(in, n, width, scratch);
+      return lz_compress(scratch, n, out, std::min(cap, n));
+    case CacheCodec::DeltaShuffleLZ:
+      byte_shuffle(in, n, width, scratch, true);
+      return lz_compress(scratch, n, out, std::min(cap, n));
+  }
+  return 0;
+}
+
+inline bool codec_decode(CacheCodec codec, std::size_t width, const char *in,
+                         std::size_t n, char *out, std::size_t raw,
+                         char *scratch) {
+  if (width == 0) width = 1;
+  switch (codec) {
+    case CacheCodec::None:
+      if (n != raw) return false;
+      std::memcpy(out, in, n);
+      return true;
+    case CacheCodec::LZ:
+      return lz_decompress(in, n, out, raw);
+    case CacheCodec::ShuffleLZ:
+      if (!lz_decompress(in, n, scratch, raw)) return false;
+      byte_unshuffle(scratch, raw, width, out);
+      return true;
+    case CacheCodec::DeltaShuffleLZ:
+      if (!lz_decompress(in, n, scratch, raw)) return false;
+      byte_unshuffle(scratch, raw, width, out, true);
+      return true;
+  }
+  return false;
+}
+
+}  // namespace putils
@@ -0,0 +1,290 @@
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "FileCache.hpp"
+
+double elapsed(const std::chrono::steady_clock::time_point &ts) {
+  std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+  return d.count();
+}
+
+// write ntot doubles in chunks of nchunk then read them back npass times
+bool run(putils::FileCache &cache, size_t ntot, size_t nchunk, int npass,
+         bool mapped = true) {
+  std::vector<double> x(nchunk);
+  auto ts = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < ntot; i += nchunk) {
+    size_t n = std::min(nchunk, ntot - i);
+    for (size_t j = 0; j < n; ++j) x[j] = double(i + j);
+    cache.putData(x.data(), n);
+  }
+  cache.Close();
+  std::cout << "  write " << elapsed(ts) << " s files "
+            << cache.NumberOfFiles() << " bytes " << cache.TotalSize()
+            << (cache.InMemory() ? " in memory" : "") << "\n";
+  bool ok = true;
+  for (int pass = 0; pass < npass; ++pass) {
+    cache.Rewind();
+    ts = std::chrono::steady_clock::now();
+    size_t nread = 0;
+    for (;;) {
+      size_t n = cache.getData(x.data(), nchunk);
+      for (size_t j = 0; j < n; ++j) ok = ok && (x[j] == double(nread + j));
+      nread += n;
+      if (n < nchunk) break;
+    }
+    ok = ok && nread == ntot && cache.EndOfCache() && !cache.Error();
+    std::cout << "  read  " << elapsed(ts) << " s doubles " << nread << "\n";
+  }
+  if (!mapped) return ok;
+  // zero copy pass over the mapped segments
+  cache.RewindMapped();
+  ts = std::chrono::steady_clock::now();
+  size_t nread = 0;
+  for (;;) {
+    std::span<const double> s = cache.mapData<double>(nchunk);
+    if (s.empty()) break;
+    for (size_t j = 0; j < s.size(); ++j)
+      ok = ok && (s[j] == double(nread + j));
+    nread += s.size();
+  }
+  ok = ok && nread == ntot && cache.EndOfCache();
+  std::cout << "  map   " << elapsed(ts) << " s doubles " << nread << "\n";
+  return ok;
+}
+
+// nthreads readers over a closed cache, each sums the values it owns
+bool read_parallel(const putils::FileCache &cache, size_t ntot,
+                   size_t nthreads) {
+  std::vector<double> sums(nthreads, 0.0);
+  std::vector<size_t> counts(nthreads, 0);
+  std::vector<std::thread> threads;
+  auto ts = std::chrono::steady_clock::now();
+  for (size_t id = 0; id < nthreads; ++id) {
+    threads.emplace_back([&, id] {
+      putils::FileCache::Reader rd = cache.MakeReader(id, nthreads);
+      std::vector<double> x(4096);
+      while (rd.NextSegment()) {
+        size_t n;
+        while ((n = rd.getData(x.data(), x.size())) != 0) {
+          for (size_t j = 0; j < n; ++j) sums[id] += x[j];
+          counts[id] += n;
+        }
+      }
+    });
+  }
+  for (auto &t : threads) t.join();
+  double sum = 0.0;
+  size_t count = 0;
+  for (size_t id = 0; id < nthreads; ++id) {
+    sum += sums[id];
+    count += counts[id];
+  }
+  std::cout << "  " << nthreads << " readers " << elapsed(ts) << " s doubles "
+            << count << "\n";
+  return count == ntot && sum == 0.5 * double(ntot) * double(ntot - 1);
+}
+
+// records of varying length, read back out of order
+bool records_test(putils::FileCache &cache, size_t nrec) {
+  std::vector<double> x;
+  std::vector<std::int32_t> ix(17);
+  for (size_t k = 0; k < nrec; ++k) {
+    if (k % 5 == 4) {
+      for (size_t j = 0; j < ix.size(); ++j) ix[j] = std::int32_t(k + j);
+      cache.putRecord(ix.data(), ix.size(), 1);
+    } else {
+      x.resize(1000 + 37 * k);
+      for (size_t j = 0; j < x.size(); ++j) x[j] = double(k) + 1.e-6 * double(j);
+      cache.putRecord(x.data(), x.size());
+    }
+  }
+  cache.Close();
+  bool ok = cache.NumberOfRecords() == nrec;
+  auto ts = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < nrec; ++i) {
+    size_t k = (i * 7919) % nrec;
+    const putils::FileCache::RecordInfo &r = cache.Record(k);
+    if (r.tag == 1) {
+      ok = cache.getRecord(k, ix.data(), ix.size()) == ix.size() && ok;
+      for (size_t j = 0; j < ix.size(); ++j) ok = ok && ix[j] == std::int32_t(k + j);
+      if (k == 4) ok = cache.getRecord(k, x.data(), 1) == 0 && ok;
+    } else {
+      x.resize(r.count);
+      ok = cache.getRecord(k, x.data(), x.size()) == r.count && ok;
+      for (size_t j = 0; j < x.size(); ++j)
+        ok = ok && x[j] == double(k) + 1.e-6 * double(j);
+    }
+  }
+  ok = ok && !cache.Error();
+  std::cout << "  " << nrec << " records read out of order " << elapsed(ts)
+            << " s\n";
+  return ok;
+}
+
+int main() {
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / "filecache_test";
+  const size_t mb = 1048576;
+  const size_t ntot = 8 * mb;
+  bool ok = true;
+  for (size_t nbuf : {1, 2, 4}) {
+    std::cout << "buffers " << nbuf << "\n";
+    putils::FileCache cache(dir, "ints", mb, nbuf, 16 * mb);
+    ok = run(cache, ntot, 1000, 2) && ok;
+  }
+  for (putils::CacheCodec codec :
+       {putils::CacheCodec::LZ, putils::CacheCodec::ShuffleLZ,
+        putils::CacheCodec::DeltaShuffleLZ}) {
+    for (size_t nbuf : {1, 4}) {
+      std::cout << "codec " << int(codec) << " buffers " << nbuf << "\n";
+      putils::FileCache cache(dir, "packed", mb, nbuf, 2 * mb);
+      cache.SetCodec(codec, sizeof(double), 2);
+      ok = run(cache, ntot, 1000, 2, false) && ok;
+    }
+  }
+  {
+    std::cout << "perserved compressed cache\n";
+    {
+      putils::FileCache cache(dir, "zkeep", mb, 2, mb);
+      cache.SetCodec(putils::CacheCodec::DeltaShuffleLZ);
+      cache.SetPerserve();
+      ok = run(cache, ntot, 4096, 0, false) && ok;
+    }
+    putils::FileCache cache(dir, mb, 3);
+    std::vector<double> x(ntot);
+    ok = cache.getData(x.data(), ntot) == ntot && !cache.Error() && ok;
+    for (size_t j = 0; j < ntot; ++j) ok = ok && (x[j] == double(j));
+    cache.RemoveFiles();
+  }
+  {
+    std::cout << "striped cache\n";
+    std::vector<std::filesystem::path> dirs;
+    for (int i = 0; i < 3; ++i) dirs.push_back(dir.parent_path() / ("filecache_disk" + std::to_string(i)));
+    {
+      putils::FileCache cache(dirs, "stripe", mb, 2, mb);
+      cache.SetPerserve();
+      ok = run(cache, ntot, 1000, 1) && ok;
+      ok = cache.NumberOfStripes() == 3 && ok;
+      ok = read_parallel(cache, ntot, 3) && ok;
+      ok = read_parallel(cache, ntot, 4) && ok;
+    }
+    putils::FileCache cache(dirs, mb, 2);
+    ok = read_parallel(cache, ntot, 3) && ok;
+    cache.RemoveFiles();
+    putils::FileCache packed(dirs, "zstripe", mb, 4, 2 * mb);
+    packed.SetCodec(putils::CacheCodec::ShuffleLZ, sizeof(double), 2);
+    ok = run(packed, ntot, 1000, 0, false) && ok;
+    ok = read_parallel(packed, ntot, 3) && ok;
+    for (auto &d : dirs) std::filesystem::remove_all(d);
+  }
+  {
+    std::cout << "records\n";
+    {
+      putils::FileCache cache(dir, "rec", mb, 2, mb);
+      cache.SetPerserve();
+      ok = records_test(cache, 200) && ok;
+    }
+    {
+      putils::FileCache packed(dir.parent_path() / "filecache_packed", "zrec",
+                               mb, 2, mb);
+      packed.SetCodec(putils::CacheCodec::DeltaShuffleLZ);
+      ok = records_test(packed, 200) && ok;
+    }
+    std::filesystem::remove_all(dir.parent_path() / "filecache_packed");
+    {
+      // the index is saved next to the segments
+      putils::FileCache cache(dir, mb);
+      std::vector<double> x(cache.Record(3).count);
+      ok = cache.NumberOfRecords() == 200 && ok;
+      ok = cache.getRecord(3, x.data(), x.size()) == x.size() && ok;
+      ok = x.back() == 3.0 + 1.e-6 * double(x.size() - 1) && !cache.Error() && ok;
+    }
+    {
+      // flip a byte inside record 3 and the checksum has to catch it
+      FILE *f = fopen((dir / "rec0.DAT").c_str(), "r+");
+      putils::FileCache::RecordInfo r;
+      {
+        putils::FileCache cache(dir, mb);
+        r = cache.Record(3);
+      }
+      fseek(f, long(r.offset) + 11, SEEK_SET);
+      int c = fgetc(f);
+      fseek(f, long(r.offset) + 11, SEEK_SET);
+      fputc(c ^ 0x40, f);
+      fclose(f);
+      putils::FileCache cache(dir, mb);
+      std::vector<double> x(r.count);
+      std::cout << "  expect a checksum mismatch: ";
+      cache.getRecord(3, x.data(), x.size());
+      ok = cache.Error() && ok;
+      cache.RemoveFiles();
+    }
+  }
+  {
+    // segments that split a double
+    std::cout << "odd segments\n";
+    putils::FileCache cache(dir, "odd", mb, 2, mb + 4);
+    ok = run(cache, mb, 1000, 1) && ok;
+  }
+  {
+    std::cout << "small cache\n";
+    putils::FileCache cache(dir, "small", mb, 2);
+    ok = run(cache, 1000, 300, 1) && ok;
+    ok = cache.InMemory() && ok;
+  }
+  for (size_t nbuf : {1, 2}) {
+    // a second pass appends to the cache kept in memory
+    std::cout << "small cache reopened, buffers " << nbuf << "\n";
+    putils::FileCache cache(dir, "small", mb, nbuf);
+    std::vector<double> x(100);
+    for (size_t j = 0; j < 100; ++j) x[j] = double(j);
+    cache.putData(x.data(), 50);
+    cache.Close();
+    cache.putData(x.data() + 50, 50);
+    cache.Close();
+    cache.Rewind();
+    std::vector<double> y(200);
+    ok = cache.getData(y.data(), 200) == 100 && cache.InMemory() && ok;
+    for (size_t j = 0; j < 100; ++j) ok = ok && (y[j] == double(j));
+  }
+  {
+    // a prefix ending in a digit, with more than ten segments
+    std::cout << "perserved cache run2\n";
+    {
+      putils::FileCache cache(dir, "run2", mb, 2, mb);
+      cache.SetPerserve();
+      ok = run(cache, 2 * mb, 4096, 0) && ok;
+      ok = cache.NumberOfFiles() == 16 && ok;
+    }
+    putils::FileCache cache(dir, mb, 2);
+    ok = cache.NumberOfFiles() == 16 && ok;
+    std::vector<double> x(2 * mb);
+    ok = cache.getData(x.data(), 2 * mb) == 2 * mb && ok;
+    for (size_t j = 0; j < 2 * mb; ++j) ok = ok && (x[j] == double(j));
+    cache.RemoveFiles();
+  }
+  {
+    std::cout << "perserved cache\n";
+    {
+      putils::FileCache cache(dir, "keep", mb, 2, 4 * mb);
+      cache.SetPerserve();
+      ok = run(cache, mb, 4096, 0) && ok;
+      cache.Clear();
+      ok = run(cache, mb, 4096, 0) && ok;
+    }
+    putils::FileCache cache(dir, mb, 3);
+    cache.SetPerserve();
+    std::vector<double> x(mb);
+    ok = cache.getData(x.data(), mb) == mb && ok;
+    for (size_t j = 0; j < mb; ++j) ok = ok && (x[j] == double(j));
+    cache.RemoveFiles();
+  }
+  std::filesystem::remove_all(dir);
+  std::cout << (ok ? "filecache test passed\n" : "filecache test FAILED\n");
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
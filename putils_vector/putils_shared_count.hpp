@@ -1,155 +1,264 @@
+#ifndef PUTILS_SHARED_COUNT_HPP
+#define PUTILS_SHARED_COUNT_HPP
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
 
+namespace putils {
 
+/////////////////////////////////////////////////////
+//  Reference counts for rc_ptr.
+//  A new reference is always made from an existing one so
+//    the increment needs no ordering. The decrement is
+//    acquire-release, the owner that drops the count to zero
+//    then sees every write made through the other owners
+//    before it destroys the object.
+//  sub returns the count before the decrement.
+/////////////////////////////////////////////////////
+struct shared_refcount {
+  std::atomic<std::int32_t> cnt;
 
+  explicit shared_refcount(std::int32_t n = 1) noexcept : cnt(n) {}
 
-namespace putils {
+  std::int32_t add() noexcept { return cnt.fetch_add(1, std::memory_order_relaxed); }
+  std::int32_t sub() noexcept { return cnt.fetch_sub(1, std::memory_order_acq_rel); }
+  std::int32_t get() const noexcept { return cnt.load(std::memory_order_relaxed); }
+  std::int32_t exchange(std::int32_t new_value = 0) noexcept {
+    return cnt.exchange(new_value, std::memory_order_acq_rel);
+  }
+};
 
-    
-struct shared_refcount {
+// the same count for pointers that never leave one thread
+struct local_refcount {
+  std::int32_t cnt;
 
-    atomic<std::int32_t> cnt;
-    
-    std::int32_t add() {
-        return cnt.fetch_and_add(1);
-    }
-    std::int32_t sub() {
-        return cnt.fetch_and_sub(1);
-    }
-    std::int32_t get() {
-        return cnt.load(); 
-    }
-    std::int32_t exchange(std::int32_t new_value=0) {
-        return cnt.exchange(new_value);
-    }
-}
+  explicit local_refcount(std::int32_t n = 1) noexcept : cnt(n) {}
 
-template < typename T, class Alloc = putils::allocator<T>, class RcntAlloc = putils::allocator<shared_refcnt> >
-struct rc_ptr {
-    typedef T value_type;
-    typedef T& reference;
-    typedef const T& const_reference;
-    typedef std::size_t size_type;
-    typedef std::ptrdiff_t difference_type;
-    typedef RcntAlloc rcnt_alloc_;
-    typedef Alloc alloc_; 
-    
-    T* ptr;
-    shared_refcount *rcnt;
-    
-    rc_ptr(const rc_ptr& p) = delete ;
-    
-    rc_ptr():ptr(nullptr),rcnt(null_ptr) {}
-    
-    explicit rc_ptr(rc_ptr& p) {
-        ptr = p.ptr;
-        rcnt = p.rcnt;
-        rcnt->add(1);
-    }
-    
-    rc_ptr(rc_ptr&& p) {
-        ptr = p.ptr;
-        rcnt = p.rcnt;
-        p.reset(nullptr);
-    }
-        
-    rc_ptr(pointer p):ptr(p),rcnt(rcnt_alloc_.allocate(1)) {
-    }
+  std::int32_t add() noexcept { return cnt++; }
+  std::int32_t sub() noexcept { return cnt--; }
+  std::int32_t get() const noexcept { return cnt; }
+  std::int32_t exchange(std::int32_t new_value = 0) noexcept {
+    return std::exchange(cnt, new_value);
+  }
+};
 
-    rc_ptr(size_type n,const_reference v):ptr(alloc_.allocate(n,v)),rcnt(rcnt_alloc_.allocate(1)) {
-    }    
-    rc_ptr(size_type n,value_type v):ptr(alloc_.allocate(n,v)),rcnt(rcnt_alloc_.allocate(1)) {
-    }    
-    rc_ptr(size_type n,T&& v):ptr(alloc_.allocate(n,v)),rcnt(rcnt_alloc_.allocate(1)) {
-    }    
-    
-    template < void ... Args >
-    rc_ptr(Args&&...args):ptr(alloc_.allocate(args)),rcnt(rcnt_alloc_.allocate(1)) {}
-
-    ~rc_ptr() {
-        if (!rcnt->sub()) {
-            alloc_.deallocate(ptr);
-        }
-        rcnt_alloc_.dealloc(rcnt);
-    }
+/////////////////////////////////////////////////////
+//  Control block of an rc_ptr. The count, the number of
+//    elements and the allocator sit in front of the elements
+//    in a single allocation, so a buffer costs one call to
+//    the allocator and the count shares its cache line.
+/////////////////////////////////////////////////////
+template <typename T, class Count, class Alloc>
+struct rc_block {
+  typedef std::size_t size_type;
 
-    constexpr rc_ptr& operator=(const rc_ptr& r) noexcept {
-        if (!rcnt->sub()) alloc_.dealloc(ptr);
-        ptr = r.ptr;
-        rcnt->reset(r.rcnt);
-        return *this;
-    }
-    constexpr rc_ptr& operator=(rc_ptr&& r) noexcept {
-        if (!rcnt->sub()) alloc_.dealloc(ptr);
-        ptr = r.ptr;
-        rcnt->reset(r.rcnt);
-        r.reset(nullptr);
-        return *this;
-    }
+  Count cnt;
+  size_type n;
+  [[no_unique_address]] Alloc alloc;
 
-    pointer base() { return ptr;}
-    const_pointer base() const noexcept { return ptr;}
- 
-    bool unique() const noexcept { return rcnt->unique();}
-    bool empty() const noexcept { return ptr==nullptr;}
-    size_type use_count() const noexcept { return rcnt->use_count();}
-    
-    pointer operator->() { return ptr;}
-    reference operator*() { return *ptr;}
-    rc_ptr& operator++() noexcept {
-        ++ptr;
-        return *this;
-    }
-    rc_ptr& operator++(int) noexcept {
-        rc_ptr r(*this);
-        ++ptr;
-        return r;
-    }
-    rc_ptr& operator+=(difference_type n) {
-        ptr+=n;
-        return *this;
-    }
-    rc_ptr& operator--() noexcept {
-        --ptr;
-        return *this;
-    }
-    rc_ptr& operator--(int) noexcept {
-        rc_ptr r(*this);
-        --ptr;
-        return r;
-    }
-    rc_ptr& operator-=(difference_type n) {
-        ptr-=n;
-        return *this;
-    }
-    
-    reference operator[](size_type i) const noexcept {
-        return ptr[[n];
+  static constexpr std::size_t align =
+      alignof(T) > alignof(rc_block) ? alignof(T) : alignof(rc_block);
+  static constexpr std::size_t data_offset =
+      (sizeof(rc_block) + alignof(T) - 1) / alignof(T) * alignof(T);
+
+  struct alignas(align) unit {
+    unsigned char b[align];
+  };
+  typedef typename std::allocator_traits<Alloc>::template rebind_alloc<unit> unit_alloc;
+
+  rc_block(size_type n_, const Alloc &a) noexcept : cnt(1), n(n_), alloc(a) {}
+
+  static size_type units(size_type n) noexcept {
+    return (data_offset + n * sizeof(T) + sizeof(unit) - 1) / sizeof(unit);
+  }
+
+  T *data() noexcept {
+    return reinterpret_cast<T *>(reinterpret_cast<unsigned char *>(this) + data_offset);
+  }
+
+  // raw storage for n elements with the count set to 1
+  static rc_block *allocate(const Alloc &a, size_type n) {
+    unit_alloc ua(a);
+    unit *p = std::allocator_traits<unit_alloc>::allocate(ua, units(n));
+    return ::new (static_cast<void *>(p)) rc_block(n, a);
+  }
+
+  static void deallocate(rc_block *b) noexcept {
+    unit_alloc ua(b->alloc);
+    size_type nu = units(b->n);
+    b->~rc_block();
+    std::allocator_traits<unit_alloc>::deallocate(ua, reinterpret_cast<unit *>(b), nu);
+  }
+
+  // n copies of v
+  static rc_block *create(const Alloc &a, size_type n, const T &v) {
+    rc_block *b = allocate(a, n);
+    try {
+      std::uninitialized_fill_n(b->data(), n, v);
+    } catch (...) {
+      deallocate(b);
+      throw;
     }
-    
-    void reset(pointer p=nullptr) {
-        if (!rcnt->sub()) {
-            alloc_.deallocate(ptr);
-        }
-        if (p) {
-            ptr = p;
-            rcnt = new atomic<uint32_t>(0);
-        }else{
-            ptr = nullptr;
-            rcnt = nullptr;
-        }
+    return b;
+  }
+
+  // elements left default initialized, plain numbers are not touched
+  static rc_block *create_for_overwrite(const Alloc &a, size_type n) {
+    rc_block *b = allocate(a, n);
+    try {
+      std::uninitialized_default_construct_n(b->data(), n);
+    } catch (...) {
+      deallocate(b);
+      throw;
     }
+    return b;
+  }
 
-    void swap(rc_ptr& r) {
-        pointer tmp_ptr = ptr;
-        rcnt * tmp_rcnt = rcnt;
-        ptr = r.ptr;
-        rcnt = r.rcnt;         
-        r.ptr = tmp_ptr;
-        r.rcnt = tmp_rcnt;   
+  static void destroy(rc_block *b) noexcept {
+    T *p = b->data();
+    for (size_type i = b->n; i > 0; --i) p[i - 1].~T();
+    deallocate(b);
+  }
+};
+
+/////////////////////////////////////////////////////
+//  Intrusive reference counted pointer to one object or
+//    to a buffer of n objects. It is a single pointer to
+//    the control block; copies bump the count and the last
+//    owner destroys the elements and frees the block.
+//  Count is shared_refcount or local_refcount.
+/////////////////////////////////////////////////////
+template <typename T, class Count = shared_refcount, class Alloc = std::allocator<T> >
+class rc_ptr {
+ public:
+  typedef T value_type;
+  typedef T *pointer;
+  typedef const T *const_pointer;
+  typedef T &reference;
+  typedef const T &const_reference;
+  typedef std::size_t size_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef Alloc allocator_type;
+  typedef rc_block<T, Count, Alloc> block_type;
+
+ private:
+  block_type *blk;
+
+  void release() noexcept {
+    if (blk && blk->cnt.sub() == 1) block_type::destroy(blk);
+  }
+
+ public:
+  constexpr rc_ptr() noexcept : blk(nullptr) {}
+
+  // takes over a block made by block_type::create
+  explicit rc_ptr(block_type *b) noexcept : blk(b) {}
+
+  rc_ptr(const rc_ptr &p) noexcept : blk(p.blk) {
+    if (blk) blk->cnt.add();
+  }
+
+  rc_ptr(rc_ptr &&p) noexcept : blk(p.blk) { p.blk = nullptr; }
+
+  ~rc_ptr() { release(); }
+
+  rc_ptr &operator=(const rc_ptr &p) noexcept {
+    if (p.blk) p.blk->cnt.add();
+    release();
+    blk = p.blk;
+    return *this;
+  }
+
+  rc_ptr &operator=(rc_ptr &&p) noexcept {
+    if (this != &p) {
+      release();
+      blk = p.blk;
+      p.blk = nullptr;
     }
-    
+    return *this;
+  }
+
+  void reset() noexcept {
+    release();
+    blk = nullptr;
+  }
+
+  void swap(rc_ptr &p) noexcept { std::swap(blk, p.blk); }
+
+  pointer get() const noexcept { return blk ? blk->data() : nullptr; }
+  pointer data() const noexcept { return get(); }
+  size_type size() const noexcept { return blk ? blk->n : 0; }
+  pointer begin() const noexcept { return get(); }
+  pointer end() const noexcept { return get() + size(); }
+
+  size_type use_count() const noexcept { return blk ? size_type(blk->cnt.get()) : 0; }
+  bool unique() const noexcept { return use_count() == 1; }
+  bool empty() const noexcept { return blk == nullptr; }
+  explicit operator bool() const noexcept { return blk != nullptr; }
+
+  reference operator*() const noexcept { return *blk->data(); }
+  pointer operator->() const noexcept { return blk->data(); }
+  reference operator[](size_type i) const noexcept { return blk->data()[i]; }
+
+  bool operator==(const rc_ptr &p) const noexcept { return blk == p.blk; }
+};
+
+// single threaded variant without atomic operations
+template <typename T, class Alloc = std::allocator<T> >
+using local_rc_ptr = rc_ptr<T, local_refcount, Alloc>;
+
+/////////////////////////////////////////////////////
+//  Factories, the count and the object(s) in one allocation
+//  make_rc<T>(args...)           one T built from args
+//  make_rc_buffer<T>(n, v)       n copies of v
+//  make_rc_buffer<T>(n)          n default initialized T
+//  allocate_rc... the same with an allocator
+/////////////////////////////////////////////////////
+template <typename T, class Count = shared_refcount, class Alloc, class... Args>
+rc_ptr<T, Count, Alloc> allocate_rc(const Alloc &a, Args &&...args) {
+  typedef rc_block<T, Count, Alloc> block_type;
+  block_type *b = block_type::allocate(a, 1);
+  try {
+    ::new (static_cast<void *>(b->data())) T(std::forward<Args>(args)...);
+  } catch (...) {
+    block_type::deallocate(b);
+    throw;
+  }
+  return rc_ptr<T, Count, Alloc>(b);
+}
+
+template <typename T, class Count = shared_refcount, class... Args>
+rc_ptr<T, Count> make_rc(Args &&...args) {
+  return allocate_rc<T, Count>(std::allocator<T>(), std::forward<Args>(args)...);
+}
+
+template <typename T, class Count = shared_refcount, class Alloc>
+rc_ptr<T, Count, Alloc> allocate_rc_buffer(const Alloc &a, std::size_t n, const T &v) {
+  return rc_ptr<T, Count, Alloc>(rc_block<T, Count, Alloc>::create(a, n, v));
+}
+
+template <typename T, class Count = shared_refcount, class Alloc>
+rc_ptr<T, Count, Alloc> allocate_rc_buffer(const Alloc &a, std::size_t n) {
+  return rc_ptr<T, Count, Alloc>(rc_block<T, Count, Alloc>::create_for_overwrite(a, n));
 }
 
+template <typename T, class Count = shared_refcount>
+rc_ptr<T, Count> make_rc_buffer(std::size_t n, const T &v) {
+  return allocate_rc_buffer<T, Count>(std::allocator<T>(), n, v);
+}
 
+template <typename T, class Count = shared_refcount>
+rc_ptr<T, Count> make_rc_buffer(std::size_t n) {
+  return allocate_rc_buffer<T, Count>(std::allocator<T>(), n);
 }
-#endif
\ No newline at end of file
+
+template <typename T, class... Args>
+local_rc_ptr<T> make_local_rc(Args &&...args) {
+  return make_rc<T, local_refcount>(std::forward<Args>(args)...);
+}
+
+}  // namespace putils
+#endif
@@ -1,12 +1,18 @@
 #ifndef PUTILS_VECTOR_HPP
 #define PUTILS_VECTOR_HPP
+#include <concepts>
 #include <cstdlib>
+#include <cstring>
 #include <exception>
+#include <functional>
 #include <initializer_list>
 #include <iostream>
 #include <iterator>
 #include <memory>
 #include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
 
 namespace putils {
 
@@ -15,15 +21,15 @@ constexpr auto default_size = 32;
 struct out_of_range_exception : public std::exception {
   std::size_t index_;
   std::size_t max_index_;
+  std::string msg_;
   out_of_range_exception(std::size_t index, std::size_t max_index)
-      : index_(index), max_index_(max_index) {}
-  const char* what() const noexcept {
+      : index_(index), max_index_(max_index) {
     std::ostringstream os;
     os << "out of range access " << index_ << " in array of size " << max_index_
        << "\n";
-    std::string err_str(os.str());
-    return err_str.c_str();
+    msg_ = os.str();
   }
+  const char* what() const noexcept { return msg_.c_str(); }
 };
 
 template <class iter>
@@ -121,7 +127,85 @@ constexpr bool bool_abs_cmp(iter x, iter xlast, iter y) {
   return true;
 }
 
-template <typename T, class Allocator = std::allocator<T> >
+
+/////////////////////////////////////////////////////
+//  Types that can be moved to new storage with memcpy and
+//    the old bytes dropped without running a destructor.
+//    Every trivially copyable type is, specialize it for
+//    classes that only hold pointers or handles.
+/////////////////////////////////////////////////////
+template <typename T>
+struct is_trivially_relocatable : std::bool_constant<std::is_trivially_copyable_v<T> > {};
+
+template <typename T>
+inline constexpr bool is_trivially_relocatable_v = is_trivially_relocatable<T>::value;
+
+// tag for default initialized elements, numbers are left as they are
+struct default_init_t {
+  explicit default_init_t() = default;
+};
+inline constexpr default_init_t default_init{};
+
+/////////////////////////////////////////////////////
+//  malloc based allocator with reallocate, a vector of
+//    trivially relocatable elements grows with realloc and
+//    large blocks are then often extended in place.
+/////////////////////////////////////////////////////
+template <typename T>
+struct realloc_allocator {
+  typedef T value_type;
+  typedef std::true_type is_always_equal;
+
+  realloc_allocator() noexcept = default;
+  template <typename U>
+  realloc_allocator(const realloc_allocator<U>&) noexcept {}
+
+  T* allocate(std::size_t n) {
+    void* p = std::malloc(n * sizeof(T));
+    if (!p) throw std::bad_alloc();
+    return static_cast<T*>(p);
+  }
+  T* reallocate(T* p, std::size_t, std::size_t new_n) {
+    void* q = std::realloc(p, new_n * sizeof(T));
+    if (!q) throw std::bad_alloc();
+    return static_cast<T*>(q);
+  }
+  void deallocate(T* p, std::size_t) noexcept { std::free(p); }
+
+  template <typename U>
+  bool operator==(const realloc_allocator<U>&) const noexcept { return true; }
+};
+
+namespace vector_detail {
+
+template <typename T, std::size_t N>
+struct inline_storage {
+  alignas(T) unsigned char buf[N * sizeof(T)];
+};
+
+template <typename T>
+struct inline_storage<T, 0> {};
+
+template <class A, typename T>
+concept has_reallocate = requires(A a, T* p, std::size_t n) {
+  { a.reallocate(p, n, n) } -> std::same_as<T*>;
+};
+
+}  // namespace vector_detail
+
+/////////////////////////////////////////////////////
+//  Contiguous vector.
+//  N elements live inside the object, a vector that never
+//    holds more does not allocate. Beyond that capacity
+//    doubles.
+//  Trivially relocatable elements move to new storage with
+//    memcpy, or with the allocator's reallocate when it has
+//    one, instead of one move and destroy per element.
+//  resize(n, default_init) and resize_uninitialized(n)
+//    default initialize new elements, plain numbers are left
+//    unwritten for the caller to fill.
+/////////////////////////////////////////////////////
+template <typename T, class Allocator = std::allocator<T>, std::size_t N = 0>
 struct vector {
   typedef T value_type;
   typedef T* pointer;
@@ -135,276 +219,269 @@ struct vector {
   typedef Allocator allocator_type;
   typedef T* iterator;
   typedef const_pointer const_iterator;
+  typedef std::allocator_traits<Allocator> alloc_traits;
+
+  static constexpr size_type inline_capacity = N;
+  static constexpr bool relocatable = is_trivially_relocatable_v<T>;
 
+  [[no_unique_address]] vector_detail::inline_storage<T, N> ibuf_;
   pointer data_;
   size_type sz, cap;
-  Allocator alloc_;
-
-  vector() : data_(), sz(0), cap(default_size), alloc_() {
-    data_ = alloc_.allocate(cap);
-  }
-  explicit vector(const Allocator& alloc)
-      : data_(alloc.allocate(default_size)),
-        sz(0),
-        cap(default_size),
-        alloc_(alloc) {}
-  vector(size_type n, const Allocator& alloc = Allocator())
-      : data_(alloc.allocate(default_size)), sz(0), cap(n), alloc_(alloc) {}
-  vector(size_type n, value_type t, const Allocator& alloc = Allocator())
-      : data_(alloc.allocate(n)), sz(n), cap(n), alloc_(alloc) {
-    fill(data_, data_ + sz, t);
+  [[no_unique_address]] Allocator alloc_;
+
+  vector() noexcept(noexcept(Allocator())) : data_(inline_ptr()), sz(0), cap(N), alloc_() {}
+  explicit vector(const Allocator& alloc) noexcept
+      : data_(inline_ptr()), sz(0), cap(N), alloc_(alloc) {}
+  explicit vector(size_type n, const Allocator& alloc = Allocator())
+      : data_(inline_ptr()), sz(0), cap(N), alloc_(alloc) {
+    resize(n);
+  }
+  vector(size_type n, default_init_t, const Allocator& alloc = Allocator())
+      : data_(inline_ptr()), sz(0), cap(N), alloc_(alloc) {
+    resize(n, default_init);
   }
   vector(size_type n, const_reference t, const Allocator& alloc = Allocator())
-      : data_(alloc.allocate(n)), sz(n), cap(n), alloc_(alloc) {
-    fill(data_, data_ + sz, t);
+      : data_(inline_ptr()), sz(0), cap(N), alloc_(alloc) {
+    resize(n, t);
   }
-  vector(size_type n, pointer p, const Allocator& alloc = Allocator())
-      : data_(alloc.allocate(n)), sz(n), cap(n), alloc_(alloc) {
-    copy(data_, data_ + sz, p);
+  vector(size_type n, const_pointer p, const Allocator& alloc = Allocator())
+      : data_(inline_ptr()), sz(0), cap(N), alloc_(alloc) {
+    assign(p, p + n);
   }
-  vector(vector&& v) : data_(v.data_), sz(v.sz), cap(v.cap), alloc_(v.alloc_) {
-    v.data_ = nullptr;
-    v.sz = 0;
-    v.cap = 0;
+  vector(vector&& v) noexcept : data_(inline_ptr()), sz(0), cap(N), alloc_(std::move(v.alloc_)) {
+    take(v);
+  }
+  vector(const vector& v)
+      : data_(inline_ptr()), sz(0), cap(N),
+        alloc_(alloc_traits::select_on_container_copy_construction(v.alloc_)) {
+    assign(v.begin(), v.end());
   }
-  vector(const vector& v, const Allocator& alloc = Allocator())
-      : data_(alloc.allocate(v.sz)), sz(v.sz), cap(v.sz), alloc_(alloc) {
-    copy(data_, data_ + sz, v.data_);
+  vector(const vector& v, const Allocator& alloc)
+      : data_(inline_ptr()), sz(0), cap(N), alloc_(alloc) {
+    assign(v.begin(), v.end());
   }
 
-  vector(const std::initializer_list<T>& vlist,
-         const Allocator& alloc = Allocator())
-      : data_(nullptr), sz(vlist.size()), cap(vlist.size()), alloc_(alloc) {
-    data_ = alloc_.allocate(sz);
-    copy(data_, data_ + sz, vlist.begin());
+  vector(const std::initializer_list<T>& vlist, const Allocator& alloc = Allocator())
+      : data_(inline_ptr()), sz(0), cap(N), alloc_(alloc) {
+    assign(vlist.begin(), vlist.end());
   }
 
-  template <class InputIter>
+  template <class InputIter, class = typename std::iterator_traits<InputIter>::iterator_category>
   vector(InputIter iter, InputIter last, const Allocator& alloc = Allocator())
-      : data_(alloc.allocate(size_type(last - iter))),
-        sz(size_type(last - iter)),
-        cap(size_type(last - iter)),
-        alloc_(alloc) {
-    copy(data_, data_ + sz, iter);
+      : data_(inline_ptr()), sz(0), cap(N), alloc_(alloc) {
+    assign(iter, last);
   }
 
-  constexpr vector& operator=(vector&& v) {
-    data_ = v.data_;
-    sz = v.sz;
-    cap = v.cap;
-    alloc_ = v.alloc_;
-    v.data_ = nullptr;
-    v.sz = 0;
-    v.cap = 0;
+  vector& operator=(vector&& v) noexcept {
+    if (this != &v) {
+      clear();
+      release();
+      alloc_ = std::move(v.alloc_);
+      take(v);
+    }
     return *this;
   }
 
-  constexpr vector& operator=(const vector& v) {
-    if (v.sz > cap) {
-      alloc_.deallocate(data_, cap);
-    }
-    copy(data_, data_ + v.sz, v.data_);
-    sz = v.sz;
+  vector& operator=(const vector& v) {
+    if (this != &v) assign(v.begin(), v.end());
     return *this;
   }
 
-  constexpr vector& operator=(const std::initializer_list<value_type>& ilist) {
-    size_type count = ilist.size();
-    size_type new_sz = sz + count;
-    if ((count) > cap) grow(count);
-    typename std::initializer_list<value_type>::iterator iter = ilist.begin();
-    sz = count;
-    copy(data_, data_ + count, iter);
+  vector& operator=(const std::initializer_list<value_type>& ilist) {
+    assign(ilist.begin(), ilist.end());
     return *this;
   }
 
   ~vector() {
-    alloc_.deallocate(data_, cap);
-    data_ = nullptr;
-    sz = 0;
-    cap = 0;
+    clear();
+    release();
   }
 
-  allocator_type get_allocator() { return alloc_; }
+  allocator_type get_allocator() const { return alloc_; }
 
   template <class InputIter>
   void assign(InputIter iter, InputIter last) {
-    size_type n = last - iter;
-    if (n > cap) grow(n);
-    copy(data_, data_ + n, iter);
+    clear();
+    size_type n = size_type(std::distance(iter, last));
+    if (n > cap) reallocate(n);
+    std::uninitialized_copy(iter, last, data_);
     sz = n;
   }
 
-  void assign(std::initializer_list<T> ilist) {
-    size_type n = ilist.size();
-    if (n > cap) grow(n);
-    typename std::initializer_list<T>::iterator iter = ilist.begin();
-    copy(data_, data_ + n, iter);
-    sz = n;
-  }
+  void assign(std::initializer_list<T> ilist) { assign(ilist.begin(), ilist.end()); }
 
   constexpr size_type size() const noexcept { return sz; }
   constexpr size_type capacity() const noexcept { return cap; }
   constexpr bool empty() const noexcept { return sz == 0; }
   constexpr bool full() const noexcept { return sz == cap; }
+  constexpr bool is_inline() const noexcept { return N > 0 && cap == N; }
   constexpr pointer data() noexcept { return data_; }
-  constexpr const pointer data() const noexcept { return data_; }
-  constexpr void clear() noexcept { sz = 0; }
-  constexpr void shrink_to_fit() noexcept {
-    if (sz == cap) return;
-    pointer p = alloc_.allocate(sz * sizeof(value_type));
-    copy2(p, data_, sz);
-    alloc_.deallocate(data_, cap);
-    data_ = p;
-    cap = sz;
-  }
-  constexpr void grow(size_type new_sz = 0) noexcept {
-    if (sz == new_sz) return;
-    if (new_sz == 0) new_sz = sz + sz;
-    pointer p = alloc_.allocate(new_sz * sizeof(value_type));
-    copy2(p, data_, sz);
-    alloc_.deallocate(data_, cap);
-    data_ = p;
-    cap = new_sz;
+  constexpr const_pointer data() const noexcept { return data_; }
+  void clear() noexcept {
+    std::destroy_n(data_, sz);
+    sz = 0;
   }
-  constexpr void reserve(size_type n) {
-    if (sz <= n) return;
-    grow(n);
+  void shrink_to_fit() {
+    size_type new_cap = sz > N ? sz : N;
+    if (new_cap < cap) reallocate(new_cap);
   }
-
-  void push_back(const_reference t) {
-    if (full()) grow();
-    data_[sz] = t;
-    ++sz;
-    return;
+  // capacity new_cap, or the next geometric step with 0
+  void grow(size_type new_cap = 0) {
+    if (new_cap == 0) new_cap = next_capacity(sz + 1);
+    if (new_cap > cap) reallocate(new_cap);
   }
-
-  void push_back(T&& v) {
-    if (full()) grow();
-    data_[sz] = v;
-    ++sz;
-    return;
+  void reserve(size_type n) {
+    if (n > cap) reallocate(n);
   }
 
-  void push_front(const_reference t) {
-    if ((sz + 1) > cap) grow();
-    if (sz == 0) {
-      data_[0] = t;
-      sz = 1;
+  // new elements value initialized, zero for numbers
+  void resize(size_type n) {
+    if (n > cap) reallocate(next_capacity(n));
+    if (n > sz) std::uninitialized_value_construct(data_ + sz, data_ + n);
+    else std::destroy(data_ + n, data_ + sz);
+    sz = n;
+  }
+  void resize(size_type n, const_reference v) {
+    if (n > sz && in_range(&v)) {
+      value_type tmp(v);
+      resize(n, tmp);
       return;
     }
-    if (sz == 1) {
-      data_[1] = data_[0];
-      data_[0] = t;
-      sz = 2;
-      return;
+    if (n > cap) reallocate(next_capacity(n));
+    if (n > sz) std::uninitialized_fill(data_ + sz, data_ + n, v);
+    else std::destroy(data_ + n, data_ + sz);
+    sz = n;
+  }
+  void resize(size_type n, default_init_t) {
+    if (n > cap) reallocate(next_capacity(n));
+    if (n > sz) std::uninitialized_default_construct(data_ + sz, data_ + n);
+    else std::destroy(data_ + n, data_ + sz);
+    sz = n;
+  }
+  void resize_uninitialized(size_type n) { resize(n, default_init); }
+
+  template <class... Args>
+  reference emplace_back(Args&&... args) {
+    if (sz < cap) {
+      ::new (static_cast<void*>(data_ + sz)) T(std::forward<Args>(args)...);
+      return data_[sz++];
     }
-    if (sz == 2) {
-      data_[2] = data_[1];
-      data_[1] = data_[0];
-      data_[0] = t;
-      sz = 3;
-      return;
+    if constexpr (relocatable && vector_detail::has_reallocate<Allocator, T>) {
+      if (data_ != inline_ptr()) {
+        // the arguments may refer into the storage reallocate moves
+        value_type tmp(std::forward<Args>(args)...);
+        reallocate(next_capacity(sz + 1));
+        ::new (static_cast<void*>(data_ + sz)) T(std::move(tmp));
+        return data_[sz++];
+      }
     }
-    move_forward(data_, data_ + sz - 1, 1);
-    data_[0] = t;
-    ++sz;
-    return;
+    {
+      // the arguments may refer into the old storage
+      size_type new_cap = next_capacity(sz + 1);
+      pointer p = allocate(new_cap);
+      try {
+        ::new (static_cast<void*>(p + sz)) T(std::forward<Args>(args)...);
+      } catch (...) {
+        alloc_traits::deallocate(alloc_, p, new_cap);
+        throw;
+      }
+      relocate(p, data_, sz);
+      release();
+      data_ = p;
+      cap = new_cap;
+    }
+    return data_[sz++];
   }
 
-  iterator insert(iterator pos, size_type count, const_reference v) {
-    difference_type n = pos - data_;
-    size_type new_sz = sz + count;
-    if (new_sz > cap) grow();
-    move_forward(data_ + n, end(), count);
-    fill(data_ + n, data_ + n + count, v);
-    sz += count;
-    return data_ + n;
-  }
+  void push_back(const_reference t) { emplace_back(t); }
+
+  void push_back(T&& v) { emplace_back(std::move(v)); }
 
-  iterator insert(iterator pos, const_reference v) {
-    difference_type n = pos - data_;
-    if (sz == cap) grow();
-    move_forward(data_ + n, end());
-    data_[n] = v;
+  void push_front(const_reference t) { insert(begin(), t); }
+
+  template <class... Args>
+  iterator emplace(const_iterator pos, Args&&... args) {
+    value_type tmp(std::forward<Args>(args)...);
+    size_type n = size_type(pos - data_);
+    open_gap(n, 1);
+    ::new (static_cast<void*>(data_ + n)) T(std::move(tmp));
     ++sz;
     return data_ + n;
   }
 
-  iterator insert(iterator pos, T&& x) {
-    difference_type n = pos - data_;
-    if (sz == cap) grow();
-    move_forward(data_ + n, end());
-    data_[n] = T{x};
-    ++sz;
+  iterator insert(const_iterator pos, size_type count, const_reference v) {
+    value_type tmp(v);
+    size_type n = size_type(pos - data_);
+    open_gap(n, count);
+    std::uninitialized_fill_n(data_ + n, count, tmp);
+    sz += count;
     return data_ + n;
   }
 
-  iterator insert(iterator pos, std::initializer_list<value_type> ilist) {
-    size_type count = ilist.size();
-    size_type new_sz = sz + count;
-    difference_type n = pos - data_;
-    if (new_sz > cap) grow();
-    move_forward(data_ + n, end(), count);
-    sz = new_sz;
-    typename std::initializer_list<value_type>::iterator iter = ilist.begin();
-    copy(data_ + n, data_ + n + count, iter);
+  iterator insert(const_iterator pos, const_reference v) { return emplace(pos, v); }
+
+  iterator insert(const_iterator pos, T&& x) { return emplace(pos, std::move(x)); }
+
+  template <class InputIter, class = typename std::iterator_traits<InputIter>::iterator_category>
+  iterator insert(const_iterator pos, InputIter first, InputIter last) {
+    size_type count = size_type(std::distance(first, last));
+    size_type n = size_type(pos - data_);
+    open_gap(n, count);
+    std::uninitialized_copy(first, last, data_ + n);
+    sz += count;
     return data_ + n;
   }
 
-  iterator erase(iterator pos) {
-    if (sz == 0) throw out_of_range_exception(1, 0);
-    move_back(pos, end());
-    --sz;
-    return pos;
+  iterator insert(const_iterator pos, std::initializer_list<value_type> ilist) {
+    return insert(pos, ilist.begin(), ilist.end());
   }
 
-  iterator erase(iterator pos, size_type count) {
-    if (sz == 0) throw out_of_range_exception(count, 0);
-    move_back(pos, end(), count);
-    sz -= count;
-    return pos;
-  }
+  iterator erase(const_iterator pos) { return erase(pos, size_type(1)); }
 
-  iterator erase(iterator first, iterator last) {
-    if (sz == 0) throw out_of_range_exception((last - first), 0);
-    size_type count = last - first;
-    return erase(first, count);
+  iterator erase(const_iterator pos, size_type count) {
+    size_type n = size_type(pos - data_);
+    if (n + count > sz) throw out_of_range_exception(n + count, sz);
+    std::destroy_n(data_ + n, count);
+    relocate(data_ + n, data_ + n + count, sz - n - count);
+    sz -= count;
+    return data_ + n;
   }
 
   iterator erase(const_iterator first, const_iterator last) {
-    if (sz == 0) throw out_of_range_exception((last - first), 0);
-    size_type count = last - first;
-    return erase(first, count);
+    return erase(first, size_type(last - first));
   }
 
-  void swap(vector& v) {
-    pointer p = data_;
-    data_ = v.data_;
-    v.data_ = p;
-    value_type tsz = sz;
-    sz = v.sz;
-    v.sz = tsz;
-    value_type tcap = cap;
-    cap = v.cap;
-    v.cap = tcap;
+  void swap(vector& v) noexcept {
+    if (N == 0 || (!is_inline() && !v.is_inline())) {
+      std::swap(data_, v.data_);
+      std::swap(sz, v.sz);
+      std::swap(cap, v.cap);
+      std::swap(alloc_, v.alloc_);
+      return;
+    }
+    vector tmp(std::move(v));
+    v = std::move(*this);
+    *this = std::move(tmp);
   }
 
-  void pop_back() { --sz; }
+  void pop_back() noexcept {
+    --sz;
+    std::destroy_at(data_ + sz);
+  }
 
   constexpr const_reference front() const noexcept { return data_[0]; }
   constexpr const_reference back() const noexcept { return data_[sz - 1]; }
   constexpr const_reference operator[](size_type i) const noexcept {
     return data_[i];
   }
-  constexpr const_reference at(size_type i) const noexcept {
+  constexpr const_reference at(size_type i) const {
     if (i < sz) return data_[i];
     throw out_of_range_exception(i, sz);
   }
   constexpr reference front() noexcept { return data_[0]; }
   constexpr reference back() noexcept { return data_[sz - 1]; }
   constexpr reference operator[](size_type i) noexcept { return data_[i]; }
-  constexpr reference at(size_type i) noexcept {
+  constexpr reference at(size_type i) {
     if (i < sz) return data_[i];
     throw out_of_range_exception(i, sz);
   }
@@ -417,44 +494,139 @@ struct vector {
   constexpr reverse_iterator rend() noexcept {
     return reverse_iterator(begin());
   }
-  constexpr const pointer begin() const noexcept { return data_; }
-  constexpr const pointer end() const noexcept { return (data_ + sz); }
+  constexpr const_pointer begin() const noexcept { return data_; }
+  constexpr const_pointer end() const noexcept { return (data_ + sz); }
+  constexpr const_pointer cbegin() const noexcept { return data_; }
+  constexpr const_pointer cend() const noexcept { return (data_ + sz); }
   constexpr const_reverse_iterator rbegin() const noexcept {
     return const_reverse_iterator(end());
   }
   constexpr const_reverse_iterator rend() const noexcept {
     return const_reverse_iterator(begin());
   }
+
+ private:
+  pointer inline_ptr() noexcept {
+    if constexpr (N > 0) return reinterpret_cast<pointer>(&ibuf_);
+    else return nullptr;
+  }
+
+  size_type next_capacity(size_type need) const noexcept {
+    size_type c = cap ? cap + cap : size_type(default_size);
+    return c > need ? c : need;
+  }
+
+  bool in_range(const_pointer p) const noexcept {
+    return !std::less<const_pointer>()(p, data_) && std::less<const_pointer>()(p, data_ + sz);
+  }
+
+  pointer allocate(size_type n) {
+    if (n <= N) return inline_ptr();
+    return alloc_traits::allocate(alloc_, n);
+  }
+
+  // free the storage, the elements are already gone or moved
+  void release() noexcept {
+    if (data_ != inline_ptr()) alloc_traits::deallocate(alloc_, data_, cap);
+    data_ = inline_ptr();
+    cap = N;
+  }
+
+  // move n elements to uninitialized dst, the source is left uninitialized
+  static void relocate(pointer dst, pointer src, size_type n) noexcept {
+    if (n == 0 || dst == src) return;
+    if constexpr (relocatable) {
+      std::memmove(static_cast<void*>(dst), static_cast<const void*>(src), n * sizeof(T));
+    } else if (dst < src) {
+      for (size_type i = 0; i < n; ++i) {
+        ::new (static_cast<void*>(dst + i)) T(std::move(src[i]));
+        std::destroy_at(src + i);
+      }
+    } else {
+      for (size_type i = n; i-- > 0;) {
+        ::new (static_cast<void*>(dst + i)) T(std::move(src[i]));
+        std::destroy_at(src + i);
+      }
+    }
+  }
+
+  void reallocate(size_type new_cap) {
+    if constexpr (relocatable && vector_detail::has_reallocate<Allocator, T>) {
+      if (data_ != inline_ptr() && new_cap > N) {
+        data_ = alloc_.reallocate(data_, cap, new_cap);
+        cap = new_cap;
+        return;
+      }
+    }
+    pointer p = allocate(new_cap);
+    if (p == data_) return;
+    relocate(p, data_, sz);
+    release();
+    data_ = p;
+    cap = new_cap > N ? new_cap : N;
+  }
+
+  // uninitialized room for count elements at n, sz is unchanged
+  void open_gap(size_type n, size_type count) {
+    if (n > sz) throw out_of_range_exception(n, sz);
+    if (sz + count <= cap) {
+      relocate(data_ + n + count, data_ + n, sz - n);
+      return;
+    }
+    size_type new_cap = next_capacity(sz + count);
+    pointer p = allocate(new_cap);
+    relocate(p, data_, n);
+    relocate(p + n + count, data_ + n, sz - n);
+    release();
+    data_ = p;
+    cap = new_cap;
+  }
+
+  // steal the storage of v, inline elements are relocated one by one
+  void take(vector& v) noexcept {
+    if (v.data_ == v.inline_ptr()) {
+      relocate(data_, v.data_, v.sz);
+    } else {
+      data_ = v.data_;
+      cap = v.cap;
+    }
+    sz = v.sz;
+    v.data_ = v.inline_ptr();
+    v.sz = 0;
+    v.cap = N;
+  }
 };
 
-template <typename allocator_1, typename allocator_2, typename T>
-constexpr bool operator==(const vector<T, allocator_1>& lhs,
-                          const vector<T, allocator_2>& rhs) {
+// vector with n elements inside the object
+template <typename T, std::size_t N, class Allocator = std::allocator<T> >
+using small_vector = vector<T, Allocator, N>;
+
+template <typename T, class A1, std::size_t N1, class A2, std::size_t N2>
+constexpr bool operator==(const vector<T, A1, N1>& lhs, const vector<T, A2, N2>& rhs) {
   if (lhs.size() != rhs.size()) return false;
   return bool_cmp(lhs.begin(), lhs.end(), rhs.begin());
 }
 
-template <typename allocator_1, typename allocator_2, typename T>
-constexpr bool operator!=(const vector<T, allocator_1>& lhs,
-                          const vector<T, allocator_2>& rhs) {
-  if (lhs.size() != rhs.size()) return true;
-  return !bool_cmp(lhs.begin(), lhs.end(), rhs.begin());
+template <typename T, class A1, std::size_t N1, class A2, std::size_t N2>
+constexpr bool operator!=(const vector<T, A1, N1>& lhs, const vector<T, A2, N2>& rhs) {
+  return !(lhs == rhs);
 }
 
-template < typename T , class Allocator >
-void erase( putils::vector<T,Allocator> & v, T& value) {
-  putils::vector<T,Allocator>::iterator iter = v.begin();
-  putils::vector<T,Allocator>::iterator iend = v.end();
-  while (iter!=v.end()) {
-    if ( *iter == value) iter = v.erase(iter);
-    ++iter;
+// remove every element equal to value, returns the number removed
+template <typename T, class Allocator, std::size_t N>
+std::size_t erase(putils::vector<T, Allocator, N>& v, const T& value) {
+  typename putils::vector<T, Allocator, N>::iterator iter = v.begin();
+  typename putils::vector<T, Allocator, N>::iterator out = v.begin();
+  for (; iter != v.end(); ++iter) {
+    if (!(*iter == value)) {
+      if (out != iter) *out = std::move(*iter);
+      ++out;
+    }
   }
-  
-  
-}
-
-
+  std::size_t count = std::size_t(v.end() - out);
+  v.erase(out, count);
+  return count;
 }
 
 }  // namespace putils
-#endif
\ No newline at end of file
+#endif
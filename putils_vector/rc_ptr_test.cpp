@@ -0,0 +1,161 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "putils_shared_count.hpp"
+
+double elapsed(const std::chrono::steady_clock::time_point &ts) {
+  std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+  return d.count();
+}
+
+// counts live objects so leaks and double frees show up
+struct counted {
+  static int live;
+  double v;
+  counted() : v(0.0) { ++live; }
+  explicit counted(double x) : v(x) { ++live; }
+  counted(const counted &c) : v(c.v) { ++live; }
+  ~counted() { --live; }
+};
+int counted::live = 0;
+
+// an allocator that counts its calls
+template <typename T>
+struct counting_allocator {
+  typedef T value_type;
+  int *calls;
+  explicit counting_allocator(int *c) noexcept : calls(c) {}
+  template <typename U>
+  counting_allocator(const counting_allocator<U> &a) noexcept : calls(a.calls) {}
+  T *allocate(std::size_t n) {
+    ++*calls;
+    return std::allocator<T>().allocate(n);
+  }
+  void deallocate(T *p, std::size_t n) noexcept {
+    --*calls;
+    std::allocator<T>().deallocate(p, n);
+  }
+};
+
+bool check() {
+  bool ok = true;
+  {
+    putils::rc_ptr<counted> p = putils::make_rc<counted>(2.0);
+    putils::rc_ptr<counted> q(p);
+    ok = ok && p.use_count() == 2 && q->v == 2.0 && counted::live == 1;
+    putils::rc_ptr<counted> r(std::move(q));
+    ok = ok && q.empty() && r.use_count() == 2;
+    r = p;
+    ok = ok && p.use_count() == 2;
+    r.reset();
+    ok = ok && p.unique();
+  }
+  ok = ok && counted::live == 0;
+  {
+    putils::local_rc_ptr<counted> b =
+        putils::make_rc_buffer<counted, putils::local_refcount>(100, counted(1.5));
+    std::vector<putils::local_rc_ptr<counted> > c(10, b);
+    ok = ok && b.size() == 100 && c[9][99].v == 1.5 && counted::live == 100;
+    ok = ok && b.use_count() == 11;
+    c.clear();
+    ok = ok && b.unique();
+    putils::local_rc_ptr<counted> d = putils::make_local_rc<counted>(3.0);
+    ok = ok && d.unique() && counted::live == 101;
+  }
+  ok = ok && counted::live == 0;
+  {
+    // the count and the elements come from one allocation
+    int calls = 0;
+    counting_allocator<double> a(&calls);
+    auto p = putils::allocate_rc_buffer<double>(a, 1000, 1.0);
+    ok = ok && calls == 1 && reinterpret_cast<std::uintptr_t>(p.get()) % alignof(double) == 0;
+    auto q = p;
+    ok = ok && calls == 1;
+    p.reset();
+    q.reset();
+    ok = ok && calls == 0;
+  }
+  {
+    // copies made and dropped on several threads
+    auto p = putils::make_rc_buffer<double>(1000, 0.0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([p] {
+        for (int i = 0; i < 100000; ++i) {
+          putils::rc_ptr<double> q(p);
+          q.reset();
+        }
+      });
+    }
+    for (auto &t : threads) t.join();
+    ok = ok && p.unique();
+  }
+  return ok;
+}
+
+/////////////////////////////////////////////////////
+//  Copy and destroy throughput for a shared buffer, a
+//    batch of copies is made from one owner then dropped.
+/////////////////////////////////////////////////////
+template <class ptr_t>
+double copy_destroy(const ptr_t &p, size_t ncopies, int nrep) {
+  std::vector<ptr_t> v;
+  v.reserve(ncopies);
+  auto ts = std::chrono::steady_clock::now();
+  for (int rep = 0; rep < nrep; ++rep) {
+    for (size_t i = 0; i < ncopies; ++i) v.push_back(p);
+    v.clear();
+  }
+  return elapsed(ts) * 1.e9 / (double(ncopies) * nrep);
+}
+
+// allocate and release a buffer of n doubles
+template <class make_t>
+double make_destroy(make_t make, int nrep) {
+  double sum = 0.0;
+  auto ts = std::chrono::steady_clock::now();
+  for (int rep = 0; rep < nrep; ++rep) {
+    auto p = make();
+    sum += double(p.use_count());
+  }
+  double tm = elapsed(ts);
+  return (sum == double(nrep)) ? tm * 1.e9 / nrep : -1.0;
+}
+
+void bench(size_t n) {
+  const size_t ncopies = 1000;
+  const int nrep = 5000;
+  std::cout << "buffer of " << n << " doubles, ns per operation\n";
+  auto rc = putils::make_rc_buffer<double>(n, 0.0);
+  auto lrc = putils::make_rc_buffer<double, putils::local_refcount>(n, 0.0);
+  auto sp = std::make_shared<double[]>(n);
+  std::shared_ptr<double> sp2(new double[n], std::default_delete<double[]>());
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "  copy+destroy  rc_ptr " << copy_destroy(rc, ncopies, nrep)
+            << " local_rc_ptr " << copy_destroy(lrc, ncopies, nrep)
+            << " shared_ptr " << copy_destroy(sp, ncopies, nrep) << "\n";
+  const int nmake = 200000;
+  std::cout << "  make+destroy  rc_ptr "
+            << make_destroy([n] { return putils::make_rc_buffer<double>(n, 0.0); }, nmake)
+            << " local_rc_ptr "
+            << make_destroy([n] { return putils::make_rc_buffer<double, putils::local_refcount>(n, 0.0); }, nmake)
+            << " make_shared "
+            << make_destroy([n] { return std::make_shared<double[]>(n); }, nmake)
+            << " shared_ptr(new[]) "
+            << make_destroy([n] { return std::shared_ptr<double>(new double[n](), std::default_delete<double[]>()); }, nmake)
+            << "\n";
+  std::cout << "  sizeof rc_ptr " << sizeof(rc) << " shared_ptr " << sizeof(sp2) << "\n";
+}
+
+int main() {
+  bool ok = check();
+  bench(16);
+  bench(4096);
+  std::cout << (ok ? "rc_ptr test passed\n" : "rc_ptr test FAILED\n");
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
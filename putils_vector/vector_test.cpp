@@ -0,0 +1,127 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "putils_vector.hpp"
+
+double elapsed(const std::chrono::steady_clock::time_point &ts) {
+  std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+  return d.count();
+}
+
+struct particle {
+  double x[3];
+  double v[3];
+  double m;
+  int id;
+  particle() = default;
+  particle(double px, double py, double pz, int i)
+      : x{px, py, pz}, v{0.0, 0.0, 0.0}, m(1.0), id(i) {}
+};
+
+bool check() {
+  bool ok = true;
+  {
+    putils::vector<std::string> v;
+    for (int i = 0; i < 100; ++i) v.emplace_back(std::to_string(i) + " a long string past sso");
+    v.insert(v.begin() + 3, std::string("x"));
+    v.erase(v.begin(), 2);
+    v.push_back(v[0]);
+    ok = ok && v.size() == 100 && v[1] == "x" && v.back() == v[0] && v[0][0] == '2';
+    putils::vector<std::string> w(v);
+    putils::vector<std::string> u(std::move(w));
+    ok = ok && u == v && w.empty();
+  }
+  {
+    // stays inside the object until it passes 8 elements
+    putils::small_vector<std::string, 8> s;
+    for (int i = 0; i < 8; ++i) s.emplace_back(1, char('a' + i));
+    ok = ok && s.is_inline();
+    putils::small_vector<std::string, 8> t(std::move(s));
+    ok = ok && t.size() == 8 && t[7] == "h" && s.empty();
+    t.emplace_back("i");
+    ok = ok && !t.is_inline() && t.capacity() >= 9;
+    t.resize(3);
+    t.shrink_to_fit();
+    ok = ok && t.is_inline() && t[2] == "c";
+    putils::small_vector<std::string, 8> h(20, std::string("z"));
+    h.swap(t);
+    ok = ok && t.size() == 20 && h.size() == 3 && h.is_inline() && h[0] == "a";
+  }
+  {
+    putils::vector<int, putils::realloc_allocator<int> > r;
+    for (int i = 0; i < 100000; ++i) r.push_back(i);
+    r.resize_uninitialized(200000);
+    for (int i = 100000; i < 200000; ++i) r[i] = i;
+    bool seq = true;
+    for (int i = 0; i < 200000; ++i) seq = seq && r[i] == i;
+    r.resize(200010);
+    ok = ok && seq && r.back() == 0;
+    ok = ok && putils::erase(r, 7) == 1 && r[7] == 8;
+    r.shrink_to_fit();
+    ok = ok && r.full();
+    r.push_back(r[5]);
+    ok = ok && !r.full() && r.back() == 5;
+  }
+  return ok;
+}
+
+/////////////////////////////////////////////////////
+//  Rebuild a particle list every step, nparticles per step
+/////////////////////////////////////////////////////
+template <class vec_t>
+double rebuild(int nsteps, int np) {
+  double sum = 0.0;
+  auto ts = std::chrono::steady_clock::now();
+  for (int step = 0; step < nsteps; ++step) {
+    vec_t list;
+    for (int i = 0; i < np; ++i) list.emplace_back(double(i), double(step), 0.0, i);
+    sum += list[np / 2].x[0];
+  }
+  double tm = elapsed(ts);
+  return (sum == double(nsteps) * double(np / 2)) ? tm : -1.0;
+}
+
+// a list sized first and then filled
+template <class vec_t, class resize_t>
+double refill(int nsteps, int np, resize_t resize) {
+  double sum = 0.0;
+  vec_t list;
+  auto ts = std::chrono::steady_clock::now();
+  for (int step = 0; step < nsteps; ++step) {
+    list.clear();
+    list.shrink_to_fit();
+    resize(list, np);
+    for (int i = 0; i < np; ++i) list[i] = particle(double(i), double(step), 0.0, i);
+    sum += list[np / 2].x[0];
+  }
+  double tm = elapsed(ts);
+  return (sum == double(nsteps) * double(np / 2)) ? tm : -1.0;
+}
+
+int main() {
+  bool ok = check();
+  const int nsteps = 50;
+  const int np = 200000;
+  std::cout << nsteps << " rebuilds of " << np << " particles, seconds\n";
+  std::cout << "  emplace_back std::vector " << rebuild<std::vector<particle> >(nsteps, np)
+            << " putils::vector " << rebuild<putils::vector<particle> >(nsteps, np)
+            << " realloc_allocator "
+            << rebuild<putils::vector<particle, putils::realloc_allocator<particle> > >(nsteps, np)
+            << "\n";
+  std::cout << "  resize+fill  std::vector "
+            << refill<std::vector<particle> >(nsteps, np, [](auto &v, int n) { v.resize(n); })
+            << " putils resize "
+            << refill<putils::vector<particle> >(nsteps, np, [](auto &v, int n) { v.resize(n); })
+            << " resize_uninitialized "
+            << refill<putils::vector<particle> >(nsteps, np, [](auto &v, int n) { v.resize_uninitialized(n); })
+            << "\n";
+  std::cout << "  small lists of 6 std::vector "
+            << rebuild<std::vector<particle> >(nsteps * 20000, 6)
+            << " small_vector<8> "
+            << rebuild<putils::small_vector<particle, 8> >(nsteps * 20000, 6) << "\n";
+  std::cout << (ok ? "vector test passed\n" : "vector test FAILED\n");
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
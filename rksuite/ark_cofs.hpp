@@ -33,7 +33,7 @@ public:
     berr[2] = b[2] - 1408. / 2565.;
     berr[3] = b[3] - 2197.0 / 4104.;
     berr[4] = b[4] + 0.2;
-    berr[5] = -b[5];
+    berr[5] = b[5];
 
     a[0][0] = 0.25;
 
@@ -77,7 +77,7 @@ public:
   {
     b = std::move(std::vector<double>(2));
     c = std::move(std::vector<double>(1));
-    berr = std::move(std::vector<double>(1));
+    berr = std::move(std::vector<double>(2));
     a = std::move(std::vector<std::vector<double>>(1));
     a[0] = std::vector<double>(1);
     b[0] = 0.5;
@@ -1,5 +1,6 @@
 #pragma once
 #include <cmath>
+#include <iostream>
 
 namespace petlib {
 namespace runge_kutta {
@@ -57,34 +58,35 @@ struct ark_control
    } 
 
         
-    bool check_error(double& dt,
-        double err_,
-        double err_y,
-        double err_dydt,
+    template < typename T >
+    bool check_error(T& dt,
+        T err_,
+        T err_y,
+        T err_dydt,
         int q,
         int& ext_step)
     {
         ext_step = 0;
-        double S = 0.9;
-        double err_term = a_y * err_y + dt * a_dydt * err_dydt;
-        double D = eps_abs + eps_rel * err_term;
-        double EoverD = err_/D;
+        T S = T(0.9);
+        T err_term = T(a_y) * err_y + dt * T(a_dydt) * err_dydt;
+        T D = T(eps_abs) + T(eps_rel) * err_term;
+        T EoverD = err_/D;
         // if E > D * 1.1
         // E exceeds D by more than 10%  
         if ( EoverD > 1.1) {
             // reduce timestep error > max allowed
-            dt = S * dt / pow(EoverD,q);
-            if ( dt < min_dt) {
-                dt = min_dt;
+            dt = S * dt / std::pow(EoverD,T(1)/T(q));
+            if ( dt < T(min_dt)) {
+                dt = T(min_dt);
                 ext_step = 1;
             }
             return false;
         }else{
             // inflate timestep
             if ( EoverD < 0.5) {
-                dt = S *  dt / pow(EoverD,(q+1));
-                if ( dt > max_dt) {
-                    dt = max_dt;
+                dt = S *  dt / std::pow(EoverD,T(1)/T(q+1));
+                if ( dt > T(max_dt)) {
+                    dt = T(max_dt);
                     ext_step = 1;
                 }
             }
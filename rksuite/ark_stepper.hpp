@@ -1,9 +1,14 @@
 #pragma once
+#include <cassert>
 #include <cstdlib>
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <limits>
 #include <vector>
+#include <span>
 #include "rk_stepper.hpp"
+#include "rk_events.hpp"
 namespace petlib {
 namespace runge_kutta {
 
@@ -11,20 +16,21 @@ template < class rk_control_type >
 class rk_control
 {
     rk_control_type c;
-public:    
+public:
     rk_control(const rk_control_type& c0):
         c(c0)
     {}
 
-    bool check_error(double& dt,
-        double err_,
-        double err_y,
-        double err_dydt,
+    template < typename T >
+    bool check_error(T& dt,
+        T err_,
+        T err_y,
+        T err_dydt,
         int q,
         int& extreme_step)
     {
         return c.check_error(dt,err_,err_y,err_dydt,q,extreme_step);
-    }    
+    }
 };
 
 template < class cofs_t >
@@ -42,100 +48,230 @@ public:
     }
 };
 
-template < class system_type, class acofs_type, class control_type >
+template < class system_type, class acofs_type, class control_type, typename T = double >
 class adaptive_rk_stepper
 {
     rk_control<control_type> con;
-    rk_system<system_type> sys;
-    std::vector< std::vector<double> > m_derivs;
-    std::vector<double> m_y;
-    std::vector<double> m_ytmp;
-    std::vector< std::vector<double> > m_a;
-    std::vector<double> m_b;
-    std::vector<double> m_c;
-    std::vector<double> m_b_err;
-    double m_t;
-    double m_dt;
+    rk_system<system_type,T> sys;
+    std::vector<T> m_derivs;
+    std::vector<T> m_y;
+    std::vector<T> m_ytmp;
+    std::vector<T> m_a;
+    std::vector<T> m_b;
+    std::vector<T> m_c;
+    std::vector<T> m_b_err;
+    std::vector<T> m_y0;
+    T m_t;
+    T m_t0;
+    T m_dt;
     size_t n_steps;
     size_t n_vars;
     int q;
 public:
+    typedef T value_type;
+
     adaptive_rk_stepper() = delete;
     adaptive_rk_stepper(
-        std::vector<double>& y_init, const double& t_init,
-        const double& delta_t, 
+        std::span<const T> y_init, const T& t_init,
+        const T& delta_t,
         const control_type& con0,
         const system_type& sys0 = system_type()):
         con(con0),
         sys(sys0),
         m_derivs(),
-        m_y(y_init),
+        m_y(y_init.begin(),y_init.end()),
         m_ytmp(sys.num_vars()),
+        m_y0(sys.num_vars()),
         m_t(t_init),
+        m_t0(t_init),
         m_dt(delta_t),
         n_steps( ark_cofs<acofs_type>::num_steps() ),
         n_vars(sys.num_vars()),
         q(ark_cofs<acofs_type>::q())
     {
-        ark_cofs<acofs_type>::initialize(m_a,m_c,m_b,m_b_err);
-        m_derivs = std::move(std::vector< std::vector<double> >(n_steps));
-        for (int i=0;i<n_steps;++i) m_derivs[i] = std::vector<double>(n_vars);
-        
+        std::vector< std::vector<double> > a;
+        std::vector<double> b;
+        std::vector<double> c;
+        std::vector<double> berr;
+        ark_cofs<acofs_type>::initialize(a,c,b,berr);
+        flatten_rk_table<T>(a,n_steps,m_a);
+        m_b.assign(b.begin(),b.end());
+        m_c.assign(c.begin(),c.end());
+        m_b_err.assign(berr.begin(),berr.end());
+        m_derivs.assign(n_steps * n_vars, T(0));
     }
+    adaptive_rk_stepper(
+        const std::vector<T>& y_init, const T& t_init,
+        const T& delta_t,
+        const control_type& con0,
+        const system_type& sys0 = system_type()):
+        adaptive_rk_stepper(std::span<const T>(y_init),t_init,delta_t,con0,sys0)
+    {}
 
-    const std::vector<double>& current_y() const noexcept { return m_y;}
-    const double& current_time() const noexcept { return m_t;}
-    const double& time_step() const noexcept { return m_dt;}
+    const std::vector<T>& current_y() const noexcept { return m_y;}
+    const T& current_time() const noexcept { return m_t;}
+    const T& time_step() const noexcept { return m_dt;}
+    size_t num_vars() const noexcept { return n_vars;}
+    void set_time_step(const T& dt) noexcept { m_dt = dt;}
 
     void step() noexcept
     {
-        int n_tries = 0;
+        step(std::span<T>(m_y),m_t,m_dt);
+    }
+
+    /////////////////////////////////////////////////////
+    //  One try of the method from (t,y) with step h, the new
+    //    state goes to m_ytmp. Returns the largest error
+    //    estimate and the size of that component and its
+    //    derivative.
+    /////////////////////////////////////////////////////
+    T attempt(std::span<const T> y, const T& t, const T& h,
+        T& max_y_err, T& max_dydt_err) noexcept
+    {
+        T * const dv = m_derivs.data();
+        T * const yt = m_ytmp.data();
+        sys.calculate_derivs(y,t,std::span<T>(dv,n_vars));
+        for (size_t i=1; i<n_steps; ++i) {
+            const T * ai = m_a.data() + (i-1) * n_steps;
+            for (size_t j=0; j<n_vars; ++j) {
+                T sum = T(0);
+                for (size_t k=0; k<i; ++k) {
+                    sum += dv[k*n_vars+j] * ai[k];
+                }
+                yt[j] = y[j] + sum * h ;
+            }
+            T ts = t + h * m_c[i-1];
+            sys.calculate_derivs(std::span<const T>(yt,n_vars),ts,
+                std::span<T>(dv+i*n_vars,n_vars));
+        }
+        T max_err = T(0);
+        for (size_t j=0; j<n_vars; ++j) {
+            T err_sum = T(0);
+            T sum = T(0);
+            for (size_t k=0; k<n_steps; ++k) {
+                sum += m_b[k] * dv[k*n_vars+j];
+                err_sum += m_b_err[k] * dv[k*n_vars+j];
+            }
+            yt[j] = y[j] + sum * h;
+            T err_ = std::fabs(err_sum * h);
+            if ( err_ > max_err ) {
+                max_err = err_;
+                max_y_err = std::fabs(yt[j]);
+                max_dydt_err = std::fabs(sum);
+            }
+        }
+        return max_err;
+    }
+
+    /////////////////////////////////////////////////////
+    //  Advance an external state y in place by one accepted step.
+    //  On return t has been advanced by the accepted step and dt
+    //    holds the suggested size of the next one, so every member
+    //    of a population can carry its own time step.
+    /////////////////////////////////////////////////////
+    void step(std::span<T> y, T& t, T& dt) noexcept
+    {
+        assert(y.size() == n_vars);
         int max_tries = 1000000;
         bool done = false;
         int is_extreme = 0;
+        T * const yt = m_ytmp.data();
+        T h = dt;
         for (int n = 0; n < max_tries; ++n) {
-            sys.calculate_derivs(m_y,m_t,m_derivs[0]);
-            for (size_t i=1; i<n_steps; ++i) {
-                for (size_t j=0; j<n_vars; ++j) {
-                    double sum = 0.0;
-                    for (size_t k=0; k<i; ++k) {
-                        sum += m_derivs[k][j] * m_a[i-1][k];
-                    }
-                    m_ytmp[j] = m_y[j] + sum * m_dt ;
-                }
-                double ts = m_t + m_dt * m_c[i-1];
-                sys.calculate_derivs(m_ytmp,ts,m_derivs[i]);
-            }
-            double max_err = 0.;
-            double max_y_err = 0.;
-            double max_dydt_err = 0.;
-            for (size_t j=0; j<n_vars; ++j) {
-                double err_sum = 0.0;
-                double sum = 0.0;
-                for (size_t k=0; k<n_steps; ++k) {
-                    sum += m_b[k] * m_derivs[k][j];
-                    err_sum += m_b_err[k] * m_derivs[k][j];
-                }
-                m_ytmp[j] = m_y[j] + sum * m_dt;
-                double err_ = fabs(err_sum);
-                if ( err_ > max_err ) {
-                    max_err = err_;
-                    max_y_err = fabs(m_ytmp[j]);
-                    max_dydt_err = fabs(sum);
-                }
+            h = dt;
+            T max_y_err = T(0);
+            T max_dydt_err = T(0);
+            T max_err = attempt(std::span<const T>(y.data(),n_vars),t,h,
+                max_y_err,max_dydt_err);
+            if ( is_extreme == 1) {
+                done=1;
+                break;
             }
-            if ( is_extreme == 1) { 
-                done=1; 
-                break; 
-            }
-            done = con.check_error(m_dt,max_err,max_y_err,max_dydt_err,q,is_extreme);
+            done = con.check_error(dt,max_err,max_y_err,max_dydt_err,q,is_extreme);
             if ( done ) break;
         }
         if (!done) {
             std::cerr << "warning step not completed in " << max_tries << " tries\n";
         }
-        for (size_t j=0;j<n_vars;++j) m_y[j] = m_ytmp[j];
-        m_t += m_dt;
+        for (size_t j=0;j<n_vars;++j) y[j] = yt[j];
+        t += h;
+    }
+
+    template < class view_t >
+    void step_view(view_t& y, T& t, T& dt) noexcept
+    {
+        step(std::span<T>(y.data(),y.size()),t,dt);
+    }
+
+    template < class observer_t >
+    void observe(observer_t& obs) const
+    {
+        obs(m_t,std::span<const T>(m_y));
+    }
+
+    /////////////////////////////////////////////////////
+    //  Step until the current time reaches tf handing every
+    //    accepted step to the observer
+    /////////////////////////////////////////////////////
+    template < class observer_t >
+    void integrate(const T& tf, observer_t& obs)
+    {
+        while ( m_t < tf ) {
+            step();
+            obs(m_t,std::span<const T>(m_y));
+        }
+    }
+
+    /////////////////////////////////////////////////////
+    //  Dense output over the last step taken by integrate with
+    //    events: a step of the method itself from the start of
+    //    that step to t, so a located event is as accurate as
+    //    the steps are.
+    /////////////////////////////////////////////////////
+    void dense_output(const T& t, std::span<T> y) noexcept
+    {
+        T y_err = T(0);
+        T dydt_err = T(0);
+        attempt(std::span<const T>(m_y0),m_t0,t - m_t0,y_err,dydt_err);
+        std::copy(m_ytmp.begin(),m_ytmp.begin()+n_vars,y.begin());
+    }
+
+    /////////////////////////////////////////////////////
+    //  Step until tf watching the event functions.
+    //  The last step is shortened to land on tf. Crossings are
+    //    located on the dense output of each step, which costs
+    //    steps only when a g changed sign. At a terminal event
+    //    the state is set to the event and true is returned.
+    /////////////////////////////////////////////////////
+    template < class observer_t >
+    bool integrate(const T& tf, rk_events<T>& events, observer_t& obs)
+    {
+        events.initialize(m_t,std::span<const T>(m_y));
+        const T tiny = T(16) * std::numeric_limits<T>::epsilon()
+            * std::max(T(1),std::fabs(tf));
+        while ( (tf - m_t) > tiny ) {
+            std::copy(m_y.begin(),m_y.end(),m_y0.begin());
+            m_t0 = m_t;
+            T dt = std::min(m_dt,tf - m_t);
+            step(std::span<T>(m_y),m_t,dt);
+            m_dt = dt;
+            if ( events.check(m_t,std::span<const T>(m_y)) ) {
+                T t_stop = m_t;
+                auto dense = [this](const T& t, std::span<T> y) {
+                    dense_output(t,y);
+                };
+                if ( events.locate(m_t0,m_t,dense,t_stop) ) {
+                    dense_output(t_stop,std::span<T>(m_y));
+                    m_t = t_stop;
+                    obs(m_t,std::span<const T>(m_y));
+                    return true;
+                }
+            } else {
+                events.accept();
+            }
+            obs(m_t,std::span<const T>(m_y));
+        }
+        return false;
     }
 
     std::ostream& print(std::ostream& os) const
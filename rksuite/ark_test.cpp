@@ -8,11 +8,12 @@
 #include "rk_cofs.hpp"
 #include "ark_control.hpp"
 #include "rk_sys.hpp"
+#include "rk_events.hpp"
 
 bool is_done(double t,double tf,double min_dt)
 {
-    double d = fabs(t - tf);
-    if ( d < min_dt) return true;
+    // adaptive steps need not land on tf
+    if ( t > (tf - min_dt) ) return true;
     return false;
 }
 
@@ -252,6 +253,46 @@ void test4(const double& dt)
 }
 
 
+bool test5(const double& dt)
+{
+    using namespace petlib::runge_kutta;
+    // q = cos(t), crossings of q = 0 at pi/2 + k pi and a terminal
+    // event where q rises through 0.9 at t = 2 pi - acos(0.9)
+    std::vector<double> y0(2);
+    y0[0] = 1.0;
+    y0[1] = 0.0;
+    double max_dt = 1.0;
+    double min_dt = dt * 0.01;
+    HarmonicOscillator sys;
+    ark_control con(1.e-8,1.e-8,max_dt,min_dt);
+    adaptive_rk_stepper< HarmonicOscillator, RK4Fehlberg, ark_control > ark4(y0,0.0,dt,con,sys);
+    rk_events<double> events(2);
+    events.add([](const double&, std::span<const double> y) { return y[0];});
+    events.add([](const double&, std::span<const double> y) { return y[0] - 0.9;},1,true);
+    size_t nsteps = 0;
+    auto count = [&nsteps](const double&, std::span<const double>) { ++nsteps;};
+    bool stopped = ark4.integrate(20.0,events,count);
+    std::cout << "steps " << nsteps << " stopped " << stopped << "\n";
+    double max_err = 0.0;
+    for (size_t k=0; k<events.num_occurrences(); ++k) {
+        double exact = (events.event_index(k) == 0) ? M_PI * (0.5 + double(k)) :
+            2.0 * M_PI - std::acos(0.9);
+        double err = std::fabs(events.event_time(k) - exact);
+        max_err = std::max(max_err,err);
+        std::cout << "event " << events.event_index(k) << " t = "
+                  << events.event_time(k) << " error " << err << "\n";
+    }
+    std::cout << ark4;
+    std::cout << "max event time error " << max_err << "\n";
+    // the events are as accurate as the solution, a few times the tolerance
+    bool ok = stopped && events.num_occurrences() == 3 && max_err < 2.e-7;
+    std::cout << "-------------------\n";
+    std::cout << (ok ? " done test events\n" : " test events FAILED\n");
+    std::cout << "-------------------\n";
+    return ok;
+}
+
+
 int main()
 {
     test1(0.025);
@@ -259,4 +300,6 @@ int main()
     test2(0.0125);
     test3(0.005);
     test4(0.02);
+    bool ok = test5(0.1);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
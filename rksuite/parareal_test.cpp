@@ -0,0 +1,77 @@
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include "rk_stepper.hpp"
+#include "ark_stepper.hpp"
+#include "rk_cofs.hpp"
+#include "ark_cofs.hpp"
+#include "ark_control.hpp"
+#include "rk_sys.hpp"
+#include "rk_parareal.hpp"
+
+double elapsed(const std::chrono::steady_clock::time_point& ts)
+{
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+    return d.count();
+}
+
+template < class system_t >
+bool bench(const char * name, const system_t& sys, std::vector<double> y0,
+    double tf, size_t nslices, size_t ncoarse, size_t nthreads)
+{
+    using namespace petlib::runge_kutta;
+    typedef rk_propagator< system_t, Ralston > coarse_t;
+    typedef ark_propagator< system_t, RK4Fehlberg, ark_control > fine_t;
+    ark_control con(1.e-12,1.e-10,1.e-3,1.e-8);
+    coarse_t coarse(ncoarse,sys);
+    fine_t fine(1.e-4,con,sys);
+
+    std::cout << name << " t = [0," << tf << "] slices = " << nslices
+              << " threads = " << nthreads << "\n";
+    std::vector<double> yref(y0);
+    auto ts = std::chrono::steady_clock::now();
+    fine(std::span<double>(yref),0.0,tf);
+    double t_serial = elapsed(ts);
+    std::cout << "  serial fine      " << std::setw(12) << t_serial << " s\n";
+
+    parareal< coarse_t, fine_t > pr(y0.size(),nslices,nthreads,coarse,fine);
+    const double tol = 1.e-9;
+    pr.set_tolerance(tol);
+    ts = std::chrono::steady_clock::now();
+    int niter = pr.solve(std::span<const double>(y0),0.0,tf);
+    double t_par = elapsed(ts);
+    double err = 0.0;
+    std::span<const double> yf = pr.final_state();
+    for (size_t j=0; j<y0.size(); ++j) err = std::max(err,std::fabs(yf[j]-yref[j]));
+    std::cout << "  parareal         " << std::setw(12) << t_par << " s  iterations = "
+              << niter << " last update = " << pr.last_update() << "\n";
+    std::cout << "  max |y - y_fine| " << std::setw(12) << err << "\n";
+    std::cout << "  speedup          " << std::setw(12) << t_serial / t_par << "\n";
+    // converged before every slice had been handed its exact start,
+    // and within a few updates of the tolerance of the fine solution
+    bool ok = niter <= int(nslices) && pr.last_update() < tol && err < 10.0 * tol;
+    std::cout << (ok ? "  passed\n" : "  FAILED\n");
+    std::cout << "-------------------\n";
+    return ok;
+}
+
+int main()
+{
+    using namespace petlib::runge_kutta;
+    size_t nthreads = std::max(1u,std::thread::hardware_concurrency());
+    std::vector<double> y_lv(2);
+    y_lv[0] = 0.9;
+    y_lv[1] = 0.9;
+    bool ok = bench("LoktaVolterra",LoktaVolterra(),y_lv,200.0,64,20,nthreads);
+    std::vector<double> y_lz(3);
+    y_lz[0] = 2.0;
+    y_lz[1] = 1.0;
+    y_lz[2] = 1.0;
+    ok = bench("Lorenz",Lorenz(),y_lz,4.0,64,20,nthreads) && ok;
+    std::cout << (ok ? "parareal test passed\n" : "parareal test FAILED\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,200 @@
+#pragma once
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <vector>
+#include <span>
+
+namespace petlib {
+namespace runge_kutta {
+
+/////////////////////////////////////////////////////
+//  Event functions g(t,y) watched during an adaptive
+//    integration. An event occurs where g changes sign
+//    inside an accepted step, its time is located on the
+//    dense output of that step so the stepper does not
+//    have to shorten its steps to see it.
+//  direction  +1 only rising crossings, -1 only falling
+//              ones, 0 both
+//  terminal   the integration stops at the event
+/////////////////////////////////////////////////////
+template < typename T = double >
+class rk_events
+{
+public:
+    typedef std::function<T(const T&,std::span<const T>)> event_function;
+private:
+    struct event
+    {
+        event_function g;
+        int direction;
+        bool terminal;
+    };
+    struct crossing
+    {
+        T t;
+        size_t index;
+        bool operator < (const crossing& c) const noexcept { return t < c.t;}
+    };
+    std::vector<event> m_events;
+    std::vector<T> m_g0;
+    std::vector<T> m_g1;
+    std::vector<crossing> m_cross;
+    std::vector<size_t> m_index;
+    std::vector<T> m_times;
+    std::vector<T> m_states;
+    std::vector<T> m_ytmp;
+    size_t n_vars;
+    T m_tol;
+    int m_max_iter;
+
+    bool is_crossing(size_t i) const noexcept
+    {
+        const T g0 = m_g0[i];
+        const T g1 = m_g1[i];
+        const int dir = m_events[i].direction;
+        if ( g0 < T(0) && g1 >= T(0) ) return dir >= 0;
+        if ( g0 > T(0) && g1 <= T(0) ) return dir <= 0;
+        return false;
+    }
+
+    /////////////////////////////////////////////////////
+    //  Illinois regula falsi on the dense output
+    /////////////////////////////////////////////////////
+    template < class dense_t >
+    T find_root(const event_function& g, T a, T ga, T b, T gb,
+        dense_t& dense) noexcept
+    {
+        std::span<T> y(m_ytmp);
+        int side = 0;
+        T c = b;
+        for (int it=0; it<m_max_iter; ++it) {
+            T tol = m_tol;
+            if ( tol <= T(0) ) {
+                tol = T(4) * std::numeric_limits<T>::epsilon()
+                    * std::max(T(1),std::fabs(b));
+            }
+            if ( std::fabs(b - a) <= tol ) break;
+            c = (a * gb - b * ga) / (gb - ga);
+            dense(c,y);
+            T gc = g(c,std::span<const T>(y));
+            if ( gc == T(0) ) break;
+            if ( (gc > T(0)) == (gb > T(0)) ) {
+                b = c;
+                gb = gc;
+                if ( side == -1 ) ga *= T(0.5);
+                side = -1;
+            } else {
+                a = c;
+                ga = gc;
+                if ( side == 1 ) gb *= T(0.5);
+                side = 1;
+            }
+        }
+        return c;
+    }
+public:
+    explicit rk_events(size_t num_vars, const T& tol = T(0), int max_iter = 100):
+        m_events(),
+        n_vars(num_vars),
+        m_tol(tol),
+        m_max_iter(max_iter)
+    {
+        m_ytmp.resize(num_vars);
+    }
+
+    size_t add(event_function g, int direction = 0, bool terminal = false)
+    {
+        m_events.push_back(event{g,direction,terminal});
+        m_g0.push_back(T(0));
+        m_g1.push_back(T(0));
+        return m_events.size() - 1;
+    }
+
+    size_t size() const noexcept { return m_events.size();}
+
+    // events located so far in time order
+    size_t num_occurrences() const noexcept { return m_index.size();}
+    size_t event_index(size_t k) const noexcept { return m_index[k];}
+    const T& event_time(size_t k) const noexcept { return m_times[k];}
+    std::span<const T> event_state(size_t k) const noexcept
+    {
+        return std::span<const T>(m_states.data()+k*n_vars,n_vars);
+    }
+    void clear_occurrences() noexcept
+    {
+        m_index.clear();
+        m_times.clear();
+        m_states.clear();
+    }
+
+    // evaluate every g at the start of the integration
+    void initialize(const T& t, std::span<const T> y)
+    {
+        for (size_t i=0; i<m_events.size(); ++i) m_g0[i] = m_events[i].g(t,y);
+    }
+
+    /////////////////////////////////////////////////////
+    //  Evaluate every g at the end of an accepted step.
+    //  Returns true when one of them crossed zero, the stepper
+    //    should then set up its dense output and call locate,
+    //    otherwise accept.
+    /////////////////////////////////////////////////////
+    bool check(const T& t1, std::span<const T> y1)
+    {
+        bool found = false;
+        for (size_t i=0; i<m_events.size(); ++i) {
+            m_g1[i] = m_events[i].g(t1,y1);
+            if ( is_crossing(i) ) found = true;
+        }
+        return found;
+    }
+
+    void accept() noexcept { std::swap(m_g0,m_g1);}
+
+    /////////////////////////////////////////////////////
+    //  Locate the crossings of the step [t0,t1] on the dense
+    //    output dense(t,y) and record them in time order up
+    //    to the first terminal one.
+    //  Returns the time of the terminal event in t_stop and
+    //    true if there was one.
+    /////////////////////////////////////////////////////
+    template < class dense_t >
+    bool locate(const T& t0, const T& t1, dense_t dense, T& t_stop)
+    {
+        m_cross.clear();
+        for (size_t i=0; i<m_events.size(); ++i) {
+            if ( !is_crossing(i) ) continue;
+            T tc = (m_g1[i] == T(0)) ? t1 :
+                find_root(m_events[i].g,t0,m_g0[i],t1,m_g1[i],dense);
+            m_cross.push_back(crossing{tc,i});
+        }
+        std::sort(m_cross.begin(),m_cross.end());
+        bool stop = false;
+        for (const crossing& c : m_cross) {
+            m_index.push_back(c.index);
+            m_times.push_back(c.t);
+            dense(c.t,std::span<T>(m_ytmp));
+            m_states.insert(m_states.end(),m_ytmp.begin(),m_ytmp.end());
+            if ( m_events[c.index].terminal ) {
+                t_stop = c.t;
+                stop = true;
+                break;
+            }
+        }
+        if ( stop ) {
+            // restart from the event, a g sitting on zero is not seen again
+            dense(t_stop,std::span<T>(m_ytmp));
+            initialize(t_stop,std::span<const T>(m_ytmp));
+            m_g0[m_index.back()] = T(0);
+        } else {
+            accept();
+        }
+        return stop;
+    }
+};
+
+}
+}
@@ -0,0 +1,331 @@
+#pragma once
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <span>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace petlib {
+namespace runge_kutta {
+
+/////////////////////////////////////////////////////
+//  Trajectory observers.
+//  An observer is anything callable as obs(t,y) with
+//    y a std::span<const T>. The steppers hand their state
+//    to an observer after each step instead of formatting
+//    it through iostream.
+//  Every recorder stores a record as t followed by the
+//    n_vars components of y, all of type T, and keeps only
+//    every decimate'th record offered to it.
+/////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////
+//  Fixed size in memory ring of records.
+//  Once capacity records are stored the oldest is overwritten.
+//  A capacity of 0 is taken as 1.
+/////////////////////////////////////////////////////
+template < typename T >
+class trajectory_ring
+{
+    std::vector<T> m_buf;
+    size_t n_vars;
+    size_t rec_len;
+    size_t m_capacity;
+    size_t m_head;
+    size_t m_size;
+    size_t m_decimate;
+    size_t m_count;
+public:
+    trajectory_ring(size_t num_vars, size_t capacity, size_t decimate = 1):
+        m_buf((num_vars+1)*(capacity ? capacity:1)),
+        n_vars(num_vars),
+        rec_len(num_vars+1),
+        m_capacity(capacity ? capacity:1),
+        m_head(0),
+        m_size(0),
+        m_decimate(decimate ? decimate:1),
+        m_count(0)
+    {}
+
+    void operator()(const T& t, std::span<const T> y) noexcept
+    {
+        if ( (m_count++ % m_decimate) != 0 ) return;
+        T * r = m_buf.data() + m_head * rec_len;
+        r[0] = t;
+        std::memcpy(r+1,y.data(),n_vars*sizeof(T));
+        m_head = (m_head + 1 == m_capacity) ? 0 : m_head + 1;
+        if ( m_size < m_capacity ) ++m_size;
+    }
+
+    size_t size() const noexcept { return m_size;}
+    size_t capacity() const noexcept { return m_capacity;}
+    size_t num_vars() const noexcept { return n_vars;}
+    void clear() noexcept { m_head = m_size = m_count = 0;}
+
+    // record i counted from the oldest one still held
+    const T * record(size_t i) const noexcept
+    {
+        size_t first = (m_size < m_capacity) ? 0 : m_head;
+        size_t k = first + i;
+        if ( k >= m_capacity ) k -= m_capacity;
+        return m_buf.data() + k * rec_len;
+    }
+    const T& time(size_t i) const noexcept { return record(i)[0];}
+    std::span<const T> state(size_t i) const noexcept
+    {
+        return std::span<const T>(record(i)+1,n_vars);
+    }
+};
+
+/////////////////////////////////////////////////////
+//  Double buffered binary trajectory file.
+//  Records fill one block in memory while the other block
+//    is written by a background thread, so the integration
+//    only waits on the disk if it outruns it by a full block.
+/////////////////////////////////////////////////////
+template < typename T >
+class trajectory_writer
+{
+    FILE * m_fp;
+    size_t n_vars;
+    size_t rec_len;
+    size_t m_block;
+    size_t m_decimate;
+    size_t m_count;
+    size_t m_fill;
+    // read on the caller's thread while the writer updates them
+    std::atomic<size_t> m_written;
+    int m_active;
+    std::vector<T> m_buf[2];
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    size_t m_pending;
+    int m_pending_buf;
+    bool m_quit;
+    std::atomic<bool> m_error;
+    std::thread m_thread;
+
+    void write_loop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;) {
+            while ( !m_pending && !m_quit ) m_cond.wait(lock);
+            if ( !m_pending && m_quit ) return;
+            int ib = m_pending_buf;
+            size_t nrec = m_pending;
+            lock.unlock();
+            size_t nw = fwrite(m_buf[ib].data(),sizeof(T)*rec_len,nrec,m_fp);
+            lock.lock();
+            if ( nw != nrec ) m_error = true;
+            m_written += nw;
+            m_pending = 0;
+            m_cond.notify_all();
+        }
+    }
+
+    void hand_off()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while ( m_pending ) m_cond.wait(lock);
+        m_pending = m_fill;
+        m_pending_buf = m_active;
+        lock.unlock();
+        m_cond.notify_all();
+        m_active ^= 1;
+        m_fill = 0;
+    }
+public:
+    trajectory_writer(const std::string& filename, size_t num_vars,
+        size_t block_records = 4096, size_t decimate = 1):
+        m_fp(nullptr),
+        n_vars(num_vars),
+        rec_len(num_vars+1),
+        m_block(block_records ? block_records:1),
+        m_decimate(decimate ? decimate:1),
+        m_count(0),
+        m_fill(0),
+        m_written(0),
+        m_active(0),
+        m_pending(0),
+        m_pending_buf(0),
+        m_quit(false),
+        m_error(false)
+    {
+        m_fp = fopen(filename.c_str(),"wb");
+        if ( m_fp == nullptr ) {
+            std::cerr << "Unable to open trajectory file " << filename << "\n";
+            exit(EXIT_FAILURE);
+        }
+        m_buf[0].resize(m_block*rec_len);
+        m_buf[1].resize(m_block*rec_len);
+        m_thread = std::thread(&trajectory_writer::write_loop,this);
+    }
+
+    trajectory_writer(const trajectory_writer&) = delete;
+    trajectory_writer& operator=(const trajectory_writer&) = delete;
+
+    ~trajectory_writer()
+    {
+        close();
+    }
+
+    void operator()(const T& t, std::span<const T> y)
+    {
+        if ( (m_count++ % m_decimate) != 0 ) return;
+        T * r = m_buf[m_active].data() + m_fill * rec_len;
+        r[0] = t;
+        std::memcpy(r+1,y.data(),n_vars*sizeof(T));
+        if ( ++m_fill == m_block ) hand_off();
+    }
+
+    // push out the partly filled block and wait until it is on disk
+    void flush()
+    {
+        if ( m_fill ) hand_off();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while ( m_pending ) m_cond.wait(lock);
+        if ( m_fp ) fflush(m_fp);
+    }
+
+    void close()
+    {
+        if ( !m_fp ) return;
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_cond.notify_all();
+        m_thread.join();
+        fclose(m_fp);
+        m_fp = nullptr;
+    }
+
+    size_t records_written() const noexcept { return m_written.load();}
+    bool error() const noexcept { return m_error.load();}
+};
+
+/////////////////////////////////////////////////////
+//  Trajectory stored straight into a memory mapped file
+//    sized for max_records up front. Each full block is
+//    handed to the kernel with msync(MS_ASYNC), the file is
+//    trimmed to the records actually stored on close.
+//    Records offered once the file is full are counted in
+//    dropped() and not stored, with max_records 0 nothing is
+//    mapped and every record is dropped.
+/////////////////////////////////////////////////////
+template < typename T >
+class trajectory_mmap
+{
+    int m_fd;
+    T * m_map;
+    size_t n_vars;
+    size_t rec_len;
+    size_t m_max;
+    size_t m_block;
+    size_t m_decimate;
+    size_t m_count;
+    size_t m_size;
+    size_t m_synced;
+    size_t m_dropped;
+public:
+    trajectory_mmap(const std::string& filename, size_t num_vars,
+        size_t max_records, size_t decimate = 1, size_t block_records = 4096):
+        m_fd(-1),
+        m_map(nullptr),
+        n_vars(num_vars),
+        rec_len(num_vars+1),
+        m_max(max_records),
+        m_block(block_records ? block_records:1),
+        m_decimate(decimate ? decimate:1),
+        m_count(0),
+        m_size(0),
+        m_synced(0),
+        m_dropped(0)
+    {
+        size_t nbytes = m_max * rec_len * sizeof(T);
+        m_fd = open(filename.c_str(),O_RDWR|O_CREAT|O_TRUNC,0644);
+        if ( m_fd < 0 || ftruncate(m_fd,off_t(nbytes)) != 0 ) {
+            std::cerr << "Unable to create trajectory file " << filename << "\n";
+            exit(EXIT_FAILURE);
+        }
+        // mmap rejects a zero length
+        if ( nbytes == 0 ) return;
+        void * p = mmap(nullptr,nbytes,PROT_READ|PROT_WRITE,MAP_SHARED,m_fd,0);
+        if ( p == MAP_FAILED ) {
+            std::cerr << "Unable to map trajectory file " << filename << "\n";
+            exit(EXIT_FAILURE);
+        }
+        m_map = reinterpret_cast<T*>(p);
+    }
+
+    trajectory_mmap(const trajectory_mmap&) = delete;
+    trajectory_mmap& operator=(const trajectory_mmap&) = delete;
+
+    ~trajectory_mmap()
+    {
+        close();
+    }
+
+    void operator()(const T& t, std::span<const T> y) noexcept
+    {
+        if ( (m_count++ % m_decimate) != 0 ) return;
+        if ( m_size == m_max ) {
+            ++m_dropped;
+            return;
+        }
+        T * r = m_map + m_size * rec_len;
+        r[0] = t;
+        std::memcpy(r+1,y.data(),n_vars*sizeof(T));
+        ++m_size;
+        if ( m_size - m_synced == m_block ) sync_async();
+    }
+
+    size_t size() const noexcept { return m_size;}
+    bool full() const noexcept { return m_size == m_max;}
+    size_t dropped() const noexcept { return m_dropped;}
+    const T& time(size_t i) const noexcept { return m_map[i*rec_len];}
+    std::span<const T> state(size_t i) const noexcept
+    {
+        return std::span<const T>(m_map+i*rec_len+1,n_vars);
+    }
+
+    void close() noexcept
+    {
+        if ( m_fd < 0 ) return;
+        size_t nbytes = m_max * rec_len * sizeof(T);
+        if ( m_map ) {
+            msync(m_map,nbytes,MS_SYNC);
+            munmap(m_map,nbytes);
+        }
+        if ( ftruncate(m_fd,off_t(m_size*rec_len*sizeof(T))) != 0 ) {
+            std::cerr << "warning unable to trim trajectory file\n";
+        }
+        ::close(m_fd);
+        m_fd = -1;
+        m_map = nullptr;
+    }
+private:
+    void sync_async() noexcept
+    {
+        // msync wants a page aligned start
+        const size_t page = size_t(sysconf(_SC_PAGESIZE));
+        size_t lo = m_synced * rec_len * sizeof(T);
+        size_t hi = m_size * rec_len * sizeof(T);
+        lo -= lo % page;
+        msync(reinterpret_cast<char*>(m_map)+lo,hi-lo,MS_ASYNC);
+        m_synced = m_size;
+    }
+};
+
+}
+}
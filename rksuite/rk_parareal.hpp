@@ -0,0 +1,276 @@
+#pragma once
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+#include "rk_stepper.hpp"
+#include "ark_stepper.hpp"
+
+namespace petlib {
+namespace runge_kutta {
+
+/////////////////////////////////////////////////////
+//  Propagators advance a state y in place from t0 to t1
+//    prop(y,t0,t1)
+//  They are what the parareal driver works with, the
+//    coarse one is applied serially and the fine one in
+//    parallel, one copy per worker thread.
+/////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////
+//  Fixed step propagator taking n_sub equal steps per call
+/////////////////////////////////////////////////////
+template < class system_t, class cofs_t, typename T = double >
+class rk_propagator
+{
+    rk_stepper<system_t,cofs_t,T> stepper;
+    size_t n_sub;
+public:
+    rk_propagator(size_t num_sub_steps, const system_t& sys0 = system_t()):
+        stepper(std::vector<T>(sys0.num_vars()),T(0),T(0),sys0),
+        n_sub(num_sub_steps ? num_sub_steps:1)
+    {}
+
+    void operator()(std::span<T> y, const T& t0, const T& t1) noexcept
+    {
+        T dt = (t1 - t0) / T(n_sub);
+        stepper.set_time_step(dt);
+        for (size_t i=0; i<n_sub; ++i) {
+            stepper.step(y,t0 + T(i) * dt);
+        }
+    }
+};
+
+/////////////////////////////////////////////////////
+//  Adaptive propagator, the last step is shortened to land on t1
+/////////////////////////////////////////////////////
+template < class system_t, class acofs_t, class control_t, typename T = double >
+class ark_propagator
+{
+    adaptive_rk_stepper<system_t,acofs_t,control_t,T> stepper;
+    T dt0;
+public:
+    ark_propagator(const T& dt_init, const control_t& con0,
+        const system_t& sys0 = system_t()):
+        stepper(std::vector<T>(sys0.num_vars()),T(0),dt_init,con0,sys0),
+        dt0(dt_init)
+    {}
+
+    void operator()(std::span<T> y, const T& t0, const T& t1) noexcept
+    {
+        const T tiny = T(16) * std::numeric_limits<T>::epsilon()
+            * std::max(T(1),std::fabs(t1));
+        T t = t0;
+        T dt = dt0;
+        while ( (t1 - t) > tiny ) {
+            T h = std::min(dt,t1-t);
+            stepper.step(y,t,h);
+            dt = h;
+        }
+    }
+};
+
+/////////////////////////////////////////////////////
+//  Persistent worker pool used by the parareal driver.
+//  run(n,f) calls f(i,worker) for i in [0,n) spread over
+//    the workers and returns when all calls are done.
+/////////////////////////////////////////////////////
+class parareal_pool
+{
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::condition_variable m_done_cond;
+    std::function<void(size_t,size_t)> m_task;
+    std::atomic<size_t> m_next;
+    size_t m_ntasks;
+    size_t m_busy;
+    size_t m_generation;
+    bool m_quit;
+
+    void work(size_t id)
+    {
+        size_t gen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                while ( gen == m_generation && !m_quit ) m_cond.wait(lock);
+                if ( m_quit ) return;
+                gen = m_generation;
+            }
+            drain(id);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if ( --m_busy == 0 ) m_done_cond.notify_all();
+        }
+    }
+
+    void drain(size_t id)
+    {
+        for (;;) {
+            size_t i = m_next.fetch_add(1);
+            if ( i >= m_ntasks ) return;
+            m_task(i,id);
+        }
+    }
+public:
+    explicit parareal_pool(size_t num_threads):
+        m_threads(),
+        m_next(0),
+        m_ntasks(0),
+        m_busy(0),
+        m_generation(0),
+        m_quit(false)
+    {
+        // the calling thread is worker 0
+        for (size_t i=1; i<num_threads; ++i) {
+            m_threads.emplace_back(&parareal_pool::work,this,i);
+        }
+    }
+
+    ~parareal_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_cond.notify_all();
+        for (auto& th : m_threads) th.join();
+    }
+
+    size_t num_threads() const noexcept { return m_threads.size() + 1;}
+
+    template < class task_t >
+    void run(size_t ntasks, task_t task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_task = task;
+            m_ntasks = ntasks;
+            m_next.store(0);
+            m_busy = m_threads.size();
+            ++m_generation;
+        }
+        m_cond.notify_all();
+        drain(0);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while ( m_busy ) m_done_cond.wait(lock);
+    }
+};
+
+/////////////////////////////////////////////////////
+//  Parareal parallel in time driver.
+//  [t0,tf] is split into n_slices equal slices. A serial
+//    sweep of the coarse propagator predicts the state at
+//    every slice boundary, then each iteration
+//      runs the fine propagator on all open slices in parallel
+//      corrects serially U[n+1] = G(U[n]) + F(U_old[n]) - G(U_old[n])
+//    until the largest change of a boundary state drops
+//    below the tolerance or max_iterations is reached.
+//  After k iterations the first k slices are exact to the
+//    fine propagator so they are not propagated again.
+/////////////////////////////////////////////////////
+template < class coarse_t, class fine_t, typename T = double >
+class parareal
+{
+    coarse_t m_coarse;
+    std::vector<fine_t> m_fine;
+    parareal_pool m_pool;
+    size_t n_vars;
+    size_t n_slices;
+    int m_max_iter;
+    T m_tol;
+    T m_update;
+    std::vector<T> m_u;
+    std::vector<T> m_f;
+    std::vector<T> m_g;
+    std::vector<T> m_tmp;
+    std::vector<T> m_times;
+public:
+    parareal(size_t num_vars, size_t num_slices, size_t num_threads,
+        const coarse_t& coarse, const fine_t& fine):
+        m_coarse(coarse),
+        m_fine(num_threads ? num_threads:1,fine),
+        m_pool(num_threads ? num_threads:1),
+        n_vars(num_vars),
+        n_slices(num_slices),
+        m_max_iter(int(num_slices)),
+        m_tol(T(1.e-8)),
+        m_update(T(0)),
+        m_u((num_slices+1)*num_vars),
+        m_f((num_slices+1)*num_vars),
+        m_g((num_slices+1)*num_vars),
+        m_tmp(num_vars),
+        m_times(num_slices+1)
+    {}
+
+    void set_max_iterations(int n) noexcept { m_max_iter = n;}
+    void set_tolerance(const T& tol) noexcept { m_tol = tol;}
+    T last_update() const noexcept { return m_update;}
+    size_t num_slices() const noexcept { return n_slices;}
+    const T& time(size_t n) const noexcept { return m_times[n];}
+    std::span<const T> state(size_t n) const noexcept
+    {
+        return std::span<const T>(m_u.data()+n*n_vars,n_vars);
+    }
+    std::span<const T> final_state() const noexcept { return state(n_slices);}
+
+    // returns the number of parareal iterations taken
+    int solve(std::span<const T> y0, const T& t0, const T& tf)
+    {
+        for (size_t n=0; n<=n_slices; ++n) {
+            m_times[n] = t0 + (tf - t0) * T(n) / T(n_slices);
+        }
+        std::copy(y0.begin(),y0.begin()+n_vars,m_u.begin());
+        for (size_t n=0; n<n_slices; ++n) {
+            T * un = m_u.data() + n * n_vars;
+            T * gn = m_g.data() + (n+1) * n_vars;
+            std::copy(un,un+n_vars,gn);
+            m_coarse(std::span<T>(gn,n_vars),m_times[n],m_times[n+1]);
+            std::copy(gn,gn+n_vars,un+n_vars);
+        }
+        int k = 0;
+        for (; k<m_max_iter && size_t(k)<n_slices; ++k) {
+            const size_t first = size_t(k);
+            m_pool.run(n_slices-first,[this,first](size_t i,size_t id) {
+                size_t n = first + i;
+                T * fn = m_f.data() + (n+1) * n_vars;
+                const T * un = m_u.data() + n * n_vars;
+                std::copy(un,un+n_vars,fn);
+                m_fine[id](std::span<T>(fn,n_vars),m_times[n],m_times[n+1]);
+            });
+            // slice first is now exact to the fine solution
+            T max_update = T(0);
+            for (size_t n=first; n<n_slices; ++n) {
+                T * un = m_u.data() + n * n_vars;
+                T * un1 = un + n_vars;
+                T * gn = m_g.data() + (n+1) * n_vars;
+                const T * fn = m_f.data() + (n+1) * n_vars;
+                std::copy(un,un+n_vars,m_tmp.begin());
+                m_coarse(std::span<T>(m_tmp),m_times[n],m_times[n+1]);
+                for (size_t j=0; j<n_vars; ++j) {
+                    T unew = m_tmp[j] + fn[j] - gn[j];
+                    T scale = std::max(T(1),std::fabs(unew));
+                    max_update = std::max(max_update,std::fabs(unew - un1[j])/scale);
+                    un1[j] = unew;
+                    gn[j] = m_tmp[j];
+                }
+            }
+            m_update = max_update;
+            if ( max_update < m_tol ) {
+                ++k;
+                break;
+            }
+        }
+        return k;
+    }
+};
+
+}
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <cassert>
 #include <cstdlib>
 #include <cmath>
 #include <iostream>
@@ -6,7 +7,7 @@
 #include <vector>
 #include <span>
 
-namespace petlib 
+namespace petlib
 {
 namespace runge_kutta
 {
@@ -16,21 +17,28 @@ namespace runge_kutta
 //  using the BN trick.
 //  Any implemented system type should define
 //    the member functions num_vars and calculate_derivs
+//
+//  calculate_derivs works on views so the state can live
+//    in a std::vector, a petlib SubArray or a row of a
+//    petlib Matrix without being copied. The system type
+//    provides calculate_derivs as a member template on the
+//    value type.
 /////////////////////////////////////////////////////
-template < class system_t >
+template < class system_t, typename T = double >
 class rk_system
 {
 public:
+    typedef T value_type;
     rk_system():sys() {}
     rk_system(const system_t& sys0):sys(sys0) {}
     constexpr int num_vars() const noexcept
     {
         return sys.num_vars();
     }
-    constexpr void calculate_derivs(const std::vector<double>& y,const double& t,
-            std::vector<double>& derivs) const noexcept
+    constexpr void calculate_derivs(std::span<const T> y,const T& t,
+            std::span<T> derivs) const noexcept
     {
-        return sys.calculate_derivs(y,t,derivs);
+        return sys.template calculate_derivs<T>(y,t,derivs);
     }
 private:
     system_t sys;
@@ -51,71 +59,143 @@ public:
         std::vector<double>& b,
         std::vector<double>& c) noexcept
     {
-        cofs_t::initialize(a,b,c);    
+        cofs_t::initialize(a,b,c);
     }
     static int num_steps() noexcept { return cofs_t::num_steps();}
 };
 
-template < class system_t, class cofs_t >
+/////////////////////////////////////////////////////
+//  Flatten the lower triangular a table into row i-1 * num_steps + k
+//    so every coefficient and stage lives in one contiguous block.
+/////////////////////////////////////////////////////
+template < typename T >
+void flatten_rk_table(const std::vector< std::vector<double> >& a,
+    size_t n_steps, std::vector<T>& flat_a) noexcept
+{
+    flat_a.assign(n_steps * n_steps, T(0));
+    for (size_t i=1; i<n_steps; ++i) {
+        for (size_t k=0; k<i; ++k) flat_a[(i-1)*n_steps+k] = T(a[i-1][k]);
+    }
+}
+
+template < class system_t, class cofs_t, typename T = double >
 class rk_stepper
 {
-    rk_system<system_t> sys;
-    std::vector< std::vector<double> > m_derivs;
-    std::vector<double> m_y;
-    std::vector<double> m_ytmp;
-    std::vector< std::vector<double> > m_a;
-    std::vector<double> m_b;
-    std::vector<double> m_c;
-    double m_t;
-    double m_dt;
+    rk_system<system_t,T> sys;
+    std::vector<T> m_derivs;
+    std::vector<T> m_y;
+    std::vector<T> m_ytmp;
+    std::vector<T> m_a;
+    std::vector<T> m_b;
+    std::vector<T> m_c;
+    T m_t;
+    T m_dt;
     size_t n_steps;
     size_t n_vars;
 public:
+    typedef T value_type;
+
     rk_stepper() = delete;
     rk_stepper(
-        std::vector<double>& y_init, const double& t_init,
-        const double& delta_t, const system_t& sys0 = system_t()):
+        std::span<const T> y_init, const T& t_init,
+        const T& delta_t, const system_t& sys0 = system_t()):
         sys(sys0),
         m_derivs(),
-        m_y(y_init),
+        m_y(y_init.begin(),y_init.end()),
         m_ytmp(sys0.num_vars()),
         m_t(t_init),
         m_dt(delta_t),
         n_steps(rk_cofs<cofs_t>::num_steps()),
         n_vars(sys0.num_vars())
     {
-        rk_cofs<cofs_t>::initialize(m_a,m_b,m_c);
-        m_derivs = std::move(std::vector< std::vector<double> >(n_steps));
-        for (int i=0;i<n_steps;++i) m_derivs[i] = std::vector<double>(n_vars);
-        
+        std::vector< std::vector<double> > a;
+        std::vector<double> b;
+        std::vector<double> c;
+        rk_cofs<cofs_t>::initialize(a,b,c);
+        flatten_rk_table<T>(a,n_steps,m_a);
+        m_b.assign(b.begin(),b.end());
+        m_c.assign(c.begin(),c.end());
+        m_derivs.assign(n_steps * n_vars, T(0));
     }
+    rk_stepper(
+        const std::vector<T>& y_init, const T& t_init,
+        const T& delta_t, const system_t& sys0 = system_t()):
+        rk_stepper(std::span<const T>(y_init),t_init,delta_t,sys0)
+    {}
 
-    const std::vector<double>& current_y() const noexcept { return m_y;}
-    const double& current_time() const noexcept { return m_t;}
-    const double& time_step() const noexcept { return m_dt;}
+    const std::vector<T>& current_y() const noexcept { return m_y;}
+    const T& current_time() const noexcept { return m_t;}
+    const T& time_step() const noexcept { return m_dt;}
+    size_t num_vars() const noexcept { return n_vars;}
+    void set_time_step(const T& dt) noexcept { m_dt = dt;}
 
     void step() noexcept
     {
-        sys.calculate_derivs(m_y,m_t,m_derivs[0]);
+        step(std::span<T>(m_y),m_t);
+        m_t += m_dt;
+    }
+
+    /////////////////////////////////////////////////////
+    //  Advance an external state y from t to t + dt in place.
+    //  y may be a view into a larger Array or Matrix row,
+    //    only the stage scratch space of this stepper is used.
+    /////////////////////////////////////////////////////
+    void step(std::span<T> y, const T& t) noexcept
+    {
+        assert(y.size() == n_vars);
+        T * const dv = m_derivs.data();
+        T * const yt = m_ytmp.data();
+        sys.calculate_derivs(std::span<const T>(y.data(),n_vars),t,
+            std::span<T>(dv,n_vars));
         for (size_t i=1; i<n_steps; ++i) {
+            const T * ai = m_a.data() + (i-1) * n_steps;
             for (size_t j=0; j<n_vars; ++j) {
-                double sum = 0.0;
+                T sum = T(0);
                 for (size_t k=0; k<i; ++k) {
-                    sum += m_derivs[k][j] * m_a[i-1][k];
+                    sum += dv[k*n_vars+j] * ai[k];
                 }
-                m_ytmp[j] = m_y[j] + sum * m_dt ;
+                yt[j] = y[j] + sum * m_dt ;
             }
-            double ts = m_t + m_dt * m_c[i-1];
-            sys.calculate_derivs(m_ytmp,ts,m_derivs[i]);
+            T ts = t + m_dt * m_c[i-1];
+            sys.calculate_derivs(std::span<const T>(yt,n_vars),ts,
+                std::span<T>(dv+i*n_vars,n_vars));
         }
         for (size_t j=0; j<n_vars; ++j) {
-            double sum = 0.0;
+            T sum = T(0);
             for (size_t k=0; k<n_steps; ++k) {
-                sum += m_b[k] * m_derivs[k][j];
+                sum += m_b[k] * dv[k*n_vars+j];
             }
-            m_y[j] += sum * m_dt;
+            y[j] += sum * m_dt;
+        }
+    }
+
+    /////////////////////////////////////////////////////
+    //  Any contiguous view with data() and size()
+    //    ie. petlib SubArray or Matrix::row_array(i)
+    /////////////////////////////////////////////////////
+    template < class view_t >
+    void step_view(view_t& y, const T& t) noexcept
+    {
+        step(std::span<T>(y.data(),y.size()),t);
+    }
+
+    /////////////////////////////////////////////////////
+    //  Hand the current state to an observer callable as
+    //    obs(t,y) see rk_observer.hpp
+    /////////////////////////////////////////////////////
+    template < class observer_t >
+    void observe(observer_t& obs) const
+    {
+        obs(m_t,std::span<const T>(m_y));
+    }
+
+    template < class observer_t >
+    void integrate(size_t nsteps, observer_t& obs)
+    {
+        for (size_t n=0; n<nsteps; ++n) {
+            step();
+            obs(m_t,std::span<const T>(m_y));
         }
-        m_t += m_dt;
     }
 
     std::ostream& print(std::ostream& os)
@@ -129,10 +209,10 @@ public:
         os << " derivs   ";
         for (size_t i=0;i<n_steps;++i) {
         for (size_t j=0;j<n_vars;++j) {
-            os << " " << m_derivs[i][j];
+            os << " " << m_derivs[i*n_vars+j];
         }
         }
-#endif        
+#endif
         os << "\n";
         return os;
     }
@@ -142,4 +222,4 @@ public:
     }
 };
 }
-}
\ No newline at end of file
+}
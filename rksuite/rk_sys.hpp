@@ -1,6 +1,7 @@
 #pragma once
 #include <cstdlib>
 #include <vector>
+#include <span>
 #include <cmath>
 
 namespace petlib
@@ -10,10 +11,11 @@ namespace runge_kutta
 
 struct SimpleTanDerivs
 {
+    template < typename T >
     constexpr void calculate_derivs(
-        const std::vector<double>& y,const double& t,std::vector<double>& derivs) const noexcept
+        std::span<const T> y,const T& t,std::span<T> derivs) const noexcept
     {
-        derivs[0] = tan(y[0]) + 1.0;
+        derivs[0] = std::tan(y[0]) + T(1);
     }
     constexpr int num_vars() const noexcept {
         return 1;
@@ -27,10 +29,11 @@ struct SimpleSinDerivs
     SimpleSinDerivs(const double& alpha = 1.0):
       alpha_(alpha) {}  
    
+    template < typename T >
     constexpr void calculate_derivs(
-        const std::vector<double>& y,const double& t,std::vector<double>& derivs) const noexcept
+        std::span<const T> y,const T& t,std::span<T> derivs) const noexcept
     {
-        double siny = sin(alpha_* y[0]);
+        T siny = std::sin(T(alpha_) * y[0]);
         derivs[0] = siny * siny * y[0];
     }
 
@@ -48,12 +51,13 @@ struct Lorenz
 
     Lorenz() : rho(28.0), sigma(10.0), beta(2.6666666666667) {}
 
+    template < typename T >
     constexpr void calculate_derivs(
-        const std::vector<double>& y,const double& t,std::vector<double>& derivs) const noexcept
+        std::span<const T> y,const T& t,std::span<T> derivs) const noexcept
     {
-        derivs[0] = sigma * (y[1] - y[0]);
-        derivs[1] = y[0] * (rho - y[2]) - y[1];
-        derivs[2] = y[0] * y[1] - beta * y[2];
+        derivs[0] = T(sigma) * (y[1] - y[0]);
+        derivs[1] = y[0] * (T(rho) - y[2]) - y[1];
+        derivs[2] = y[0] * y[1] - T(beta) * y[2];
     }
 
     constexpr int num_vars() const noexcept {
@@ -75,11 +79,12 @@ struct LoktaVolterra
         a(alpha),b(beta),c(delta),d(gamma)
     {}
 
-    constexpr void calculate_derivs(const std::vector<double>& y,const double& t,
-                          std::vector<double>& der) const noexcept
+    template < typename T >
+    constexpr void calculate_derivs(std::span<const T> y,const T& t,
+                          std::span<T> der) const noexcept
     {
-        der[0] = (a  - b * y[1]) * y[0];
-        der[1] = (c * y[0]  - d) * y[1];
+        der[0] = (T(a)  - T(b) * y[1]) * y[0];
+        der[1] = (T(c) * y[0]  - T(d)) * y[1];
     }
   
     constexpr size_t num_vars() const noexcept {
@@ -87,5 +92,96 @@ struct LoktaVolterra
     }
 };
 
+/////////////////////////////////////////////////////
+//  Separable hamiltonians, state is q followed by p.
+//  They provide the split interface of symplectic_stepper
+//    as well as calculate_derivs for the rk steppers.
+/////////////////////////////////////////////////////
+struct HarmonicOscillator
+{
+    double k, m;
+
+    HarmonicOscillator(): k(1.0), m(1.0) {}
+    HarmonicOscillator(const double& k_, const double& m_): k(k_), m(m_) {}
+
+    template < typename T >
+    constexpr void calculate_velocity(
+        std::span<const T> p,const T& /*t*/,std::span<T> dqdt) const noexcept
+    {
+        dqdt[0] = p[0] / T(m);
+    }
+
+    template < typename T >
+    constexpr void calculate_force(
+        std::span<const T> q,const T& /*t*/,std::span<T> dpdt) const noexcept
+    {
+        dpdt[0] = -T(k) * q[0];
+    }
+
+    template < typename T >
+    constexpr void calculate_derivs(
+        std::span<const T> y,const T& /*t*/,std::span<T> derivs) const noexcept
+    {
+        derivs[0] = y[1] / T(m);
+        derivs[1] = -T(k) * y[0];
+    }
+
+    template < typename T >
+    constexpr T energy(std::span<const T> y) const noexcept
+    {
+        return T(0.5) * (y[1] * y[1] / T(m) + T(k) * y[0] * y[0]);
+    }
+
+    constexpr int num_dof() const noexcept { return 1;}
+    constexpr int num_vars() const noexcept { return 2;}
+};
+
+/////////////////////////////////////////////////////
+//  Planar Kepler problem H = |p|^2/2 - mu/|q|
+/////////////////////////////////////////////////////
+struct Kepler
+{
+    double mu;
+
+    Kepler(): mu(1.0) {}
+    Kepler(const double& mu_): mu(mu_) {}
+
+    template < typename T >
+    constexpr void calculate_velocity(
+        std::span<const T> p,const T& /*t*/,std::span<T> dqdt) const noexcept
+    {
+        dqdt[0] = p[0];
+        dqdt[1] = p[1];
+    }
+
+    template < typename T >
+    constexpr void calculate_force(
+        std::span<const T> q,const T& /*t*/,std::span<T> dpdt) const noexcept
+    {
+        T r2 = q[0] * q[0] + q[1] * q[1];
+        T s = -T(mu) / (r2 * std::sqrt(r2));
+        dpdt[0] = s * q[0];
+        dpdt[1] = s * q[1];
+    }
+
+    template < typename T >
+    constexpr void calculate_derivs(
+        std::span<const T> y,const T& t,std::span<T> derivs) const noexcept
+    {
+        calculate_velocity<T>(y.subspan(2,2),t,derivs.subspan(0,2));
+        calculate_force<T>(y.subspan(0,2),t,derivs.subspan(2,2));
+    }
+
+    template < typename T >
+    constexpr T energy(std::span<const T> y) const noexcept
+    {
+        return T(0.5) * (y[2] * y[2] + y[3] * y[3])
+            - T(mu) / std::sqrt(y[0] * y[0] + y[1] * y[1]);
+    }
+
+    constexpr int num_dof() const noexcept { return 2;}
+    constexpr int num_vars() const noexcept { return 4;}
+};
+
 }
 }
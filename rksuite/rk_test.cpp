@@ -3,9 +3,11 @@
 #include <cmath>
 #include <iostream>
 #include <vector>
+#include <span>
 #include "rk_stepper.hpp"
 #include "rk_cofs.hpp"
 #include "rk_sys.hpp"
+#include "rk_observer.hpp"
 
 void test1(const double& dt)
 {
@@ -129,6 +131,118 @@ void test3(const double& dt)
     std::cout << "-------------------\n";    
 }
 
+bool test4(const double& dt)
+{
+    using namespace petlib::runge_kutta;
+    const size_t npop = 4;
+    const size_t nv = 3;
+    // the whole population lives in one contiguous row major block
+    std::vector<float> pop(npop * nv);
+    for (size_t i=0;i<npop;++i) {
+        pop[i*nv]   = 2.0f + 0.1f * float(i);
+        pop[i*nv+1] = 1.0f;
+        pop[i*nv+2] = 1.0f;
+    }
+    Lorenz sys;
+    std::vector<float> y0(pop.begin(),pop.begin()+nv);
+    rk_stepper< Lorenz, RK4, float > step4(y0,0.0f,float(dt),sys);
+
+    double tf = 1.0;
+    size_t nsteps = size_t(rint(tf/dt));
+    float t = 0.0f;
+    for (size_t j=0;j<nsteps;++j) {
+        for (size_t i=0;i<npop;++i) {
+            step4.step(std::span<float>(pop.data()+i*nv,nv),t);
+        }
+        step4.step();
+        t += float(dt);
+    }
+    std::cout << "float population t = " << t << "\n";
+    for (size_t i=0;i<npop;++i) {
+        std::cout << " " << pop[i*nv] << " " << pop[i*nv+1] << " " << pop[i*nv+2] << "\n";
+    }
+    std::cout << "member stepper\n";
+    std::cout << step4;
+    // member 0 started from y0, the span path has to match the vector path
+    bool ok = true;
+    for (size_t j=0;j<nv;++j) ok = ok && pop[j] == step4.current_y()[j];
+    std::cout << "-------------------\n";
+    std::cout << "Lorenz population " << (ok ? "passed" : "FAILED") << "\n\n";
+    return ok;
+}
+
+bool test5(const double& dt)
+{
+    using namespace petlib::runge_kutta;
+    std::vector<double> y0(3);
+    y0[0] = 2.0;
+    y0[1] = 1.0;
+    y0[2] = 1.0;
+    Lorenz sys;
+    rk_stepper< Lorenz, RK4 > step4(y0,0.0,dt,sys);
+    rk_stepper< Lorenz, RK4 > step4m(y0,0.0,dt,sys);
+    rk_stepper< Lorenz, RK4 > step4w(y0,0.0,dt,sys);
+
+    double tf = 30.0;
+    size_t nsteps = size_t(rint(tf/dt));
+    size_t ndec = 10;
+    bool ok = true;
+    trajectory_ring<double> ring(3,16,ndec);
+    step4.integrate(nsteps,ring);
+    std::cout << "ring holds " << ring.size() << " records\n";
+    std::cout << "last t = " << ring.time(ring.size()-1);
+    for (double x:ring.state(ring.size()-1)) std::cout << " " << x;
+    std::cout << "\n";
+    std::cout << step4;
+
+    {
+        trajectory_mmap<double> traj("rk_test_lorenz.mmap",3,nsteps/ndec+1,ndec);
+        step4m.integrate(nsteps,traj);
+        std::cout << "mmap holds " << traj.size() << " records last t = " << traj.time(traj.size()-1) << "\n";
+        ok = ok && traj.size() == nsteps/ndec && traj.dropped() == 0;
+    }
+    {
+        // a file too small for the run counts what it could not hold
+        rk_stepper< Lorenz, RK4 > s(y0,0.0,dt,sys);
+        trajectory_mmap<double> traj("rk_test_lorenz_short.mmap",3,10,ndec);
+        s.integrate(nsteps,traj);
+        std::cout << "short mmap holds " << traj.size() << " records dropped " << traj.dropped() << "\n";
+        ok = ok && traj.full() && traj.dropped() == nsteps/ndec - 10;
+        // and a ring asked for no room still keeps the last record
+        trajectory_ring<double> r0(3,0);
+        s.integrate(3,r0);
+        ok = ok && r0.size() == 1 && r0.time(0) == s.current_time();
+        // a file with no room maps nothing and drops everything
+        trajectory_mmap<double> t0("rk_test_lorenz_short.mmap",3,0,ndec);
+        s.integrate(nsteps,t0);
+        ok = ok && t0.size() == 0 && t0.full() && t0.dropped() == nsteps/ndec;
+    }
+    remove("rk_test_lorenz_short.mmap");
+    size_t nrec = 0;
+    {
+        trajectory_writer<double> traj("rk_test_lorenz.traj",3,256,ndec);
+        step4w.integrate(nsteps,traj);
+        traj.close();
+        nrec = traj.records_written();
+    }
+    std::cout << "writer stored " << nrec << " records\n";
+    // the two files hold the same records
+    FILE * f1 = fopen("rk_test_lorenz.mmap","rb");
+    FILE * f2 = fopen("rk_test_lorenz.traj","rb");
+    std::vector<double> r1(4*nrec),r2(4*nrec);
+    size_t n1 = fread(r1.data(),sizeof(double)*4,nrec,f1);
+    size_t n2 = fread(r2.data(),sizeof(double)*4,nrec,f2);
+    fclose(f1);
+    fclose(f2);
+    std::cout << "files agree = " << (n1==n2 && r1==r2) << "\n";
+    ok = ok && n1 == nrec && n2 == nrec && r1 == r2;
+    remove("rk_test_lorenz.mmap");
+    remove("rk_test_lorenz.traj");
+    std::cout << "-------------------\n";
+    std::cout << "Lorenz recorders " << (ok ? "passed" : "FAILED") << "\n\n";
+    return ok;
+}
+
 int main()
 {
     test1(0.025);
@@ -136,4 +250,7 @@ int main()
 //    test1(0.006255);
     test2(0.1);
     test3(0.02);
+    bool ok = test4(0.02);
+    ok = test5(0.002) && ok;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,158 @@
+#pragma once
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+namespace petlib
+{
+namespace runge_kutta
+{
+
+/////////////////////////////////////////////////////
+//  Splitting coefficients for separable hamiltonians
+//    H(q,p) = T(p) + V(q)
+//  One step of size h is num_stages kick/drift pairs
+//    p += d[i] * h * F(q)
+//    q += c[i] * h * V(p)
+//  A zero coefficient skips its half of the pair.
+/////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////
+//  Kick/drift coefficients for a symmetric composition
+//    of velocity verlet steps with weights w[0..n-1].
+//  Neighbouring half kicks are merged so the result
+//    has n+1 stages with a trailing zero drift.
+/////////////////////////////////////////////////////
+inline void verlet_composition(const double * w, int n,
+    std::vector<double>& d, std::vector<double>& c) noexcept
+{
+    d = std::vector<double>(n+1);
+    c = std::vector<double>(n+1);
+    d[0] = 0.5 * w[0];
+    for (int i=1; i<n; ++i) d[i] = 0.5 * (w[i-1] + w[i]);
+    d[n] = 0.5 * w[n-1];
+    for (int i=0; i<n; ++i) c[i] = w[i];
+    c[n] = 0.0;
+}
+
+struct SymplecticEuler
+{
+    static int num_stages() noexcept { return 1;}
+    static int order() noexcept { return 1;}
+
+    static void initialize(std::vector<double>& d,
+        std::vector<double>& c) noexcept
+    {
+        d = std::vector<double>(1,1.0);
+        c = std::vector<double>(1,1.0);
+    }
+};
+
+/////////////////////////////////////////////////////
+//  kick-drift-kick leapfrog
+/////////////////////////////////////////////////////
+struct VelocityVerlet
+{
+    static int num_stages() noexcept { return 2;}
+    static int order() noexcept { return 2;}
+
+    static void initialize(std::vector<double>& d,
+        std::vector<double>& c) noexcept
+    {
+        const double w[1] = { 1.0 };
+        verlet_composition(w,1,d,c);
+    }
+};
+
+/////////////////////////////////////////////////////
+//  drift-kick-drift leapfrog
+/////////////////////////////////////////////////////
+struct PositionVerlet
+{
+    static int num_stages() noexcept { return 2;}
+    static int order() noexcept { return 2;}
+
+    static void initialize(std::vector<double>& d,
+        std::vector<double>& c) noexcept
+    {
+        d = std::vector<double>(2);
+        c = std::vector<double>(2);
+        d[0] = 0.0;
+        c[0] = 0.5;
+        d[1] = 1.0;
+        c[1] = 0.5;
+    }
+};
+
+/////////////////////////////////////////////////////
+//  Yoshida (1990) triple jump, same as Forest-Ruth
+/////////////////////////////////////////////////////
+struct Yoshida4
+{
+    static int num_stages() noexcept { return 4;}
+    static int order() noexcept { return 4;}
+
+    static void initialize(std::vector<double>& d,
+        std::vector<double>& c) noexcept
+    {
+        const double cbrt2 = std::cbrt(2.0);
+        const double w1 = 1.0 / (2.0 - cbrt2);
+        const double w0 = -cbrt2 * w1;
+        const double w[3] = { w1, w0, w1 };
+        verlet_composition(w,3,d,c);
+    }
+};
+
+/////////////////////////////////////////////////////
+//  Yoshida (1990) sixth order, solution A
+/////////////////////////////////////////////////////
+struct Yoshida6
+{
+    static int num_stages() noexcept { return 8;}
+    static int order() noexcept { return 6;}
+
+    static void initialize(std::vector<double>& d,
+        std::vector<double>& c) noexcept
+    {
+        const double w1 = -1.17767998417887;
+        const double w2 = 0.235573213359357;
+        const double w3 = 0.784513610477560;
+        const double w0 = 1.0 - 2.0 * (w1 + w2 + w3);
+        const double w[7] = { w3, w2, w1, w0, w1, w2, w3 };
+        verlet_composition(w,7,d,c);
+    }
+};
+
+/////////////////////////////////////////////////////
+//  Omelyan, Mryglod and Folk (2002) position extended
+//    forest-ruth like scheme. Fourth order with an error
+//    constant two orders of magnitude below Yoshida4.
+/////////////////////////////////////////////////////
+struct PEFRL
+{
+    static int num_stages() noexcept { return 5;}
+    static int order() noexcept { return 4;}
+
+    static void initialize(std::vector<double>& d,
+        std::vector<double>& c) noexcept
+    {
+        const double xi = 0.1786178958448091;
+        const double lambda = -0.2123418310626054;
+        const double chi = -0.06626458266981849;
+        d = std::vector<double>(5);
+        c = std::vector<double>(5);
+        d[0] = 0.0;
+        c[0] = xi;
+        d[1] = 0.5 * (1.0 - 2.0 * lambda);
+        c[1] = chi;
+        d[2] = lambda;
+        c[2] = 1.0 - 2.0 * (chi + xi);
+        d[3] = lambda;
+        c[3] = chi;
+        d[4] = 0.5 * (1.0 - 2.0 * lambda);
+        c[4] = xi;
+    }
+};
+
+}
+}
@@ -0,0 +1,225 @@
+#pragma once
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <span>
+
+namespace petlib
+{
+namespace runge_kutta
+{
+
+/////////////////////////////////////////////////////
+//  Wrapper around a separable hamiltonian system type
+//  using the BN trick, the split counterpart of rk_system.
+//  Any implemented system type should define
+//    num_dof  the number of coordinates q (and momenta p)
+//    calculate_velocity(p,t,dqdt)   dq/dt =  dH/dp
+//    calculate_force(q,t,dpdt)      dp/dt = -dH/dq
+//  as member templates on the value type.
+//  The state is stored as q followed by p so it is 2*num_dof
+//    long and can be handed to the trajectory observers.
+/////////////////////////////////////////////////////
+template < class system_t, typename T = double >
+class split_system
+{
+public:
+    typedef T value_type;
+    split_system():sys() {}
+    split_system(const system_t& sys0):sys(sys0) {}
+    constexpr int num_dof() const noexcept
+    {
+        return sys.num_dof();
+    }
+    constexpr void calculate_velocity(std::span<const T> p,const T& t,
+            std::span<T> dqdt) const noexcept
+    {
+        return sys.template calculate_velocity<T>(p,t,dqdt);
+    }
+    constexpr void calculate_force(std::span<const T> q,const T& t,
+            std::span<T> dpdt) const noexcept
+    {
+        return sys.template calculate_force<T>(q,t,dpdt);
+    }
+private:
+    system_t sys;
+};
+
+/////////////////////////////////////////////////////
+//  Wrapper around a splitting coefficients type
+//  see symplectic_cofs.hpp
+/////////////////////////////////////////////////////
+template < class cofs_t >
+class symplectic_cofs
+{
+public:
+    static void initialize(std::vector<double>& d,
+        std::vector<double>& c) noexcept
+    {
+        cofs_t::initialize(d,c);
+    }
+    static int num_stages() noexcept { return cofs_t::num_stages();}
+    static int order() noexcept { return cofs_t::order();}
+};
+
+/////////////////////////////////////////////////////
+//  Fixed step symplectic splitting integrator.
+//  When a scheme ends on a kick the force at the end of a
+//    step is the force at the start of the next one, step()
+//    keeps it and saves one force evaluation per step.
+/////////////////////////////////////////////////////
+template < class system_t, class cofs_t, typename T = double >
+class symplectic_stepper
+{
+    split_system<system_t,T> sys;
+    std::vector<T> m_y;
+    std::vector<T> m_force;
+    std::vector<T> m_vel;
+    std::vector<T> m_d;
+    std::vector<T> m_c;
+    T m_t;
+    T m_dt;
+    size_t n_stages;
+    size_t n_dof;
+    size_t n_force_evals;
+    bool m_force_valid;
+
+    /////////////////////////////////////////////////////
+    //  q and p are advanced in place from t to t + dt.
+    //  If force_valid m_force already holds F(q,t).
+    //  Returns true when m_force holds F(q,t+dt) on exit.
+    /////////////////////////////////////////////////////
+    bool advance(T * q, T * p, const T& t, bool force_valid) noexcept
+    {
+        T * const f = m_force.data();
+        T * const v = m_vel.data();
+        T tq = t;
+        T tp = t;
+        bool valid = force_valid;
+        for (size_t i=0; i<n_stages; ++i) {
+            if ( m_d[i] != T(0) ) {
+                if ( !valid ) {
+                    sys.calculate_force(std::span<const T>(q,n_dof),tq,
+                        std::span<T>(f,n_dof));
+                    ++n_force_evals;
+                }
+                const T h = m_d[i] * m_dt;
+                for (size_t j=0; j<n_dof; ++j) p[j] += h * f[j];
+                tp += h;
+                valid = true;
+            }
+            if ( m_c[i] != T(0) ) {
+                sys.calculate_velocity(std::span<const T>(p,n_dof),tp,
+                    std::span<T>(v,n_dof));
+                const T h = m_c[i] * m_dt;
+                for (size_t j=0; j<n_dof; ++j) q[j] += h * v[j];
+                tq += h;
+                valid = false;
+            }
+        }
+        return valid;
+    }
+public:
+    typedef T value_type;
+
+    symplectic_stepper() = delete;
+    symplectic_stepper(
+        std::span<const T> y_init, const T& t_init,
+        const T& delta_t, const system_t& sys0 = system_t()):
+        sys(sys0),
+        m_y(y_init.begin(),y_init.end()),
+        m_force(sys0.num_dof()),
+        m_vel(sys0.num_dof()),
+        m_t(t_init),
+        m_dt(delta_t),
+        n_stages(symplectic_cofs<cofs_t>::num_stages()),
+        n_dof(sys0.num_dof()),
+        n_force_evals(0),
+        m_force_valid(false)
+    {
+        std::vector<double> d;
+        std::vector<double> c;
+        symplectic_cofs<cofs_t>::initialize(d,c);
+        m_d.assign(d.begin(),d.end());
+        m_c.assign(c.begin(),c.end());
+    }
+    symplectic_stepper(
+        const std::vector<T>& y_init, const T& t_init,
+        const T& delta_t, const system_t& sys0 = system_t()):
+        symplectic_stepper(std::span<const T>(y_init),t_init,delta_t,sys0)
+    {}
+
+    const std::vector<T>& current_y() const noexcept { return m_y;}
+    const T& current_time() const noexcept { return m_t;}
+    const T& time_step() const noexcept { return m_dt;}
+    size_t num_vars() const noexcept { return 2 * n_dof;}
+    size_t num_dof() const noexcept { return n_dof;}
+    size_t num_force_evaluations() const noexcept { return n_force_evals;}
+    void set_time_step(const T& dt) noexcept { m_dt = dt;}
+
+    std::span<const T> position() const noexcept
+    {
+        return std::span<const T>(m_y.data(),n_dof);
+    }
+    std::span<const T> momentum() const noexcept
+    {
+        return std::span<const T>(m_y.data()+n_dof,n_dof);
+    }
+
+    void step() noexcept
+    {
+        m_force_valid = advance(m_y.data(),m_y.data()+n_dof,m_t,m_force_valid);
+        m_t += m_dt;
+    }
+
+    /////////////////////////////////////////////////////
+    //  Advance an external state y = (q,p) from t to t + dt
+    //    in place. Only the scratch space of this stepper is used.
+    /////////////////////////////////////////////////////
+    void step(std::span<T> y, const T& t) noexcept
+    {
+        advance(y.data(),y.data()+n_dof,t,false);
+        m_force_valid = false;
+    }
+
+    template < class view_t >
+    void step_view(view_t& y, const T& t) noexcept
+    {
+        step(std::span<T>(y.data(),y.size()),t);
+    }
+
+    template < class observer_t >
+    void observe(observer_t& obs) const
+    {
+        obs(m_t,std::span<const T>(m_y));
+    }
+
+    template < class observer_t >
+    void integrate(size_t nsteps, observer_t& obs)
+    {
+        for (size_t n=0; n<nsteps; ++n) {
+            step();
+            obs(m_t,std::span<const T>(m_y));
+        }
+    }
+
+    std::ostream& print(std::ostream& os) const
+    {
+        os << std::setw(20) << std::setprecision(8) << std::fixed;
+        os << "t = " << m_t << " q = ";
+        for (size_t j=0; j<n_dof; ++j) os << " " << m_y[j];
+        os << " p = ";
+        for (size_t j=0; j<n_dof; ++j) os << " " << m_y[n_dof+j];
+        os << "\n";
+        return os;
+    }
+    friend std::ostream& operator << ( std::ostream& os, const symplectic_stepper& s)
+    {
+        return s.print(os);
+    }
+};
+
+}
+}
@@ -0,0 +1,127 @@
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <span>
+#include "rk_stepper.hpp"
+#include "rk_cofs.hpp"
+#include "rk_sys.hpp"
+#include "symplectic_stepper.hpp"
+#include "symplectic_cofs.hpp"
+
+double elapsed(const std::chrono::steady_clock::time_point& ts)
+{
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+    return d.count();
+}
+
+/////////////////////////////////////////////////////
+//  global error of the harmonic oscillator at t = 10
+//    halving dt should divide it by 2^order
+/////////////////////////////////////////////////////
+template < class cofs_t >
+void order_test(const char * name)
+{
+    using namespace petlib::runge_kutta;
+    std::vector<double> y0(2);
+    y0[0] = 1.0;
+    y0[1] = 0.0;
+    double tf = 10.0;
+    double err[2];
+    for (int k=0; k<2; ++k) {
+        size_t nsteps = size_t(50) << k;
+        symplectic_stepper< HarmonicOscillator, cofs_t > s(y0,0.0,tf/double(nsteps));
+        for (size_t n=0; n<nsteps; ++n) s.step();
+        err[k] = std::fabs(s.current_y()[0] - std::cos(tf));
+    }
+    std::cout << std::setw(16) << name << " order " << cofs_t::order()
+              << " observed " << std::setprecision(3) << std::fixed
+              << std::log2(err[0]/err[1]) << "\n";
+}
+
+void test1()
+{
+    order_test< petlib::runge_kutta::SymplecticEuler >("SymplecticEuler");
+    order_test< petlib::runge_kutta::VelocityVerlet >("VelocityVerlet");
+    order_test< petlib::runge_kutta::PositionVerlet >("PositionVerlet");
+    order_test< petlib::runge_kutta::Yoshida4 >("Yoshida4");
+    order_test< petlib::runge_kutta::PEFRL >("PEFRL");
+    order_test< petlib::runge_kutta::Yoshida6 >("Yoshida6");
+    std::cout << "test 1 done\n\n";
+}
+
+/////////////////////////////////////////////////////
+//  Kepler orbit with eccentricity 0.5 over many periods
+//    the symplectic schemes keep the energy error bounded
+//    while rk4 drifts, at the same number of force evaluations
+/////////////////////////////////////////////////////
+template < class stepper_t >
+void kepler_run(const char * name, stepper_t& s, size_t nsteps,
+    size_t evals_per_step)
+{
+    using namespace petlib::runge_kutta;
+    Kepler sys;
+    std::span<const double> y(s.current_y());
+    double e0 = sys.energy(y);
+    double max_err = 0.0;
+    auto ts = std::chrono::steady_clock::now();
+    for (size_t n=0; n<nsteps; ++n) {
+        s.step();
+        max_err = std::max(max_err,std::fabs(sys.energy(y) - e0));
+    }
+    double tm = elapsed(ts);
+    std::cout << std::setw(16) << name << " dt = " << std::setprecision(5)
+              << std::fixed << s.time_step()
+              << " evals = " << std::setw(9) << nsteps * evals_per_step
+              << " max |dE| = " << std::scientific << std::setprecision(3)
+              << max_err << " final |dE| = " << std::fabs(sys.energy(y)-e0)
+              << " time = " << std::fixed << tm << "\n";
+}
+
+void test2(size_t n_orbits, size_t steps_per_orbit)
+{
+    using namespace petlib::runge_kutta;
+    const double e = 0.5;
+    std::vector<double> y0(4);
+    y0[0] = 1.0 - e;
+    y0[1] = 0.0;
+    y0[2] = 0.0;
+    y0[3] = std::sqrt((1.0 + e) / (1.0 - e));
+    const double period = 2.0 * M_PI;
+    // every scheme gets the same force evaluations per orbit
+    const size_t n_evals = n_orbits * steps_per_orbit;
+    {
+        size_t nsteps = n_evals / 4;
+        rk_stepper< Kepler, RK4 > s(y0,0.0,period*n_orbits/nsteps);
+        kepler_run("RK4",s,nsteps,4);
+    }
+    {
+        size_t nsteps = n_evals;
+        symplectic_stepper< Kepler, VelocityVerlet > s(y0,0.0,period*n_orbits/nsteps);
+        kepler_run("VelocityVerlet",s,nsteps,1);
+    }
+    {
+        size_t nsteps = n_evals / 3;
+        symplectic_stepper< Kepler, Yoshida4 > s(y0,0.0,period*n_orbits/nsteps);
+        kepler_run("Yoshida4",s,nsteps,3);
+    }
+    {
+        size_t nsteps = n_evals / 4;
+        symplectic_stepper< Kepler, PEFRL > s(y0,0.0,period*n_orbits/nsteps);
+        kepler_run("PEFRL",s,nsteps,4);
+    }
+    {
+        size_t nsteps = n_evals / 7;
+        symplectic_stepper< Kepler, Yoshida6 > s(y0,0.0,period*n_orbits/nsteps);
+        kepler_run("Yoshida6",s,nsteps,7);
+    }
+    std::cout << "test 2 done\n\n";
+}
+
+int main()
+{
+    test1();
+    test2(1000,400);
+}
@@ -0,0 +1,221 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include "petlib.hpp"
+#include "petlib_banded.hpp"
+#include "petlib_chol.hpp"
+
+double elapsed(const std::chrono::steady_clock::time_point& ts)
+{
+   std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+   return d.count();
+}
+
+// max |A x - b| by the full matrix
+template < class M >
+double residual(const M& a,const petlib::Array<double>& x,const petlib::Array<double>& b)
+{
+   const petlib::Matrix<double> f = a.full();
+   const petlib::Array<double>& cx = x;
+   double e = 0.0;
+   for (size_t i=0;i<f.nrows();++i) {
+      double s = -b[i];
+      for (size_t j=0;j<f.ncols();++j) s += f(i,j) * cx[j];
+      e = std::max(e,std::fabs(s));
+   }
+   return e;
+}
+
+template < class M >
+bool check_multiply(const M& a,const petlib::Array<double>& x)
+{
+   const size_t n = a.nrows();
+   petlib::Array<double> y(n),y3(n);
+   a.multiply(x,y);
+   a.multiply(x,y3,3);
+   return residual(a,x,y) < 1.e-13 && std::memcmp(static_cast<const petlib::Array<double>&>(y).data(),
+                                                  static_cast<const petlib::Array<double>&>(y3).data(),n * sizeof(double)) == 0;
+}
+
+int main()
+{
+   bool ok = true;
+   std::mt19937_64 gen(17);
+   std::uniform_real_distribution<double> u(-1.0,1.0);
+   {
+      std::cout << "tridiagonal\n";
+      for (size_t n : { 1,2,7,100 }) {
+         petlib::TridiagonalMatrix<double> t(n);
+         for (size_t i=0;i<n;++i) {
+            t(i,i) = 3.0 + u(gen);
+            if (i + 1 < n) {
+               t(i,i + 1) = u(gen);
+               t(i + 1,i) = u(gen);
+            }
+         }
+         const petlib::TridiagonalMatrix<double>& ct = t;
+         const petlib::Matrix<double> f = ct.full();
+         double e = 0.0;
+         for (size_t i=0;i<n;++i)
+            for (size_t j=0;j<n;++j) e = std::max(e,std::fabs(ct(i,j) - f(i,j)));
+         ok = ok && e == 0.0 && (n < 3 || ct(0,2) == 0.0);
+         petlib::Array<double> b(n),x(n);
+         for (size_t i=0;i<n;++i) b[i] = std::cos(double(i));
+         ok = ok && check_multiply(ct,b);
+         x = b;
+         ct.solve(x);
+         ok = ok && residual(ct,x,b) < 1.e-14;
+         // many right hand sides at once are the single solves bit for bit
+         const size_t m = 600;
+         petlib::Matrix<double> xs(n,m);
+         for (size_t i=0;i<n;++i)
+            for (size_t s=0;s<m;++s) xs(i,s) = double(s % 5 + 1) * b[i];
+         petlib::Matrix<double> xs3(xs);
+         ct.solve(xs);
+         ct.solve(xs3,3);
+         const petlib::Matrix<double>& cxs = xs;
+         petlib::Array<double> x5(n);
+         for (size_t i=0;i<n;++i) x5[i] = 5.0 * b[i];
+         ct.solve(x5);
+         const petlib::Array<double>& cx5 = x5;
+         for (size_t i=0;i<n;++i) ok = ok && cxs(i,4) == cx5[i];
+         ok = ok && std::memcmp(cxs.data(),static_cast<const petlib::Matrix<double>&>(xs3).data(),n * m * sizeof(double)) == 0;
+         std::cout << "  n " << n << (ok ? " ok\n" : " FAILED\n");
+      }
+   }
+   {
+      std::cout << "tridiagonal batch\n";
+      const size_t n = 50,m = 1000;
+      petlib::TridiagonalBatch<double> tb(n,m);
+      petlib::Matrix<double> x(n,m);
+      for (size_t k=0;k<n;++k)
+         for (size_t s=0;s<m;++s) {
+            tb.sub()(k,s) = k > 0 ? u(gen) : 0.0;
+            tb.super()(k,s) = k + 1 < n ? u(gen) : 0.0;
+            tb.diag()(k,s) = 3.0 + u(gen);
+            x(k,s) = u(gen);
+         }
+      const petlib::Matrix<double> b(x);
+      petlib::Matrix<double> x3(x);
+      tb.solve(x);
+      tb.solve(x3,3);
+      const petlib::Matrix<double>& cx = x;
+      const petlib::TridiagonalBatch<double>& ctb = tb;
+      double e = 0.0;
+      for (size_t s=0;s<m;++s)
+         for (size_t k=0;k<n;++k) {
+            double r = ctb.diag()(k,s) * cx(k,s) - b(k,s);
+            if (k > 0) r += ctb.sub()(k,s) * cx(k - 1,s);
+            if (k + 1 < n) r += ctb.super()(k,s) * cx(k + 1,s);
+            e = std::max(e,std::fabs(r));
+         }
+      ok = ok && e < 1.e-14;
+      ok = ok && std::memcmp(cx.data(),static_cast<const petlib::Matrix<double>&>(x3).data(),n * m * sizeof(double)) == 0;
+      std::cout << "  n " << n << " m " << m << " residual " << e << "\n";
+   }
+   {
+      std::cout << "banded lu\n";
+      for (size_t n : { 1,5,60 }) {
+         petlib::BandMatrix<double> a(n,2,3);
+         for (size_t i=0;i<n;++i)
+            for (size_t j=i > 2 ? i - 2 : 0;j<std::min(n,i + 4);++j) a(i,j) = u(gen);
+         // no dominant diagonal, some zero, the factorization has to pivot
+         for (size_t i=0;i<n;i+=3) a(i,i) = 0.0;
+         if (n == 1) a(0,0) = 2.0;
+         const petlib::BandMatrix<double>& ca = a;
+         const petlib::BandMatrix<double> a2(2,3,ca.full());
+         double e = 0.0;
+         for (size_t i=0;i<n;++i)
+            for (size_t j=0;j<n;++j) e = std::max(e,std::fabs(a2(i,j) - ca(i,j)));
+         ok = ok && e == 0.0;
+         petlib::Array<double> b(n);
+         for (size_t i=0;i<n;++i) b[i] = 1.0 + double(i % 3);
+         ok = ok && check_multiply(ca,b);
+         petlib::Band_LU_decomposition<double> lu(ca);
+         petlib::Array<double> x = lu.solve(b);
+         e = residual(ca,x,b);
+         petlib::Matrix<double> bm(n,2);
+         for (size_t i=0;i<n;++i) {
+            bm(i,0) = b[i];
+            bm(i,1) = -2.0 * b[i];
+         }
+         const petlib::Matrix<double> xm = lu.matrix_solve(bm);
+         const petlib::Array<double>& cx = x;
+         for (size_t i=0;i<n;++i) e = std::max(e,std::fabs(xm(i,0) - cx[i]) + std::fabs(xm(i,1) + 2.0 * cx[i]));
+         ok = ok && e < 1.e-11;
+         std::cout << "  n " << n << " error " << e << "\n";
+      }
+   }
+   {
+      std::cout << "banded cholesky\n";
+      // the 1d biharmonic, 1 -4 6 -4 1, with a shift
+      const size_t n = 200;
+      petlib::BandMatrix<double> a(n,2,2);
+      for (size_t i=0;i<n;++i) {
+         a(i,i) = 6.1;
+         if (i + 1 < n) a(i,i + 1) = a(i + 1,i) = -4.0;
+         if (i + 2 < n) a(i,i + 2) = a(i + 2,i) = 1.0;
+      }
+      petlib::Array<double> b(n);
+      for (size_t i=0;i<n;++i) b[i] = std::sin(0.1 * double(i));
+      petlib::Band_Cholesky_decomposition<double> ch(a);
+      petlib::Array<double> x = ch.solve(b);
+      const double e = residual(a,x,b);
+      std::cout << "  n " << n << " residual " << e << "\n";
+      ok = ok && e < 1.e-12;
+   }
+   {
+      std::cout << "seconds\n";
+      // an ADI half step, n x n points, one system per grid line
+      const size_t n = 512;
+      petlib::TridiagonalMatrix<double> t(n,-1.0,2.5,-1.0);
+      petlib::Matrix<double> x(n,n);
+      for (size_t i=0;i<n;++i)
+         for (size_t j=0;j<n;++j) x(i,j) = u(gen);
+      const petlib::Matrix<double> x0(x);
+      const int reps = 10;
+      auto ts = std::chrono::steady_clock::now();
+      for (int r=0;r<reps;++r) {
+         petlib::Array<double> c(n);
+         for (size_t s=0;s<n;++s) {
+            for (size_t k=0;k<n;++k) c[k] = x0(k,s);
+            t.solve(c);
+            for (size_t k=0;k<n;++k) x(k,s) = static_cast<const petlib::Array<double>&>(c)[k];
+         }
+      }
+      const double t1 = elapsed(ts) / reps;
+      petlib::Matrix<double> y(x0);
+      ts = std::chrono::steady_clock::now();
+      for (int r=0;r<reps;++r) {
+         y = x0;
+         t.solve(y);
+      }
+      const double tm = elapsed(ts) / reps;
+      petlib::TridiagonalBatch<double> tb(n,n);
+      tb.sub() = -1.0;
+      tb.diag() = 2.5;
+      tb.super() = -1.0;
+      ts = std::chrono::steady_clock::now();
+      for (int r=0;r<reps;++r) {
+         y = x0;
+         tb.solve(y);
+      }
+      const double tbat = elapsed(ts) / reps;
+      // dense Cholesky of the same matrix for one line
+      ts = std::chrono::steady_clock::now();
+      petlib::Cholesky_decomposition<double> dense(t.full());
+      const double td = elapsed(ts);
+      std::cout << "  " << n << " lines of " << n << ": one at a time " << t1 << " interleaved " << tm
+                << " batch " << tbat << ", dense factor " << td << "\n";
+      double e = 0.0;
+      const petlib::Matrix<double>& cx = x;
+      const petlib::Matrix<double>& cy = y;
+      for (size_t i=0;i<n;++i)
+         for (size_t j=0;j<n;++j) e = std::max(e,std::fabs(cx(i,j) - cy(i,j)));
+      ok = ok && e < 1.e-13;
+   }
+   std::cout << (ok ? "banded test passed\n" : "banded test FAILED\n");
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
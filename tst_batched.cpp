@@ -0,0 +1,239 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "petlib.hpp"
+#include "petlib_batched.hpp"
+#include "petlib_gemm.hpp"
+
+double elapsed(const std::chrono::steady_clock::time_point& ts)
+{
+   std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+   return d.count();
+}
+
+template < class B >
+void random_fill(B& b,std::mt19937_64& gen)
+{
+   std::uniform_real_distribution<double> u(-1.0,1.0);
+   for (size_t m=0;m<b.count();++m)
+      for (size_t i=0;i<B::rows;++i)
+         for (size_t j=0;j<B::cols;++j) b(m,i,j) = u(gen);
+}
+
+// max |A X - B| over the batch
+template < size_t N,size_t M >
+double residual(const petlib::MatrixBatch<double,N,N>& a,const petlib::MatrixBatch<double,N,M>& x,
+                const petlib::MatrixBatch<double,N,M>& b)
+{
+   double e = 0.0;
+   for (size_t m=0;m<b.count();++m)
+      for (size_t i=0;i<N;++i)
+         for (size_t j=0;j<M;++j) {
+            double s = -b(m,i,j);
+            for (size_t k=0;k<N;++k) s += a(m,i,k) * x(m,k,j);
+            e = std::max(e,std::fabs(s));
+         }
+   return e;
+}
+
+template < size_t N >
+bool check(size_t count)
+{
+   typedef petlib::MatrixBatch<double,N,N> batch_t;
+   bool ok = true;
+   std::mt19937_64 gen(N);
+   {
+      // d = 2 a b against the plain triple loop, on 1 and 3 threads
+      petlib::MatrixBatch<double,N,N + 3> a(count);
+      petlib::MatrixBatch<double,N + 3,N> b(count);
+      random_fill(a,gen);
+      random_fill(b,gen);
+      petlib::MatrixBatch<double,N,N> d(count),d3(count);
+      petlib::batched::gemm(2.0,a,b,d);
+      petlib::batched::gemm(2.0,a,b,d3,3);
+      double e = 0.0;
+      for (size_t m=0;m<count;++m)
+         for (size_t i=0;i<N;++i)
+            for (size_t j=0;j<N;++j) {
+               double s = 0.0;
+               for (size_t k=0;k<N + 3;++k) s += a(m,i,k) * b(m,k,j);
+               e = std::max(e,std::fabs(2.0 * s - static_cast<const petlib::MatrixBatch<double,N,N>&>(d)(m,i,j)));
+            }
+      ok = ok && e < 1.e-13;
+      ok = ok && std::memcmp(static_cast<const petlib::MatrixBatch<double,N,N>&>(d).data(),
+                             static_cast<const petlib::MatrixBatch<double,N,N>&>(d3).data(),d.bytes()) == 0;
+      // and b a, the wide shape
+      petlib::MatrixBatch<double,N + 3,N + 3> w(count);
+      petlib::batched::gemm(1.0,b,a,w);
+      e = 0.0;
+      for (size_t m=0;m<count;++m)
+         for (size_t i=0;i<N + 3;++i)
+            for (size_t j=0;j<N + 3;++j) {
+               double s = 0.0;
+               for (size_t k=0;k<N;++k) s += b(m,i,k) * a(m,k,j);
+               e = std::max(e,std::fabs(s - static_cast<const petlib::MatrixBatch<double,N + 3,N + 3>&>(w)(m,i,j)));
+            }
+      ok = ok && e < 1.e-13;
+   }
+   {
+      // LU with pivoting, one matrix singular
+      batch_t a(count);
+      random_fill(a,gen);
+      for (size_t j=0;j<N;++j) a(count / 2,N - 1,j) = 0.0;
+      const batch_t a0(a);
+      petlib::PivotBatch<N> piv(count);
+      const size_t nbad = petlib::batched::lu_decomp(a,piv);
+      ok = ok && nbad == 1;
+      petlib::MatrixBatch<double,N,3> b(count);
+      random_fill(b,gen);
+      const petlib::MatrixBatch<double,N,3> b0(b);
+      petlib::batched::lu_solve(a,piv,b,3);
+      double e = 0.0;
+      for (size_t m=0;m<count;++m) {
+         if (m == count / 2) continue;
+         for (size_t i=0;i<N;++i)
+            for (size_t j=0;j<3;++j) {
+               double s = -b0(m,i,j);
+               for (size_t k=0;k<N;++k) s += a0(m,i,k) * static_cast<const petlib::MatrixBatch<double,N,3>&>(b)(m,k,j);
+               e = std::max(e,std::fabs(s));
+            }
+      }
+      std::cout << "  N " << N << " lu residual " << e;
+      ok = ok && e < 1.e-10;
+   }
+   {
+      // Cholesky of G G' + N I, one matrix not positive definite
+      batch_t g(count),a(count);
+      random_fill(g,gen);
+      petlib::MatrixBatch<double,N,N> gt(count);
+      for (size_t m=0;m<count;++m)
+         for (size_t i=0;i<N;++i) {
+            for (size_t j=0;j<N;++j) gt(m,i,j) = static_cast<const batch_t&>(g)(m,j,i);
+            a(m,i,i) = double(N);
+         }
+      petlib::batched::gemm(1.0,g,gt,a);
+      a(0,N - 1,N - 1) = -1.0;
+      const batch_t a0(a);
+      ok = ok && petlib::batched::chol_decomp(a) == 1;
+      petlib::MatrixBatch<double,N,2> b(count);
+      random_fill(b,gen);
+      const petlib::MatrixBatch<double,N,2> b0(b);
+      petlib::batched::chol_solve(a,b);
+      double e = 0.0;
+      for (size_t m=1;m<count;++m)
+         for (size_t i=0;i<N;++i)
+            for (size_t j=0;j<2;++j) {
+               double s = -b0(m,i,j);
+               for (size_t k=0;k<N;++k) s += a0(m,i,k) * static_cast<const petlib::MatrixBatch<double,N,2>&>(b)(m,k,j);
+               e = std::max(e,std::fabs(s));
+            }
+      std::cout << " cholesky residual " << e;
+      ok = ok && e < 1.e-12;
+      // the triangles on their own, U x = b then L y = U x
+      batch_t t(count);
+      random_fill(t,gen);
+      for (size_t m=0;m<count;++m)
+         for (size_t i=0;i<N;++i) t(m,i,i) = 4.0;
+      petlib::MatrixBatch<double,N,1> x(count);
+      random_fill(x,gen);
+      const petlib::MatrixBatch<double,N,1> x0(x);
+      petlib::batched::trsm_upper(t,x);
+      petlib::batched::trsm_lower(t,x);
+      const batch_t& ct = t;
+      const petlib::MatrixBatch<double,N,1>& cx = x;
+      e = 0.0;
+      for (size_t m=0;m<count;++m) {
+         // y = L x is U^-1 b, and U y is b
+         double y[N];
+         for (size_t i=0;i<N;++i) {
+            y[i] = 0.0;
+            for (size_t k=0;k<=i;++k) y[i] += ct(m,i,k) * cx(m,k,0);
+         }
+         for (size_t i=0;i<N;++i) {
+            double s = -x0(m,i,0);
+            for (size_t k=i;k<N;++k) s += ct(m,i,k) * y[k];
+            e = std::max(e,std::fabs(s));
+         }
+      }
+      std::cout << " triangular residual " << e << "\n";
+      ok = ok && e < 1.e-12;
+   }
+   return ok;
+}
+
+// flops per second on a batch that stays in cache, the batched product
+// against one Matrix at a time and the factorizations
+template < size_t N >
+void timing()
+{
+   typedef petlib::MatrixBatch<double,N,N> batch_t;
+   const size_t count = std::max<size_t>(8,(1 << 17) / (3 * N * N)) / 8 * 8;
+   const size_t reps = std::max<size_t>(1,size_t(2.e8 / (2.0 * double(N * N * N) * double(count))));
+   batch_t a(count),b(count),c(count);
+   std::mt19937_64 gen(1);
+   random_fill(a,gen);
+   random_fill(b,gen);
+   // b + 2 N I made symmetric for Cholesky
+   for (size_t m=0;m<count;++m)
+      for (size_t i=0;i<N;++i) {
+         b(m,i,i) += 2.0 * double(N);
+         for (size_t j=0;j<i;++j) b(m,j,i) = static_cast<const batch_t&>(b)(m,i,j);
+      }
+   std::vector<petlib::Matrix<double> > va,vb,vc;
+   for (size_t m=0;m<count;++m) {
+      va.push_back(a.matrix(m));
+      vb.push_back(b.matrix(m));
+      vc.push_back(petlib::Matrix<double>(N,N));
+      vc.back() = 0.0;
+   }
+   const double flops = 2.0 * double(N * N * N) * double(count) * double(reps);
+   auto ts = std::chrono::steady_clock::now();
+   for (size_t r=0;r<reps;++r)
+      for (size_t m=0;m<count;++m)
+         petlib::gemm<double>(N,N,N,1.0,static_cast<const petlib::Matrix<double>&>(va[m]).data(),N,
+                              static_cast<const petlib::Matrix<double>&>(vb[m]).data(),N,vc[m].data(),N);
+   const double t0 = elapsed(ts);
+   ts = std::chrono::steady_clock::now();
+   for (size_t r=0;r<reps;++r) petlib::batched::gemm(1.0,a,b,c);
+   const double t1 = elapsed(ts);
+   // the factorizations work in place, each pass on a fresh copy
+   batch_t f(count);
+   petlib::PivotBatch<N> piv(count);
+   const batch_t& ca = a;
+   const batch_t& cb = b;
+   double* pf = f.data();
+   ts = std::chrono::steady_clock::now();
+   for (size_t r=0;r<reps;++r) {
+      std::memcpy(pf,ca.data(),a.bytes());
+      petlib::batched::lu_decomp(f,piv);
+   }
+   const double t2 = elapsed(ts);
+   ts = std::chrono::steady_clock::now();
+   for (size_t r=0;r<reps;++r) {
+      std::memcpy(pf,cb.data(),b.bytes());
+      petlib::batched::chol_decomp(f);
+   }
+   const double t3 = elapsed(ts);
+   std::cout << "  " << count << " of " << N << " x " << N << " GF/s, gemm one by one " << 1.e-9 * flops / t0
+             << " batched " << 1.e-9 * flops / t1 << " lu " << 1.e-9 * flops / 3.0 / t2
+             << " cholesky " << 1.e-9 * flops / 6.0 / t3 << "\n";
+}
+
+int main()
+{
+   bool ok = true;
+   std::cout << "batched\n";
+   ok = ok && check<4>(37);
+   ok = ok && check<7>(37);
+   ok = ok && check<16>(37);
+   std::cout << "seconds\n";
+   timing<4>();
+   timing<8>();
+   timing<16>();
+   timing<32>();
+   std::cout << (ok ? "batched test passed\n" : "batched test FAILED\n");
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
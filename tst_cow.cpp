@@ -0,0 +1,105 @@
+#include <chrono>
+#include <vector>
+#include "petlib.hpp"
+#include "petlib_matrix.hpp"
+
+double elapsed(const std::chrono::steady_clock::time_point& ts)
+{
+   std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+   return d.count();
+}
+
+int main()
+{
+   bool ok = true;
+   const size_t n = 1000;
+   // data() pins r, a copy of it gets a fresh buffer that can be shared
+   petlib::Array<double> r(n * n);
+   petlib::randomFill<double>(r.data(),r.size());
+   petlib::Array<double> a(r);
+   ok = ok && r.is_pinned() && !a.is_pinned() && !a.shares_storage(r);
+   // reads go through const references, a non-const a[i] would detach
+   const petlib::Array<double>& ca = a;
+   {
+      // copies share until one of them writes
+      petlib::Array<double> b(a);
+      petlib::Array<double> c(a.size());
+      c = a;
+      ok = ok && b.shares_storage(a) && c.shares_storage(a) && a.use_count() == 3;
+      const petlib::Array<double>& cb = b;
+      double x = cb[10] + cb.max();
+      ok = ok && b.shares_storage(a);
+      b[10] = x;
+      ok = ok && !b.shares_storage(a) && a.use_count() == 2;
+      ok = ok && cb[10] == x && ca[10] != x && ca.use_count() == 2;
+      c += 1.0;
+      ok = ok && ca.use_count() == 1 && c[5] == ca[5] + 1.0;
+   }
+   {
+      // a view or pointer handed out before a copy cannot write into it
+      petlib::Array<double> v(a);
+      petlib::Range rg(0,10);
+      petlib::SubArray<double> sv = v(rg);
+      petlib::Array<double> w(v);
+      sv[0] = -1.0;
+      ok = ok && !w.shares_storage(v) && w[0] == ca[0] && v[0] == -1.0;
+      petlib::Matrix<double> p(4,4);
+      p = 1.0;
+      double* pp = p.data();
+      petlib::SubArray<double> row = p.row_array(1);
+      petlib::Matrix<double> q(p);
+      pp[0] = 2.0;
+      row[0] = 3.0;
+      const petlib::Matrix<double>& cq = q;
+      ok = ok && !q.shares_storage(p) && cq(0,0) == 1.0 && cq(1,0) == 1.0;
+      // the copy of a pinned buffer shares again
+      petlib::Matrix<double> q2(q);
+      ok = ok && q2.shares_storage(q);
+      // an assignment ends the pin, copies after it share again
+      p = 0.0;
+      petlib::Matrix<double> q3(p);
+      v = ca;
+      v = 2.0;
+      petlib::Array<double> w2(v);
+      ok = ok && !p.is_pinned() && q3.shares_storage(p);
+      ok = ok && !v.is_pinned() && w2.shares_storage(v);
+      v(rg) = 1.0;
+      petlib::Array<double> w3(v);
+      ok = ok && v.is_pinned() && !w3.shares_storage(v) && w2[0] == 2.0;
+   }
+   petlib::Matrix<double> m(n,n);
+   {
+      petlib::Matrix<double> f(n,n);
+      petlib::randomFill<double>(f.data(),f.size());
+      m = petlib::Matrix<double>(static_cast<const petlib::Matrix<double>&>(f));
+   }
+   const petlib::Matrix<double>& cm = m;
+   {
+      petlib::Matrix<double> p(m);
+      ok = ok && p.shares_storage(m) && m.use_count() == 2;
+      ok = ok && p.trace() == m.trace();
+      p.scal_row(0,2.0);
+      ok = ok && !p.shares_storage(m) && p(0,3) == 2.0 * cm(0,3) && p(1,3) == cm(1,3);
+      petlib::Matrix<double> q;
+      q = m;
+      q(2,2) = 0.0;
+      ok = ok && m.use_count() == 1 && cm(2,2) != 0.0;
+   }
+   {
+      // fan out of a large matrix to many read only stages
+      const int nstages = 64;
+      auto ts = std::chrono::steady_clock::now();
+      std::vector< petlib::Matrix<double> > stages(nstages,m);
+      for (const auto& s : stages) ok = ok && s.norm() == cm.norm();
+      double tm = elapsed(ts);
+      ok = ok && m.use_count() == nstages + 1;
+      ts = std::chrono::steady_clock::now();
+      for (auto& s : stages) s(0,0) = 1.0;
+      double tw = elapsed(ts);
+      ok = ok && m.use_count() == 1;
+      std::cout << nstages << " copies of a " << n << "x" << n << " matrix, read "
+                << tm << " s, first writes " << tw << " s\n";
+   }
+   std::cout << (ok ? "cow test passed\n" : "cow test FAILED\n");
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
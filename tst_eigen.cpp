@@ -0,0 +1,213 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include "petlib.hpp"
+#include "petlib_eigen.hpp"
+
+double elapsed(const std::chrono::steady_clock::time_point& ts)
+{
+   std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+   return d.count();
+}
+
+// max |A z - w z| / |A| and max |Z'Z - I|
+template < class E >
+bool check(const char* name,const petlib::Matrix<double>& a,const E& eig)
+{
+   const size_t n = a.nrows(),k = eig.count();
+   const petlib::Matrix<double>& z = eig.vectors();
+   const petlib::Array<double>& w = eig.values();
+   double anorm = 0.0,res = 0.0,orth = 0.0;
+   for (size_t i=0;i<n;++i)
+      for (size_t j=0;j<n;++j) anorm = std::max(anorm,std::fabs(a(i,j)));
+   for (size_t j=0;j<k;++j) {
+      if (j > 0 && w[j] < w[j - 1]) return false;
+      for (size_t i=0;i<n;++i) {
+         double s = -w[j] * z(i,j);
+         for (size_t l=0;l<n;++l) s += a(i,l) * z(l,j);
+         res = std::max(res,std::fabs(s));
+      }
+      for (size_t l=0;l<=j;++l) {
+         double s = l == j ? -1.0 : 0.0;
+         for (size_t i=0;i<n;++i) s += z(i,j) * z(i,l);
+         orth = std::max(orth,std::fabs(s));
+      }
+   }
+   res /= anorm * double(n);
+   orth /= double(n);
+   std::cout << "  " << name << " n " << n << " k " << k << " residual " << res << " orthogonality " << orth << "\n";
+   return res < 1.e-14 && orth < 1.e-14;
+}
+
+// eigenvalues alone, by QL on the tridiagonal
+petlib::Array<double> reference_values(const petlib::Matrix<double>& m)
+{
+   const size_t n = m.nrows();
+   petlib::Matrix<double> a(m);
+   std::vector<double> d(n),e(n),tau(n);
+   petlib::eigen::tridiagonalize<double>(n,a.data(),d.data(),e.data(),tau.data());
+   petlib::eigen::tridiagonal_ql<double>(n,d.data(),e.data(),nullptr,0);
+   std::sort(d.begin(),d.end());
+   petlib::Array<double> w(n);
+   for (size_t i=0;i<n;++i) w[i] = d[i];
+   return w;
+}
+
+double max_diff(const petlib::Array<double>& x,const petlib::Array<double>& y,size_t n)
+{
+   double e = 0.0;
+   for (size_t i=0;i<n;++i) e = std::max(e,std::fabs(x[i] - y[i]));
+   return e;
+}
+
+petlib::Matrix<double> random_symmetric(size_t n,unsigned seed)
+{
+   std::mt19937_64 gen(seed);
+   std::uniform_real_distribution<double> u(-1.0,1.0);
+   petlib::Matrix<double> a(n,n);
+   for (size_t i=0;i<n;++i)
+      for (size_t j=0;j<=i;++j) a(i,j) = a(j,i) = u(gen);
+   return a;
+}
+
+int main()
+{
+   bool ok = true;
+   {
+      std::cout << "random symmetric\n";
+      for (size_t n : { 1,2,3,33,100,301 }) {
+         petlib::Matrix<double> a = random_symmetric(n,n);
+         petlib::Symmetric_eigen_decomposition<double> eig(a);
+         ok = ok && check("all",a,eig);
+         ok = ok && max_diff(eig.values(),reference_values(a),n) < 1.e-12;
+      }
+      // threads split rows and column strips, the bits do not change
+      petlib::Matrix<double> a = random_symmetric(301,7);
+      petlib::Symmetric_eigen_decomposition<double> e1(a),e3(a,0,3),l1(a,12),l3(a,12,3);
+      ok = ok && std::memcmp(e1.vectors().data(),e3.vectors().data(),301 * 301 * sizeof(double)) == 0;
+      ok = ok && std::memcmp(l1.vectors().data(),l3.vectors().data(),301 * 12 * sizeof(double)) == 0;
+      ok = ok && check("lowest",a,l3);
+      ok = ok && max_diff(l1.values(),e1.values(),12) < 1.e-13;
+   }
+   {
+      // the 1d Laplacian, eigenvalues 2 - 2 cos(k pi / (n + 1))
+      std::cout << "1d Laplacian\n";
+      const size_t n = 400;
+      petlib::Matrix<double> a(n,n);
+      a = 0.0;
+      for (size_t i=0;i<n;++i) {
+         a(i,i) = 2.0;
+         if (i + 1 < n) a(i,i + 1) = a(i + 1,i) = -1.0;
+      }
+      petlib::Symmetric_eigen_decomposition<double> eig(a),low(a,8);
+      ok = ok && check("all",a,eig) && check("lowest",a,low);
+      double e = 0.0;
+      for (size_t k=0;k<n;++k) e = std::max(e,std::fabs(eig.values()[k] - (2.0 - 2.0 * std::cos(double(k + 1) * M_PI / double(n + 1)))));
+      ok = ok && e < 1.e-13;
+   }
+   {
+      // three distinct eigenvalues, everything deflates and clusters
+      std::cout << "repeated eigenvalues\n";
+      const size_t n = 200;
+      petlib::Matrix<double> a(n,n);
+      a = 0.0;
+      for (size_t i=0;i<n;++i) a(i,i) = double(i % 3) - 1.0;
+      std::mt19937_64 gen(3);
+      std::uniform_real_distribution<double> u(-1.0,1.0);
+      petlib::Matrix<double> b(n,n);
+      for (int r=0;r<4;++r) {
+         // a = H a H with H = I - 2 v v' / v'v
+         std::vector<double> v(n),av(n);
+         double vv = 0.0;
+         for (size_t i=0;i<n;++i) {
+            v[i] = u(gen);
+            vv += v[i] * v[i];
+         }
+         const petlib::Matrix<double>& ca = a;
+         for (size_t i=0;i<n;++i) {
+            av[i] = 0.0;
+            for (size_t j=0;j<n;++j) av[i] += ca(i,j) * v[j];
+         }
+         double vav = 0.0;
+         for (size_t i=0;i<n;++i) vav += v[i] * av[i];
+         for (size_t i=0;i<n;++i)
+            for (size_t j=0;j<n;++j)
+               b(i,j) = ca(i,j) - 2.0 * (v[i] * av[j] + av[i] * v[j]) / vv + 4.0 * vav * v[i] * v[j] / (vv * vv);
+         a = b;
+         b = petlib::Matrix<double>(n,n);
+      }
+      petlib::Symmetric_eigen_decomposition<double> eig(a),low(a,80);
+      ok = ok && check("all",a,eig) && check("lowest",a,low);
+      double e = 0.0;
+      for (size_t k=0;k<n;++k) e = std::max(e,std::fabs(eig.values()[k] - (double(3 * k / n) - 1.0)));
+      ok = ok && e < 1.e-13;
+   }
+   {
+      // the zero matrix, |T| = 0 leaves only the floors of the tolerances
+      std::cout << "zero matrix\n";
+      const size_t n = 50,k = 10;
+      std::vector<double> d(n,0.0),e(n,0.0),w(k),z(n * k);
+      petlib::eigen::tridiagonal_lowest<double>(n,d.data(),e.data(),k,w.data(),z.data(),k);
+      double wmax = 0.0,orth = 0.0;
+      for (size_t i=0;i<n * k;++i) ok = ok && std::isfinite(z[i]);
+      for (size_t j=0;j<k;++j) {
+         wmax = std::max(wmax,std::fabs(w[j]));
+         for (size_t l=0;l<=j;++l) {
+            double s = l == j ? -1.0 : 0.0;
+            for (size_t i=0;i<n;++i) s += z[i * k + j] * z[i * k + l];
+            orth = std::max(orth,std::fabs(s));
+         }
+      }
+      std::cout << "  tridiagonal n " << n << " k " << k << " max |w| " << wmax << " orthogonality " << orth << "\n";
+      ok = ok && wmax <= std::numeric_limits<double>::min() && orth < 1.e-14;
+      petlib::Matrix<double> a(n,n);
+      a = 0.0;
+      petlib::Symmetric_eigen_decomposition<double> low(a,k);
+      ok = ok && low.count() == k && std::fabs(low.values()[0]) <= std::numeric_limits<double>::min();
+   }
+   {
+      // Wilkinson's W+, pairs of eigenvalues close to working precision
+      std::cout << "Wilkinson W+\n";
+      const size_t n = 201;
+      petlib::Matrix<double> a(n,n);
+      a = 0.0;
+      for (size_t i=0;i<n;++i) {
+         a(i,i) = std::fabs(double(i) - double(n / 2));
+         if (i + 1 < n) a(i,i + 1) = a(i + 1,i) = 1.0;
+      }
+      petlib::Symmetric_eigen_decomposition<double> eig(a),low(a,n - 1);
+      ok = ok && check("all",a,eig) && check("lowest",a,low);
+      ok = ok && max_diff(eig.values(),low.values(),n - 1) < 1.e-12;
+   }
+   {
+      std::cout << "seconds\n";
+      const size_t n = 1500;
+      petlib::Matrix<double> a = random_symmetric(n,11);
+      std::vector<double> d(n),e(n),tau(n);
+      auto ts = std::chrono::steady_clock::now();
+      {
+         petlib::Matrix<double> c(a);
+         petlib::eigen::tridiagonalize<double>(n,c.data(),d.data(),e.data(),tau.data(),1);
+      }
+      const double t1 = elapsed(ts);
+      ts = std::chrono::steady_clock::now();
+      {
+         petlib::Matrix<double> c(a);
+         petlib::eigen::tridiagonalize<double>(n,c.data(),d.data(),e.data(),tau.data());
+      }
+      const double t32 = elapsed(ts);
+      ts = std::chrono::steady_clock::now();
+      petlib::Symmetric_eigen_decomposition<double> eig(a);
+      const double tall = elapsed(ts);
+      ts = std::chrono::steady_clock::now();
+      petlib::Symmetric_eigen_decomposition<double> low(a,20);
+      const double tlow = elapsed(ts);
+      std::cout << "  n " << n << " tridiagonalize unblocked " << t1 << " blocked " << t32 << "\n";
+      std::cout << "  all eigenpairs " << tall << " lowest 20 " << tlow << "\n";
+      ok = ok && max_diff(eig.values(),low.values(),20) < 1.e-12;
+   }
+   std::cout << (ok ? "eigen test passed\n" : "eigen test FAILED\n");
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include "petlib.hpp"
+
+double elapsed(const std::chrono::steady_clock::time_point& ts)
+{
+   std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+   return d.count();
+}
+
+bool same_bits(const double* x,const double* y,size_t n) { return std::memcmp(x,y,n * sizeof(double)) == 0; }
+
+int main()
+{
+   bool ok = true;
+   {
+      // views take part in expressions on either side
+      petlib::Array<double> a(10),b(4);
+      for (size_t i=0;i<a.size();++i) a[i] = double(i);
+      petlib::Array<size_t> idx(4);
+      size_t is[] = { 7,2,2,9 };
+      std::copy(is,is + 4,idx.data());
+      b = a(idx) * 2.0 + 1.0;
+      const petlib::Array<double>& cb = b;
+      ok = ok && cb[0] == 15.0 && cb[1] == 5.0 && cb[2] == 5.0 && cb[3] == 19.0;
+      // += with a repeated index adds twice
+      a(idx) += b;
+      const petlib::Array<double>& ca = a;
+      ok = ok && ca[7] == 22.0 && ca[2] == 12.0 && ca[9] == 28.0 && ca[0] == 0.0;
+      a(idx) = 0.0;
+      ok = ok && ca[7] == 0.0 && ca[2] == 0.0 && ca[8] == 8.0;
+      ok = ok && petlib::sum(a(idx)) == 0.0 && petlib::sum(a(idx) + 1.0) == 4.0;
+      // indirect to indirect copies the elements
+      petlib::Array<int> jdx(4);
+      int js[] = { 0,1,3,4 };
+      // element by element, jdx.data() would pin it and the view would copy it
+      for (size_t i=0;i<4;++i) jdx[i] = js[i];
+      a(idx) = a(jdx);
+      ok = ok && ca[7] == 0.0 && ca[2] == 3.0 && ca[9] == 4.0;
+      // the index array stays shared, not copied
+      ok = ok && a(jdx).indices().data() == static_cast<const petlib::Array<int>&>(jdx).data();
+   }
+   {
+      petlib::Array<double> a(8);
+      petlib::Array<bool> m(8);
+      for (size_t i=0;i<a.size();++i) {
+         a[i] = double(i) - 3.5;
+         m[i] = a[i] < 0.0;
+      }
+      const petlib::Array<double>& ca = a;
+      petlib::Array<double> neg(a(m));
+      ok = ok && neg.size() == 4 && static_cast<const petlib::Array<double>&>(neg)[3] == -0.5;
+      a(m) *= -1.0;
+      ok = ok && ca.min() == 0.5 && ca[0] == 3.5;
+      petlib::SubArray<double> s(a.data() + 0,8);
+      s(m) = 1.0;
+      ok = ok && ca[3] == 1.0 && ca[4] == 0.5;
+   }
+   // an unstructured mesh scatter, each node gets the flux of its edges
+   const size_t nnode = 1 << 20,nedge = 6 * nnode;
+   std::mt19937_64 gen(99);
+   std::uniform_int_distribution<int> node(0,int(nnode) - 1);
+   petlib::Array<int> idx(nedge);
+   petlib::Array<double> x(nedge),y0(nnode),y1(nnode);
+   for (size_t e=0;e<nedge;++e) {
+      idx[e] = node(gen);
+      x[e] = std::ldexp(double(gen() % 1000000),-int(gen() % 30));
+   }
+   const petlib::Array<int>& cidx = idx;
+   const petlib::Array<double>& cx = x;
+   petlib::ScatterPlan<int> plan(idx);
+   std::cout << nedge << " entries on " << nnode << " nodes, " << plan.colours() << " colours\n";
+   y0 = 0.0;
+   petlib::scatter_add(y0.data(),cidx.data(),cx.data(),nedge);
+   // the same bits as the serial loop on any number of threads
+   for (unsigned nt : { 1u,2u,3u,8u }) {
+      y1 = 0.0;
+      petlib::scatter_add(y1,plan,x,nt);
+      ok = ok && same_bits(y0.data(),y1.data(),nnode);
+   }
+   y1 = 0.0;
+   y1(idx) += x;
+   ok = ok && same_bits(y0.data(),y1.data(),nnode);
+   y1 = 0.0;
+   y1(idx).add(plan,x,4);
+   ok = ok && same_bits(y0.data(),y1.data(),nnode);
+   // gathers with int and size_t indices
+   petlib::Array<size_t> lidx(nedge);
+   for (size_t e=0;e<nedge;++e) lidx[e] = size_t(cidx[e]);
+   petlib::Array<double> g(nedge);
+   const int nrep = 20;
+   auto ts = std::chrono::steady_clock::now();
+   for (int r=0;r<nrep;++r) y0(idx).gather(g.data());
+   double tint = elapsed(ts);
+   ts = std::chrono::steady_clock::now();
+   for (int r=0;r<nrep;++r) y0(lidx).gather(g.data());
+   double tlong = elapsed(ts);
+   std::cout << nrep << " gathers, seconds, int " << tint << " size_t " << tlong << "\n";
+   const double* pg = g.data();
+   for (size_t e=0;e<nedge;e+=101) ok = ok && pg[e] == static_cast<const petlib::Array<double>&>(y0)[cidx[e]];
+   ts = std::chrono::steady_clock::now();
+   for (int r=0;r<nrep;++r) petlib::scatter_add(y0.data(),cidx.data(),cx.data(),nedge);
+   double tser = elapsed(ts);
+   const unsigned nhw = std::max(1u,std::thread::hardware_concurrency());
+   ts = std::chrono::steady_clock::now();
+   for (int r=0;r<nrep;++r) plan.add(y1.data(),cx.data(),nhw);
+   double tplan = elapsed(ts);
+   std::cout << nrep << " scatter adds, seconds, serial " << tser << " plan on " << nhw << " threads " << tplan << "\n";
+   std::cout << (ok ? "indirect test passed\n" : "indirect test FAILED\n");
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,288 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include "petlib.hpp"
+#include "petlib_krylov.hpp"
+#include "petlib_sparse.hpp"
+
+double elapsed(const std::chrono::steady_clock::time_point& ts)
+{
+   std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+   return d.count();
+}
+
+// |b - A x| / |b| by the plain product
+template < class A >
+double true_residual(const A& a,const petlib::Array<double>& b,const petlib::Array<double>& x)
+{
+   petlib::Array<double> y(b.size());
+   a.multiply(x,y);
+   const petlib::Array<double>& cy = y;
+   double rr = 0.0,bb = 0.0;
+   for (size_t i=0;i<b.size();++i) {
+      rr += (b[i] - cy[i]) * (b[i] - cy[i]);
+      bb += b[i] * b[i];
+   }
+   return std::sqrt(rr / bb);
+}
+
+template < class A >
+bool report(const char* name,const petlib::KrylovResult& r,const A& a,const petlib::Array<double>& b,
+            const petlib::Array<double>& x,double tol)
+{
+   const double tres = true_residual(a,b,x);
+   std::cout << "  " << name << " " << r.iterations << " iterations, residual " << r.residual << " check " << tres << "\n";
+   return r.converged && r.residual <= tol && tres <= 1.01 * tol && std::fabs(tres - r.residual) <= 1.e-3 * tol;
+}
+
+// the textbook CG, three sweeps and two reductions per iteration
+template < class A >
+size_t plain_cg(const A& a,const petlib::Array<double>& b,petlib::Array<double>& x,double tol)
+{
+   const size_t n = b.size();
+   petlib::Array<double> r(n),p(n),q(n);
+   const double* pb = b.data();
+   double* px = x.data();
+   double* pr = r.data();
+   double* pp = p.data();
+   double* pq = q.data();
+   double bb = 0.0,rr = 0.0;
+   for (size_t i=0;i<n;++i) {
+      px[i] = 0.0;
+      pr[i] = pp[i] = pb[i];
+      bb += pb[i] * pb[i];
+   }
+   rr = bb;
+   size_t it = 0;
+   while (rr > tol * tol * bb) {
+      a.multiply(p,q);
+      double pq2 = 0.0;
+      for (size_t i=0;i<n;++i) pq2 += pp[i] * pq[i];
+      const double alpha = rr / pq2;
+      double rr1 = 0.0;
+      for (size_t i=0;i<n;++i) {
+         px[i] += alpha * pp[i];
+         pr[i] -= alpha * pq[i];
+         rr1 += pr[i] * pr[i];
+      }
+      const double beta = rr1 / rr;
+      rr = rr1;
+      for (size_t i=0;i<n;++i) pp[i] = pr[i] + beta * pp[i];
+      ++it;
+   }
+   return it;
+}
+
+int main()
+{
+   bool ok = true;
+   {
+      // the factorization the block preconditioner is built on
+      const size_t n = 50;
+      petlib::Matrix<double> g(n,n),a(n,n);
+      petlib::randomFill<double>(g.data(),g.size());
+      const petlib::Matrix<double>& cg = g;
+      for (size_t i=0;i<n;++i)
+         for (size_t j=0;j<n;++j) {
+            double s = i == j ? double(n) : 0.0;
+            for (size_t k=0;k<n;++k) s += cg(i,k) * cg(j,k);
+            a(i,j) = s;
+         }
+      const petlib::Matrix<double>& ca = a;
+      petlib::Cholesky_decomposition<double> ch(a);
+      petlib::Matrix<double> l = ch.L();
+      const petlib::Matrix<double>& cl = l;
+      double e = 0.0;
+      for (size_t i=0;i<n;++i)
+         for (size_t j=0;j<n;++j) {
+            double s = 0.0;
+            for (size_t k=0;k<n;++k) s += cl(i,k) * cl(j,k);
+            e = std::max(e,std::fabs(s - ca(i,j)) / ca(i,i));
+         }
+      petlib::Array<double> b(n);
+      for (size_t i=0;i<n;++i) b[i] = double(i % 7) - 3.0;
+      petlib::Array<double> x = ch.solve(b);
+      petlib::Matrix<double> bm(n,2);
+      for (size_t i=0;i<n;++i) bm(i,0) = bm(i,1) = static_cast<const petlib::Array<double>&>(b)[i];
+      petlib::Matrix<double> xm = ch.matrix_solve(bm);
+      const petlib::Matrix<double>& cxm = xm;
+      const petlib::Array<double>& cx = x;
+      for (size_t i=0;i<n;++i) {
+         double s = 0.0;
+         for (size_t j=0;j<n;++j) s += ca(i,j) * cx[j];
+         e = std::max(e,std::fabs(s - b[i]));
+         e = std::max(e,std::fabs(cxm(i,0) - cx[i]) + std::fabs(cxm(i,1) - cx[i]));
+      }
+      ok = ok && e < 1.e-12;
+   }
+   const double tol = 1.e-10;
+   petlib::KrylovOptions opt;
+   opt.tol = tol;
+   opt.max_iter = 5000;
+   {
+      // 2d Poisson in every form the solvers take
+      const size_t nx = 64;
+      petlib::CsrMatrix<double> a(petlib::poisson<double>(nx,nx));
+      petlib::CscMatrix<double> c(petlib::poisson<double>(nx,nx));
+      petlib::BsrMatrix<double,2> bs(petlib::poisson<double>(nx,nx,1,2));
+      const size_t n = a.nrows();
+      petlib::Array<double> b(n),x(n),b2(2 * n),x2(2 * n);
+      for (size_t i=0;i<n;++i) b[i] = std::sin(0.01 * double(i)) + 1.0;
+      for (size_t i=0;i<2 * n;++i) b2[i] = std::cos(0.01 * double(i));
+      std::cout << "2d Poisson, " << n << " unknowns\n";
+      x = 0.0;
+      {
+         petlib::KrylovResult r = petlib::cg(a,b,x,opt);
+         ok = ok && report("cg csr",r,a,b,x,tol);
+      }
+      petlib::Array<double> x1(x);
+      // the same bits on more threads, the sweeps are blocked
+      x = 0.0;
+      petlib::KrylovOptions opt3 = opt;
+      opt3.nthreads = 3;
+      opt3.cg = petlib::CgMethod::Classic;
+      petlib::cg(a,b,x,opt3);
+      ok = ok && std::memcmp(static_cast<const petlib::Array<double>&>(x).data(),
+                             static_cast<const petlib::Array<double>&>(x1).data(),n * sizeof(double)) == 0;
+      x = 0.0;
+      {
+         petlib::KrylovOptions o = opt;
+         o.cg = petlib::CgMethod::Pipelined;
+         petlib::KrylovResult r = petlib::cg(a,b,x,o);
+         ok = ok && report("pipelined cg csr",r,a,b,x,tol);
+      }
+      x1 = x;
+      x = 0.0;
+      opt3.cg = petlib::CgMethod::Auto;
+      petlib::cg(a,b,x,opt3);
+      ok = ok && std::memcmp(static_cast<const petlib::Array<double>&>(x).data(),
+                             static_cast<const petlib::Array<double>&>(x1).data(),n * sizeof(double)) == 0;
+      x = 0.0;
+      {
+         petlib::KrylovResult r = petlib::pcg(a,petlib::Jacobi<double>(a),b,x,opt);
+         ok = ok && report("pcg jacobi",r,a,b,x,tol);
+      }
+      x = 0.0;
+      {
+         petlib::KrylovOptions o = opt;
+         o.cg = petlib::CgMethod::Pipelined;
+         petlib::KrylovResult r = petlib::pcg(a,petlib::Jacobi<double>(a),b,x,o);
+         ok = ok && report("pipelined pcg jacobi",r,a,b,x,tol);
+      }
+      x2 = 0.0;
+      {
+         petlib::KrylovResult r = petlib::pcg(bs,petlib::BlockJacobi<double>(bs,2),b2,x2,opt);
+         ok = ok && report("pcg bsr block jacobi",r,bs,b2,x2,tol);
+      }
+      x = 0.0;
+      {
+         petlib::KrylovResult r = petlib::bicgstab(c,b,x,opt);
+         ok = ok && report("bicgstab csc",r,c,b,x,tol);
+      }
+      x = 0.0;
+      {
+         petlib::KrylovOptions o = opt;
+         o.restart = 40;
+         petlib::KrylovResult r = petlib::gmres(a,petlib::BlockJacobi<double>(a,8),b,x,o);
+         ok = ok && report("gmres(40) block jacobi",r,a,b,x,tol);
+      }
+      // a user lambda
+      auto op = [&](const petlib::Array<double>& u,petlib::Array<double>& v) { a.multiply(u,v); };
+      x = 0.0;
+      {
+         petlib::KrylovResult r = petlib::cg(op,b,x,opt);
+         ok = ok && report("cg lambda",r,a,b,x,tol);
+      }
+   }
+   {
+      // convection makes it unsymmetric, repeated triplets are summed
+      const size_t nx = 48;
+      petlib::CooMatrix<double> coo = petlib::poisson<double>(nx,nx);
+      for (size_t p=0;p + 1<nx * nx;++p) coo.add(p,p + 1,0.4);
+      petlib::CsrMatrix<double> a(coo);
+      const size_t n = a.nrows();
+      petlib::Array<double> b(n),x(n);
+      for (size_t i=0;i<n;++i) b[i] = 1.0 / (1.0 + double(i % 13));
+      std::cout << "2d convection diffusion, " << n << " unknowns\n";
+      x = 0.0;
+      {
+         petlib::KrylovResult r = petlib::bicgstab(a,b,x,opt);
+         ok = ok && report("bicgstab",r,a,b,x,tol);
+      }
+      x = 0.0;
+      {
+         petlib::KrylovResult r = petlib::bicgstab(a,petlib::Jacobi<double>(a),b,x,opt);
+         ok = ok && report("bicgstab jacobi",r,a,b,x,tol);
+      }
+      x = 0.0;
+      {
+         petlib::KrylovResult r = petlib::gmres(a,b,x,opt);
+         ok = ok && report("gmres(30)",r,a,b,x,tol);
+      }
+      x = 0.0;
+      {
+         petlib::KrylovResult r = petlib::gmres(a,petlib::Jacobi<double>(a),b,x,opt);
+         ok = ok && report("gmres(30) jacobi",r,a,b,x,tol);
+      }
+   }
+   {
+      // a dense matrix
+      const size_t n = 200;
+      petlib::Matrix<double> a(n,n);
+      petlib::randomFill<double>(a.data(),a.size());
+      const petlib::Matrix<double>& ca = a;
+      petlib::Matrix<double> s(n,n);
+      for (size_t i=0;i<n;++i)
+         for (size_t j=0;j<n;++j) s(i,j) = 0.5 * (ca(i,j) + ca(j,i)) + (i == j ? 2.0 * std::sqrt(double(n)) : 0.0);
+      const petlib::Matrix<double>& cs = s;
+      petlib::Array<double> b(n),x(n),y(n);
+      for (size_t i=0;i<n;++i) b[i] = 1.0;
+      x = 0.0;
+      petlib::KrylovResult r = petlib::cg(cs,b,x,opt);
+      const petlib::Array<double>& cx = x;
+      double e = 0.0;
+      for (size_t i=0;i<n;++i) {
+         double t = 0.0;
+         for (size_t j=0;j<n;++j) t += cs(i,j) * cx[j];
+         e = std::max(e,std::fabs(t - 1.0));
+      }
+      std::cout << "dense spd " << n << ", cg " << r.iterations << " iterations, max error " << e << "\n";
+      ok = ok && r.converged && e < 1.e-8;
+      x = 0.0;
+      r = petlib::gmres(cs,petlib::BlockJacobi<double>(cs,20),b,x,opt);
+      ok = ok && r.converged;
+   }
+   {
+      // the classic recurrence against the textbook loop and the
+      // pipelined one, on a single thread
+      const size_t nx = 60;
+      petlib::CsrMatrix<double> a(petlib::poisson<double>(nx,nx,nx));
+      const size_t n = a.nrows();
+      petlib::Array<double> b(n),x(n);
+      for (size_t i=0;i<n;++i) b[i] = 1.0;
+      auto ts = std::chrono::steady_clock::now();
+      size_t it0 = plain_cg(a,b,x,1.e-8);
+      double t0 = elapsed(ts);
+      x = 0.0;
+      petlib::KrylovOptions o;
+      o.tol = 1.e-8;
+      ts = std::chrono::steady_clock::now();
+      petlib::KrylovResult r = petlib::cg(a,b,x,o);
+      double t1 = elapsed(ts);
+      ok = ok && r.converged;
+      x = 0.0;
+      o.cg = petlib::CgMethod::Pipelined;
+      ts = std::chrono::steady_clock::now();
+      petlib::KrylovResult r2 = petlib::cg(a,b,x,o);
+      double t2 = elapsed(ts);
+      std::cout << "3d Poisson, " << n << " unknowns, seconds per iteration\n";
+      std::cout << "  textbook cg " << t0 / double(it0) << " (" << it0 << ") cg "
+                << t1 / double(r.iterations) << " (" << r.iterations << ") pipelined cg "
+                << t2 / double(r2.iterations) << " (" << r2.iterations << ")\n";
+      ok = ok && r2.converged;
+   }
+   std::cout << (ok ? "krylov test passed\n" : "krylov test FAILED\n");
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
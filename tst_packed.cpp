@@ -0,0 +1,185 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include "petlib.hpp"
+#include "petlib_chol.hpp"
+#include "petlib_krylov.hpp"
+#include "petlib_packed.hpp"
+
+double elapsed(const std::chrono::steady_clock::time_point& ts)
+{
+   std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+   return d.count();
+}
+
+// G G' + n I
+petlib::Matrix<double> random_spd(size_t n,unsigned seed)
+{
+   std::mt19937_64 gen(seed);
+   std::uniform_real_distribution<double> u(-1.0,1.0);
+   std::vector<double> g(n * n);
+   for (double& x : g) x = u(gen);
+   petlib::Matrix<double> a(n,n);
+   for (size_t i=0;i<n;++i)
+      for (size_t j=0;j<=i;++j) {
+         double s = i == j ? double(n) : 0.0;
+         for (size_t k=0;k<n;++k) s += g[i * n + k] * g[j * n + k];
+         a(i,j) = a(j,i) = s;
+      }
+   return a;
+}
+
+template < class M >
+double max_diff(const M& s,const petlib::Matrix<double>& a)
+{
+   double e = 0.0;
+   for (size_t i=0;i<a.nrows();++i)
+      for (size_t j=0;j<a.ncols();++j) e = std::max(e,std::fabs(s(i,j) - a(i,j)));
+   return e;
+}
+
+template < class Layout >
+bool check(size_t n)
+{
+   typedef petlib::SymmetricMatrix<double,Layout> sym_t;
+   bool ok = true;
+   const petlib::Matrix<double> a = random_spd(n,unsigned(n));
+   sym_t s(a);
+   ok = ok && max_diff(s,a) == 0.0 && max_diff(s.full(),a) == 0.0;
+   ok = ok && s.bytes() == n * (n + 1) / 2 * sizeof(double) && s.size() == n * n;
+   // expressions read the whole matrix and write the lower triangle
+   sym_t t(s + s * s);
+   petlib::Matrix<double> f(n,n);
+   f = a + a * a;
+   ok = ok && max_diff(t,f) == 0.0;
+   t = s * 2.0;
+   t -= s;
+   t *= 4.0;
+   t /= 4.0;
+   ok = ok && max_diff(t,a) == 0.0;
+   // a copy shares until written
+   sym_t c(s);
+   c(0,n - 1) = -1.0;
+   ok = ok && s(n - 1,0) == a(n - 1,0) && c(n - 1,0) == -1.0;
+
+   petlib::Array<double> x(n),y(n),y3(n);
+   for (size_t i=0;i<n;++i) x[i] = std::sin(double(i) + 0.5);
+   const petlib::Array<double>& cx = x;
+   s.multiply(x,y);
+   s.multiply(x,y3,3);
+   const petlib::Array<double>& cy = y;
+   double e = 0.0,ymax = 0.0;
+   for (size_t i=0;i<n;++i) {
+      double r = 0.0;
+      for (size_t j=0;j<n;++j) r += a(i,j) * cx[j];
+      e = std::max(e,std::fabs(r - cy[i]));
+      ymax = std::max(ymax,std::fabs(r));
+   }
+   ok = ok && e <= 1.e-14 * ymax;
+   ok = ok && std::memcmp(cy.data(),static_cast<const petlib::Array<double>&>(y3).data(),n * sizeof(double)) == 0;
+
+   // L L' = A and the solves
+   petlib::TriangularMatrix<double,Layout> l = petlib::cholesky(s);
+   const petlib::Matrix<double> lf = l.full();
+   e = 0.0;
+   for (size_t i=0;i<n;++i)
+      for (size_t j=0;j<n;++j) {
+         double r = 0.0;
+         for (size_t k=0;k<n;++k) r += lf(i,k) * lf(j,k);
+         e = std::max(e,std::fabs(r - a(i,j)) / a(i,i));
+      }
+   ok = ok && e < 1.e-14;
+   petlib::Array<double> z(y);
+   l.solve(z);
+   l.solve_transpose(z);
+   const petlib::Array<double>& cz = z;
+   e = 0.0;
+   for (size_t i=0;i<n;++i) e = std::max(e,std::fabs(cz[i] - cx[i]));
+   ok = ok && e < 1.e-12;
+   petlib::Matrix<double> b(n,3);
+   for (size_t i=0;i<n;++i)
+      for (size_t j=0;j<3;++j) b(i,j) = double(j + 1) * cy[i];
+   l.solve(b);
+   l.solve_transpose(b);
+   const petlib::Matrix<double>& cb = b;
+   e = 0.0;
+   for (size_t i=0;i<n;++i)
+      for (size_t j=0;j<3;++j) e = std::max(e,std::fabs(cb(i,j) - double(j + 1) * cx[i]));
+   ok = ok && e < 1.e-11;
+   std::cout << "  n " << n << (ok ? " ok\n" : " FAILED\n");
+   return ok;
+}
+
+int main()
+{
+   bool ok = true;
+   std::cout << "packed\n";
+   for (size_t n : { 1,2,5,8,33,100 }) ok = ok && check<petlib::PackedLayout>(n);
+   std::cout << "rectangular full packed\n";
+   for (size_t n : { 1,2,3,8,33,100 }) ok = ok && check<petlib::RfpLayout>(n);
+   {
+      // the factor of the full matrix in packed form, and a Krylov operator
+      const size_t n = 60;
+      const petlib::Matrix<double> a = random_spd(n,5);
+      petlib::Cholesky_decomposition<double> ch(a);
+      petlib::TriangularMatrix<double> l = ch.lower();
+      ok = ok && max_diff(l,ch.L()) == 0.0;
+      petlib::SymmetricMatrix<double,petlib::RfpLayout> s(a);
+      petlib::Array<double> b(n),x(n);
+      b = 1.0;
+      x = 0.0;
+      petlib::KrylovOptions opt;
+      opt.tol = 1.e-12;
+      petlib::KrylovResult r = petlib::cg(s,b,x,opt);
+      ok = ok && r.converged;
+   }
+   {
+      std::cout << "seconds\n";
+      const size_t n = 2000;
+      std::mt19937_64 gen(1);
+      std::uniform_real_distribution<double> u(-1.0,1.0);
+      petlib::Matrix<double> a(n,n);
+      for (size_t i=0;i<n;++i)
+         for (size_t j=0;j<=i;++j) a(i,j) = a(j,i) = u(gen) + (i == j ? 2.0 * double(n) : 0.0);
+      petlib::SymmetricMatrix<double> p(a);
+      petlib::SymmetricMatrix<double,petlib::RfpLayout> q(a);
+      petlib::Array<double> x(n),y(n);
+      x = 1.0;
+      const petlib::Matrix<double>& ca = a;
+      const int reps = 20;
+      auto ts = std::chrono::steady_clock::now();
+      for (int r=0;r<reps;++r) {
+         double* py = y.data();
+         const double* px = static_cast<const petlib::Array<double>&>(x).data();
+         const double* pa = ca.data();
+         for (size_t i=0;i<n;++i) {
+            double s = 0.0;
+            for (size_t j=0;j<n;++j) s += pa[i * n + j] * px[j];
+            py[i] = s;
+         }
+      }
+      const double tf = elapsed(ts) / reps;
+      ts = std::chrono::steady_clock::now();
+      for (int r=0;r<reps;++r) p.multiply(x,y);
+      const double tp = elapsed(ts) / reps;
+      ts = std::chrono::steady_clock::now();
+      for (int r=0;r<reps;++r) q.multiply(x,y);
+      const double tq = elapsed(ts) / reps;
+      std::cout << "  n " << n << " gemv full " << tf << " symv packed " << tp << " rfp " << tq << "\n";
+      ts = std::chrono::steady_clock::now();
+      petlib::Cholesky_decomposition<double> ch(a);
+      const double cf = elapsed(ts);
+      ts = std::chrono::steady_clock::now();
+      petlib::TriangularMatrix<double> lp = petlib::cholesky(std::move(p));
+      const double cp = elapsed(ts);
+      ts = std::chrono::steady_clock::now();
+      petlib::TriangularMatrix<double,petlib::RfpLayout> lq = petlib::cholesky(std::move(q));
+      const double cq = elapsed(ts);
+      std::cout << "  cholesky full " << cf << " packed " << cp << " rfp " << cq << "\n";
+      ok = ok && max_diff(lq,ch.L()) < 1.e-12 && max_diff(lp,ch.L()) < 1.e-12;
+   }
+   std::cout << (ok ? "packed test passed\n" : "packed test FAILED\n");
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,160 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include "petlib.hpp"
+#include "petlib_sparse.hpp"
+
+double elapsed(const std::chrono::steady_clock::time_point& ts)
+{
+   std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+   return d.count();
+}
+
+bool same_bits(const double* x,const double* y,size_t n) { return std::memcmp(x,y,n * sizeof(double)) == 0; }
+
+double max_diff(const petlib::Array<double>& x,const petlib::Array<double>& y)
+{
+   double e = 0.0;
+   for (size_t i=0;i<x.size();++i) e = std::max(e,std::fabs(x[i] - y[i]));
+   return e;
+}
+
+// seconds per call of f, best of a few rounds
+template < class F >
+double best_time(F f,int nrep)
+{
+   double t = 1.e300;
+   for (int r=0;r<3;++r) {
+      auto ts = std::chrono::steady_clock::now();
+      for (int k=0;k<nrep;++k) f();
+      t = std::min(t,elapsed(ts) / nrep);
+   }
+   return t;
+}
+
+int main()
+{
+   bool ok = true;
+   {
+      // unsorted triplets with repeats against a dense copy
+      const size_t n1 = 37,n2 = 29;
+      std::mt19937_64 gen(5);
+      petlib::CooMatrix<double> coo(n1,n2);
+      petlib::Matrix<double> d(n1,n2);
+      d = 0.0;
+      for (int k=0;k<300;++k) {
+         size_t i = gen() % n1,j = gen() % n2;
+         double v = double(gen() % 100) - 50.0;
+         coo.add(i,j,v);
+         d(i,j) += v;
+      }
+      const petlib::Matrix<double>& cd = d;
+      petlib::CsrMatrix<double> a(coo,3);
+      petlib::CscMatrix<double> c(coo);
+      bool same = true;
+      for (size_t i=0;i<n1;++i)
+         for (size_t j=0;j<n2;++j) same = same && a(i,j) == cd(i,j) && c(i,j) == cd(i,j);
+      for (size_t i=0;i<n1;++i)
+         for (size_t k=a.row_ptr()[i] + 1;k<a.row_ptr()[i + 1];++k) same = same && a.col_index()[k - 1] < a.col_index()[k];
+      ok = ok && same && a.nnz() == c.nnz();
+      petlib::Array<double> x(n2),y(n1),yd(n1),u(n1),v(n2),vd(n2);
+      for (size_t j=0;j<n2;++j) x[j] = double(j) - 3.0;
+      for (size_t i=0;i<n1;++i) u[i] = 1.0 + double(i % 5);
+      for (size_t i=0;i<n1;++i) {
+         yd[i] = 0.0;
+         for (size_t j=0;j<n2;++j) yd[i] += cd(i,j) * static_cast<const petlib::Array<double>&>(x)[j];
+      }
+      for (size_t j=0;j<n2;++j) {
+         vd[j] = 0.0;
+         for (size_t i=0;i<n1;++i) vd[j] += cd(i,j) * static_cast<const petlib::Array<double>&>(u)[i];
+      }
+      a.multiply(x,y);
+      ok = ok && max_diff(y,yd) == 0.0;
+      c.multiply(x,y);
+      ok = ok && max_diff(y,yd) == 0.0;
+      a.multiply_transpose(u,v);
+      ok = ok && max_diff(v,vd) == 0.0;
+      c.multiply_transpose(u,v);
+      ok = ok && max_diff(v,vd) == 0.0;
+      a.transpose().multiply(u,v);
+      ok = ok && max_diff(v,vd) == 0.0;
+   }
+   // a 3d Poisson matrix in all three forms, dof 2 for the blocks
+   const size_t nx = 40;
+   petlib::CooMatrix<double> coo = petlib::poisson<double>(nx,nx,nx,2);
+   petlib::CsrMatrix<double> a(coo,4);
+   ok = ok && a.nnz() == coo.nnz();
+   petlib::CscMatrix<double> c(coo,2);
+   petlib::BsrMatrix<double,2> b(coo);
+   const size_t n = a.nrows();
+   petlib::Array<double> x(n),y(n),z(n);
+   petlib::randomFill<double>(x.data(),x.size());
+   a.multiply(x,y);
+   for (unsigned nt : { 2u,3u,8u }) {
+      a.multiply(x,z,nt);
+      ok = ok && same_bits(y.data(),z.data(),n);
+   }
+   c.multiply(x,z,3);
+   ok = ok && max_diff(y,z) < 1.e-13;
+   b.multiply(x,z,3);
+   ok = ok && max_diff(y,z) < 1.e-13;
+   a.multiply_transpose(x,z,3);
+   ok = ok && max_diff(y,z) < 1.e-13;
+   b.multiply_transpose(x,z,2);
+   ok = ok && max_diff(y,z) < 1.e-13;
+   {
+      // SpMM against one column at a time
+      const size_t m = 5;
+      petlib::Matrix<double> xm(n,m),ym(n,m),yb(n,m);
+      petlib::randomFill<double>(xm.data(),xm.size());
+      a.multiply(xm,ym,3);
+      b.multiply(xm,yb,2);
+      const petlib::Matrix<double>& cxm = xm;
+      const petlib::Matrix<double>& cym = ym;
+      const petlib::Matrix<double>& cyb = yb;
+      double e = 0.0;
+      for (size_t j=0;j<m;++j) {
+         for (size_t i=0;i<n;++i) x[i] = cxm(i,j);
+         a.multiply(x,y);
+         for (size_t i=0;i<n;++i) {
+            e = std::max(e,std::fabs(cym(i,j) - static_cast<const petlib::Array<double>&>(y)[i]));
+            e = std::max(e,std::fabs(cyb(i,j) - static_cast<const petlib::Array<double>&>(y)[i]));
+         }
+      }
+      ok = ok && e < 1.e-13;
+   }
+   // bandwidth of a triad on arrays as large as the matrix
+   const size_t nb = 1 << 24;
+   std::vector<double> ta(nb,1.0),tb(nb,2.0),tc(nb,3.0);
+   double* pa = ta.data();
+   const double* pb = tb.data();
+   const double* pc = tc.data();
+   double ttriad = best_time([&]() {
+      for (size_t i=0;i<nb;++i) pa[i] = pb[i] + 0.5 * pc[i];
+      asm volatile("" ::: "memory");
+   },4);
+   const double bw = 3.0 * nb * sizeof(double) / ttriad * 1.e-9;
+   std::cout << "triad " << bw << " GB/s\n";
+   const size_t np = 120;
+   petlib::CsrMatrix<double> p1(petlib::poisson<double>(np,np,np));
+   petlib::CsrMatrix<double,long> p2(petlib::poisson<double,long>(np,np,np));
+   petlib::BsrMatrix<double,3> p3(petlib::poisson<double>(np / 2,np / 2,np / 2,3));
+   petlib::Array<double> x1(p1.nrows()),y1(p1.nrows()),x3(p3.nrows()),y3(p3.nrows());
+   petlib::randomFill<double>(x1.data(),x1.size());
+   petlib::randomFill<double>(x3.data(),x3.size());
+   struct { const char* name; double bytes,sec; } tab[] = {
+      { "csr int",      double(p1.bytes()),best_time([&]() { p1.multiply(x1,y1);},10) },
+      { "csr long",     double(p2.bytes()),best_time([&]() { p2.multiply(x1,y1);},10) },
+      { "csr transpose",double(p1.bytes()),best_time([&]() { p1.multiply_transpose(x1,y1);},10) },
+      { "bsr 3x3",      double(p3.bytes()),best_time([&]() { p3.multiply(x3,y3);},10) },
+   };
+   std::cout << "SpMV on 3d Poisson, " << p1.nrows() << " rows, " << p1.nnz() << " nonzeros\n";
+   for (auto& t : tab) {
+      const double gbs = t.bytes / t.sec * 1.e-9;
+      std::cout << "  " << t.name << " " << t.sec << " s " << gbs << " GB/s " << 100.0 * gbs / bw << " % of triad\n";
+   }
+   std::cout << (ok ? "sparse test passed\n" : "sparse test FAILED\n");
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
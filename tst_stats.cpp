@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include "petlib.hpp"
+
+double elapsed(const std::chrono::steady_clock::time_point& ts)
+{
+   std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+   return d.count();
+}
+
+bool same_bits(double x,double y) { return std::memcmp(&x,&y,sizeof(x)) == 0; }
+
+bool abs_less(double x,double y) { return std::fabs(x) < std::fabs(y); }
+
+// every field against the std::min_element and std::max_element answers
+template < class S >
+bool check(const S& s,const double* x,size_t n)
+{
+   const double* b = x;
+   const double* e = x + n;
+   bool ok = s.count == n;
+   ok = ok && s.min == *std::min_element(b,e) && s.index_min == size_t(std::min_element(b,e) - b);
+   ok = ok && s.max == *std::max_element(b,e) && s.index_max == size_t(std::max_element(b,e) - b);
+   ok = ok && s.amin == *std::min_element(b,e,abs_less) && s.index_amin == size_t(std::min_element(b,e,abs_less) - b);
+   ok = ok && s.amax == *std::max_element(b,e,abs_less) && s.index_amax == size_t(std::max_element(b,e,abs_less) - b);
+   long double sum = 0.0L,sq = 0.0L;
+   for (size_t i=0;i<n;++i) {
+      sum += x[i];
+      sq += (long double)x[i] * x[i];
+   }
+   ok = ok && std::fabs(s.sum - double(sum)) <= 1.e-10 * double(sq + 1.0L);
+   ok = ok && std::fabs(s.norm() - double(std::sqrt(sq))) <= 1.e-12 * double(std::sqrt(sq));
+   return ok;
+}
+
+template < class S >
+bool same_stats(const S& s,const S& t)
+{
+   return s.count == t.count && s.min == t.min && s.max == t.max && s.amin == t.amin && s.amax == t.amax &&
+      s.index_min == t.index_min && s.index_max == t.index_max && s.index_amin == t.index_amin &&
+      s.index_amax == t.index_amax && same_bits(s.sum,t.sum) && same_bits(s.sumsq,t.sumsq);
+}
+
+int main()
+{
+   bool ok = true;
+   const size_t n = 10000019;
+   std::mt19937_64 gen(4321);
+   // few distinct values so that every statistic has many ties
+   std::uniform_int_distribution<int> u(-1000,1000);
+   petlib::Array<double> a(n),b(n);
+   double* pa = a.data();
+   double* pb = b.data();
+   for (size_t i=0;i<n;++i) {
+      pa[i] = u(gen) * 0.25;
+      pb[i] = u(gen) * 0.5;
+   }
+   const petlib::Array<double>& ca = a;
+   const petlib::Array<double>& cb = b;
+   petlib::Stats<double> s = ca.stats();
+   ok = ok && check(s,pa,n);
+   // the same answer, to the bit, on any number of threads
+   for (unsigned nt : { 2u,3u,8u }) ok = ok && same_stats(s,ca.stats(nt));
+   ok = ok && same_stats(s,petlib::stats(ca,4));
+   // a subset only fills in its own fields
+   petlib::Stats<double> m = ca.stats<petlib::Stat::max | petlib::Stat::index_max>(2);
+   ok = ok && m.max == s.max && m.index_max == s.index_max && m.sum == 0.0;
+   // short arrays take the tail loop only
+   for (size_t len : { size_t(1),size_t(3),size_t(5),size_t(4099) }) {
+      petlib::SubArray<double> sub(pa + 7,len);
+      const petlib::SubArray<double>& cs = sub;
+      ok = ok && check(cs.stats(),pa + 7,len) && same_stats(cs.stats(),cs.stats(3));
+   }
+   ok = ok && ca.stats().index_amax == ca.index_amax() && ca.stats().index_min == ca.index_min();
+   {
+      // a strided slice, checked against a packed copy
+      const size_t stride = 3,len = n / stride;
+      petlib::SliceArray<double> sl(pa + 1,len,stride);
+      std::vector<double> v(len);
+      for (size_t i=0;i<len;++i) v[i] = pa[1 + i * stride];
+      const petlib::SliceArray<double>& csl = sl;
+      ok = ok && check(csl.stats(2),v.data(),len);
+   }
+   {
+      // an expression, no temporary
+      petlib::Stats<double> x = petlib::stats(ca * cb - 2.0,3);
+      petlib::Array<double> c(ca * cb - 2.0);
+      ok = ok && check(x,c.data(),n);
+      petlib::Array<int> k(1001);
+      for (size_t i=0;i<k.size();++i) k[i] = int(i) - 700;
+      const petlib::Array<int>& ck = k;
+      petlib::Stats<int> ks = ck.stats();
+      ok = ok && ks.min == -700 && ks.max == 300 && ks.amin == 0 && ks.amax == -700 && ks.sum == -200200;
+      ok = ok && ks.index_amin == 700 && ks.index_amax == 0;
+   }
+   // one fused sweep against the six separate passes it replaces
+   double t = 0.0;
+   for (size_t len : { n,size_t(16384) }) {
+      const int nrep = int(100000000 / len);
+      petlib::SubArray<double> sub(pa,len);
+      const petlib::SubArray<double>& cs = sub;
+      auto ts = std::chrono::steady_clock::now();
+      for (int r=0;r<nrep;++r) {
+         t += cs.max() + cs.min() + cs.amax() + cs.amin() + cs.sum() + std::sqrt(cs.dotProduct(cs));
+         t += double(cs.index_max() + cs.index_min() + cs.index_amax() + cs.index_amin());
+      }
+      double tsep = elapsed(ts);
+      ts = std::chrono::steady_clock::now();
+      for (int r=0;r<nrep;++r) {
+         petlib::Stats<double> st = cs.stats();
+         t += st.max + st.min + st.amax + st.amin + st.sum + st.norm();
+         t += double(st.index_max + st.index_min + st.index_amax + st.index_amin);
+      }
+      double tfused = elapsed(ts);
+      std::cout << nrep << " sweeps of " << len << " doubles, seconds\n";
+      std::cout << "  separate " << tsep << " fused " << tfused << "\n";
+   }
+   ok = ok && t != 0.0;
+   std::cout << (ok ? "stats test passed\n" : "stats test FAILED\n");
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include "petlib.hpp"
+
+double elapsed(const std::chrono::steady_clock::time_point& ts)
+{
+   std::chrono::duration<double> d = std::chrono::steady_clock::now() - ts;
+   return d.count();
+}
+
+bool same_bits(double x,double y) { return std::memcmp(&x,&y,sizeof(x)) == 0; }
+
+const petlib::SumMode modes[] = { petlib::SumMode::Fast,petlib::SumMode::Pairwise,
+   petlib::SumMode::Compensated,petlib::SumMode::Binned };
+const char* names[] = { "fast","pairwise","compensated","binned" };
+
+int main()
+{
+   bool ok = true;
+   const size_t n = 10000019;
+   std::mt19937_64 gen(2024);
+   std::uniform_real_distribution<double> u(-1.0,1.0);
+   // terms spread over 40 binades with heavy cancellation
+   petlib::Array<double> a(n),b(n);
+   double* pa = a.data();
+   double* pb = b.data();
+   for (size_t i=0;i<n;++i) {
+      pa[i] = std::ldexp(u(gen),int(40.0 * (u(gen) + 1.0) / 2.0) - 20);
+      pb[i] = u(gen);
+   }
+   const petlib::Array<double>& ca = a;
+   const petlib::Array<double>& cb = b;
+   long double ref = 0.0L,dref = 0.0L;
+   for (size_t i=0;i<n;++i) {
+      ref += (long double)ca[i];
+      dref += (long double)ca[i] * (long double)cb[i];
+   }
+   double serial = 0.0;
+   for (size_t i=0;i<n;++i) serial += ca[i];
+   std::cout << "sum of " << n << " terms, relative error\n";
+   std::cout << "  serial " << double(std::fabs((serial - ref) / ref)) << "\n";
+   double err[4];
+   for (int m=0;m<4;++m) {
+      double s = ca.sum(modes[m]);
+      err[m] = double(std::fabs((s - ref) / ref));
+      std::cout << "  " << names[m] << " " << err[m] << "\n";
+      // the same bits on any number of threads
+      for (unsigned nt : { 2u,3u,8u }) ok = ok && same_bits(s,ca.sum(modes[m],nt));
+      double d = ca.dotProduct(cb,modes[m]);
+      for (unsigned nt : { 2u,5u }) ok = ok && same_bits(d,ca.dotProduct(cb,modes[m],nt));
+      ok = ok && same_bits(d,petlib::dotProduct(ca,cb,modes[m],3));
+      ok = ok && std::fabs((d - dref) / dref) < 1.e-10;
+   }
+   ok = ok && err[1] < 1.e-12 && err[2] < 1.e-15 && err[3] < 1.e-15;
+   {
+      // binned sums do not depend on the order of the terms
+      petlib::Array<double> c(a);
+      double* pc = c.data();
+      std::shuffle(pc,pc + n,gen);
+      const petlib::Array<double>& cc = c;
+      ok = ok && same_bits(ca.sum(petlib::SumMode::Binned),cc.sum(petlib::SumMode::Binned,4));
+      std::reverse(pc,pc + n);
+      ok = ok && same_bits(ca.sum(petlib::SumMode::Binned),cc.sum(petlib::SumMode::Binned));
+   }
+   {
+      // an ill conditioned dot product, x.y = 1 with |x||y| = 2^100
+      petlib::Array<double> x(6),y(6);
+      double xs[] = { 0x1p50,1.0,-0x1p50,0x1p-20,3.0,-3.0 };
+      double ys[] = { 0x1p50,1.0,0x1p50,0.0,1.0,1.0 };
+      std::copy(xs,xs + 6,x.data());
+      std::copy(ys,ys + 6,y.data());
+      const petlib::Array<double>& cx = x;
+      ok = ok && cx.dotProduct(y,petlib::SumMode::Compensated) == 1.0;
+      ok = ok && cx.dotProduct(y,petlib::SumMode::Binned) == 1.0;
+      // huge, tiny and special terms, only the binned grid is scaled to
+      // stay clear of the overflow of 1e308 + 1e308
+      petlib::Array<double> h(4);
+      double hs[] = { 1.e308,1.e308,-1.e308,1.e-300 };
+      std::copy(hs,hs + 4,h.data());
+      const petlib::Array<double>& ch = h;
+      ok = ok && ch.sum(petlib::SumMode::Binned) == 1.e308;
+      h[3] = HUGE_VAL;
+      ok = ok && ch.sum(petlib::SumMode::Binned) == HUGE_VAL;
+      petlib::Array<float> f(1000);
+      for (size_t i=0;i<f.size();++i) f[i] = 0.1f;
+      const petlib::Array<float>& cf = f;
+      ok = ok && cf.sum(petlib::SumMode::Binned) == 100.0f && cf.sum(petlib::SumMode::Compensated) == 100.0f;
+      petlib::Array<int> k(10001);
+      for (size_t i=0;i<k.size();++i) k[i] = int(i);
+      const petlib::Array<int>& ck = k;
+      ok = ok && ck.sum() == 50005000 && ck.sum(petlib::SumMode::Binned,2) == 50005000;
+      ok = ok && petlib::sum(ck + ck) == 100010000;
+   }
+   // a stream from memory and a block that stays in cache
+   double t = 0.0;
+   for (size_t len : { n,size_t(16384) }) {
+      const int nrep = int(100000000 / len);
+      auto ts = std::chrono::steady_clock::now();
+      for (int r=0;r<nrep;++r) {
+         double s = 0.0;
+         for (size_t i=0;i<len;++i) s += pa[i];
+         t += s;
+         // keep the compiler from hoisting the loop out of the repeats
+         asm volatile("" ::: "memory");
+      }
+      std::cout << nrep << " sums of " << len << " doubles, seconds\n";
+      std::cout << "  serial loop " << elapsed(ts) << "\n";
+      petlib::SubArray<double> sub(pa,len);
+      const petlib::SubArray<double>& cs = sub;
+      for (int m=0;m<4;++m) {
+         ts = std::chrono::steady_clock::now();
+         for (int r=0;r<nrep;++r) t += cs.sum(modes[m]);
+         std::cout << "  " << names[m] << " " << elapsed(ts) << "\n";
+      }
+   }
+   ok = ok && t != 0.0;
+   std::cout << (ok ? "sum test passed\n" : "sum test FAILED\n");
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}